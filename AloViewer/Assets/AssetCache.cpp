@@ -0,0 +1,214 @@
+#include "Assets/AssetCache.h"
+#include "General/Profiler.h"
+#include <windows.h>
+#include <list>
+#include <map>
+using namespace std;
+
+namespace Alamo {
+namespace AssetCache {
+
+static const unsigned long DEFAULT_BUDGET = 64 * 1024 * 1024;
+static const int           NUM_TYPES      = Assets::AT_TEXTURE + 1;
+
+// Set when an asset has been loaded; threads that want the same asset wait for it
+class LoadEvent : public IObject
+{
+    ~LoadEvent() { CloseHandle(m_hEvent); }
+public:
+    HANDLE m_hEvent;
+    LoadEvent() { m_hEvent = CreateEvent(NULL, TRUE, FALSE, NULL); }
+};
+
+typedef pair<Assets::AssetType, string> Key;
+
+struct Entry
+{
+    Key            key;
+    ptr<IObject>   asset;
+    unsigned long  fileBytes;   // Size of the asset file
+    ptr<LoadEvent> loading;     // Until the asset has been loaded
+};
+
+typedef list<Entry>                   EntryList;
+typedef map<Key, EntryList::iterator> EntryMap;
+
+typedef IObject* (*CREATE_FUNC)(ptr<IFile> file, const string& filename);
+
+// The cache is used from any thread, so it's locked
+struct Lock
+{
+    CRITICAL_SECTION cs;
+    Lock()  { InitializeCriticalSection(&cs); }
+    ~Lock() { DeleteCriticalSection(&cs); }
+};
+
+static Lock          g_lock;
+static EntryList     g_entries;         // Most recently used first
+static EntryMap      g_index;
+static unsigned long g_fileBytes = 0;
+static unsigned long g_budget    = DEFAULT_BUDGET;
+static Usage         g_usage[NUM_TYPES];
+
+// Removes a loaded asset from the cache
+static EntryList::iterator Drop(EntryList::iterator p)
+{
+    Usage& usage = g_usage[p->key.first];
+    usage.count--;
+    usage.fileBytes -= p->fileBytes;
+    g_fileBytes     -= p->fileBytes;
+    g_index.erase(p->key);
+    return g_entries.erase(p);
+}
+
+// Drops the least recently used assets that nobody else uses, until the cache fits
+static void Evict()
+{
+    EntryList::iterator p = g_entries.end();
+    while (g_fileBytes > g_budget && p != g_entries.begin())
+    {
+        --p;
+        if (p->loading == NULL && p->asset->GetRefCount() == 1)
+        {
+            p = Drop(p);
+        }
+    }
+}
+
+static ptr<IObject> Load(Assets::AssetType type, const string& filename, CREATE_FUNC create)
+{
+    const Key key(type, Assets::GetCanonicalName(type, filename));
+
+    EnterCriticalSection(&g_lock.cs);
+    EntryMap::iterator p;
+    while ((p = g_index.find(key)) != g_index.end())
+    {
+        EntryList::iterator entry = p->second;
+        if (entry->loading == NULL)
+        {
+            // It's cached, move it to the front
+            g_entries.splice(g_entries.begin(), g_entries, entry);
+            g_usage[type].hits++;
+            ptr<IObject> asset = entry->asset;
+            LeaveCriticalSection(&g_lock.cs);
+            return asset;
+        }
+
+        // Another thread is loading it; wait for it and look again
+        ptr<LoadEvent> loading = entry->loading;
+        LeaveCriticalSection(&g_lock.cs);
+        WaitForSingleObject(loading->m_hEvent, INFINITE);
+        EnterCriticalSection(&g_lock.cs);
+    }
+
+    // Add the entry before loading, so other threads wait for this load
+    g_entries.push_front(Entry());
+    EntryList::iterator entry = g_entries.begin();
+    entry->key       = key;
+    entry->fileBytes = 0;
+    entry->loading   = new LoadEvent;
+    g_index.insert(make_pair(key, entry));
+    g_usage[type].misses++;
+
+    ptr<LoadEvent> loading = entry->loading;
+    LeaveCriticalSection(&g_lock.cs);
+
+    ptr<IObject>  asset;
+    unsigned long size = 0;
+    try
+    {
+        PROFILE_SCOPE("assets", key.second.c_str());
+        ptr<IFile> file = Assets::FindAsset(type, filename);
+        if (file != NULL)
+        {
+            size  = (unsigned long)file->size();
+            asset = create(file, filename);
+        }
+    }
+    catch (...)
+    {
+        // Let the waiting threads try for themselves
+        EnterCriticalSection(&g_lock.cs);
+        g_index.erase(key);
+        g_entries.erase(entry);
+        LeaveCriticalSection(&g_lock.cs);
+        SetEvent(loading->m_hEvent);
+        throw;
+    }
+
+    EnterCriticalSection(&g_lock.cs);
+    if (asset == NULL)
+    {
+        g_index.erase(key);
+        g_entries.erase(entry);
+    }
+    else
+    {
+        entry->asset     = asset;
+        entry->fileBytes = size;
+        entry->loading   = NULL;
+        g_usage[type].count++;
+        g_usage[type].fileBytes += size;
+        g_fileBytes             += size;
+        Evict();
+    }
+    LeaveCriticalSection(&g_lock.cs);
+    SetEvent(loading->m_hEvent);
+    return asset;
+}
+
+static IObject* CreateModel(ptr<IFile> file, const string&)
+{
+    return new Model(file);
+}
+
+static IObject* CreateParticleSystem(ptr<IFile> file, const string& filename)
+{
+    return new ParticleSystem(file, filename);
+}
+
+ptr<Model> LoadModel(const string& filename)
+{
+    return Load(Assets::AT_MODEL, filename, CreateModel).cast<Model>();
+}
+
+ptr<ParticleSystem> LoadParticleSystem(const string& filename)
+{
+    return Load(Assets::AT_PARTICLESYSTEM, filename, CreateParticleSystem).cast<ParticleSystem>();
+}
+
+void SetFileBudget(unsigned long fileBytes)
+{
+    EnterCriticalSection(&g_lock.cs);
+    g_budget = fileBytes;
+    Evict();
+    LeaveCriticalSection(&g_lock.cs);
+}
+
+unsigned long GetFileBudget()
+{
+    return g_budget;
+}
+
+Usage GetUsage(Assets::AssetType type)
+{
+    EnterCriticalSection(&g_lock.cs);
+    Usage usage = g_usage[type];
+    LeaveCriticalSection(&g_lock.cs);
+    return usage;
+}
+
+void Clear()
+{
+    EnterCriticalSection(&g_lock.cs);
+    for (EntryList::iterator p = g_entries.begin(); p != g_entries.end();)
+    {
+        // Assets that are still being loaded are left to their loader
+        if (p->loading == NULL) p = Drop(p);
+        else                    ++p;
+    }
+    LeaveCriticalSection(&g_lock.cs);
+}
+
+}
+}
@@ -0,0 +1,61 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include "Assets/Assets.h"
+
+namespace Alamo
+{
+
+/*
+ * A cache of loaded models and particle systems, shared by all threads.
+ * Assets are identified by their type and canonical path, so all object
+ * templates and proxies that use the same asset share one copy of it.
+ *
+ * Assets that are no longer used outside of the cache are kept until the
+ * total size of the cache exceeds its budget; then the least recently used
+ * of them are dropped. Assets that are still in use count towards the
+ * budget, but are never dropped.
+ *
+ * Sizes are the sizes of the asset files, not the memory the loaded assets
+ * use. That's cheap to know and roughly proportional, but a model usually
+ * takes more memory than its file.
+ */
+namespace AssetCache
+{
+    // Cache use for one type of asset
+    struct Usage
+    {
+        size_t        count;        // Number of cached assets
+        unsigned long fileBytes;    // Total size of their files
+        unsigned long hits;
+        unsigned long misses;
+    };
+
+    /* Sets the total file size, in bytes, of the assets to keep in the cache.
+     * Unused assets are dropped until the cache fits.
+     */
+    void          SetFileBudget(unsigned long fileBytes);
+    unsigned long GetFileBudget();
+
+    // Returns the cache use for a type of asset
+    Usage GetUsage(Assets::AssetType type);
+
+    /* Drops all assets from the cache. Call this when the asset search paths
+     * change. Assets that are still in use stay valid, but are loaded again
+     * when they are requested next.
+     */
+    void Clear();
+
+    /* Returns the asset from the cache, or loads and caches it. If another
+     * thread is already loading the asset, waits for that load instead.
+     * Can be called from any thread.
+     *
+     * Returns NULL if the asset could not be found.
+     * Throws an exception if the asset could not be loaded.
+     */
+    ptr<Model>          LoadModel(const std::string& filename);
+    ptr<ParticleSystem> LoadParticleSystem(const std::string& filename);
+}
+
+}
+#endif
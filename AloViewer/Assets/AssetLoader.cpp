@@ -0,0 +1,374 @@
+#include "Assets/AssetLoader.h"
+#include "Assets/AssetCache.h"
+#include "General/Exceptions.h"
+#include "General/Utils.h"
+#include "General/Profiler.h"
+#include <windows.h>
+#include <algorithm>
+#include <set>
+using namespace std;
+
+namespace Alamo {
+
+// Maximum number of worker threads
+static const size_t MAX_THREADS = 4;
+
+static CRITICAL_SECTION           g_lock;
+static HANDLE                     g_hWork;      // Semaphore; counts the queued requests
+static HANDLE                     g_hIdle;      // Set when nothing is queued or being loaded
+static vector<HANDLE>             g_hThreads;
+static vector<ptr<AssetRequest> > g_queue;      // Heap, highest priority on top
+static vector<ptr<AssetRequest> > g_finished;   // Finished requests with a callback
+static size_t                     g_running;
+static unsigned long              g_sequence;
+static volatile long              g_generation; // Incremented by CancelAll()
+static bool                       g_quit;
+
+// Does the work for the requests; has access to their internals
+class AssetQueue
+{
+    static void AddDependencies(const ptr<AssetRequest>& request);
+    static void Finish(ptr<AssetRequest> request);
+
+public:
+    // Heap order; lower priority, then later requests, go last
+    static bool Before(const ptr<AssetRequest>& a, const ptr<AssetRequest>& b)
+    {
+        return (a->m_priority != b->m_priority) ? a->m_priority < b->m_priority : a->m_sequence > b->m_sequence;
+    }
+
+    static ptr<AssetRequest> Queue(Assets::AssetType type, const string& name, ptr<IFile> file, int priority,
+        const ptr<AssetRequest>& parent, AssetRequest::CALLBACK_FUNC callback, void* data);
+
+    static void Run(const ptr<AssetRequest>& request);
+    static void Dispatch();
+};
+
+//
+// AssetRequest
+//
+bool AssetRequest::IsCancelled() const
+{
+    return m_cancelled != 0 || m_generation != g_generation || (m_parent != NULL && m_parent->IsCancelled());
+}
+
+const AssetRequest* AssetRequest::FindDependency(Assets::AssetType type, const string& name) const
+{
+    for (size_t i = 0; i < m_dependencies.size(); i++)
+    {
+        const AssetRequest& dep = *m_dependencies[i];
+        if (dep.m_type == type && dep.GetState() == LOADED && _stricmp(dep.m_name.c_str(), name.c_str()) == 0)
+        {
+            return &dep;
+        }
+    }
+    return NULL;
+}
+
+void AssetRequest::Cancel()
+{
+    _InterlockedExchange(&m_cancelled, 1);
+}
+
+AssetRequest::AssetRequest(Assets::AssetType type, const string& name, ptr<IFile> file, int priority, CALLBACK_FUNC callback, void* data)
+    : m_type(type), m_name(name), m_file(file), m_priority(priority), m_callback(callback), m_data(data)
+{
+    m_sequence   = 0;
+    m_generation = g_generation;
+    m_state      = QUEUED;
+    m_cancelled  = 0;
+    m_pending    = 1;
+}
+
+//
+// AssetQueue
+//
+ptr<AssetRequest> AssetQueue::Queue(Assets::AssetType type, const string& name, ptr<IFile> file, int priority,
+    const ptr<AssetRequest>& parent, AssetRequest::CALLBACK_FUNC callback, void* data)
+{
+    ptr<AssetRequest> request = new AssetRequest(type, name, file, priority, callback, data);
+    if (parent != NULL)
+    {
+        // The parent isn't finished until this one is
+        request->m_parent     = parent;
+        request->m_generation = parent->m_generation;
+        _InterlockedIncrement(&parent->m_pending);
+        parent->m_dependencies.push_back(request);
+    }
+
+    EnterCriticalSection(&g_lock);
+    request->m_sequence = g_sequence++;
+    g_queue.push_back(request);
+    push_heap(g_queue.begin(), g_queue.end(), Before);
+    ResetEvent(g_hIdle);
+    LeaveCriticalSection(&g_lock);
+
+    ReleaseSemaphore(g_hWork, 1, NULL);
+    return request;
+}
+
+// Queues the assets that a loaded asset uses
+void AssetQueue::AddDependencies(const ptr<AssetRequest>& request)
+{
+    set<string> textures, particles;
+    if (request->m_model != NULL)
+    {
+        const Model& model = *request->m_model;
+        for (size_t i = 0; i < model.GetNumMeshes(); i++)
+        {
+            const Model::Mesh& mesh = model.GetMesh(i);
+            for (size_t j = 0; j < mesh.subMeshes.size(); j++)
+            {
+                const vector<ShaderParameter>& params = mesh.subMeshes[j].parameters;
+                for (size_t k = 0; k < params.size(); k++)
+                {
+                    if (params[k].m_type == SPT_TEXTURE && !params[k].m_texture.empty())
+                    {
+                        textures.insert(Uppercase(params[k].m_texture));
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < model.GetNumDazzles(); i++)
+        {
+            textures.insert(Uppercase(model.GetDazzle(i).texture));
+        }
+
+        for (size_t i = 0; i < model.GetNumProxies(); i++)
+        {
+            particles.insert(Uppercase(Assets::GetProxyAssetName(model.GetProxy(i).name)));
+        }
+    }
+
+    for (set<string>::const_iterator p = particles.begin(); p != particles.end(); p++)
+    {
+        Queue(Assets::AT_PARTICLESYSTEM, *p, NULL, request->m_priority, request, NULL, NULL);
+    }
+
+    for (set<string>::const_iterator p = textures.begin(); p != textures.end(); p++)
+    {
+        Queue(Assets::AT_TEXTURE, *p, NULL, request->m_priority, request, NULL, NULL);
+    }
+}
+
+// Marks one load of the request as done, and finishes it and its parents
+// when nothing is left.
+void AssetQueue::Finish(ptr<AssetRequest> request)
+{
+    while (request != NULL && _InterlockedDecrement(&request->m_pending) == 0)
+    {
+        if (request->m_callback != NULL)
+        {
+            EnterCriticalSection(&g_lock);
+            g_finished.push_back(request);
+            LeaveCriticalSection(&g_lock);
+        }
+
+        ptr<AssetRequest> parent = request->m_parent;
+        request->m_parent = NULL;
+        request = parent;
+    }
+}
+
+void AssetQueue::Run(const ptr<AssetRequest>& request)
+{
+    AssetRequest& r = *request;
+    if (r.IsCancelled())
+    {
+        r.m_state = AssetRequest::CANCELLED;
+    }
+    else
+    {
+        r.m_state = AssetRequest::LOADING;
+        PROFILE_SCOPE("assets", r.m_name.c_str());
+        try
+        {
+            if (r.m_type == Assets::AT_PARTICLESYSTEM)
+            {
+                // Shared with the main thread and other requests
+                if ((r.m_particleSystem = AssetCache::LoadParticleSystem(r.m_name)) == NULL)
+                {
+                    throw FileNotFoundException(AnsiToWide(r.m_name));
+                }
+            }
+            else
+            {
+                ptr<IFile> file = r.m_file;
+                if (file == NULL && (file = Assets::FindAsset(r.m_type, r.m_name)) == NULL)
+                {
+                    throw FileNotFoundException(AnsiToWide(r.m_name));
+                }
+
+                if (r.m_type == Assets::AT_MODEL)
+                {
+                    r.m_model = new Model(file);
+                    r.m_file  = NULL;
+                    AddDependencies(request);
+                }
+                else
+                {
+                    // Read the file, it's turned into a resource on the main thread
+                    r.m_file = new MemoryFile(*file);
+                }
+            }
+            r.m_state = AssetRequest::LOADED;
+        }
+        catch (wexception& e)
+        {
+            r.m_error = e.what();
+            r.m_state = AssetRequest::FAILED;
+        }
+        catch (exception& e)
+        {
+            r.m_error = AnsiToWide(e.what());
+            r.m_state = AssetRequest::FAILED;
+        }
+    }
+    Finish(request);
+}
+
+void AssetQueue::Dispatch()
+{
+    vector<ptr<AssetRequest> > finished;
+    EnterCriticalSection(&g_lock);
+    finished.swap(g_finished);
+    LeaveCriticalSection(&g_lock);
+
+    for (size_t i = 0; i < finished.size(); i++)
+    {
+        AssetRequest& request = *finished[i];
+        if (!request.IsCancelled())
+        {
+            request.m_callback(request, request.m_data);
+        }
+    }
+}
+
+static DWORD WINAPI WorkerThread(LPVOID)
+{
+    for (;;)
+    {
+        WaitForSingleObject(g_hWork, INFINITE);
+
+        EnterCriticalSection(&g_lock);
+        if (g_quit)
+        {
+            LeaveCriticalSection(&g_lock);
+            break;
+        }
+        pop_heap(g_queue.begin(), g_queue.end(), AssetQueue::Before);
+        ptr<AssetRequest> request = g_queue.back();
+        g_queue.pop_back();
+        g_running++;
+        LeaveCriticalSection(&g_lock);
+
+        AssetQueue::Run(request);
+        request = NULL;
+
+        EnterCriticalSection(&g_lock);
+        if (--g_running == 0 && g_queue.empty())
+        {
+            SetEvent(g_hIdle);
+        }
+        LeaveCriticalSection(&g_lock);
+    }
+    return 0;
+}
+
+namespace AssetLoader {
+
+ptr<AssetRequest> LoadModel(ptr<IFile> file, Priority priority, AssetRequest::CALLBACK_FUNC callback, void* data)
+{
+    return AssetQueue::Queue(Assets::AT_MODEL, WideToAnsi(file->name()), file, priority, NULL, callback, data);
+}
+
+ptr<AssetRequest> LoadParticleSystem(const string& filename, Priority priority, AssetRequest::CALLBACK_FUNC callback, void* data)
+{
+    return AssetQueue::Queue(Assets::AT_PARTICLESYSTEM, filename, NULL, priority, NULL, callback, data);
+}
+
+ptr<AssetRequest> LoadTexture(const string& filename, Priority priority, AssetRequest::CALLBACK_FUNC callback, void* data)
+{
+    return AssetQueue::Queue(Assets::AT_TEXTURE, filename, NULL, priority, NULL, callback, data);
+}
+
+void CancelAll()
+{
+    if (!g_hThreads.empty())
+    {
+        // Requests from before this are now cancelled; wait for the
+        // workers to skip or finish them
+        _InterlockedIncrement(&g_generation);
+        WaitForSingleObject(g_hIdle, INFINITE);
+
+        EnterCriticalSection(&g_lock);
+        g_finished.clear();
+        LeaveCriticalSection(&g_lock);
+    }
+}
+
+void Dispatch()
+{
+    AssetQueue::Dispatch();
+}
+
+void Initialize()
+{
+    InitializeCriticalSection(&g_lock);
+    g_hWork    = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    g_hIdle    = CreateEvent(NULL, TRUE, TRUE, NULL);
+    g_running  = 0;
+    g_sequence = 0;
+    g_quit     = false;
+
+    // Leave a processor for the main thread
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    size_t nThreads = (si.dwNumberOfProcessors > 1) ? si.dwNumberOfProcessors - 1 : 1;
+    nThreads = min(nThreads, MAX_THREADS);
+    for (size_t i = 0; i < nThreads; i++)
+    {
+        DWORD  ThreadID;
+        HANDLE hThread = CreateThread(NULL, 0, WorkerThread, NULL, 0, &ThreadID);
+        if (hThread != NULL)
+        {
+            g_hThreads.push_back(hThread);
+        }
+    }
+
+    if (g_hThreads.empty())
+    {
+        throw runtime_error("Unable to create thread");
+    }
+}
+
+void Uninitialize()
+{
+    if (g_hThreads.empty())
+    {
+        return;
+    }
+    CancelAll();
+
+    EnterCriticalSection(&g_lock);
+    g_quit = true;
+    LeaveCriticalSection(&g_lock);
+
+    ReleaseSemaphore(g_hWork, (LONG)g_hThreads.size(), NULL);
+    WaitForMultipleObjects((DWORD)g_hThreads.size(), &g_hThreads[0], TRUE, INFINITE);
+    for (size_t i = 0; i < g_hThreads.size(); i++)
+    {
+        CloseHandle(g_hThreads[i]);
+    }
+    g_hThreads.clear();
+    g_queue.clear();
+    g_finished.clear();
+
+    CloseHandle(g_hIdle);
+    CloseHandle(g_hWork);
+    DeleteCriticalSection(&g_lock);
+}
+
+}
+}
@@ -0,0 +1,115 @@
+#ifndef ASSETLOADER_H
+#define ASSETLOADER_H
+
+#include "Assets/Assets.h"
+#include <vector>
+
+namespace Alamo {
+
+/*
+ * A request to load an asset on a background thread.
+ * A request has finished when its asset and all of its dependencies are
+ * loaded; e.g., a model depends on the textures and particle systems it uses.
+ * Its results may only be used once it has finished.
+ */
+class AssetRequest : public IObject
+{
+    friend class AssetQueue;
+
+public:
+    enum State { QUEUED, LOADING, LOADED, FAILED, CANCELLED };
+
+    // Called from AssetLoader::Dispatch() when the request has finished
+    typedef void (*CALLBACK_FUNC)(AssetRequest& request, void* data);
+
+private:
+    Assets::AssetType               m_type;
+    std::string                     m_name;
+    ptr<IFile>                      m_file;
+    ptr<Model>                      m_model;
+    ptr<ParticleSystem>             m_particleSystem;
+    std::wstring                    m_error;
+    int                             m_priority;
+    unsigned long                   m_sequence;
+    long                            m_generation;
+    volatile long                   m_state;
+    volatile long                   m_cancelled;
+    volatile long                   m_pending;      // Unfinished loads, including its own
+    ptr<AssetRequest>               m_parent;       // Until the request has finished
+    std::vector<ptr<AssetRequest> > m_dependencies;
+    CALLBACK_FUNC                   m_callback;
+    void*                           m_data;
+
+    AssetRequest(Assets::AssetType type, const std::string& name, ptr<IFile> file, int priority, CALLBACK_FUNC callback, void* data);
+    ~AssetRequest() {}
+public:
+    Assets::AssetType   GetType()     const { return m_type; }
+    const std::string&  GetName()     const { return m_name; }
+    State               GetState()    const { return (State)m_state; }
+    bool                IsFinished()  const { return m_pending == 0; }
+    bool                IsCancelled() const;
+
+    // Why the request failed
+    const std::wstring& GetError() const { return m_error; }
+
+    // The loaded asset. Textures are loaded into memory as files.
+    ptr<Model>          GetModel()          const { return m_model; }
+    ptr<ParticleSystem> GetParticleSystem() const { return m_particleSystem; }
+    ptr<IFile>          GetFile()           const { return m_file; }
+
+    size_t              GetNumDependencies()     const { return m_dependencies.size(); }
+    const AssetRequest& GetDependency(size_t i)  const { return *m_dependencies[i]; }
+
+    /* Returns the loaded dependency with the specified type and name,
+     * or NULL if there's no such dependency or it failed to load.
+     *  @name: case-insensitive name of the asset.
+     */
+    const AssetRequest* FindDependency(Assets::AssetType type, const std::string& name) const;
+
+    // Stops the request and its dependencies. Its callback won't be called.
+    void Cancel();
+};
+
+/*
+ * The asset loader loads assets on worker threads, so the main thread can
+ * keep going while a large model is being loaded.
+ * Requests are handled in order of priority, and in the order they were made
+ * for the same priority. Dependencies have the priority of their parent.
+ */
+namespace AssetLoader
+{
+    enum Priority
+    {
+        PRIORITY_LOW,
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH
+    };
+
+    // Starts the worker threads
+    void Initialize();
+
+    // Cancels all requests and stops the worker threads
+    void Uninitialize();
+
+    /* These functions queue a request for the various assets.
+     * The callback, if any, is called from Dispatch() when the request has
+     * finished, unless it was cancelled.
+     */
+    ptr<AssetRequest> LoadModel(ptr<IFile> file, Priority priority, AssetRequest::CALLBACK_FUNC callback = NULL, void* data = NULL);
+    ptr<AssetRequest> LoadParticleSystem(const std::string& filename, Priority priority, AssetRequest::CALLBACK_FUNC callback = NULL, void* data = NULL);
+    ptr<AssetRequest> LoadTexture(const std::string& filename, Priority priority, AssetRequest::CALLBACK_FUNC callback = NULL, void* data = NULL);
+
+    /* Cancels all requests and waits until the worker threads are no longer
+     * loading anything. Call this before the assets change.
+     */
+    void CancelAll();
+
+    /* Calls the callbacks of the requests that have finished.
+     * Call this regularly from the main thread.
+     */
+    void Dispatch();
+}
+
+}
+
+#endif
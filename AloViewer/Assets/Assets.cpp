@@ -1,4 +1,6 @@
 #include "Assets/Assets.h"
+#include "Assets/AssetLoader.h"
+#include "Assets/AssetCache.h"
 #include "General/Exceptions.h"
 #include "General/Utils.h"
 #include "General/XML.h"
@@ -27,6 +29,24 @@ static const char*    PARTICLESYSTEMS_BASE_PATH = "Data\\Art\\Models\\";
 static const char*    SHADERS_BASE_PATH         = "Data\\Art\\Shaders\\";
 static const char*    TEXTURES_BASE_PATH        = "Data\\Art\\Textures\\";
 
+static const char* ModelExtensions[]          = {"alo", NULL};
+static const char* AnimationExtensions[]      = {"ala", NULL};
+static const char* ParticleSystemExtensions[] = {"alo", NULL};
+static const char* ShaderExtensions[]         = {"fx", "fxo", NULL};
+static const char* TextureExtensions[]        = {"tga", "dds", NULL};
+
+// Where to look for each AssetType
+static const struct {
+    const char*        basepath;
+    const char* const* extensions;
+} AssetLocations[] = {
+    {MODELS_BASE_PATH,          ModelExtensions},
+    {ANIMATIONS_BASE_PATH,      AnimationExtensions},
+    {PARTICLESYSTEMS_BASE_PATH, ParticleSystemExtensions},
+    {SHADERS_BASE_PATH,         ShaderExtensions},
+    {TEXTURES_BASE_PATH,        TextureExtensions},
+};
+
 // MegaFile parsers
 #pragma pack(1)
 struct MEGHEADER
@@ -59,8 +79,9 @@ struct MegaFileInfo
 
 typedef vector<MegaFileInfo> MegaFileIndex;
 
-static MegaFileIndex    g_megaFiles;
-static vector<wstring>  g_basepaths;
+static MegaFileIndex       g_megaFiles;
+static vector<wstring>     g_basepaths;
+static const AssetRequest* g_preloaded = NULL;
 
 static void IndexMegaFile(const wstring& path, const string& basepath = "")
 {
@@ -200,6 +221,9 @@ void Initialize(const vector<wstring>& basepaths)
 // Clear the master file index
 void Uninitialize()
 {
+    // Cached assets may come from the old search paths
+    AssetCache::Clear();
+
     for (MegaFileIndex::const_iterator p = g_megaFiles.begin(); p != g_megaFiles.end(); p++)
     {
         delete[] p->m_data;
@@ -344,21 +368,64 @@ ptr<IFile> LoadFile(const string& filename, const char* prefix, const char* cons
 	return NULL;
 }
 
-ptr<Model> LoadModel(const string& filename)
+ptr<IFile> FindAsset(AssetType type, const string& filename)
 {
-    static const char* ModelExtensions[] = {"alo", NULL};
+    return LoadFile(filename, AssetLocations[type].basepath, AssetLocations[type].extensions);
+}
+
+string GetCanonicalName(AssetType type, const string& filename)
+{
+    string name = filename;
+    replace(name.begin(), name.end(), '/', '\\');
+    if (name.find_first_of(":") == string::npos)
+    {
+        // Relative path
+        name = AssetLocations[type].basepath + name;
+    }
 
-    ptr<IFile> file = LoadFile(filename, MODELS_BASE_PATH, ModelExtensions);
-    return (file == NULL) ? NULL : new Model(file);
+    string::size_type ofs = name.find_last_of(".\\");
+    if (ofs == string::npos || name[ofs] != '.')
+    {
+        name = name + "." + AssetLocations[type].extensions[0];
+    }
+    return Uppercase(name);
 }
 
-ptr<ParticleSystem> LoadParticleSystem(const string& filename)
+string GetProxyAssetName(const string& proxy)
 {
-    static const char* ParticleSystemExtensions[] = {"alo", NULL};
+    string name = proxy;
 
-    ptr<IFile> file = LoadFile(filename, PARTICLESYSTEMS_BASE_PATH, ParticleSystemExtensions);
-    if (file != NULL) try {
-        return new ParticleSystem(file, filename);
+    // Strip ALT and LOD from name
+    string::size_type ofs;
+    while ((ofs = name.find("_ALT")) != string::npos) {
+        name = name.substr(0, ofs) + name.substr(ofs + 5);
+    }
+    while ((ofs = name.find("_LOD")) != string::npos) {
+        name = name.substr(0, ofs) + name.substr(ofs + 5);
+    }
+    return name;
+}
+
+void SetPreloaded(const AssetRequest* request)
+{
+    g_preloaded = request;
+}
+
+// Returns the preloaded asset, or NULL if it wasn't preloaded
+static const AssetRequest* FindPreloaded(AssetType type, const string& filename)
+{
+    return (g_preloaded != NULL) ? g_preloaded->FindDependency(type, filename) : NULL;
+}
+
+ptr<Model> LoadModel(const string& filename)
+{
+    return AssetCache::LoadModel(filename);
+}
+
+ptr<ParticleSystem> LoadParticleSystem(const string& filename)
+{
+    try {
+        return AssetCache::LoadParticleSystem(filename);
     } catch (wexception&) {
     }
     return NULL;
@@ -366,9 +433,7 @@ ptr<ParticleSystem> LoadParticleSystem(const string& filename)
 
 ptr<Animation> LoadAnimation(const string& filename, const Model& model)
 {
-    static const char* AnimationExtensions[] = {"ala", NULL};
-
-    ptr<IFile> file = LoadFile(filename, ANIMATIONS_BASE_PATH, AnimationExtensions);
+    ptr<IFile> file = FindAsset(AT_ANIMATION, filename);
     if (file != NULL) try {
         return new Animation(file, model);
     } catch (wexception&) {
@@ -378,16 +443,19 @@ ptr<Animation> LoadAnimation(const string& filename, const Model& model)
 
 ptr<IFile> LoadShader(const string& filename)
 {
-    static const char* ShaderExtensions[] = {"fx", "fxo", NULL};
-
-    return LoadFile(filename, SHADERS_BASE_PATH, ShaderExtensions);
+    return FindAsset(AT_SHADER, filename);
 }
 
 ptr<IFile> LoadTexture(const string& filename)
 {
-    static const char* TextureExtensions[] = {"tga", "dds", NULL};
-
-    return LoadFile(filename, TEXTURES_BASE_PATH, TextureExtensions);
+    const AssetRequest* preloaded = FindPreloaded(AT_TEXTURE, filename);
+    if (preloaded != NULL)
+    {
+        ptr<IFile> file = preloaded->GetFile();
+        file->seek(0);
+        return file;
+    }
+    return FindAsset(AT_TEXTURE, filename);
 }
 
 }
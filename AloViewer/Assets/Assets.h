@@ -9,6 +9,8 @@
 namespace Alamo
 {
 
+class AssetRequest;
+
 /*
  * General note for all Assets::LoadXxxxx() functions:
  *
@@ -18,6 +20,16 @@ namespace Alamo
  */
 namespace Assets
 {
+    // The types of assets
+    enum AssetType
+    {
+        AT_MODEL,
+        AT_ANIMATION,
+        AT_PARTICLESYSTEM,
+        AT_SHADER,
+        AT_TEXTURE
+    };
+
     /* Initializes the asset manager. Call this once at program startup.
      *  @basepaths: List of paths to consider when loading files.
      *
@@ -38,8 +50,33 @@ namespace Assets
      */
     ptr<IFile> LoadFile(const std::string& _filename, const char* prefix = NULL, const char* const* extensions = NULL);
 
+    /* Finds the file for an asset the same way the LoadXxxxx() function for its type
+     * does, without loading the asset. Unlike those functions, this can be called
+     * from any thread.
+     */
+    ptr<IFile> FindAsset(AssetType type, const std::string& filename);
+
+    /* Returns the name that identifies the asset regardless of how it's
+     * referenced: uppercase, with backslashes, the base path for its type and
+     * the default extension if it had none. E.g. "p_smoke" for a particle
+     * system becomes "DATA\ART\MODELS\P_SMOKE.ALO".
+     */
+    std::string GetCanonicalName(AssetType type, const std::string& filename);
+
+    /* Returns the name of the particle system used by a model's proxy.
+     * This is the name of the proxy without any _ALT and _LOD suffixes.
+     */
+    std::string GetProxyAssetName(const std::string& proxy);
+
+    /* Lets LoadTexture() use the textures that a finished background request
+     * has already read, instead of reading them again. Pass NULL to stop.
+     * Only the main thread may use this.
+     */
+    void SetPreloaded(const AssetRequest* request);
+
     /* These functions load the various assets. Shaders and textures are returned
      * as raw data, to be used for creating the RenderEngine resources.
+     * Models and particle systems are shared through the AssetCache.
      */
     ptr<Model>          LoadModel(const std::string& filename);
     ptr<Animation>      LoadAnimation(const std::string& filename, const Model& model);
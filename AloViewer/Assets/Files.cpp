@@ -1,6 +1,7 @@
 #include <windows.h>
 #include "General/Exceptions.h"
 #include "General/Utils.h"
+#include "General/Profiler.h"
 #include "Assets/Files.h"
 using namespace Alamo;
 using namespace std;
@@ -26,6 +27,16 @@ size_t PhysicalFile::size() const
 	return GetFileSize(m_hFile, NULL);
 }
 
+uint64_t PhysicalFile::stamp() const
+{
+	FILETIME modified;
+	if (!GetFileTime(m_hFile, NULL, NULL, &modified))
+	{
+		return 0;
+	}
+	return ((uint64_t)modified.dwHighDateTime << 32) | modified.dwLowDateTime;
+}
+
 unsigned long PhysicalFile::tell() const
 {
 	return m_offset;
@@ -43,13 +54,28 @@ unsigned long PhysicalFile::skip(long count)
 
 size_t PhysicalFile::read(void* buffer, size_t size)
 {
+	size_t read = this->read(m_offset, buffer, size);
+	m_offset += (unsigned long)read;
+	return read;
+}
+
+size_t PhysicalFile::read(unsigned long offset, void* buffer, size_t size)
+{
+	// Pass the offset along with the read, instead of moving the shared
+	// file pointer, so reads from other threads can't come in between.
+	OVERLAPPED overlapped = {0};
+	overlapped.Offset = offset;
+
 	DWORD read;
-	SetFilePointer(m_hFile, m_offset, NULL, FILE_BEGIN);
-	if (!ReadFile(m_hFile, buffer, (DWORD)size, &read, NULL))
+	if (!ReadFile(m_hFile, buffer, (DWORD)size, &read, &overlapped))
 	{
-		throw ReadException();
+		if (GetLastError() != ERROR_HANDLE_EOF)
+		{
+			throw ReadException();
+		}
+		read = 0;
 	}
-	m_offset += read;
+	Profiler::Add(Profiler::FILE_BYTES, read);
 	return read;
 }
 
@@ -99,6 +125,13 @@ size_t SubFile::size() const
 	return m_size;
 }
 
+uint64_t SubFile::stamp() const
+{
+	// The containing file's stamp changes when it's rebuilt; within the
+	// same file, the position identifies the contents
+	return m_file->stamp() ^ ((uint64_t)m_start << 16);
+}
+
 unsigned long SubFile::tell() const
 {
 	return m_offset;
@@ -116,13 +149,22 @@ unsigned long SubFile::skip(long count)
 
 size_t SubFile::read(void* buffer, size_t size)
 {
-	m_file->seek(m_start + m_offset);
-    size = min(size, m_size - m_offset);
-	size_t read = m_file->read(buffer, size);
+	size_t read = this->read(m_offset, buffer, size);
 	m_offset += (unsigned long)read;
 	return read;
 }
 
+size_t SubFile::read(unsigned long offset, void* buffer, size_t size)
+{
+	if (offset >= m_size)
+	{
+		return 0;
+	}
+	size_t read = m_file->read(m_start + offset, buffer, min(size, (size_t)(m_size - offset)));
+	Profiler::AddFileRead(m_file->name(), (unsigned long)read);
+	return read;
+}
+
 size_t SubFile::write(const void* buffer, size_t size)
 {
 	m_file->seek(m_start + m_offset);
@@ -145,3 +187,69 @@ SubFile::~SubFile()
 {
 	SAFE_RELEASE(m_file);
 }
+
+/*
+ * MemoryFile class
+ */
+bool MemoryFile::eof() const
+{
+	return tell() == size();
+}
+
+size_t MemoryFile::size() const
+{
+	return m_data.size();
+}
+
+uint64_t MemoryFile::stamp() const
+{
+	return m_stamp;
+}
+
+unsigned long MemoryFile::tell() const
+{
+	return m_offset;
+}
+
+unsigned long MemoryFile::seek(unsigned long pos)
+{
+	return m_offset = pos;
+}
+
+unsigned long MemoryFile::skip(long count)
+{
+	return m_offset = min(max(m_offset + count, 0), (unsigned long)size() - 1);
+}
+
+size_t MemoryFile::read(void* buffer, size_t size)
+{
+	size_t read = this->read(m_offset, buffer, size);
+	m_offset += (unsigned long)read;
+	return read;
+}
+
+size_t MemoryFile::read(unsigned long offset, void* buffer, size_t size)
+{
+	if (offset >= m_data.size())
+	{
+		return 0;
+	}
+	size = min(size, m_data.size() - offset);
+	memcpy(buffer, m_data + offset, size);
+	return size;
+}
+
+size_t MemoryFile::write(const void* buffer, size_t size)
+{
+	throw WriteException();
+}
+
+MemoryFile::MemoryFile(IFile& file)
+    : IFile(file.name()), m_data(file.size()), m_stamp(file.stamp())
+{
+	if (file.read(0, m_data, m_data.size()) != m_data.size())
+	{
+		throw ReadException();
+	}
+	m_offset = 0;
+}
@@ -2,6 +2,7 @@
 #define FILES_H
 
 #include "General/Objects.h"
+#include "General/ExactTypes.h"
 #include <string>
 
 namespace Alamo
@@ -25,6 +26,12 @@ public:
     // Returns the size of the file
 	virtual size_t size() const = 0;
 
+    /* Returns a value that changes when the file is modified, without reading
+     * the file, e.g. its modification time. Together with the name and size,
+     * it tells if a file is still the same as before.
+     */
+	virtual uint64_t stamp() const = 0;
+
     // Returns the current position of the file cursor, relative to the start of the file.
 	virtual unsigned long tell() const = 0;
     
@@ -47,6 +54,16 @@ public:
      */
 	virtual size_t read(void* buffer, size_t size) = 0;
 
+    /* Reads data from the file at the specified position. The file cursor is
+     * neither used nor changed, so unlike seek() and read(), this can be called
+     * from several threads at the same time.
+     * Returns the number of bytes read, like read().
+     *  @offset: position, in bytes, relative to the start of the file.
+     *  @buffer: address in memory to write data to.
+     *  @size:   number of bytes to read from the file.
+     */
+	virtual size_t read(unsigned long offset, void* buffer, size_t size) = 0;
+
     /* Writes data to the file at the current file cursor.
      * Returns the number of bytes written.
      * If the file could not be written, a WriteException is thrown.
@@ -71,10 +88,12 @@ public:
     // Functions inherited from IFile
 	bool eof() const;
 	size_t size() const;
+	uint64_t stamp() const;
 	unsigned long tell() const;
 	unsigned long seek(unsigned long pos);
 	unsigned long skip(long count);
 	size_t read(void* buffer, size_t size);
+	size_t read(unsigned long offset, void* buffer, size_t size);
 	size_t write(const void* buffer, size_t size);
 
     /* Constructs the file for the given filename.
@@ -98,10 +117,12 @@ public:
     // Functions inherited from IFile
 	bool eof() const;
 	size_t size() const;
+	uint64_t stamp() const;
 	unsigned long tell() const;
 	unsigned long seek(unsigned long pos);
 	unsigned long skip(long count);
 	size_t read(void* buffer, size_t size);
+	size_t read(unsigned long offset, void* buffer, size_t size);
 	size_t write(const void* buffer, size_t size);
 
     /* Constructs the file from the given file, at the specified range.
@@ -112,6 +133,32 @@ public:
     SubFile(IFile* file, const std::string& subfilename, unsigned long start, unsigned long size);
 };
 
+/* IFile implementation for files read into memory. Writing is not supported. */
+class MemoryFile : public IFile
+{
+	Buffer<char>  m_data;
+	unsigned long m_offset;
+	uint64_t      m_stamp;
+
+	~MemoryFile() {}
+public:
+    // Functions inherited from IFile
+	bool eof() const;
+	size_t size() const;
+	uint64_t stamp() const;
+	unsigned long tell() const;
+	unsigned long seek(unsigned long pos);
+	unsigned long skip(long count);
+	size_t read(void* buffer, size_t size);
+	size_t read(unsigned long offset, void* buffer, size_t size);
+	size_t write(const void* buffer, size_t size);
+
+    /* Reads the entire file into memory. The new file has the same name.
+     *  @file: the file to read.
+     */
+    MemoryFile(IFile& file);
+};
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,643 @@
+#include <windows.h>
+#include "Assets/GameObjects.h"
+#include "Assets/Assets.h"
+#include "General/ExactTypes.h"
+#include "General/Exceptions.h"
+#include "General/Utils.h"
+#include "General/XML.h"
+#include "General/Log.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+using namespace std;
+
+namespace Alamo {
+
+static const char*    XML_PREFIX        = "Data/XML/";
+static const char*    INDEX_FILENAME    = "GameObjectFiles.xml";
+static const char*    VARIANT_PROPERTY  = "Variant_Of_Existing_Type";
+static const uint32_t SNAPSHOT_VERSION  = 1;
+
+// Properties that hold an object's model, in order of preference
+static const char* MODEL_PROPERTIES[] = {"Space_Model_Name", "Land_Model_Name", "Galactic_Model_Name", NULL};
+
+/*
+ * The snapshot is one block of data; all references in it are offsets from
+ * its start, so it can be used straight from a file mapping. Strings are
+ * NUL-terminated and stored once. Objects are sorted by name, and so are the
+ * properties of every object.
+ */
+#pragma pack(1)
+struct SNAPSHOTHEADER
+{
+    char     magic[4];      // "AVGO"
+    uint32_t version;
+    uint32_t fingerprint;   // Of the XML files the snapshot was built from
+    uint32_t size;          // Of the entire snapshot
+    uint32_t nObjects;
+    uint32_t objects;       // Offset of the SNAPSHOTOBJECTs
+};
+
+struct SNAPSHOTOBJECT
+{
+    uint32_t name;
+    uint32_t type;
+    uint32_t base;          // Index of the base object plus one; zero for none
+    uint32_t nProperties;
+    uint32_t properties;    // Offset of the SNAPSHOTPROPERTYs
+};
+
+struct SNAPSHOTPROPERTY
+{
+    uint32_t name;
+    uint32_t value;
+};
+#pragma pack()
+
+// Case-insensitive comparison, in the order of the snapshot
+static int CompareNames(const char* s1, const char* s2)
+{
+    for (;; s1++, s2++)
+    {
+        int c1 = toupper((unsigned char)*s1);
+        int c2 = toupper((unsigned char)*s2);
+        if (c1 != c2 || c1 == '\0')
+        {
+            return c1 - c2;
+        }
+    }
+}
+
+//
+// GameObject class
+//
+const char* GameObject::getPropertyName(size_t i) const
+{
+    return (const char*)m_snapshot + ((const SNAPSHOTPROPERTY*)m_properties)[i].name;
+}
+
+const char* GameObject::getPropertyValue(size_t i) const
+{
+    return (const char*)m_snapshot + ((const SNAPSHOTPROPERTY*)m_properties)[i].value;
+}
+
+const char* GameObject::getProperty(const char* name) const
+{
+    size_t low = 0, high = m_numProperties;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int    cmp = CompareNames(getPropertyName(mid), name);
+        if (cmp == 0) return getPropertyValue(mid);
+        if (cmp < 0) low  = mid + 1;
+        else         high = mid;
+    }
+    return NULL;
+}
+
+const char* GameObject::getModel() const
+{
+    for (const char* const* p = MODEL_PROPERTIES; *p != NULL; p++)
+    {
+        const char* model = getProperty(*p);
+        if (model != NULL && *model != '\0')
+        {
+            return model;
+        }
+    }
+    return NULL;
+}
+
+//
+// The loaded snapshot, either mapped from its file or built in memory
+//
+class GameObjectSnapshot
+{
+    HANDLE             m_hFile;
+    HANDLE             m_hMapping;
+    const char*        m_view;
+    vector<char>       m_data;
+    vector<GameObject> m_objects;
+
+    bool attach(const char* data, size_t size, uint32_t fingerprint);
+
+public:
+    size_t            size() const          { return m_objects.size(); }
+    const GameObject& operator[](size_t i) const { return m_objects[i]; }
+    const GameObject* find(const char* name) const;
+
+    bool map(const wstring& filename, uint32_t fingerprint);
+    bool assign(vector<char>& data, uint32_t fingerprint);
+    void close();
+
+    GameObjectSnapshot() : m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL), m_view(NULL) {}
+    ~GameObjectSnapshot() { close(); }
+};
+
+// Checks the snapshot and sets up the objects
+bool GameObjectSnapshot::attach(const char* data, size_t size, uint32_t fingerprint)
+{
+    const SNAPSHOTHEADER* header = (const SNAPSHOTHEADER*)data;
+    if (size < sizeof(SNAPSHOTHEADER) || memcmp(header->magic, "AVGO", 4) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->fingerprint != fingerprint ||
+        header->size != size || data[size - 1] != '\0')
+    {
+        // Not a snapshot, or one for different files
+        return false;
+    }
+
+    // Every string ends before the end of the snapshot, so offsets only have
+    // to be checked against the size.
+    if (header->objects > size || header->nObjects > (size - header->objects) / sizeof(SNAPSHOTOBJECT))
+    {
+        return false;
+    }
+
+    const SNAPSHOTOBJECT* objects = (const SNAPSHOTOBJECT*)(data + header->objects);
+    m_objects.resize(header->nObjects);
+    for (uint32_t i = 0; i < header->nObjects; i++)
+    {
+        const SNAPSHOTOBJECT& o = objects[i];
+        if (o.name >= size || o.type >= size || o.base > header->nObjects || o.properties > size ||
+            o.nProperties > (size - o.properties) / sizeof(SNAPSHOTPROPERTY))
+        {
+            m_objects.clear();
+            return false;
+        }
+
+        const SNAPSHOTPROPERTY* properties = (const SNAPSHOTPROPERTY*)(data + o.properties);
+        for (uint32_t j = 0; j < o.nProperties; j++)
+        {
+            if (properties[j].name >= size || properties[j].value >= size)
+            {
+                m_objects.clear();
+                return false;
+            }
+        }
+
+        GameObject& object = m_objects[i];
+        object.m_snapshot      = data;
+        object.m_name          = data + o.name;
+        object.m_type          = data + o.type;
+        object.m_base          = (o.base != 0) ? &m_objects[o.base - 1] : NULL;
+        object.m_properties    = properties;
+        object.m_numProperties = o.nProperties;
+    }
+    return true;
+}
+
+const GameObject* GameObjectSnapshot::find(const char* name) const
+{
+    size_t low = 0, high = m_objects.size();
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        int    cmp = CompareNames(m_objects[mid].m_name, name);
+        if (cmp == 0) return &m_objects[mid];
+        if (cmp < 0) low  = mid + 1;
+        else         high = mid;
+    }
+    return NULL;
+}
+
+bool GameObjectSnapshot::map(const wstring& filename, uint32_t fingerprint)
+{
+    close();
+    m_hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        DWORD size = GetFileSize(m_hFile, NULL);
+        if (size != INVALID_FILE_SIZE && size > 0)
+        {
+            m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (m_hMapping != NULL)
+            {
+                m_view = (const char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+                if (m_view != NULL && attach(m_view, size, fingerprint))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    close();
+    return false;
+}
+
+bool GameObjectSnapshot::assign(vector<char>& data, uint32_t fingerprint)
+{
+    close();
+    m_data.swap(data);
+    if (m_data.empty() || !attach(&m_data[0], m_data.size(), fingerprint))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void GameObjectSnapshot::close()
+{
+    m_objects.clear();
+    m_data.clear();
+    if (m_view != NULL)
+    {
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_hMapping != NULL)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+}
+
+namespace GameObjects {
+
+typedef map<string, pair<string, string> > PropertyMap;    // Uppercase name -> (name, value)
+
+// An object type as defined in the XML
+struct Definition
+{
+    string      name;
+    string      type;
+    string      base;
+    PropertyMap properties;     // Its own properties
+    PropertyMap resolved;       // Including the inherited ones
+    int         state;          // 0: unresolved, 1: resolving, 2: resolved
+};
+
+typedef map<string, size_t> DefinitionMap;  // Uppercase name -> index
+
+static GameObjectSnapshot m_database;
+static wstring            m_snapshot;
+static bool               m_pending = false;  // Initialized, but not loaded yet
+
+// Returns a CRC over the names, sizes and stamps of the files.
+// The contents aren't read, so checking a snapshot costs no I/O.
+static uint32_t GetFingerprint(const vector<string>& filenames, const vector< ptr<IFile> >& files)
+{
+    vector<unsigned long> crcs;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        string name = Uppercase(filenames[i]);
+        crcs.push_back(crc32(name.c_str(), name.length()));
+        if (files[i] != NULL)
+        {
+            uint64_t stamp = files[i]->stamp();
+            crcs.push_back((unsigned long)files[i]->size());
+            crcs.push_back((unsigned long)(stamp & 0xFFFFFFFF));
+            crcs.push_back((unsigned long)(stamp >> 32));
+        }
+    }
+    return crc32(&crcs[0], crcs.size() * sizeof(unsigned long));
+}
+
+static void AddDefinitions(vector<Definition>& defs, DefinitionMap& index, const XMLTree& xml)
+{
+    const XMLNode* root = xml.getRoot();
+    for (size_t i = 0; i < root->getNumChildren(); i++)
+    {
+        const XMLNode* node = root->getChild(i);
+        const char*    name = node->getAttribute("Name");
+        if (name == NULL || *name == '\0')
+        {
+            continue;
+        }
+
+        Definition def;
+        def.name  = name;
+        def.type  = node->getName();
+        def.state = 0;
+        for (size_t j = 0; j < node->getNumChildren(); j++)
+        {
+            const XMLNode* prop = node->getChild(j);
+            const char*    data = prop->getData();
+            if (data == NULL)
+            {
+                continue;
+            }
+
+            if (prop->equals(VARIANT_PROPERTY)) {
+                def.base = data;
+            } else {
+                // The first occurrence of a property counts
+                def.properties.insert(make_pair(Uppercase(prop->getName()), make_pair(string(prop->getName()), string(data))));
+            }
+        }
+
+        // Later definitions replace earlier ones
+        pair<DefinitionMap::iterator, bool> p = index.insert(make_pair(Uppercase(def.name), defs.size()));
+        if (p.second) {
+            defs.push_back(def);
+        } else {
+            defs[p.first->second] = def;
+        }
+    }
+}
+
+static void Resolve(vector<Definition>& defs, const DefinitionMap& index, size_t i)
+{
+    Definition& def = defs[i];
+    if (def.state == 2)
+    {
+        return;
+    }
+
+    if (def.state == 1)
+    {
+        Log::WriteError("Game object %s is its own variant through Variant_Of_Existing_Type\n", def.name.c_str());
+        def.base.clear();
+    }
+    else if (!def.base.empty())
+    {
+        def.state = 1;
+        DefinitionMap::const_iterator p = index.find(Uppercase(def.base));
+        if (p == index.end())
+        {
+            Log::WriteError("Game object %s is a variant of unknown type %s\n", def.name.c_str(), def.base.c_str());
+            def.base.clear();
+        }
+        else
+        {
+            Resolve(defs, index, p->second);
+            def.resolved = defs[p->second].resolved;
+        }
+    }
+
+    // Own properties override inherited ones
+    for (PropertyMap::const_iterator p = def.properties.begin(); p != def.properties.end(); p++)
+    {
+        def.resolved[p->first] = p->second;
+    }
+    def.state = 2;
+}
+
+struct DefinitionOrder
+{
+    const vector<Definition>* defs;
+    bool operator()(size_t a, size_t b) const { return CompareNames((*defs)[a].name.c_str(), (*defs)[b].name.c_str()) < 0; }
+};
+
+static bool PropertyOrder(const pair<string, string>* a, const pair<string, string>* b)
+{
+    return CompareNames(a->first.c_str(), b->first.c_str()) < 0;
+}
+
+// Adds a string to the pool, if it's not there yet, and returns its offset
+static uint32_t AddString(vector<char>& pool, map<string, uint32_t>& strings, const string& str)
+{
+    pair<map<string, uint32_t>::iterator, bool> p = strings.insert(make_pair(str, (uint32_t)pool.size()));
+    if (p.second)
+    {
+        pool.insert(pool.end(), str.c_str(), str.c_str() + str.length() + 1);
+    }
+    return p.first->second;
+}
+
+// Builds the snapshot from the object definitions
+static void BuildSnapshot(vector<char>& data, vector<Definition>& defs, const DefinitionMap& index, uint32_t fingerprint)
+{
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        Resolve(defs, index, i);
+    }
+
+    // Sort the objects by name
+    vector<size_t> order(defs.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    DefinitionOrder cmp = {&defs};
+    sort(order.begin(), order.end(), cmp);
+
+    vector<uint32_t> position(defs.size());
+    size_t nProperties = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        position[order[i]] = (uint32_t)i;
+        nProperties += defs[order[i]].resolved.size();
+    }
+
+    size_t objectsStart    = sizeof(SNAPSHOTHEADER);
+    size_t propertiesStart = objectsStart    + defs.size() * sizeof(SNAPSHOTOBJECT);
+    size_t poolStart       = propertiesStart + nProperties * sizeof(SNAPSHOTPROPERTY);
+
+    vector<SNAPSHOTOBJECT>   objects(defs.size());
+    vector<SNAPSHOTPROPERTY> properties;
+    vector<char>             pool;
+    map<string, uint32_t>    strings;
+    properties.reserve(nProperties);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const Definition& def = defs[order[i]];
+        SNAPSHOTOBJECT&   o   = objects[i];
+        o.name        = (uint32_t)poolStart + AddString(pool, strings, def.name);
+        o.type        = (uint32_t)poolStart + AddString(pool, strings, def.type);
+        o.base        = 0;
+        o.nProperties = (uint32_t)def.resolved.size();
+        o.properties  = (uint32_t)(propertiesStart + properties.size() * sizeof(SNAPSHOTPROPERTY));
+        if (!def.base.empty())
+        {
+            o.base = position[index.find(Uppercase(def.base))->second] + 1;
+        }
+
+        vector<const pair<string, string>*> props;
+        for (PropertyMap::const_iterator p = def.resolved.begin(); p != def.resolved.end(); p++)
+        {
+            props.push_back(&p->second);
+        }
+        sort(props.begin(), props.end(), PropertyOrder);
+
+        for (size_t j = 0; j < props.size(); j++)
+        {
+            SNAPSHOTPROPERTY prop;
+            prop.name  = (uint32_t)poolStart + AddString(pool, strings, props[j]->first);
+            prop.value = (uint32_t)poolStart + AddString(pool, strings, props[j]->second);
+            properties.push_back(prop);
+        }
+    }
+    pool.push_back('\0');   // So the snapshot always ends with a NUL
+
+    SNAPSHOTHEADER header;
+    memcpy(header.magic, "AVGO", 4);
+    header.version     = SNAPSHOT_VERSION;
+    header.fingerprint = fingerprint;
+    header.size        = (uint32_t)(poolStart + pool.size());
+    header.nObjects    = (uint32_t)objects.size();
+    header.objects     = (uint32_t)objectsStart;
+
+    data.resize(header.size);
+    memcpy(&data[0], &header, sizeof header);
+    if (!objects.empty())    memcpy(&data[objectsStart],    &objects[0],    objects.size()    * sizeof(SNAPSHOTOBJECT));
+    if (!properties.empty()) memcpy(&data[propertiesStart], &properties[0], properties.size() * sizeof(SNAPSHOTPROPERTY));
+    memcpy(&data[poolStart], &pool[0], pool.size());
+}
+
+// Writes the snapshot to a temporary file which then replaces the old one,
+// so a snapshot is never half-written.
+static void SaveSnapshot(const wstring& filename, const vector<char>& data)
+{
+    wstring dir = filename.substr(0, filename.find_last_of(L"\\/") + 1);
+    wchar_t tempname[MAX_PATH];
+    if (GetTempFileName(dir.empty() ? L"." : dir.c_str(), L"ago", 0, tempname) == 0)
+    {
+        throw IOException(L"Unable to create file in:\n" + dir);
+    }
+
+    HANDLE hFile = CreateFile(tempname, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        DeleteFile(tempname);
+        throw IOException(L"Unable to create file:\n" + wstring(tempname));
+    }
+
+    DWORD written;
+    BOOL  success = WriteFile(hFile, &data[0], (DWORD)data.size(), &written, NULL) && written == data.size();
+    CloseHandle(hFile);
+    if (!success || !MoveFileEx(tempname, filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        DeleteFile(tempname);
+        throw WriteException();
+    }
+}
+
+// Loads the database; the first lookup after Initialize() does this
+static void Load(const wstring& snapshot)
+{
+    ptr<IFile> file = Assets::LoadFile(INDEX_FILENAME, XML_PREFIX);
+    if (file == NULL)
+    {
+        return;
+    }
+
+    XMLTree xml;
+    try
+    {
+        xml.parse(file);
+    }
+    catch (ParseException& e)
+    {
+        // Can't parse XML
+        Log::WriteError("Parse error in %s%s: %s\n", XML_PREFIX, INDEX_FILENAME, e.what());
+        return;
+    }
+
+    // The index itself is part of the fingerprint as well
+    vector<string>       filenames(1, INDEX_FILENAME);
+    vector< ptr<IFile> > files(1, file);
+    const XMLNode* root = xml.getRoot();
+    if (root == NULL)
+    {
+        Log::WriteError("%s%s is empty\n", XML_PREFIX, INDEX_FILENAME);
+        return;
+    }
+
+    for (size_t i = 0; i < root->getNumChildren(); i++)
+    {
+        const char* data = root->getChild(i)->getData();
+        if (data != NULL)
+        {
+            filenames.push_back(data);
+            files.push_back(Assets::LoadFile(data, XML_PREFIX));
+        }
+    }
+
+    uint32_t fingerprint = GetFingerprint(filenames, files);
+    if (!snapshot.empty() && m_database.map(snapshot, fingerprint))
+    {
+        return;
+    }
+
+    // No usable snapshot; parse the object files
+    filenames.erase(filenames.begin());
+    files.erase(files.begin());
+
+    XMLTreeList trees;
+    trees.parse(files);
+
+    vector<Definition> defs;
+    DefinitionMap      index;
+    for (size_t i = 0; i < trees.size(); i++)
+    {
+        if (trees.getError(i) != NULL)
+        {
+            // Can't parse XML
+            Log::WriteError("Parse error in %s%s: %s\n", XML_PREFIX, filenames[i].c_str(), trees.getError(i));
+            continue;
+        }
+        if (trees[i].getRoot() == NULL)
+        {
+            // Missing files are skipped quietly
+            if (files[i] != NULL) {
+                Log::WriteError("%s%s is empty\n", XML_PREFIX, filenames[i].c_str());
+            }
+            continue;
+        }
+        AddDefinitions(defs, index, trees[i]);
+    }
+
+    vector<char> data;
+    BuildSnapshot(data, defs, index, fingerprint);
+    if (!snapshot.empty())
+    {
+        try
+        {
+            SaveSnapshot(snapshot, data);
+        }
+        catch (wexception& e)
+        {
+            Log::WriteError("Unable to save game object snapshot: %s\n", WideToAnsi(e.what()).c_str());
+        }
+    }
+    m_database.assign(data, fingerprint);
+}
+
+static const GameObjectSnapshot& GetDatabase()
+{
+    if (m_pending)
+    {
+        // Only try once; a failed load leaves the database empty
+        m_pending = false;
+        Load(m_snapshot);
+    }
+    return m_database;
+}
+
+void Initialize(const wstring& snapshot)
+{
+    Uninitialize();
+    m_snapshot = snapshot;
+    m_pending  = true;
+}
+
+void Uninitialize()
+{
+    m_pending = false;
+    m_snapshot.clear();
+    m_database.close();
+}
+
+const GameObject* FindObject(const string& name)
+{
+    return GetDatabase().find(name.c_str());
+}
+
+size_t GetNumObjects()
+{
+    return GetDatabase().size();
+}
+
+const GameObject* GetObjectByIndex(size_t i)
+{
+    return &GetDatabase()[i];
+}
+
+}
+}
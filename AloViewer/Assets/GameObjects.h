@@ -0,0 +1,83 @@
+#ifndef GAMEOBJECTS_H
+#define GAMEOBJECTS_H
+
+#include <string>
+
+namespace Alamo {
+
+/*
+ * The game object database holds every object type from the game's XML files
+ * (Data/XML/GameObjectFiles.xml), with Variant_Of_Existing_Type already
+ * resolved; an object has all properties of its base type, except those it
+ * overrides.
+ *
+ * Parsing all object files takes a while, so the resolved database is stored
+ * in a binary snapshot. As long as the XML files don't change, the next
+ * load only maps the snapshot into memory.
+ */
+class GameObject
+{
+    friend class GameObjectSnapshot;
+
+    const void*       m_snapshot;
+    const char*       m_name;
+    const char*       m_type;
+    const GameObject* m_base;
+    const void*       m_properties;
+    size_t            m_numProperties;
+
+public:
+    // The name of the object type
+    const char*       getName() const { return m_name; }
+
+    // The XML tag the object was defined with, e.g. "SpaceUnit"
+    const char*       getType() const { return m_type; }
+
+    // The type this object is a variant of, or NULL
+    const GameObject* getBase() const { return m_base; }
+
+    /* Returns the value of the specified property, including those inherited
+     * from the base type. Returns NULL if the object doesn't have the property.
+     * @name: case-insensitive name of the property, e.g. "Space_Model_Name".
+     */
+    const char* getProperty(const char* name) const;
+    const char* getProperty(const std::string& name) const {
+        return getProperty(name.c_str());
+    }
+
+    // All properties, sorted by name
+    size_t      getNumProperties() const { return m_numProperties; }
+    const char* getPropertyName(size_t i) const;
+    const char* getPropertyValue(size_t i) const;
+
+    /* Returns the name of the model the object uses, or NULL if it has none.
+     * The animations for the object are named after its model.
+     */
+    const char* getModel() const;
+};
+
+namespace GameObjects {
+
+/* Sets up the game object database for the current assets.
+ * Call this after Assets::Initialize(). The database is only loaded when
+ * it's first used, on the calling thread, so nothing is read until then.
+ *  @snapshot: filename of the snapshot to use. If empty, the database is
+ *             built from the XML files without storing it.
+ */
+void Initialize(const std::wstring& snapshot);
+void Uninitialize();
+
+/* Returns the object type with the specified name.
+ * Returns NULL if no such type exists.
+ * @name: case-insensitive name of the object type.
+ */
+const GameObject* FindObject(const std::string& name);
+
+// All object types, sorted by name
+size_t            GetNumObjects();
+const GameObject* GetObjectByIndex(size_t i);
+
+}
+}
+
+#endif
@@ -1,16 +1,16 @@
 #include "Effects/SurfaceFX.h"
+#include "General/NameTable.h"
 #include "General/XML.h"
 #include "General/Utils.h"
 #include "General/Exceptions.h"
 #include "General/Log.h"
 #include "Assets/Assets.h"
-#include <map>
 using namespace std;
 
 namespace Alamo {
 namespace SurfaceFX {
 
-typedef map<string, Effect> EffectMap;
+typedef NameTable<Effect> EffectMap;
 
 static const char* XML_PREFIX = "Data/XML/";
 
@@ -33,7 +33,7 @@ static void ParseSurfaceFX(const XMLNode* ent, const string& name)
                 e.sound = data;
             }
         }
-        m_effects[Uppercase(name)] = e;
+        m_effects[name] = e;
     }
 }
 
@@ -74,10 +74,9 @@ void Uninitialize()
     m_effects.clear();
 }
 
-const Effect* GetEffect(const std::string& name)
+const Effect* GetEffect(const HashedString& name)
 {
-    EffectMap::const_iterator p = m_effects.find(Uppercase(name));
-    return (p != m_effects.end()) ? &p->second : NULL;
+    return m_effects.find(name);
 }
 
 }
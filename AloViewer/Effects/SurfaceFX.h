@@ -1,6 +1,7 @@
 #ifndef SURFACEFX_H
 #define SURFACEFX_H
 
+#include "General/Utils.h"
 #include <string>
 
 namespace Alamo {
@@ -8,13 +9,14 @@ namespace SurfaceFX {
 
 struct Effect
 {
-    std::string sound;
+    HashedString sound;
 };
 
 void Initialize();
 void Uninitialize();
 
-const Effect* GetEffect(const std::string& name);
+// Returns the effect with the specified (case-insensitive) name, or NULL
+const Effect* GetEffect(const HashedString& name);
 
 }
 }
@@ -1,27 +1,253 @@
 #ifndef NDEBUG
 #include <iostream>
 #endif
+#include <windows.h>
+#include <intrin.h>
 #include <stdarg.h>
 #include <stack>
 #include "log.h"
+#include "General/ExactTypes.h"
 using namespace std;
 
 namespace Log
 {
 
-static vector<Line>					      g_lines;
+static const long     RING_SIZE      = 256;     // In lines; must be a power of two
+static const size_t   MAX_PENDING    = 4096;    // Lines waiting for Flush() beyond this are dropped
+static const DWORD    DRAIN_INTERVAL = 50;      // Milliseconds
+static const uint32_t FILE_VERSION   = 1;
+
+// A line in the ring buffer. The sequence is the write position that may use
+// the slot, and one more once the line has been written to it.
+struct Slot
+{
+    volatile long sequence;
+    time_t        time;
+    LineType      type;
+    char          text[MAX_LINE_LENGTH];
+};
+
+struct Ring
+{
+    Slot slots[RING_SIZE];
+    Ring() { for (long i = 0; i < RING_SIZE; i++) slots[i].sequence = i; }
+};
+
+#pragma pack(1)
+struct LOGRECORD
+{
+    uint32_t time;
+    uint8_t  type;
+    uint16_t length;
+};
+#pragma pack()
+
+// Protects everything but the ring buffer
+struct Lock
+{
+    CRITICAL_SECTION cs;
+    Lock()  { InitializeCriticalSection(&cs); }
+    ~Lock() { DeleteCriticalSection(&cs); }
+};
+
+static Lock                               g_lock;
+static Ring                               g_ring;
+static volatile long                      g_writePos = 0;
+static volatile long                      g_readPos  = 0;
+static volatile long                      g_dropped  = 0;
+static volatile long                      g_level    = LT_INFO;
+static const DWORD                        g_mainThread = GetCurrentThreadId();
+static HANDLE                             g_hThread = NULL;
+static HANDLE                             g_hQuit   = NULL;
+static HANDLE                             g_hWake   = NULL;    // Set when the ring buffer is half full
+static HANDLE                             g_hFile   = INVALID_HANDLE_VALUE;
+static vector<Line>                       g_pending;    // Lines not yet passed to the callbacks
 static vector<pair<CALLBACK_FUNC,void*> > g_callbacks;
 static stack<size_t>                      g_freeCallbacks;
 
+// Adds a line taken from the ring buffer. Call with the lock held.
+static void AddLine(const Line& line, string& record)
+{
+#ifndef NDEBUG
+    cout << line.text << endl;
+#endif
+    if (g_pending.size() < MAX_PENDING)
+    {
+        g_pending.push_back(line);
+    }
+
+    if (g_hFile != INVALID_HANDLE_VALUE)
+    {
+        LOGRECORD header;
+        header.time   = (uint32_t)line.time;
+        header.type   = (uint8_t)line.type;
+        header.length = (uint16_t)line.text.length();
+        record.append((const char*)&header, sizeof header);
+        record.append(line.text);
+    }
+}
+
+// Takes all written lines from the ring buffer. Call with the lock held.
+static void Drain()
+{
+    string record;
+    for (;;)
+    {
+        Slot& slot = g_ring.slots[g_readPos & (RING_SIZE - 1)];
+        if (slot.sequence != g_readPos + 1)
+        {
+            // Empty, or still being written
+            break;
+        }
+
+        Line line;
+        line.time = slot.time;
+        line.type = slot.type;
+        for (const char* text = slot.text;;)
+        {
+            const char* end = strchr(text, '\n');
+            line.text.assign(text, (end != NULL) ? end - text : strlen(text));
+            AddLine(line, record);
+            if (end == NULL || end[1] == '\0')
+            {
+                break;
+            }
+            text = end + 1;
+        }
+
+        // Free the slot for the next round
+        _InterlockedExchange(&slot.sequence, g_readPos + RING_SIZE);
+        _InterlockedIncrement(&g_readPos);
+    }
+
+    long dropped = _InterlockedExchange(&g_dropped, 0);
+    if (dropped > 0)
+    {
+        char text[64];
+        sprintf(text, "(%ld lines dropped)", dropped);
+
+        Line line;
+        line.time = time(NULL);
+        line.type = LT_ERROR;
+        line.text = text;
+        AddLine(line, record);
+    }
+
+    if (!record.empty())
+    {
+        DWORD written;
+        WriteFile(g_hFile, record.c_str(), (DWORD)record.length(), &written, NULL);
+    }
+}
+
+// Reserves a slot at the returned position, or returns NULL if the ring buffer is full
+static Slot* Reserve(long& pos)
+{
+    pos = g_writePos;
+    for (;;)
+    {
+        Slot& slot = g_ring.slots[pos & (RING_SIZE - 1)];
+        long  diff = slot.sequence - pos;
+        if (diff == 0)
+        {
+            long prev = _InterlockedCompareExchange(&g_writePos, pos + 1, pos);
+            if (prev == pos)
+            {
+                return &slot;
+            }
+            pos = prev;
+        }
+        else if (diff < 0)
+        {
+            // Not read yet since the last round
+            return NULL;
+        }
+        else
+        {
+            // Another thread took this one
+            pos = g_writePos;
+        }
+    }
+}
+
+static DWORD WINAPI DrainThread(LPVOID)
+{
+    HANDLE handles[2] = {g_hQuit, g_hWake};
+    while (WaitForMultipleObjects(2, handles, FALSE, DRAIN_INTERVAL) != WAIT_OBJECT_0)
+    {
+        EnterCriticalSection(&g_lock.cs);
+        Drain();
+        LeaveCriticalSection(&g_lock.cs);
+    }
+    return 0;
+}
+
+void Initialize()
+{
+    g_hQuit   = CreateEvent(NULL, TRUE,  FALSE, NULL);
+    g_hWake   = CreateEvent(NULL, FALSE, FALSE, NULL);
+    g_hThread = CreateThread(NULL, 0, DrainThread, NULL, 0, NULL);
+}
+
 void Uninitialize()
 {
-    g_lines.clear();
+    if (g_hThread != NULL)
+    {
+        SetEvent(g_hQuit);
+        WaitForSingleObject(g_hThread, INFINITE);
+        CloseHandle(g_hThread);
+        CloseHandle(g_hQuit);
+        CloseHandle(g_hWake);
+        g_hThread = NULL;
+    }
+    CloseFile();
+
+    EnterCriticalSection(&g_lock.cs);
+    g_pending.clear();
+    LeaveCriticalSection(&g_lock.cs);
     g_callbacks.clear();
     while (!g_freeCallbacks.empty()) {
         g_freeCallbacks.pop();
     }
 }
 
+bool OpenFile(const wstring& filename)
+{
+    CloseFile();
+
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written;
+    WriteFile(hFile, "ALOG", 4, &written, NULL);
+    WriteFile(hFile, &FILE_VERSION, sizeof FILE_VERSION, &written, NULL);
+
+    EnterCriticalSection(&g_lock.cs);
+    g_hFile = hFile;
+    LeaveCriticalSection(&g_lock.cs);
+    return true;
+}
+
+void CloseFile()
+{
+    EnterCriticalSection(&g_lock.cs);
+    if (g_hFile != INVALID_HANDLE_VALUE)
+    {
+        Drain();
+        CloseHandle(g_hFile);
+        g_hFile = INVALID_HANDLE_VALUE;
+    }
+    LeaveCriticalSection(&g_lock.cs);
+}
+
+void SetLevel(LineType level)
+{
+    _InterlockedExchange(&g_level, level);
+}
+
 size_t RegisterCallback(CALLBACK_FUNC callback, void* data)
 {
     if (g_freeCallbacks.empty())
@@ -47,39 +273,66 @@ void UnregisterCallback(size_t callback)
 
 static void Write(LineType type, const char* format, va_list args)
 {
-	// Format string
-	size_t size = _vscprintf(format, args);
-	string str(size, ' ');
-	vsprintf((char*)str.c_str(), format, args);
-    
-    // Make sure the string ends in a newline
-    if (*str.rbegin() != '\n') {
-        str += "\n";
-    }
-	
-    Line line;
-    line.time = time(NULL);
-    line.type = type;
-
-	// Add the lines
-	vector<Line> newlines;
-	for (size_t end, ofs = 0; (end = str.find_first_of("\n", ofs)) != string::npos; ofs = end + 1)
-	{
-		line.text = str.substr(ofs, end - ofs);
+    if (type < g_level)
+    {
+        return;
+    }
 
-        g_lines.push_back(line);
-        newlines.push_back(line);
-#ifndef NDEBUG
-		cout << line.text << endl;
-#endif
-	}
+    long  pos;
+    Slot* slot = Reserve(pos);
+    if (slot == NULL && GetCurrentThreadId() == g_mainThread)
+    {
+        // Make room instead of dropping the line
+        EnterCriticalSection(&g_lock.cs);
+        Drain();
+        LeaveCriticalSection(&g_lock.cs);
+        slot = Reserve(pos);
+    }
+
+    if (slot == NULL)
+    {
+        _InterlockedIncrement(&g_dropped);
+        return;
+    }
 
-	for (vector<pair<CALLBACK_FUNC, void*> >::const_iterator p = g_callbacks.begin(); p != g_callbacks.end(); p++)
-	{
-		p->first(newlines, p->second);
-	}
+	// Format string, cut off if it doesn't fit
+    slot->time = time(NULL);
+    slot->type = type;
+    _vsnprintf(slot->text, MAX_LINE_LENGTH - 1, format, args);
+    slot->text[MAX_LINE_LENGTH - 1] = '\0';
+    _InterlockedExchange(&slot->sequence, pos + 1);
+
+    // The callbacks generally update the UI, so lines from other
+    // threads wait for the main thread to call Flush().
+    if (GetCurrentThreadId() == g_mainThread)
+    {
+        Flush();
+    }
+    else if (pos - g_readPos >= RING_SIZE / 2 && g_hWake != NULL)
+    {
+        SetEvent(g_hWake);
+    }
 };
 
+void Flush()
+{
+	vector<Line> newlines;
+    EnterCriticalSection(&g_lock.cs);
+    Drain();
+    newlines.swap(g_pending);
+    LeaveCriticalSection(&g_lock.cs);
+
+    if (!newlines.empty())
+    {
+	    for (vector<pair<CALLBACK_FUNC, void*> >::const_iterator p = g_callbacks.begin(); p != g_callbacks.end(); p++)
+	    {
+            if (p->first != NULL)
+            {
+		        p->first(newlines, p->second);
+            }
+	    }
+    }
+}
 void WriteInfo(const char* format, ...)
 {
 	va_list args;
@@ -22,10 +22,37 @@ namespace Log
 	
 	typedef void (*CALLBACK_FUNC)(const std::vector<Line>& newlines, void* data);
 
+	/* Lines may be written from any thread. Writing only formats the line
+	 * into a fixed-size ring buffer, without locking or allocating; a
+	 * background thread takes them from there. When the ring buffer is full,
+	 * the main thread makes room, but lines from other threads are dropped.
+	 * Lines longer than MAX_LINE_LENGTH are cut off.
+	 */
+	static const size_t MAX_LINE_LENGTH = 1024;
+
 	void WriteInfo(const char* format, ...);
 	void WriteError(const char* format, ...);
 	size_t RegisterCallback(CALLBACK_FUNC callback, void* data);
 	void UnregisterCallback(size_t callback);
+
+	// Lines of a lower type than this are dropped before they're formatted
+	void SetLevel(LineType level);
+
+	/* Also writes all lines to a binary log file. The file starts with
+	 * "ALOG" and a 32-bit version, followed by a record for every line:
+	 * a 32-bit time, an 8-bit LineType, a 16-bit length and the text.
+	 * All values are little-endian. Returns false if the file could not be created.
+	 */
+	bool OpenFile(const std::wstring& filename);
+	void CloseFile();
+
+	// Passes the lines written from other threads to the callbacks.
+	// Call this regularly from the main thread.
+	void Flush();
+
+	// Starts the background thread. Before this, lines are only taken from
+	// the ring buffer by Flush().
+	void Initialize();
     void Uninitialize();
 };
 
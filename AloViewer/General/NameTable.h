@@ -0,0 +1,100 @@
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+#include "General/Utils.h"
+#include <deque>
+#include <vector>
+
+namespace Alamo
+{
+
+/*
+ * A hash table of objects by case-insensitive name.
+ * Looking up a HashedString uses its precomputed hash, so it neither hashes
+ * nor allocates. Objects stay at the same address once they've been added.
+ */
+template <typename T>
+class NameTable
+{
+    struct Entry
+    {
+        HashedString name;
+        T            value;
+
+        Entry(const HashedString& _name) : name(_name), value() {}
+    };
+
+    std::deque<Entry>   m_entries;
+    std::vector<size_t> m_slots;    // Index into m_entries plus one; zero is empty
+
+    // Returns the slot of the name, or the empty slot where it belongs
+    size_t lookup(const char* name, unsigned long hash) const
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t slot = hash & mask;
+        for (; m_slots[slot] != 0; slot = (slot + 1) & mask)
+        {
+            const HashedString& n = m_entries[m_slots[slot] - 1].name;
+            if (n.hash == hash && _stricmp(n.str.c_str(), name) == 0)
+            {
+                break;
+            }
+        }
+        return slot;
+    }
+
+    void grow()
+    {
+        std::vector<size_t> slots(m_slots.empty() ? 64 : m_slots.size() * 2, 0);
+        size_t mask = slots.size() - 1;
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            size_t slot = m_entries[i].name.hash & mask;
+            while (slots[slot] != 0) slot = (slot + 1) & mask;
+            slots[slot] = i + 1;
+        }
+        m_slots.swap(slots);
+    }
+
+    const T* find(const char* name, unsigned long hash) const
+    {
+        if (m_slots.empty()) return NULL;
+        size_t slot = lookup(name, hash);
+        return (m_slots[slot] != 0) ? &m_entries[m_slots[slot] - 1].value : NULL;
+    }
+
+public:
+    // Returns the object with the name, or NULL if there's none
+    const T* find(const HashedString& name) const { return find(name.str.c_str(), name.hash); }
+    const T* find(const char* name)         const { return find(name, HashName(name)); }
+    T*       find(const HashedString& name)       { return const_cast<T*>(static_cast<const NameTable*>(this)->find(name)); }
+
+    // Returns the object with the name, adding a default one if there's none
+    T& operator[](const HashedString& name)
+    {
+        if ((m_entries.size() + 1) * 2 > m_slots.size())
+        {
+            grow();
+        }
+
+        size_t slot = lookup(name.str.c_str(), name.hash);
+        if (m_slots[slot] == 0)
+        {
+            m_entries.push_back(Entry(name));
+            m_slots[slot] = m_entries.size();
+        }
+        return m_entries[m_slots[slot] - 1].value;
+    }
+
+    size_t size() const { return m_entries.size(); }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_slots.clear();
+    }
+};
+
+}
+
+#endif
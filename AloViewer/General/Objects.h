@@ -3,14 +3,16 @@
 
 #include <cstdlib>
 #include <cassert>
+#include <intrin.h>
 
 /*
  * Reference counted object base.
  * Inherit from this to make your objects reference counted.
+ * The reference count is atomic, so objects can be passed between threads.
  */
 class IObject
 {
-	unsigned long nReferences;
+	volatile long nReferences;
 
 protected:
     virtual ~IObject() {}
@@ -18,19 +20,25 @@ protected:
 public:
 	unsigned long AddRef()
 	{
-		return ++nReferences;
+		return _InterlockedIncrement(&nReferences);
 	}
 
 	unsigned long Release()
 	{
-		unsigned long refs = --nReferences;
-		if (nReferences == 0)
+		long refs = _InterlockedDecrement(&nReferences);
+		if (refs == 0)
 		{
 			delete this;
 		}
 		return refs;
 	}
 
+	// Only meaningful when no other thread can add a reference meanwhile
+	unsigned long GetRefCount() const
+	{
+		return nReferences;
+	}
+
 	IObject() : nReferences(1) {}
 };
 
@@ -0,0 +1,322 @@
+#include "General/Profiler.h"
+#include "General/Utils.h"
+#include <windows.h>
+#include <intrin.h>
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+using namespace std;
+
+namespace Profiler
+{
+
+// Events beyond this are dropped, so a long recording can't take all memory
+static const size_t MAX_EVENTS = 1000000;
+
+static const char* CounterNames[NUM_COUNTERS] = {
+    "Particles alive",
+    "Particles spawned",
+    "Particles killed",
+    "Draw calls",
+    "Primitives",
+    "Vertex bytes",
+    "Index bytes",
+    "File bytes",
+};
+
+struct Event
+{
+    const char* category;
+    const char* name;
+    DWORD       thread;
+    int64_t     start;
+    int64_t     end;
+};
+
+typedef map<wstring, unsigned long> FileReads;
+
+struct Frame
+{
+    int64_t   start;
+    int64_t   end;
+    long      counters[NUM_COUNTERS];
+    FileReads files;
+};
+
+// Events and file reads come from any thread, so they're locked
+struct Lock
+{
+    CRITICAL_SECTION cs;
+    Lock()  { InitializeCriticalSection(&cs); }
+    ~Lock() { DeleteCriticalSection(&cs); }
+};
+
+volatile bool g_enabled = false;
+
+static Lock          g_lock;
+static int64_t       g_frequency;
+static int64_t       g_start;
+static int64_t       g_frameStart = -1;
+static DWORD         g_mainThread;
+static volatile long g_counters[NUM_COUNTERS];
+static FileReads     g_fileReads;   // Of the current frame
+static vector<Event> g_events;
+static vector<Frame> g_frames;
+static set<string>   g_names;       // Copies of the event names
+static size_t        g_dropped;
+
+int64_t GetTimestamp()
+{
+    LARGE_INTEGER time;
+    QueryPerformanceCounter(&time);
+    return time.QuadPart;
+}
+
+void Start()
+{
+    g_enabled = false;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    EnterCriticalSection(&g_lock.cs);
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        _InterlockedExchange(&g_counters[i], 0);
+    }
+    g_fileReads.clear();
+    g_events.clear();
+    g_frames.clear();
+    g_names.clear();
+    g_dropped    = 0;
+    g_frequency  = frequency.QuadPart;
+    g_start      = GetTimestamp();
+    g_frameStart = -1;
+    g_mainThread = GetCurrentThreadId();
+    LeaveCriticalSection(&g_lock.cs);
+
+    g_enabled = true;
+}
+
+void Stop()
+{
+    g_enabled = false;
+}
+
+void BeginFrame()
+{
+    if (g_enabled)
+    {
+        g_frameStart = GetTimestamp();
+    }
+}
+
+void EndFrame()
+{
+    if (g_enabled && g_frameStart != -1)
+    {
+        Frame frame;
+        frame.start = g_frameStart;
+        frame.end   = GetTimestamp();
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            frame.counters[i] = _InterlockedExchange(&g_counters[i], 0);
+        }
+
+        EnterCriticalSection(&g_lock.cs);
+        g_frames.push_back(frame);
+        g_frames.back().files.swap(g_fileReads);
+        LeaveCriticalSection(&g_lock.cs);
+        g_frameStart = -1;
+    }
+}
+
+void AddCounter(Counter counter, long value)
+{
+    _InterlockedExchangeAdd(&g_counters[counter], value);
+}
+
+void SetCounter(Counter counter, long value)
+{
+    _InterlockedExchange(&g_counters[counter], value);
+}
+
+void AddFileReadCounter(const wstring& file, unsigned long bytes)
+{
+    EnterCriticalSection(&g_lock.cs);
+    g_fileReads[file] += bytes;
+    LeaveCriticalSection(&g_lock.cs);
+}
+
+void AddEvent(const char* category, const char* name, int64_t start, int64_t end)
+{
+    EnterCriticalSection(&g_lock.cs);
+    if (g_events.size() < MAX_EVENTS)
+    {
+        Event e;
+        e.category = category;
+        e.name     = g_names.insert(name).first->c_str();
+        e.thread   = GetCurrentThreadId();
+        e.start    = start;
+        e.end      = end;
+        g_events.push_back(e);
+    }
+    else
+    {
+        g_dropped++;
+    }
+    LeaveCriticalSection(&g_lock.cs);
+}
+
+// Converts a timestamp to microseconds since the start of the recording
+static double ToMicroseconds(int64_t time)
+{
+    return (time - g_start) * 1000000.0 / g_frequency;
+}
+
+static string EscapeJSON(const string& str)
+{
+    string escaped;
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        if (str[i] == '"' || str[i] == '\\') escaped += '\\';
+        escaped += ((unsigned char)str[i] < 32) ? ' ' : str[i];
+    }
+    return escaped;
+}
+
+static string EscapeCSV(const string& str)
+{
+    if (str.find_first_of(",\"") == string::npos)
+    {
+        return str;
+    }
+
+    string escaped = "\"";
+    for (size_t i = 0; i < str.length(); i++)
+    {
+        if (str[i] == '"') escaped += '"';
+        escaped += str[i];
+    }
+    return escaped + "\"";
+}
+
+// Returns the names of all MegaFiles that were read from
+static set<wstring> GetFileNames()
+{
+    set<wstring> names;
+    for (size_t i = 0; i < g_frames.size(); i++)
+    {
+        for (FileReads::const_iterator p = g_frames[i].files.begin(); p != g_frames[i].files.end(); p++)
+        {
+            names.insert(p->first);
+        }
+    }
+    return names;
+}
+
+static bool WriteToFile(const wstring& filename, const string& data)
+{
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written;
+    BOOL  success = WriteFile(hFile, data.c_str(), (DWORD)data.length(), &written, NULL) && written == data.length();
+    CloseHandle(hFile);
+    return success != FALSE;
+}
+
+bool WriteTrace(const wstring& filename)
+{
+    EnterCriticalSection(&g_lock.cs);
+    const set<wstring> files = GetFileNames();
+
+    ostringstream json;
+    json << fixed << setprecision(3);
+    json << "{\"traceEvents\":[\n";
+
+    const char* separator = "";
+    for (size_t i = 0; i < g_events.size(); i++)
+    {
+        const Event& e = g_events[i];
+        json << separator << "{\"name\":\"" << EscapeJSON(e.name) << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+             << ",\"ts\":" << ToMicroseconds(e.start) << ",\"dur\":" << ToMicroseconds(e.end) - ToMicroseconds(e.start) << "}";
+        separator = ",\n";
+    }
+
+    for (size_t i = 0; i < g_frames.size(); i++)
+    {
+        const Frame& frame = g_frames[i];
+        json << separator << "{\"name\":\"Frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" << g_mainThread
+             << ",\"ts\":" << ToMicroseconds(frame.start) << ",\"dur\":" << ToMicroseconds(frame.end) - ToMicroseconds(frame.start) << "}";
+        separator = ",\n";
+
+        // A counter track per counter
+        for (int j = 0; j < NUM_COUNTERS; j++)
+        {
+            json << separator << "{\"name\":\"" << CounterNames[j] << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ToMicroseconds(frame.start)
+                 << ",\"args\":{\"value\":" << frame.counters[j] << "}}";
+        }
+
+        // And one with a series per MegaFile
+        if (!files.empty())
+        {
+            json << separator << "{\"name\":\"MegaFile bytes\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ToMicroseconds(frame.start) << ",\"args\":{";
+            for (set<wstring>::const_iterator p = files.begin(); p != files.end(); p++)
+            {
+                FileReads::const_iterator q = frame.files.find(*p);
+                json << ((p != files.begin()) ? "," : "") << "\"" << EscapeJSON(Alamo::WideToAnsi(*p)) << "\":" << ((q != frame.files.end()) ? q->second : 0);
+            }
+            json << "}}";
+        }
+    }
+    json << "\n],\"otherData\":{\"droppedEvents\":\"" << g_dropped << "\"}}\n";
+    LeaveCriticalSection(&g_lock.cs);
+
+    return WriteToFile(filename, json.str());
+}
+
+bool WriteCSV(const wstring& filename)
+{
+    EnterCriticalSection(&g_lock.cs);
+    const set<wstring> files = GetFileNames();
+
+    ostringstream csv;
+    csv << fixed << setprecision(3);
+    csv << "Frame,Start (ms),Duration (ms)";
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        csv << "," << CounterNames[i];
+    }
+    for (set<wstring>::const_iterator p = files.begin(); p != files.end(); p++)
+    {
+        csv << "," << EscapeCSV(Alamo::WideToAnsi(*p));
+    }
+    csv << "\n";
+
+    for (size_t i = 0; i < g_frames.size(); i++)
+    {
+        const Frame& frame = g_frames[i];
+        csv << i << "," << ToMicroseconds(frame.start) / 1000 << "," << (ToMicroseconds(frame.end) - ToMicroseconds(frame.start)) / 1000;
+        for (int j = 0; j < NUM_COUNTERS; j++)
+        {
+            csv << "," << frame.counters[j];
+        }
+        for (set<wstring>::const_iterator p = files.begin(); p != files.end(); p++)
+        {
+            FileReads::const_iterator q = frame.files.find(*p);
+            csv << "," << ((q != frame.files.end()) ? q->second : 0);
+        }
+        csv << "\n";
+    }
+    LeaveCriticalSection(&g_lock.cs);
+
+    return WriteToFile(filename, csv.str());
+}
+
+}
@@ -0,0 +1,107 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "General/ExactTypes.h"
+#include <string>
+
+/*
+ * Instrumentation for finding out where the time in a frame goes.
+ * While profiling is stopped, which it is by default, timers and counters
+ * only check a flag and do nothing else.
+ *
+ * The recording can be written as a Chrome trace (chrome://tracing) with
+ * all timed scopes and a counter track per frame, or as a CSV file with a
+ * row per frame.
+ */
+namespace Profiler
+{
+    enum Counter
+    {
+        PARTICLES_ALIVE,
+        PARTICLES_SPAWNED,
+        PARTICLES_KILLED,
+        DRAW_CALLS,
+        PRIMITIVES,
+        VERTEX_BYTES,   // Vertex data sent to the device
+        INDEX_BYTES,    // Index data sent to the device
+        FILE_BYTES,     // Read from asset files
+        NUM_COUNTERS
+    };
+
+    extern volatile bool g_enabled;
+
+    inline bool IsEnabled()
+    {
+        return g_enabled;
+    }
+
+    // Starts a new recording, or stops the current one
+    void Start();
+    void Stop();
+
+    // Frames are recorded between these calls. Call them from the main thread.
+    void BeginFrame();
+    void EndFrame();
+
+    // Counters can be changed from any thread. Their values are taken,
+    // and reset, at the end of every frame.
+    void AddCounter(Counter counter, long value);
+    void SetCounter(Counter counter, long value);
+    void AddFileReadCounter(const std::wstring& file, unsigned long bytes);
+
+    inline void Add(Counter counter, long value = 1)
+    {
+        if (g_enabled) AddCounter(counter, value);
+    }
+
+    inline void Set(Counter counter, long value)
+    {
+        if (g_enabled) SetCounter(counter, value);
+    }
+
+    inline void AddDrawCall(long primitives)
+    {
+        if (g_enabled)
+        {
+            AddCounter(DRAW_CALLS, 1);
+            AddCounter(PRIMITIVES, primitives);
+        }
+    }
+
+    // Counts the bytes read from a MegaFile
+    inline void AddFileRead(const std::wstring& file, unsigned long bytes)
+    {
+        if (g_enabled) AddFileReadCounter(file, bytes);
+    }
+
+    int64_t GetTimestamp();
+    void    AddEvent(const char* category, const char* name, int64_t start, int64_t end);
+
+    /* Records the time from construction to destruction as an event.
+     * The name is copied when the event is recorded, so it only has to
+     * stay valid during the scope. Can be used from any thread.
+     */
+    class ScopedTimer
+    {
+        const char* m_category;
+        const char* m_name;
+        int64_t     m_start;
+
+    public:
+        ScopedTimer(const char* category, const char* name)
+            : m_category(category), m_name(name), m_start(g_enabled ? GetTimestamp() : -1) {}
+
+        ~ScopedTimer()
+        {
+            if (m_start != -1 && g_enabled) AddEvent(m_category, m_name, m_start, GetTimestamp());
+        }
+    };
+
+    // Write the recording; these return false if the file could not be written
+    bool WriteTrace(const std::wstring& filename);
+    bool WriteCSV(const std::wstring& filename);
+}
+
+#define PROFILE_SCOPE(category, name) Profiler::ScopedTimer _profileScope(category, name)
+
+#endif
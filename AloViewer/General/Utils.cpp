@@ -34,6 +34,19 @@ unsigned long crc32(const void *data, size_t size)
 	return crc ^ 0xFFFFFFFF;
 }
 
+// Case-insensitive (ASCII) FNV-1a hash
+unsigned long HashName(const char* str)
+{
+    unsigned long hash = 2166136261UL;
+    for (; *str != '\0'; str++)
+    {
+        unsigned char c = *str;
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        hash = (hash ^ c) * 16777619UL;
+    }
+    return hash;
+}
+
 // Convert an ANSI string to a wide (UCS-2) string
 wstring AnsiToWide(const char* cstr)
 {
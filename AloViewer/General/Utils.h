@@ -30,6 +30,21 @@ struct range
 // Calculates the CRC-32 checksum of the specified block of data
 unsigned long crc32(const void* data, size_t size);
 
+// Calculates a case-insensitive hash of the specified string
+unsigned long HashName(const char* str);
+
+// A string along with its case-insensitive hash, for names that are looked
+// up repeatedly; the hash is calculated only once.
+struct HashedString
+{
+    std::string   str;
+    unsigned long hash;
+
+    HashedString()                     : hash(HashName("")) {}
+    HashedString(const char* s)        : str(s), hash(HashName(s)) {}
+    HashedString(const std::string& s) : str(s), hash(HashName(s.c_str())) {}
+};
+
 // Converts an ANSI string to a wide (UCS-2) string and back
 std::wstring AnsiToWide(const char* cstr);
 std::string  WideToAnsi(const wchar_t* cstr, const char* defChar = " ");
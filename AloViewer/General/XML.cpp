@@ -14,12 +14,189 @@ namespace Alamo
 
 static const int BUFFER_SIZE = 32*1024;	// Read this much at once
 
-XMLNode::~XMLNode()
+static const size_t MIN_BLOCK_SIZE       = 16*1024;
+static const size_t MIN_INDEXED_CHILDREN = 8;        // Fewer children are scanned
+
+//
+// XMLNode class
+//
+const XMLNode* XMLNode::findChild(const char* name) const
 {
-	for (vector<XMLNode*>::iterator i = m_children.begin(); i != m_children.end(); i++)
-	{
-		delete *i;
-	}
+    unsigned long hash = HashName(name);
+    if (m_index != NULL)
+    {
+        // Names that differ in case share a hash but not a slot; keep the first match
+        size_t mask = m_indexSize - 1, best = m_numChildren;
+        for (size_t slot = hash & mask; m_index[slot] != 0; slot = (slot + 1) & mask)
+        {
+            size_t         i = m_index[slot] - 1;
+            const XMLName* n = m_children[i]->m_name;
+            if (i < best && n->hash == hash && _stricmp(n->str, name) == 0)
+            {
+                best = i;
+            }
+        }
+        return (best < m_numChildren) ? m_children[best] : NULL;
+    }
+
+    for (size_t i = 0; i < m_numChildren; i++)
+    {
+        const XMLName* n = m_children[i]->m_name;
+        if (n->hash == hash && _stricmp(n->str, name) == 0)
+        {
+            return m_children[i];
+        }
+    }
+    return NULL;
+}
+
+const char* XMLNode::getAttribute(const char* name) const
+{
+    unsigned long hash = HashName(name);
+    for (size_t i = 0; i < m_numAttributes; i++)
+    {
+        const XMLName* n = m_attributes[i].name;
+        if (n->hash == hash && _stricmp(n->str, name) == 0)
+        {
+            return m_attributes[i].value;
+        }
+    }
+    return NULL;
+}
+
+//
+// XMLTree class
+//
+void* XMLTree::allocate(size_t size)
+{
+    // Keep everything pointer-aligned
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    if (size > m_left)
+    {
+        size_t blockSize = max(m_blockSize, size);
+        char*  block     = new char[blockSize];
+        m_blocks.push_back(block);
+        m_free = block;
+        m_left = blockSize;
+    }
+    void* ptr = m_free;
+    m_free += size;
+    m_left -= size;
+    return ptr;
+}
+
+char* XMLTree::copyString(const char* str, size_t len)
+{
+    char* copy = (char*)allocate(len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+const XMLName* XMLTree::intern(const char* str)
+{
+    if ((m_numNames + 1) * 2 > m_names.size())
+    {
+        // Grow the table
+        vector<XMLName*> names(max(m_names.size() * 2, (size_t)64), (XMLName*)NULL);
+        size_t mask = names.size() - 1;
+        for (size_t i = 0; i < m_names.size(); i++)
+        {
+            if (m_names[i] != NULL)
+            {
+                size_t slot = m_names[i]->hash & mask;
+                while (names[slot] != NULL) slot = (slot + 1) & mask;
+                names[slot] = m_names[i];
+            }
+        }
+        m_names.swap(names);
+    }
+
+    unsigned long hash = HashName(str);
+    size_t        mask = m_names.size() - 1;
+    size_t        slot = hash & mask;
+    for (; m_names[slot] != NULL; slot = (slot + 1) & mask)
+    {
+        if (m_names[slot]->hash == hash && strcmp(m_names[slot]->str, str) == 0)
+        {
+            return m_names[slot];
+        }
+    }
+
+    XMLName* name = (XMLName*)allocate(sizeof(XMLName));
+    name->str  = copyString(str, strlen(str));
+    name->hash = hash;
+    m_names[slot] = name;
+    m_numNames++;
+    return name;
+}
+
+// Moves the node's children from the pending list into the tree
+void XMLTree::finishNode(XMLNode* node)
+{
+    size_t first = m_firstPending.back();
+    size_t count = m_pending.size() - first;
+    m_firstPending.pop_back();
+    if (count == 0)
+    {
+        return;
+    }
+
+    node->m_children    = (XMLNode**)allocate(count * sizeof(XMLNode*));
+    node->m_numChildren = count;
+    copy(m_pending.begin() + first, m_pending.end(), node->m_children);
+    m_pending.resize(first);
+
+    if (count >= MIN_INDEXED_CHILDREN)
+    {
+        // Hash the children by name, with a load factor of at most one half.
+        // Slots hold the child's index plus one; zero is empty.
+        size_t size = 1;
+        while (size < count * 2) size *= 2;
+        size_t* index = (size_t*)allocate(size * sizeof(size_t));
+        memset(index, 0, size * sizeof(size_t));
+
+        size_t mask = size - 1;
+        for (size_t i = 0; i < count; i++)
+        {
+            const XMLName* name = node->m_children[i]->m_name;
+            size_t slot = name->hash & mask;
+            while (index[slot] != 0 && node->m_children[index[slot] - 1]->m_name != name)
+            {
+                slot = (slot + 1) & mask;
+            }
+            if (index[slot] == 0)
+            {
+                // Only the first child with a name is needed
+                index[slot] = i + 1;
+            }
+        }
+        node->m_index     = index;
+        node->m_indexSize = size;
+    }
+}
+
+void XMLTree::reset(size_t sizeHint)
+{
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        delete[] m_blocks[i];
+    }
+    m_blocks.clear();
+    m_free = NULL;
+    m_left = 0;
+
+    // Aim for one block for the entire document; names, data and nodes
+    // together are rarely more than twice the size of the text.
+    m_blockSize = max(MIN_BLOCK_SIZE, sizeHint * 2);
+
+    m_names.clear();
+    m_numNames    = 0;
+	m_root        = NULL;
+	m_currentNode = NULL;
+    m_currentData.clear();
+    m_pending.clear();
+    m_firstPending.clear();
 }
 
 static void onStartElement(void* userData, const XML_Char *name, const XML_Char **atts)
@@ -27,32 +204,41 @@ static void onStartElement(void* userData, const XML_Char *name, const XML_Char
 	XMLTree* tree = (XMLTree*)userData;
 
     // Create the node
-    XMLNode* node = new XMLNode;
-    node->m_parent = tree->m_currentNode;
-    node->m_name   = tree->m_data.append(name, strlen(name) + 1);
-    node->m_data   = NULL;
-	while (*atts != NULL)
-	{
-		node->m_attributes.push_back(make_pair(
-            tree->m_data.append(atts[0], strlen(atts[0]) + 1),
-            tree->m_data.append(atts[1], strlen(atts[1]) + 1)
-        ));
-		atts += 2;
-	}
+    XMLNode* node = (XMLNode*)tree->allocate(sizeof(XMLNode));
+    node->m_parent        = tree->m_currentNode;
+    node->m_name          = tree->intern(name);
+    node->m_data          = NULL;
+    node->m_attributes    = NULL;
+    node->m_numAttributes = 0;
+    node->m_children      = NULL;
+    node->m_numChildren   = 0;
+    node->m_index         = NULL;
+    node->m_indexSize     = 0;
+
+    size_t numAttributes = 0;
+    while (atts[numAttributes * 2] != NULL) numAttributes++;
+    if (numAttributes > 0)
+    {
+        XMLNode::Attribute* attributes = (XMLNode::Attribute*)tree->allocate(numAttributes * sizeof(XMLNode::Attribute));
+        for (size_t i = 0; i < numAttributes; i++)
+        {
+            attributes[i].name  = tree->intern(atts[i * 2]);
+            attributes[i].value = tree->copyString(atts[i * 2 + 1], strlen(atts[i * 2 + 1]));
+        }
+        node->m_attributes    = attributes;
+        node->m_numAttributes = numAttributes;
+    }
 
 	if (tree->m_currentNode == NULL)
 	{
         // This is the root
-		if (tree->m_root != NULL)
-		{
-			delete tree->m_root;
-		}
 		tree->m_root = node;
 	}
 	else
 	{
-		tree->m_currentNode->m_children.push_back( node );
+		tree->m_pending.push_back( node );
 	}
+    tree->m_firstPending.push_back(tree->m_pending.size());
 	tree->m_currentNode = node;
     tree->m_currentData.resize(0);
 }
@@ -62,23 +248,24 @@ static void onEndElement(void* userData, const XML_Char *name)
 	XMLTree* tree = (XMLTree*)userData;
 	if (tree->m_currentNode != NULL)
 	{
-        if (tree->m_currentNode->m_children.empty() && tree->m_currentData.size() > 0)
+        bool hasChildren = tree->m_pending.size() > tree->m_firstPending.back();
+        if (!hasChildren && tree->m_currentData.size() > 0)
         {
             tree->m_currentData.append("", 1); // Append the NUL terminator
 
             // Set the collected node data; but trim it first
             char* begin = tree->m_currentData;
             char* end   = tree->m_currentData + tree->m_currentData.size() - 1;
-            
+
             while (begin != end && isspace(*begin)) begin++;
             if (begin != end)
             {
                 while (end != begin && isspace(*(end - 1))) end--;
-                *end = '\0';
-                tree->m_currentNode->m_data = tree->m_data.append(begin, end - begin + 1);
+                tree->m_currentNode->m_data = tree->copyString(begin, end - begin);
             }
         }
-        
+        tree->finishNode(tree->m_currentNode);
+
         // Move up the tree
 		tree->m_currentNode = tree->m_currentNode->m_parent;
 	}
@@ -87,43 +274,50 @@ static void onEndElement(void* userData, const XML_Char *name)
 static void onCharacterData(void *userData, const XML_Char *s, int len)
 {
 	XMLTree* tree = (XMLTree*)userData;
-	if (tree->m_currentNode != NULL && tree->m_currentNode->m_children.empty())
+	if (tree->m_currentNode != NULL && tree->m_pending.size() == tree->m_firstPending.back())
 	{
         // Only nodes without child nodes can have data
         tree->m_currentData.append(s, len);
 	}
 }
 
-void XMLTree::parse(IFile* file)
+static XML_Parser CreateParser(XMLTree* tree)
 {
-	// Reset tree
-	delete m_root;
-	m_root        = NULL;
-	m_currentNode = NULL;
-
 	XML_Parser parser = XML_ParserCreate(NULL);
 	if (parser == NULL)
 	{
 		throw wruntime_error(L"Unable to create XML parser");
 	}
 
-	XML_SetUserData(parser, this);
+	XML_SetUserData(parser, tree);
 	XML_SetElementHandler(parser, onStartElement, onEndElement);
 	XML_SetCharacterDataHandler(parser, onCharacterData);
+    return parser;
+}
+
+static void ParseData(XML_Parser parser, const char* data, size_t size, bool isFinal)
+{
+	if (XML_Parse(parser, data, (int)size, isFinal) == 0)
+	{
+		stringstream error;
+		error << XML_ErrorString(XML_GetErrorCode(parser)) << " at line " << XML_GetCurrentLineNumber(parser);
+		throw ParseException( error.str() );
+	}
+}
+
+void XMLTree::parse(IFile* file)
+{
+	// Reset tree
+    reset(file->size());
 
+	XML_Parser parser = CreateParser(this);
 	try
 	{
-        m_data.reserve(file->size());
 		while (!file->eof())
 		{
             char buffer [ BUFFER_SIZE ];
 			size_t n = file->read(buffer, BUFFER_SIZE);
-			if (XML_Parse(parser, buffer, (int)n, file->eof()) == 0)
-			{
-				stringstream error;
-				error << XML_ErrorString(XML_GetErrorCode(parser)) << " at line " << XML_GetCurrentLineNumber(parser);
-				throw ParseException( error.str() );
-			}
+            ParseData(parser, buffer, n, file->eof());
 		}
 
         // Cleanup
@@ -138,15 +332,153 @@ void XMLTree::parse(IFile* file)
 	}
 }
 
+void XMLTree::parse(const char* data, size_t size)
+{
+    reset(size);
+
+	XML_Parser parser = CreateParser(this);
+	try
+	{
+        ParseData(parser, data, size, true);
+
+        // Cleanup
+        m_currentNode = NULL;
+        m_currentData.clear();
+		XML_ParserFree(parser);
+    }
+	catch (...)
+	{
+		XML_ParserFree(parser);
+		throw;
+	}
+}
+
 XMLTree::XMLTree()
 {
+    m_free        = NULL;
+    m_left        = 0;
+    m_blockSize   = MIN_BLOCK_SIZE;
+    m_numNames    = 0;
 	m_root        = NULL;
 	m_currentNode = NULL;
 }
 
 XMLTree::~XMLTree()
 {
-	delete m_root;
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        delete[] m_blocks[i];
+    }
+}
+
+//
+// XMLTreeList class
+//
+struct PARSE_INFO
+{
+    const vector< vector<char> >* contents;
+    vector<XMLTree*>*             trees;
+    vector<string>*               errors;
+    volatile LONG                 next;
+};
+
+static DWORD WINAPI ParseThread(LPVOID lpParam)
+{
+    PARSE_INFO* info = (PARSE_INFO*)lpParam;
+    LONG i;
+    while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->trees->size())
+    {
+        const vector<char>& data = (*info->contents)[i];
+        if (!data.empty())
+        {
+            try
+            {
+                (*info->trees)[i]->parse(&data[0], data.size());
+            }
+            catch (exception& e)
+            {
+                (*info->errors)[i] = e.what();
+            }
+            catch (wexception& e)
+            {
+                (*info->errors)[i] = WideToAnsi(e.what());
+            }
+        }
+    }
+    return 0;
+}
+
+void XMLTreeList::parse(const vector< ptr<IFile> >& files)
+{
+    for (size_t i = 0; i < m_trees.size(); i++)
+    {
+        delete m_trees[i];
+    }
+    m_trees.clear();
+    m_errors.clear();
+
+    m_trees.resize(files.size(), NULL);
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        m_trees[i] = new XMLTree;
+    }
+    m_errors.resize(files.size());
+
+    // Read all files on this thread
+    vector< vector<char> > contents(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (files[i] != NULL)
+        {
+            contents[i].resize(files[i]->size());
+            if (!contents[i].empty())
+            {
+                files[i]->seek(0);
+                contents[i].resize(files[i]->read(&contents[i][0], contents[i].size()));
+            }
+        }
+    }
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    size_t nThreads = min((size_t)si.dwNumberOfProcessors, files.size());
+
+    PARSE_INFO info;
+    info.contents = &contents;
+    info.trees    = &m_trees;
+    info.errors   = &m_errors;
+    info.next     = 0;
+
+    vector<HANDLE> hThreads;
+    for (size_t i = 1; i < nThreads; i++)
+    {
+        DWORD  ThreadID;
+        HANDLE hThread = CreateThread(NULL, 0, ParseThread, &info, 0, &ThreadID);
+        if (hThread != NULL)
+        {
+            hThreads.push_back(hThread);
+        }
+    }
+
+    // This thread helps out as well
+    ParseThread(&info);
+
+    if (!hThreads.empty())
+    {
+        WaitForMultipleObjects((DWORD)hThreads.size(), &hThreads[0], TRUE, INFINITE);
+        for (size_t i = 0; i < hThreads.size(); i++)
+        {
+            CloseHandle(hThreads[i]);
+        }
+    }
+}
+
+XMLTreeList::~XMLTreeList()
+{
+    for (size_t i = 0; i < m_trees.size(); i++)
+    {
+        delete m_trees[i];
+    }
 }
 
-}
\ No newline at end of file
+}
@@ -2,6 +2,11 @@
  * Defines a XMLTree class that holds ab XML document parsed into a tree.
  * It uses a slight restriction for XML; nodes can either contain child
  * nodes or data, but not both.
+ *
+ * All nodes, names and data of a tree live in a few large blocks owned by
+ * the tree. Tag and attribute names are stored once per tree, along with a
+ * case-insensitive hash, so looking up children and attributes by name
+ * mostly compares hashes.
  */
 #ifndef XML_H
 #define XML_H
@@ -19,6 +24,13 @@ namespace Alamo
 
 class XMLTree;
 
+// A tag or attribute name, shared by all uses within a tree
+struct XMLName
+{
+    const char*   str;
+    unsigned long hash;     // Case-insensitive
+};
+
 /* Represents a node in an XML Tree.
  * Note that pointers to XMLNode's, as handed out by XMLTree and XMLNode are valid only
  * during the lifetime of the XMLTree variable.
@@ -30,38 +42,45 @@ class XMLNode
 	friend static void onCharacterData(void *userData, const XML_Char *s, int len);
 	friend class XMLTree;
 
-    typedef std::vector< std::pair<XML_Char*,XML_Char*> > AttrList;
-
-	XMLNode*              m_parent;
-	XML_Char*             m_name;
-	XML_Char*             m_data;
-	AttrList              m_attributes;
-	std::vector<XMLNode*> m_children;
-
-	~XMLNode();
+    struct Attribute
+    {
+        const XMLName* name;
+        const char*    value;
+    };
+
+	XMLNode*        m_parent;
+	const XMLName*  m_name;
+	const char*     m_data;
+	const Attribute* m_attributes;
+    size_t          m_numAttributes;
+	XMLNode**       m_children;
+    size_t          m_numChildren;
+    size_t*         m_index;        // Hash table into m_children, or NULL
+    size_t          m_indexSize;
 
 public:
-	bool           isAnonymous() const      { return strcmp(m_name,"") == 0; }
+	bool           isAnonymous() const      { return m_name->str[0] == '\0'; }
 	const char*    getData() const          { return m_data; }
-	const char*    getName() const          { return m_name; }
-	const size_t   getNumChildren() const   { return m_children.size(); }
+	const char*    getName() const          { return m_name->str; }
+	const size_t   getNumChildren() const   { return m_numChildren; }
 	const XMLNode* getChild(size_t i) const { return m_children[i]; }
-	bool           equals(const char* name)        const { return _stricmp(m_name, name) == 0; }
+	bool           equals(const char* name)        const { return _stricmp(m_name->str, name) == 0; }
 	bool           equals(const std::string& name) const { return equals(name.c_str()); }
-	
+
+    /* Returns the first child with the specified name.
+     * Returns NULL if there is no such child.
+     * @name: case-insensitive name of the child.
+     */
+    const XMLNode* findChild(const char* name) const;
+    const XMLNode* findChild(const std::string& name) const {
+        return findChild(name.c_str());
+    }
+
     /* Returns the value of the specified attribute.
      * Returns NULL if the attribute does not exist.
      * @name: case-insensitive name of the attribute.
      */
-	const char* getAttribute(const char* name) const {
-        for (AttrList::const_iterator i = m_attributes.begin(); i != m_attributes.end(); i++) {
-            if (_stricmp(i->first, name) == 0) {
-                return i->second;
-            }
-        }
-		return NULL;
-	}
-
+	const char* getAttribute(const char* name) const;
     const char* getAttribute(const std::string& name) const {
         return getAttribute(name.c_str());
     }
@@ -74,12 +93,33 @@ class XMLTree
 	friend static void onEndElement(void* userData, const XML_Char *name);
 	friend static void onCharacterData(void *userData, const XML_Char *s, int len);
 
-    Buffer<XML_Char> m_data;
-	XMLNode*         m_root;
+    // The tree's memory. Blocks never move, so pointers into them stay valid.
+    std::vector<char*>   m_blocks;
+    char*                m_free;
+    size_t               m_left;
+    size_t               m_blockSize;
+
+    // Interned names; open addressing, with NULL for empty slots
+    std::vector<XMLName*> m_names;
+    size_t                m_numNames;
+
+	XMLNode*             m_root;
 
     // Used during parsing
-	XMLNode*         m_currentNode;
-    Buffer<XML_Char> m_currentData;
+	XMLNode*              m_currentNode;
+    Buffer<XML_Char>      m_currentData;
+    std::vector<XMLNode*> m_pending;        // Children of the open nodes
+    std::vector<size_t>   m_firstPending;   // Per open node, its first child in m_pending
+
+    void*          allocate(size_t size);
+    char*          copyString(const char* str, size_t len);
+    const XMLName* intern(const char* str);
+    void           finishNode(XMLNode* node);
+    void           reset(size_t sizeHint);
+
+    // Trees own their memory, so they can't be copied
+    XMLTree(const XMLTree&);
+    XMLTree& operator=(const XMLTree&);
 
 public:
     // Returns the root node
@@ -91,10 +131,41 @@ public:
     // Builds the tree using the specified XML file
 	void parse(IFile* file);
 
+    // Builds the tree from a XML document in memory
+    void parse(const char* data, size_t size);
+
 	XMLTree();
 	~XMLTree();
 };
 
+/* Parses a list of XML files concurrently, into one tree per file.
+ * The files are read on the calling thread, since files aren't thread-safe,
+ * and then parsed on all processors.
+ */
+class XMLTreeList
+{
+    std::vector<XMLTree*>    m_trees;
+    std::vector<std::string> m_errors;
+
+    XMLTreeList(const XMLTreeList&);
+    XMLTreeList& operator=(const XMLTreeList&);
+
+public:
+    size_t         size() const               { return m_trees.size(); }
+    const XMLTree& operator[](size_t i) const { return *m_trees[i]; }
+
+    // Returns the parse error for the file, or NULL if there was none
+    const char*    getError(size_t i) const   { return m_errors[i].empty() ? NULL : m_errors[i].c_str(); }
+
+    /* Parses the files. NULL files result in an empty tree, without an error.
+     * The trees are in the same order as the files.
+     */
+    void parse(const std::vector< ptr<IFile> >& files);
+
+    XMLTreeList() {}
+    ~XMLTreeList();
+};
+
 }
 
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "RenderEngine/DirectX9/RenderObject.h"
 #include "General/GameTime.h"
 #include "General/Math.h"
+#include "General/Profiler.h"
 
 namespace Alamo {
 namespace DirectX9 {
@@ -79,6 +80,7 @@ void LightFieldInstance::Render() const
             pDevice->SetRenderState(D3DRS_SEPARATEALPHABLENDENABLE, TRUE);
             pDevice->SetRenderState(D3DRS_BLENDOPALPHA,   D3DBLENDOP_MAX);
             pDevice->DrawPrimitiveUP(D3DPT_TRIANGLEFAN, 2, m_quad, sizeof(VERTEX_MESH_NU2C));
+            Profiler::AddDrawCall(2);
         }
         g_LightFieldEffect->EndPass();
     }
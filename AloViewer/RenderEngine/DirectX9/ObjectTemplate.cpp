@@ -6,6 +6,7 @@
 #include "General/Exceptions.h"
 #include "General/GameTime.h"
 #include "General/Log.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -190,6 +191,7 @@ bool ObjectTemplate::SubMesh::Render(const RenderObject& object, bool special) c
         if (effect->BeginPass(i))
         {
             pDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, m_vertices->m_start, 0, m_vertices->m_count, m_indices->m_start, m_indices->m_count / 3);
+            Profiler::AddDrawCall(m_indices->m_count / 3);
         }
         effect->EndPass();
     }
@@ -246,6 +248,7 @@ void ObjectTemplate::RenderDazzles(const RenderObject& object) const
                 pDevice->SetRenderState(D3DRS_TEXTUREFACTOR, D3DCOLOR_COLORVALUE(c.r, c.g, c.b, c.a));
                 pDevice->SetTexture(0, m_dazzles[i].texture->GetTexture() );
                 pDevice->DrawPrimitiveUP(D3DPT_TRIANGLEFAN, 2, m_dazzles[i].vertices, sizeof(DazzleVertex));
+                Profiler::AddDrawCall(2);
             }
         }
     }
@@ -495,16 +498,7 @@ ObjectTemplate::ObjectTemplate(ptr<Model> model, RenderEngine& engine, VertexMan
     m_proxies.resize(model->GetNumProxies(), NULL);
     for (size_t i = 0; i < model->GetNumProxies(); i++)
     {
-        string name = model->GetProxy(i).name;
-        
-        // Strip ALT and LOD from name
-        string::size_type ofs;
-        while ((ofs = name.find("_ALT")) != string::npos) {
-            name = name.substr(0, ofs) + name.substr(ofs + 5);
-        }
-        while ((ofs = name.find("_LOD")) != string::npos) {
-            name = name.substr(0, ofs) + name.substr(ofs + 5);
-        }
+        string name = Assets::GetProxyAssetName(model->GetProxy(i).name);
 
         try
         {
@@ -1,6 +1,7 @@
 #include "RenderEngine/DirectX9/ParticleEmitterInstance.h"
 #include "RenderEngine/DirectX9/RenderObject.h"
 #include "General/GameTime.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -50,6 +51,7 @@ void ParticleEmitterInstance::SpawnParticle(float time, const Alamo::Particle* p
     }
     m_renderer.m_plugin->UpdatePrimitive(p.resources->m_base + index, p, p.resources->m_rendererData.empty() ? NULL : &p.resources->m_rendererData[m_renderer.m_dataSize * index]);
     m_numParticles++;
+    Profiler::Add(Profiler::PARTICLES_SPAWNED);
 
     // Spawn emitters registered for particle birth
     for (const ParticleSystem::Emitter* emitter = m_emitter.GetSpawnList(ParticleSystem::Emitter::SPAWN_BIRTH); emitter != NULL; emitter = emitter->GetNext())
@@ -82,6 +84,7 @@ void ParticleEmitterInstance::UpdateParticle(Particle& p)
         m_debug.erase(p.resources->m_base + (&p - &p.resources->m_particles[0]));
         FreeParticle(&p);
         m_numParticles--;
+        Profiler::Add(Profiler::PARTICLES_KILLED);
     }
     else
     {
@@ -132,14 +135,12 @@ void ParticleEmitterInstance::Update()
     CheckDestruction();
 }
 
-bool ParticleEmitterInstance::Render(RenderPhase phase) const
+void ParticleEmitterInstance::QueueParticles(ParticleQueue& queue, RenderPhase phase, float depth) const
 {
     if (m_resources != NULL && phase == m_renderer.m_plugin->GetRenderPhase())
     {
-        m_renderer.m_plugin->RenderParticles();
-        return true;
+        m_renderer.m_plugin->QueueParticles(queue, depth);
     }
-    return false;
 }
 
 // Check if we can be destroyed. Call when either of the conditions change
@@ -61,12 +61,13 @@ class ParticleEmitterInstance : public IObject, public Emitter, public LinkedLis
 public:
     ParticleEmitterInstance* Detach();
     void Update();
-    bool Render(RenderPhase phase) const;
+    void QueueParticles(ParticleQueue& queue, RenderPhase phase, float depth) const;
 
     const Matrix&          GetPrevTransform() const { return m_instance.GetPrevTransform(); }
     const Matrix&          GetTransform()     const { return m_instance.GetTransform();     }
     const IRenderEngine&   GetRenderEngine()  const { return m_instance.GetRenderEngine();  }
     const Alamo::Particle* GetParent()        const { return m_parent; }
+    size_t                 GetNumParticles()  const { return m_numParticles; }
 
     ParticleEmitterInstance(LinkedList<ParticleEmitterInstance> &list, const ParticleSystem::Emitter& emitter, RenderEngine& engine, ParticleSystemInstance& instance, Alamo::Particle* parent, const Model::Mesh* mesh, float time);
     ~ParticleEmitterInstance();
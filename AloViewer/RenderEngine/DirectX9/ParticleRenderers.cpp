@@ -1,5 +1,6 @@
 #include "RenderEngine/DirectX9/ParticleRenderers.h"
 #include "General/Log.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -39,23 +40,14 @@ ParticleRenderer::ParticleRenderer(RenderEngine& engine)
 //
 void QuadParticleRenderer::AllocatePrimitives(size_t count)
 {
-    m_vertices .resize(m_vertices.size() + count);
-    m_indices  .resize(m_indices .size() + count);
-    for (size_t i = m_indices.size() - count; i < m_indices.size(); i++)
+    m_vertices.resize(m_vertices.size() + count);
+    for (size_t i = m_vertices.size() - count; i < m_vertices.size(); i++)
     {
         // Initialize vertex
         for (size_t j = 0; j < 4; j++) {
             m_vertices[i].v[j].position = Vector3(0,0,0);
             m_vertices[i].v[j].color    = D3DCOLOR_ARGB(0,0,0,0);
         }
-
-        // Initialize index
-        m_indices[i].i[0] = (uint16_t)(i * 4 + 0);
-        m_indices[i].i[1] = (uint16_t)(i * 4 + 1);
-        m_indices[i].i[2] = (uint16_t)(i * 4 + 2);
-        m_indices[i].i[3] = (uint16_t)(i * 4 + 2);
-        m_indices[i].i[4] = (uint16_t)(i * 4 + 1);
-        m_indices[i].i[5] = (uint16_t)(i * 4 + 3);
     }
 }
 
@@ -94,25 +86,66 @@ void QuadParticleRenderer::FreePrimitive(size_t index)
     }
 }
 
-void QuadParticleRenderer::RenderParticles(Effect& effect) const
+void QuadParticleRenderer::QueueParticles(ParticleQueue& queue, float depth) const
+{
+    if (m_effect != NULL && !m_vertices.empty())
+    {
+        queue.Add(*this, depth);
+    }
+}
+
+bool QuadParticleRenderer::CanBatchWith(const QuadParticleRenderer& other) const
+{
+    return m_effect == other.m_effect && m_texture == other.m_texture && m_depthTest == other.m_depthTest;
+}
+
+void QuadParticleRenderer::SetStates() const
+{
+    RenderEngine&     engine  = GetEngine();
+    IDirect3DDevice9* pDevice = engine.GetDevice();
+
+    engine.SetWorldMatrix(Matrix::Identity, m_effect);
+    if (engine.IsUaW()) {
+        m_effect->GetEffect()->SetTexture(m_hBaseTexture, m_texture->GetTexture());
+    } else {
+        pDevice->SetTexture(0, m_texture->GetTexture());
+    }
+    pDevice->SetRenderState(D3DRS_ZENABLE, m_depthTest);
+}
+
+// Renders quads with the states of this renderer
+void QuadParticleRenderer::RenderQuads(const ParticlePrimitiveVertex* vertices, size_t count, const ParticlePrimitiveIndex* indices) const
 {
     IDirect3DDevice9* pDevice = GetEngine().GetDevice();
+    SetStates();
     pDevice->SetFVF(D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_TEX1 | D3DFVF_TEXCOORDSIZE2(0));
-    UINT nPasses = effect.Begin();
+    UINT nPasses = m_effect->Begin();
     for (UINT i = 0; i < nPasses; i++)
     {
-        if (effect.BeginPass(i))
+        if (m_effect->BeginPass(i))
         {
             OverrideStates(pDevice, i);
-            pDevice->DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, (UINT)m_vertices.size() * 4, (UINT)m_indices.size() * 2, &m_indices[0].i[0], D3DFMT_INDEX16, &m_vertices[0].v[0], sizeof(ParticleVertex));
+            pDevice->DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, (UINT)count * 4, (UINT)count * 2, &indices[0].i[0], D3DFMT_INDEX16, &vertices[0].v[0], sizeof(ParticleVertex));
+            Profiler::AddDrawCall((long)count * 2);
+            Profiler::Add(Profiler::VERTEX_BYTES, (long)(count * sizeof vertices[0]));
+            Profiler::Add(Profiler::INDEX_BYTES,  (long)(count * sizeof indices[0]));
         }
-        effect.EndPass();
+        m_effect->EndPass();
     }
-    effect.End();
+    m_effect->End();
+}
+
+void QuadParticleRenderer::LoadStates(const string& shader, const string& texture, bool disableDepthTest)
+{
+    RenderEngine& engine = GetEngine();
+    m_texture      = engine.LoadTexture(texture);
+    m_effect       = engine.LoadEffect(GetEffectName(shader));
+    m_hBaseTexture = m_effect->GetEffect()->GetParameterByName(NULL, "BaseTexture");
+    m_depthTest    = !disableDepthTest;
 }
 
 QuadParticleRenderer::QuadParticleRenderer(RenderEngine& engine)
-    : ParticleRenderer(engine)
+    : ParticleRenderer(engine), m_hBaseTexture(NULL), m_depthTest(true)
 {
 }
 
@@ -140,27 +173,10 @@ void BillboardRenderer::UpdatePrimitive(size_t index, const Particle& p, void* d
     q.v[3].color = D3DCOLOR_COLORVALUE(p.color.r, p.color.g, p.color.b, p.color.a);
 }
 
-void BillboardRenderer::RenderParticles() const
-{
-    RenderEngine&     engine  = GetEngine();
-    IDirect3DDevice9* pDevice = engine.GetDevice();
-
-    engine.SetWorldMatrix(Matrix::Identity, m_effect);
-    if (engine.IsUaW()) {
-        m_effect->GetEffect()->SetTexture(m_hBaseTexture, m_texture->GetTexture());
-    } else {
-        pDevice->SetTexture(0, m_texture->GetTexture());
-    }
-    pDevice->SetRenderState(D3DRS_ZENABLE, !m_plugin.m_disableDepthTest);
-    QuadParticleRenderer::RenderParticles(*m_effect);
-}
-
 BillboardRenderer::BillboardRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
-    m_texture = engine.LoadTexture(plugin.m_textureName);
-    m_effect  = engine.LoadEffect(GetEffectName(plugin.m_shaderName));
-    m_hBaseTexture = m_effect->GetEffect()->GetParameterByName(NULL, "BaseTexture");
+    LoadStates(plugin.m_shaderName, plugin.m_textureName, plugin.m_disableDepthTest);
 }
 
 //
@@ -215,27 +231,10 @@ void VelocityAlignedRenderer::UpdatePrimitive(size_t index, const Particle& p, v
     q.v[3].color = D3DCOLOR_COLORVALUE(p.color.r, p.color.g, p.color.b, p.color.a);
 }
 
-void VelocityAlignedRenderer::RenderParticles() const
-{
-    RenderEngine&     engine  = GetEngine();
-    IDirect3DDevice9* pDevice = engine.GetDevice();
-
-    engine.SetWorldMatrix(Matrix::Identity, m_effect);
-    if (engine.IsUaW()) {
-        m_effect->GetEffect()->SetTexture(m_hBaseTexture, m_texture->GetTexture());
-    } else {
-        pDevice->SetTexture(0, m_texture->GetTexture());
-    }
-    pDevice->SetRenderState(D3DRS_ZENABLE, !m_plugin.m_disableDepthTest);
-    QuadParticleRenderer::RenderParticles(*m_effect);
-}
-
 VelocityAlignedRenderer::VelocityAlignedRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
-    m_texture = engine.LoadTexture(plugin.m_textureName);
-    m_effect  = engine.LoadEffect(GetEffectName(plugin.m_shaderName));
-    m_hBaseTexture = m_effect->GetEffect()->GetParameterByName(NULL, "BaseTexture");
+    LoadStates(plugin.m_shaderName, plugin.m_textureName, plugin.m_disableDepthTest);
 }
 
 //
@@ -260,27 +259,10 @@ void XYAlignedRenderer::UpdatePrimitive(size_t index, const Particle& p, void* d
     q.v[3].color = D3DCOLOR_COLORVALUE(p.color.r, p.color.g, p.color.b, p.color.a);
 }
 
-void XYAlignedRenderer::RenderParticles() const
-{
-    RenderEngine&     engine  = GetEngine();
-    IDirect3DDevice9* pDevice = engine.GetDevice();
-
-    engine.SetWorldMatrix(Matrix::Identity, m_effect);
-    if (engine.IsUaW()) {
-        m_effect->GetEffect()->SetTexture(m_hBaseTexture, m_texture->GetTexture());
-    } else {
-        pDevice->SetTexture(0, m_texture->GetTexture());
-    }
-    pDevice->SetRenderState(D3DRS_ZENABLE, !m_plugin.m_disableDepthTest);
-    QuadParticleRenderer::RenderParticles(*m_effect);
-}
-
 XYAlignedRenderer::XYAlignedRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
-    m_texture = engine.LoadTexture(plugin.m_textureName);
-    m_effect  = engine.LoadEffect(GetEffectName(plugin.m_shaderName));
-    m_hBaseTexture = m_effect->GetEffect()->GetParameterByName(NULL, "BaseTexture");
+    LoadStates(plugin.m_shaderName, plugin.m_textureName, plugin.m_disableDepthTest);
 }
 
 //
@@ -321,34 +303,33 @@ void HeatSaturationRenderer::OverrideStates(IDirect3DDevice9* pDevice, int pass)
     pDevice->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
 }
 
-void HeatSaturationRenderer::RenderParticles() const
+bool HeatSaturationRenderer::CanBatchWith(const QuadParticleRenderer& other) const
 {
-    RenderEngine&     engine  = GetEngine();
-    IDirect3DDevice9* pDevice = engine.GetDevice();
-    ID3DXEffect*      effect  = m_effect->GetEffect();
+    // The heat parameters are part of the states
+    const HeatSaturationRenderer* heat = dynamic_cast<const HeatSaturationRenderer*>(&other);
+    return heat != NULL && QuadParticleRenderer::CanBatchWith(other)
+        && m_plugin.m_distanceCutoff == heat->m_plugin.m_distanceCutoff
+        && m_plugin.m_distortion     == heat->m_plugin.m_distortion
+        && m_plugin.m_saturation     == heat->m_plugin.m_saturation;
+}
 
-    engine.SetWorldMatrix(Matrix::Identity, m_effect);
-    if (engine.IsUaW()) {
-        effect->SetTexture(m_hBaseTexture,  m_texture->GetTexture());
+void HeatSaturationRenderer::SetStates() const
+{
+    QuadParticleRenderer::SetStates();
+    if (GetEngine().IsUaW()) {
+        ID3DXEffect* effect = m_effect->GetEffect();
         effect->SetFloat(m_hDistanceCutoff, m_plugin.m_distanceCutoff);
         effect->SetFloat(m_hDistortion,     m_plugin.m_distortion);
         effect->SetFloat(m_hSaturation,     m_plugin.m_saturation);
-    } else {
-        pDevice->SetTexture(0, m_texture->GetTexture());
     }
-
-    pDevice->SetRenderState(D3DRS_ZENABLE, !m_plugin.m_disableDepthTest);
-    QuadParticleRenderer::RenderParticles(*m_effect);
 }
 
 HeatSaturationRenderer::HeatSaturationRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
-    m_texture         = engine.LoadTexture(plugin.m_textureName);
-    m_effect          = engine.LoadEffect(GetEffectName(plugin.m_shaderName));
+    LoadStates(plugin.m_shaderName, plugin.m_textureName, plugin.m_disableDepthTest);
 
     ID3DXEffect* effect = m_effect->GetEffect();
-    m_hBaseTexture    = effect->GetParameterByName(NULL, "BaseTexture");
     m_hDistanceCutoff = effect->GetParameterByName(NULL, "DistanceCutoff");
     m_hDistortion     = effect->GetParameterByName(NULL, "DistortionScale");
     m_hSaturation     = effect->GetParameterByName(NULL, "SaturationScale");
@@ -397,34 +378,16 @@ void KitesRenderer::UpdatePrimitive(size_t index, const Particle& p, void* _data
     q.v[3].color = D3DCOLOR_COLORVALUE(p.color.r, p.color.g, p.color.b, p.color.a);
 }
 
-void KitesRenderer::RenderParticles() const
-{
-    RenderEngine&     engine  = GetEngine();
-    IDirect3DDevice9* pDevice = engine.GetDevice();
-
-    engine.SetWorldMatrix(Matrix::Identity, m_effect);
-    if (engine.IsUaW()) {
-        m_effect->GetEffect()->SetTexture(m_hBaseTexture, m_texture->GetTexture());
-    } else {
-        pDevice->SetTexture(0, m_texture->GetTexture());
-    }
-    pDevice->SetRenderState(D3DRS_ZENABLE, !m_plugin.m_disableDepthTest);
-    QuadParticleRenderer::RenderParticles(*m_effect);
-}
-
 KitesRenderer::KitesRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
-    m_texture = engine.LoadTexture(plugin.m_textureName);
-    m_effect  = engine.LoadEffect(GetEffectName(plugin.m_shaderName));
-    m_hBaseTexture = m_effect->GetEffect()->GetParameterByName(NULL, "BaseTexture");
+    LoadStates(plugin.m_shaderName, plugin.m_textureName, plugin.m_disableDepthTest);
 }
 
 //
 // VolumetricRenderer
 //
 void VolumetricRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void VolumetricRenderer::RenderParticles() const {}
 VolumetricRenderer::VolumetricRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -436,7 +399,6 @@ VolumetricRenderer::VolumetricRenderer(RenderEngine& engine, const PluginType& p
 // ChainRenderer
 //
 void ChainRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void ChainRenderer::RenderParticles() const {}
 ChainRenderer::ChainRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -448,7 +410,6 @@ ChainRenderer::ChainRenderer(RenderEngine& engine, const PluginType& plugin)
 // XYAlignedChainRenderer
 //
 void XYAlignedChainRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void XYAlignedChainRenderer::RenderParticles() const {}
 XYAlignedChainRenderer::XYAlignedChainRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -460,7 +421,6 @@ XYAlignedChainRenderer::XYAlignedChainRenderer(RenderEngine& engine, const Plugi
 // StretchedTextureChainRenderer
 //
 void StretchedTextureChainRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void StretchedTextureChainRenderer::RenderParticles() const {}
 StretchedTextureChainRenderer::StretchedTextureChainRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -472,7 +432,6 @@ StretchedTextureChainRenderer::StretchedTextureChainRenderer(RenderEngine& engin
 // HardwareBillboardsRenderer
 //
 void HardwareBillboardsRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void HardwareBillboardsRenderer::RenderParticles() const {}
 HardwareBillboardsRenderer::HardwareBillboardsRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -484,7 +443,6 @@ HardwareBillboardsRenderer::HardwareBillboardsRenderer(RenderEngine& engine, con
 // BumpMapRenderer
 //
 void BumpMapRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void BumpMapRenderer::RenderParticles() const {}
 BumpMapRenderer::BumpMapRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
@@ -496,12 +454,88 @@ BumpMapRenderer::BumpMapRenderer(RenderEngine& engine, const PluginType& plugin)
 // LineRenderer
 //
 void LineRenderer::UpdatePrimitive(size_t index, const Particle& p, void* data) const {}
-void LineRenderer::RenderParticles() const {}
 LineRenderer::LineRenderer(RenderEngine& engine, const PluginType& plugin)
     : QuadParticleRenderer(engine), m_plugin(plugin)
 {
     const string& name = plugin.GetEmitter().GetSystem().GetName();
     Log::WriteInfo("\"%s\" uses currently unsupported renderer plugin", name.c_str());
 }
+
+//
+// ParticleQueue
+//
+
+bool ParticleQueue::CanBatch(const void* first, const void* next)
+{
+    return static_cast<const QuadParticleRenderer*>(first)->CanBatchWith(*static_cast<const QuadParticleRenderer*>(next));
+}
+
+void ParticleQueue::Add(const QuadParticleRenderer& renderer, float depth)
+{
+    m_batches.Add(&renderer, renderer.m_vertices.size(), renderer.m_effect, renderer.m_texture, depth, renderer.m_effect->NeedsZSort());
+}
+
+bool ParticleQueue::Render()
+{
+    if (m_batches.IsEmpty())
+    {
+        return false;
+    }
+
+    PROFILE_SCOPE("render", "Particles");
+    m_batches.Sort();
+
+    for (size_t first = 0, last; first < m_batches.GetNumItems(); first = last)
+    {
+        // Find the emitters that can be rendered together with the first one
+        const QuadParticleRenderer& renderer = *static_cast<const QuadParticleRenderer*>(m_batches.GetItem(first).emitter);
+        size_t count;
+        last = m_batches.GetBatchEnd(first, CanBatch, count);
+
+        if (m_indices.size() < count)
+        {
+            // Every batch starts at the first vertex, so they all share the indices
+            size_t i = m_indices.size();
+            m_indices.resize(count);
+            for (; i < count; i++)
+            {
+                m_indices[i].i[0] = (uint16_t)(i * 4 + 0);
+                m_indices[i].i[1] = (uint16_t)(i * 4 + 1);
+                m_indices[i].i[2] = (uint16_t)(i * 4 + 2);
+                m_indices[i].i[3] = (uint16_t)(i * 4 + 2);
+                m_indices[i].i[4] = (uint16_t)(i * 4 + 1);
+                m_indices[i].i[5] = (uint16_t)(i * 4 + 3);
+            }
+        }
+
+        if (last == first + 1)
+        {
+            // Nothing to merge, render straight from the emitter
+            renderer.RenderQuads(renderer.m_vertices, count, m_indices);
+        }
+        else
+        {
+            m_vertices.resize(0);
+            for (size_t i = first; i < last; i++)
+            {
+                const QuadParticleRenderer* emitter = static_cast<const QuadParticleRenderer*>(m_batches.GetItem(i).emitter);
+                m_vertices.append(emitter->m_vertices, emitter->m_vertices.size());
+            }
+            renderer.RenderQuads(m_vertices, count, m_indices);
+        }
+    }
+
+    m_batches.Clear();
+    return true;
+}
+
+ParticleQueue::ParticleQueue()
+{
+}
+
+ParticleQueue::~ParticleQueue()
+{
+}
+
 }
 }
\ No newline at end of file
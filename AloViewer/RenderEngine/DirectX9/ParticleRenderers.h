@@ -3,14 +3,17 @@
 
 #include "RenderEngine/Particles/RendererPlugins.h"
 #include "RenderEngine/DirectX9/RenderEngine.h"
-#include "General/ExactTypes.h"
+#include "RenderEngine/ParticleBatches.h"
 
 namespace Alamo {
 namespace DirectX9 {
 
+class ParticleQueue;
+
 // Base for all particle renderers
 class ParticleRenderer
 {
+    friend class ParticleQueue;
 protected:
     struct ParticleVertex;
     struct ParticlePrimitiveVertex;
@@ -26,7 +29,7 @@ public:
     virtual void UpdatePrimitive(size_t index, const Particle& particle, void* data) const = 0;
     virtual void AllocatePrimitive(size_t index) = 0;
     virtual void FreePrimitive(size_t index) = 0;
-    virtual void RenderParticles() const = 0;
+    virtual void QueueParticles(ParticleQueue& queue, float depth) const = 0;
     virtual RenderPhase GetRenderPhase() const;
 
     virtual ~ParticleRenderer() {}
@@ -35,14 +38,24 @@ private:
 };
 
 // Base for all particle renderers based on independent quads.
-// Contains the common vertex and index management and rendering.
+// Contains the common vertex management, states and rendering.
+// The quads are in world space, so the quads of renderers with the
+// same states can be rendered together.
 class QuadParticleRenderer : public ParticleRenderer
 {
+    friend class ParticleQueue;
 protected:
     Buffer<ParticlePrimitiveVertex>  m_vertices;
-    Buffer<ParticlePrimitiveIndex>   m_indices;
+    ptr<Effect>                      m_effect;      // NULL if the renderer is unsupported
+    ptr<Texture>                     m_texture;
+    D3DXHANDLE                       m_hBaseTexture;
+    bool                             m_depthTest;
+
+    void LoadStates(const std::string& shader, const std::string& texture, bool disableDepthTest);
+    void RenderQuads(const ParticlePrimitiveVertex* vertices, size_t count, const ParticlePrimitiveIndex* indices) const;
 
-    void RenderParticles(Effect& effect) const;
+    virtual bool CanBatchWith(const QuadParticleRenderer& other) const;
+    virtual void SetStates() const;
     virtual void OverrideStates(IDirect3DDevice9* pDevice, int pass) const {}
 
 public:
@@ -50,6 +63,7 @@ public:
     void UpdatePrimitive(size_t index, const Particle& particle, void* data) const;
     void AllocatePrimitive(size_t index);
     void FreePrimitive(size_t index);
+    void QueueParticles(ParticleQueue& queue, float depth) const;
 
     QuadParticleRenderer(RenderEngine& engine);
 };
@@ -63,12 +77,8 @@ public:
 
 private:
     const PluginType& m_plugin;
-    ptr<Texture>      m_texture;
-    ptr<Effect>       m_effect;
-    D3DXHANDLE        m_hBaseTexture;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class XYAlignedRenderer : public QuadParticleRenderer
@@ -80,12 +90,8 @@ public:
 
 private:
     const PluginType& m_plugin;
-    ptr<Texture>      m_texture;
-    ptr<Effect>       m_effect;
-    D3DXHANDLE        m_hBaseTexture;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class VelocityAlignedRenderer : public QuadParticleRenderer
@@ -97,12 +103,8 @@ public:
 
 private:
     const PluginType& m_plugin;
-    ptr<Texture>      m_texture;
-    ptr<Effect>       m_effect;
-    D3DXHANDLE        m_hBaseTexture;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class HeatSaturationRenderer : public QuadParticleRenderer
@@ -114,16 +116,14 @@ public:
 
 private:
     const PluginType& m_plugin;
-    ptr<Texture>      m_texture;
-    ptr<Effect>       m_effect;
-    D3DXHANDLE        m_hBaseTexture;
     D3DXHANDLE        m_hDistanceCutoff;
     D3DXHANDLE        m_hDistortion;
     D3DXHANDLE        m_hSaturation;
 
     RenderPhase GetRenderPhase() const;
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
+    bool CanBatchWith(const QuadParticleRenderer& other) const;
+    void SetStates() const;
     void OverrideStates(IDirect3DDevice9* pDevice, int pass) const;
 };
 
@@ -136,12 +136,8 @@ public:
 
 private:
     const PluginType& m_plugin;
-    ptr<Texture>      m_texture;
-    ptr<Effect>       m_effect;
-    D3DXHANDLE        m_hBaseTexture;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class VolumetricRenderer : public QuadParticleRenderer
@@ -155,7 +151,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class ChainRenderer : public QuadParticleRenderer
@@ -169,7 +164,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class XYAlignedChainRenderer : public QuadParticleRenderer
@@ -183,7 +177,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class StretchedTextureChainRenderer : public QuadParticleRenderer
@@ -197,7 +190,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class HardwareBillboardsRenderer : public QuadParticleRenderer
@@ -211,7 +203,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class BumpMapRenderer : public QuadParticleRenderer
@@ -225,7 +216,6 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
 };
 
 class LineRenderer : public QuadParticleRenderer
@@ -239,7 +229,33 @@ private:
     const PluginType& m_plugin;
 
     void UpdatePrimitive(size_t index, const Particle& p, void* data) const;
-    void RenderParticles() const;
+};
+
+/*
+ * Collects the particles of all emitters in a render phase and renders them
+ * with as few draw calls as possible. The order and batches come from
+ * ParticleBatches; the quads of a batch are merged and drawn with one call.
+ */
+class ParticleQueue : public IObject
+{
+    typedef ParticleRenderer::ParticlePrimitiveVertex ParticlePrimitiveVertex;
+    typedef ParticleRenderer::ParticlePrimitiveIndex  ParticlePrimitiveIndex;
+
+    ParticleBatches                    m_batches;
+    Buffer<ParticlePrimitiveVertex>    m_vertices;  // Quads of the current batch
+    Buffer<ParticlePrimitiveIndex>     m_indices;   // Indices for a batch of quads
+
+    static bool CanBatch(const void* first, const void* next);
+
+    ~ParticleQueue();
+public:
+    // Adds the quads of the renderer, at the depth in view space
+    void Add(const QuadParticleRenderer& renderer, float depth);
+
+    // Renders and clears the queue. Returns true if anything was rendered.
+    bool Render();
+
+    ParticleQueue();
 };
 
 }
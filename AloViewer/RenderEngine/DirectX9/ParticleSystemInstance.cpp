@@ -1,5 +1,6 @@
 #include "RenderEngine/DirectX9/ParticleEmitterInstance.h"
 #include "RenderEngine/DirectX9/RenderObject.h"
+#include "General/Profiler.h"
 
 namespace Alamo {
 namespace DirectX9 {
@@ -11,10 +12,14 @@ void ParticleSystemInstance::Update()
         // There are emitters to update
         m_prevTransform = m_transform;
         m_transform     = m_object.GetBoneTransform(m_bone);
-        for (ParticleEmitterInstance *next, *cur = m_emitters; cur != NULL; cur = next)
         {
-            next = cur->GetNext();
-            cur->Update();
+            // The release below may delete the system, and its name
+            PROFILE_SCOPE("particles", m_system->GetName().c_str());
+            for (ParticleEmitterInstance *next, *cur = m_emitters; cur != NULL; cur = next)
+            {
+                next = cur->GetNext();
+                cur->Update();
+            }
         }
         
         if (m_emitters == NULL)
@@ -25,14 +30,22 @@ void ParticleSystemInstance::Update()
     }
 }
 
-bool ParticleSystemInstance::Render(RenderPhase phase) const
+void ParticleSystemInstance::QueueParticles(ParticleQueue& queue, RenderPhase phase, float depth) const
+{
+    for (ParticleEmitterInstance *cur = m_emitters; cur != NULL; cur = cur->GetNext())
+    {
+        cur->QueueParticles(queue, phase, depth);
+    }
+}
+
+size_t ParticleSystemInstance::GetNumParticles() const
 {
-    bool rendered = false;
+    size_t count = 0;
     for (ParticleEmitterInstance *cur = m_emitters; cur != NULL; cur = cur->GetNext())
     {
-        rendered |= cur->Render(phase);
+        count += cur->GetNumParticles();
     }
-    return rendered;
+    return count;
 }
 
 void ParticleSystemInstance::Detach()
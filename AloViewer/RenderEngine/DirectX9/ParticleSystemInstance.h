@@ -9,6 +9,7 @@ namespace Alamo {
 namespace DirectX9 {
 
 class ParticleEmitterInstance;
+class ParticleQueue;
 
 class ParticleSystemInstance : public ProxyInstance
 {
@@ -26,13 +27,14 @@ public:
     void SpawnEmitter(const ParticleSystem::Emitter& emitter, Particle* parent, float time);
 
     void Update();
-    bool Render(RenderPhase phase) const;
+    void QueueParticles(ParticleQueue& queue, RenderPhase phase, float depth) const;
     void Detach();
 
     RenderEngine& GetRenderEngine()  const { return m_engine;        }
     RenderObject& GetRenderObject()  const { return m_object;        }
     const Matrix& GetPrevTransform() const { return m_prevTransform; }
     const Matrix& GetTransform()     const { return m_transform;     }
+    size_t        GetNumParticles()  const;
 
     ParticleSystemInstance(ptr<ParticleSystem> system, RenderObject& object, size_t index, float time);
     ~ParticleSystemInstance();
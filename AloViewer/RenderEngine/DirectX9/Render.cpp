@@ -1,7 +1,9 @@
 #include "RenderEngine/DirectX9/Exceptions.h"
 #include "RenderEngine/DirectX9/RenderObject.h"
 #include "RenderEngine/DirectX9/LightFieldInstance.h"
+#include "RenderEngine/DirectX9/ParticleRenderers.h"
 #include "General/GameTime.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -27,17 +29,11 @@ bool RenderEngine::RenderRenderPhase(RenderPhase phase, bool special) const
                 rendered |= object->Render(submesh, special);
             }
         }
-        
-        for (set<ParticleSystemInstance*>::const_iterator p = m_particleSystems.begin(); p != m_particleSystems.end(); p++)
-        {
-            rendered |= (*p)->Render(phase);
-        }
     }
     else
     {
-        // Render meshes and particles sorted by distance
+        // Render meshes sorted by distance
         multimap<float, pair<const RenderObject*, const RenderObject::SubMesh*> > submeshes;
-        multimap<float, const ParticleSystemInstance*> particleSystems;
 
         for (const RenderObject* object = m_objects; object != NULL; object = object->GetNext())
         {
@@ -48,12 +44,6 @@ bool RenderEngine::RenderRenderPhase(RenderPhase phase, bool special) const
                 submeshes.insert(make_pair(distance, make_pair(object, submesh)));                
             }
         }
-        
-        for (set<ParticleSystemInstance*>::const_iterator p = m_particleSystems.begin(); p != m_particleSystems.end(); p++)
-        {
-            float distance = ((*p)->GetTransform().getTranslation() * m_matrices.m_view).z;
-            particleSystems.insert(make_pair(distance, *p));
-        }
 
         // Render meshes
         for (multimap<float, pair<const RenderObject*, const RenderObject::SubMesh*> >::const_iterator p = submeshes.begin(); p != submeshes.end(); p++)
@@ -69,13 +59,15 @@ bool RenderEngine::RenderRenderPhase(RenderPhase phase, bool special) const
                 object->RenderDazzles();
             }
         }
+    }
 
-        // Render particle systems, sorted
-        for (multimap<float, const ParticleSystemInstance*>::const_iterator p = particleSystems.begin(); p != particleSystems.end(); p++)
-        {
-            rendered |= p->second->Render(phase);
-        }
+    // Render particles; the queue sorts and batches them
+    for (set<ParticleSystemInstance*>::const_iterator p = m_particleSystems.begin(); p != m_particleSystems.end(); p++)
+    {
+        float distance = ((*p)->GetTransform().getTranslation() * m_matrices.m_view).z;
+        (*p)->QueueParticles(*m_particleQueue, phase, distance);
     }
+    rendered |= m_particleQueue->Render();
 
     return rendered;
 }
@@ -211,6 +203,7 @@ void RenderEngine::RenderGround(float groundLevel, D3DCOLOR color)
             if (m_groundEffect->BeginPass(i))
             {
                 m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_groundQuad[0], sizeof m_groundQuad[0]);
+                Profiler::AddDrawCall(2);
             }
             m_groundEffect->EndPass();
         }
@@ -257,6 +250,7 @@ void RenderEngine::RenderGround(float groundLevel, D3DCOLOR color)
         m_pDevice->SetVertexShader(NULL);
         m_pDevice->SetPixelShader(NULL);
         m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_groundQuad[0], sizeof m_groundQuad[0]);
+        Profiler::AddDrawCall(2);
         m_pDevice->SetTextureStageState(0, D3DTSS_TEXTURETRANSFORMFLAGS, D3DTTFF_DISABLE);
     }
     m_vertexManager->ResetActiveStreams();
@@ -265,6 +259,8 @@ void RenderEngine::RenderGround(float groundLevel, D3DCOLOR color)
 // Renders a complete, single frame
 void RenderEngine::Render(const RenderOptions& options)
 {
+    PROFILE_SCOPE("render", "Render");
+
     HRESULT hRes;
 	if (FAILED(hRes = m_pDevice->TestCooperativeLevel()))
 	{
@@ -294,6 +290,16 @@ void RenderEngine::Render(const RenderOptions& options)
 
     const float time = GetGameTime();
 
+    if (Profiler::IsEnabled())
+    {
+        long alive = 0;
+        for (set<ParticleSystemInstance*>::const_iterator p = m_particleSystems.begin(); p != m_particleSystems.end(); p++)
+        {
+            alive += (long)(*p)->GetNumParticles();
+        }
+        Profiler::Set(Profiler::PARTICLES_ALIVE, alive);
+    }
+
     // Update all effects with time-based values
     float windHeading = m_environment.m_wind.heading - ToRadians(90);
     const Vector4 windBendVector(cos(windHeading) * sin(time), sin(windHeading) * sin(time), 0, 0.002f);
@@ -492,6 +498,7 @@ void RenderEngine::Render(const RenderOptions& options)
                         if (m_stencilDarken->BeginPass(i))
                         {
                             m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_shadowQuad[0], sizeof(VERTEX_MESH_NC));
+                            Profiler::AddDrawCall(2);
                         }
                         m_stencilDarken->EndPass();
                     }
@@ -523,6 +530,7 @@ void RenderEngine::Render(const RenderOptions& options)
                         if (m_stencilDarkenToAlpha->BeginPass(i))
                         {
                             m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_shadowQuad[0], sizeof(VERTEX_MESH_NC));
+                            Profiler::AddDrawCall(2);
                         }
                         m_stencilDarkenToAlpha->EndPass();
                     }
@@ -554,6 +562,7 @@ void RenderEngine::Render(const RenderOptions& options)
                         if (m_stencilDarkenFinalBlur->BeginPass(i))
                         {
                             m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_sceneQuad[0], sizeof(VERTEX_MESH_NU2C));
+                            Profiler::AddDrawCall(2);
                         }
                         m_stencilDarkenFinalBlur->EndPass();
                     }
@@ -630,6 +639,7 @@ void RenderEngine::Render(const RenderOptions& options)
             m_pDevice->SetSamplerState(1, D3DSAMP_ADDRESSU, D3DTADDRESS_CLAMP);
             m_pDevice->SetSamplerState(1, D3DSAMP_ADDRESSV, D3DTADDRESS_CLAMP);
 	        m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_sceneQuad[0], sizeof(VERTEX_MESH_NU2C));
+	        Profiler::AddDrawCall(2);
 	        m_heatEffect->EndPass();
         }
         m_heatEffect->End();
@@ -671,6 +681,7 @@ void RenderEngine::Render(const RenderOptions& options)
             if (m_bloomEffect->BeginPass(i))
             {
                 m_pDevice->DrawPrimitiveUP(D3DPT_TRIANGLESTRIP, 2, &m_sceneQuad[0], sizeof(VERTEX_MESH_NU2C));
+                Profiler::AddDrawCall(2);
             }
             m_bloomEffect->EndPass();
         }
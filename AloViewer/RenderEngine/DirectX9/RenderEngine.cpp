@@ -1,8 +1,10 @@
 #include "RenderEngine/SphericalHarmonics.h"
 #include "RenderEngine/DirectX9/Exceptions.h"
 #include "RenderEngine/DirectX9/RenderObject.h"
+#include "RenderEngine/DirectX9/ParticleRenderers.h"
 #include "General/Log.h"
 #include "General/Utils.h"
+#include "General/Profiler.h"
 #include "resource.h"
 using namespace std;
 
@@ -1068,6 +1070,7 @@ ptr<Texture> RenderEngine::LoadTexture(const std::string& name, bool usePlacehol
     }
 
     // Texture wasn't loaded before, load it
+    PROFILE_SCOPE("assets", name.c_str());
     IDirect3DTexture9* pD3DTexture = NULL;
 
     // Read the file
@@ -1229,6 +1232,7 @@ RenderEngine::RenderEngine(HWND hWnd, const RenderSettings& settings, const Envi
     m_settings.m_screenRefresh = m_presentationParameters.FullScreen_RefreshRateInHz;
 
     m_vertexManager = new VertexManager(m_pDevice, isUaW);
+    m_particleQueue = new ParticleQueue;
 
     OnResolutionChanged();
     LoadStandardResources();
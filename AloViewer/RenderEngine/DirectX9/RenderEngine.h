@@ -17,6 +17,7 @@ class Effect;
 class RenderObject;
 class ParticleSystemInstance;
 class ParticleEmitterInstance;
+class ParticleQueue;
 class LightFieldInstance;
 
 class ProxyInstance : public IObject, public LinkedListObject<ProxyInstance>
@@ -113,6 +114,7 @@ private:
     LinkedList<RenderObject>          m_objects;
     std::set<ParticleSystemInstance*> m_particleSystems;
     std::set<LightFieldInstance*>     m_lightfields;
+    ptr<ParticleQueue>                m_particleQueue;
 
     //
     // Resources
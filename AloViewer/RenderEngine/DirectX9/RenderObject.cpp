@@ -1,5 +1,6 @@
 #include "RenderEngine/DirectX9/RenderObject.h"
 #include "General/GameTime.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -156,6 +157,8 @@ void RenderObject::KillProxy(size_t index)
 
 void RenderObject::Update()
 {
+    PROFILE_SCOPE("update", "RenderObject::Update");
+
     // Update all proxies
     for (ProxyInstance *next, *cur = m_instances; cur != NULL; cur = next)
     {
@@ -1,5 +1,6 @@
 #include "RenderEngine/DirectX9/Resources.h"
 #include "RenderEngine/DirectX9/Exceptions.h"
+#include "General/Profiler.h"
 using namespace std;
 
 namespace Alamo {
@@ -64,6 +65,7 @@ void D3DVertexBuffer::StoreVertices(DWORD offset, const void* data, DWORD num, b
         assert(vfi.hw.size == vfi.sw.size);
         memcpy(hwdata, swdata, num * vfi.hw.size);
     }
+    Profiler::Add(Profiler::VERTEX_BYTES, (long)(num * vfi.hw.size));
 
     m_pVertexBuffer_SW->Unlock();
     m_pVertexBuffer_HW->Unlock();
@@ -166,6 +168,7 @@ void D3DIndexBuffer::StoreIndices(DWORD offset, const uint16_t* data, DWORD num)
         memcpy(swdata, data, num * sizeof(uint16_t));
     }
     memcpy(hwdata, swdata, num * sizeof(uint16_t));
+    Profiler::Add(Profiler::INDEX_BYTES, (long)(num * sizeof(uint16_t)));
 
     m_pIndexBuffer_SW->Unlock();
     m_pIndexBuffer_HW->Unlock();
@@ -0,0 +1,105 @@
+#include "RenderEngine/ParticleBatches.h"
+using namespace std;
+
+namespace Alamo {
+
+uint64_t ParticleBatches::GetDepthKey(float depth)
+{
+    union { float f; uint32_t u; } bits;
+    bits.f = depth;
+    return (bits.u & 0x80000000) ? ~bits.u : bits.u | 0x80000000;
+}
+
+uint64_t ParticleBatches::GetId(const void* object)
+{
+    map<const void*, uint64_t>::const_iterator p = m_ids.find(object);
+    if (p == m_ids.end())
+    {
+        p = m_ids.insert(make_pair(object, (uint64_t)m_ids.size())).first;
+    }
+    return p->second;
+}
+
+void ParticleBatches::Add(const void* emitter, size_t quads, const void* effect, const void* texture, float depth, bool zsort)
+{
+    // Keys are (from most to least significant bits):
+    // unsorted effects:  0, effect (15), texture (16), depth (32)
+    // sorted effects:    1, depth (32), effect (15), texture (16)
+    // The IDs wrap if there are too many, which only costs batches.
+    const uint64_t effectId  = GetId(effect)  & 0x7FFF;
+    const uint64_t textureId = GetId(texture) & 0xFFFF;
+
+    Item item;
+    item.emitter = emitter;
+    item.quads   = quads;
+    item.key     = (zsort)
+        ? ((uint64_t)1 << 63) | (GetDepthKey(depth) << 31) | (effectId << 16) | textureId
+        : (effectId << 48) | (textureId << 32) | GetDepthKey(depth);
+    m_items.push_back(item);
+}
+
+// LSD radix sort on the keys, one byte per pass.
+// It's stable, so emitters with equal keys stay in the order they were added.
+void ParticleBatches::Sort()
+{
+    const size_t n = m_items.size();
+    if (n == 0)
+    {
+        return;
+    }
+
+    m_sorted.resize(n);
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t offsets[256] = {0};
+        for (size_t i = 0; i < n; i++)
+        {
+            offsets[(m_items[i].key >> shift) & 0xFF]++;
+        }
+
+        if (offsets[(m_items[0].key >> shift) & 0xFF] == n)
+        {
+            // All keys have the same byte here, nothing to do
+            continue;
+        }
+
+        for (size_t i = 0, offset = 0; i < 256; i++)
+        {
+            size_t count = offsets[i];
+            offsets[i] = offset;
+            offset    += count;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            m_sorted[offsets[(m_items[i].key >> shift) & 0xFF]++] = m_items[i];
+        }
+        m_items.swap(m_sorted);
+    }
+}
+
+size_t ParticleBatches::GetBatchEnd(size_t first, BATCH_FUNC canBatch, size_t& quads) const
+{
+    const void* emitter = m_items[first].emitter;
+    size_t      last;
+
+    quads = m_items[first].quads;
+    for (last = first + 1; last < m_items.size(); last++)
+    {
+        const Item& next = m_items[last];
+        if (quads + next.quads > MAX_BATCH_QUADS || !canBatch(emitter, next.emitter))
+        {
+            break;
+        }
+        quads += next.quads;
+    }
+    return last;
+}
+
+void ParticleBatches::Clear()
+{
+    m_items.clear();
+    m_ids.clear();
+}
+
+}
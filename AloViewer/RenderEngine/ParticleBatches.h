@@ -0,0 +1,76 @@
+#ifndef PARTICLEBATCHES_H
+#define PARTICLEBATCHES_H
+
+#include "General/ExactTypes.h"
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace Alamo {
+
+/*
+ * Orders the particle emitters of a render phase and splits them into
+ * batches, independent of the render API.
+ *
+ * The emitters are sorted on their effect, texture and depth, so emitters
+ * with the same states end up next to each other and can be drawn with one
+ * call. Effects that want their primitives sorted (_ALAMO_Z_SORT) come after
+ * the others and are sorted on depth first, so they're still drawn back to
+ * front. Emitters with equal keys stay in the order they were added.
+ */
+class ParticleBatches
+{
+public:
+    // Batches are limited by the 16-bit indices
+    static const size_t MAX_BATCH_QUADS = 65536 / 4;
+
+    struct Item
+    {
+        uint64_t    key;
+        const void* emitter;
+        size_t      quads;
+    };
+
+    // Returns true if the two emitters can be drawn with the same states
+    typedef bool (*BATCH_FUNC)(const void* first, const void* next);
+
+    // Maps a float onto an unsigned integer with the same ordering
+    static uint64_t GetDepthKey(float depth);
+
+    /* Adds an emitter.
+     *  @emitter: passed back through GetItem() and the BATCH_FUNC.
+     *  @quads:   number of quads the emitter renders.
+     *  @effect, @texture: identify the states; only compared.
+     *  @depth:   in view space.
+     *  @zsort:   the effect wants its primitives sorted on depth.
+     */
+    void Add(const void* emitter, size_t quads, const void* effect, const void* texture, float depth, bool zsort);
+
+    // Sorts the emitters added so far
+    void Sort();
+
+    /* Returns the end of the batch that starts with item @first: the first
+     * item that can't be drawn with it because @canBatch says so, or because
+     * the batch would exceed MAX_BATCH_QUADS. Stores the batch's number of
+     * quads in @quads. A batch always has at least one item.
+     */
+    size_t GetBatchEnd(size_t first, BATCH_FUNC canBatch, size_t& quads) const;
+
+    size_t      GetNumItems()     const { return m_items.size(); }
+    const Item& GetItem(size_t i) const { return m_items[i]; }
+    bool        IsEmpty()         const { return m_items.empty(); }
+
+    void Clear();
+
+private:
+    // Returns a small ID for the effect or texture, unique until Clear()
+    uint64_t GetId(const void* object);
+
+    std::vector<Item>               m_items;
+    std::vector<Item>               m_sorted;
+    std::map<const void*, uint64_t> m_ids;
+};
+
+}
+
+#endif
@@ -1,96 +1,86 @@
 #include "Sound/AnimationSFXMaps.h"
 #include "Assets/Assets.h"
+#include "General/NameTable.h"
 #include "General/Utils.h"
 #include "General/Log.h"
-#include <string>
-#include <sstream>
 using namespace std;
 
 namespace Alamo {
 namespace AnimationSFXMaps {
 
-typedef map<string, SFXMap> SFXMaps;
+typedef NameTable<SFXMap> SFXMaps;
 
 static SFXMaps m_maps;
 
-const SFXMap* GetEvents(const std::string& animation)
+const SFXMap* GetEvents(const HashedString& animation)
 {
-    string s = Uppercase(animation);
-    SFXMaps::const_iterator p = m_maps.find(Uppercase(animation));
-    return (p != m_maps.end()) ? &p->second : NULL;
+    return m_maps.find(animation);
 }
 
-static void ParseLine(const string& line)
+static const size_t MAX_TOKENS = 5;  // Type, animation, time, name, bone
+
+static bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// The map that the previous line went into. Lines for the same animation are
+// usually together, so this saves most of the lookups.
+struct ParseState
 {
-    // Parse one line
-    string animation;
-    Event  current;
-    float  time;
-    int    state = 0;
-
-    string::size_type start, sp = 0;
-    static const char* whitespace = " \t\r\n\v\f";
-    while ((start = line.find_first_not_of(whitespace, sp)) != string::npos)
+    const char* animation;
+    SFXMap*     map;
+};
+
+static void ParseLine(ParseState& state, char* const* tokens, size_t nTokens)
+{
+    if (nTokens == 0)
     {
-        sp = line.find_first_of(whitespace, start);
-        if (sp == string::npos) {
-            sp = line.size();
-        }
-        string token = line.substr(start, sp - start);
-        switch (state)
-        {
-            case 0:
-                token = Uppercase(token);
-                if (token == "SURFACE") {
-                    current.type = Event::SURFACE;
-                } else if (token == "SOUND") {
-                    current.type = Event::SOUND;
-                } else {
-                    Log::WriteError("Unknown SFX event type \"%s\"\n", token.c_str());
-                    return;
-                }
-                state = 1;
-                break;
+        return;
+    }
 
-            case 1:
-                animation = Uppercase(token);
-                state = 2;
-                break;
+    Event current;
+    if (_stricmp(tokens[0], "SURFACE") == 0) {
+        current.type = Event::SURFACE;
+    } else if (_stricmp(tokens[0], "SOUND") == 0) {
+        current.type = Event::SOUND;
+    } else {
+        Log::WriteError("Unknown SFX event type \"%s\"\n", tokens[0]);
+        return;
+    }
 
-            case 2:
-            {
-                stringstream ss;
-                ss << token;
-                ss >> time;
-                if (ss.fail())
-                {
-                    Log::WriteError("Invalid SFX event time\n");
-                    return;
-                }
-                time /= 3000;
-                state = 3;
-                break;
-            }
+    if (nTokens < 3)
+    {
+        return;
+    }
 
-            case 3:
-                current.name = token;
-                if (current.type == Event::SOUND)
-                {
-                    // We're done
-                    m_maps[animation].insert(make_pair(time, current));
-                    return;
-                }
-                state = 4;
-                break;
-
-            case 4:
-                current.bone = token;
-                
-                // We're done
-                m_maps[animation].insert(make_pair(time, current));
-                return;
-        }
+    char* endptr;
+    float time = (float)strtod(tokens[2], &endptr);
+    if (endptr == tokens[2])
+    {
+        Log::WriteError("Invalid SFX event time\n");
+        return;
+    }
+    time /= 3000;
+
+    if (nTokens < ((current.type == Event::SOUND) ? 4U : 5U))
+    {
+        return;
+    }
+    current.name = tokens[3];
+    if (current.type == Event::SURFACE)
+    {
+        current.bone = tokens[4];
     }
+
+    if (state.map == NULL || _stricmp(state.animation, tokens[1]) != 0)
+    {
+        state.animation = tokens[1];
+        state.map       = &m_maps[tokens[1]];
+    }
+
+    // Events are mostly in order, so try the end first
+    state.map->insert(state.map->end(), make_pair(time, current));
 }
 
 void Initialize()
@@ -99,22 +89,39 @@ void Initialize()
     ptr<IFile> file = Assets::LoadFile("AnimationSFXMaps.txt", "Data/XML/");
     if (file != NULL)
     {
-        char* tmp = new char[file->size()];
-        file->read(tmp, file->size());
-        string data(tmp, file->size());
-        delete[] tmp;
-
-        // Parse file
-        string::size_type start, sp = 0;
-        static const char* newline = "\n";
-        while ((start = data.find_first_not_of(newline, sp)) != string::npos)
+        // Read the entire file at once, with a NUL at the end. The tokens are
+        // NUL-terminated in place, so nothing is copied until it's stored.
+        Buffer<char> data(file->size() + 1);
+        data.resize(file->read(data, file->size()) + 1);
+        data[data.size() - 1] = '\0';
+
+        ParseState state;
+        state.animation = NULL;
+        state.map       = NULL;
+
+        char* p   = data;
+        char* end = data + data.size() - 1;
+        while (p != end)
         {
-            sp = data.find_first_of(newline, start);
-            if (sp == string::npos) {
-                sp = data.size();
+            // Split one line into tokens
+            char*  tokens[MAX_TOKENS];
+            size_t nTokens = 0;
+            bool   eol     = false;
+            while (!eol && p != end)
+            {
+                if (*p == '\n') {
+                    eol = true;
+                } else if (!IsSpace(*p)) {
+                    if (nTokens < MAX_TOKENS) {
+                        tokens[nTokens++] = p;
+                    }
+                    while (p != end && *p != '\n' && !IsSpace(*p)) p++;
+                    eol = (p == end || *p == '\n');
+                    *p  = '\0';
+                }
+                if (p != end) p++;
             }
-            string line = data.substr(start, sp - start);
-            ParseLine(line);
+            ParseLine(state, tokens, nTokens);
         }
     }
 }
@@ -1,6 +1,7 @@
 #ifndef ANIMATIONSFXMAPS_H
 #define ANIMATIONSFXMAPS_H
 
+#include "General/Utils.h"
 #include <string>
 #include <map>
 
@@ -12,8 +13,8 @@ struct Event
     enum Type { SOUND, SURFACE };
 
     Type        type;
-    std::string name;
-    std::string bone;   // Only valid for SURFACE events
+    HashedString name;
+    std::string  bone;  // Only valid for SURFACE events
 };
 
 typedef std::multimap<float, Event> SFXMap;
@@ -21,7 +22,8 @@ typedef std::multimap<float, Event> SFXMap;
 void Initialize();
 void Uninitialize();
 
-const SFXMap* GetEvents(const std::string& animation);
+// Returns the events for the specified (case-insensitive) animation, or NULL
+const SFXMap* GetEvents(const HashedString& animation);
 
 }
 }
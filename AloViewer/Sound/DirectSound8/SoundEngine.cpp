@@ -1,7 +1,7 @@
 #include "Assets/Assets.h"
 #include "Sound/DirectSound8/SoundEngine.h"
 #include "Sound/DirectSound8/Exceptions.h"
-#include "Sound/WaveFile.h"
+#include "Sound/WaveStream.h"
 #include "General/Math.h"
 #include "General/Log.h"
 #include <dsound.h>
@@ -10,6 +10,31 @@ using namespace std;
 namespace Alamo {
 namespace DirectSound8 {
 
+// Total size of the PCM data kept in the sample cache
+static const unsigned long CACHE_SIZE       = 32 * 1024 * 1024;
+
+// Samples larger than this are streamed from the file instead of loaded
+static const unsigned long STREAM_THRESHOLD = 512 * 1024;
+
+// Seconds of audio in each half of a stream's sound buffer
+static const float         STREAM_HALF_TIME = 0.5f;
+
+// Number of halves the stream reads ahead
+static const size_t        STREAM_BLOCKS    = 4;
+
+// The sound buffer with a cached sample's data. Every play of the sample
+// gets a duplicate, which shares the data instead of copying it.
+class MasterBuffer : public IObject
+{
+    IDirectSoundBuffer* m_buffer;
+
+    ~MasterBuffer() { SAFE_RELEASE(m_buffer); }
+public:
+    IDirectSoundBuffer* GetBuffer() const { return m_buffer; }
+
+    MasterBuffer(IDirectSoundBuffer* buffer) : m_buffer(buffer) {}
+};
+
 struct SoundEngine::SoundTypeInfo
 {
     int m_nInstances;
@@ -28,6 +53,13 @@ struct SoundEngine::Sound
     const SFXEvent& m_event;
     SoundType       m_type;
 
+    // Streaming; the buffer is split into two halves. While one half plays,
+    // the other is filled from the stream.
+    ptr<WaveStream> m_stream;
+    DWORD           m_halfSize;
+    int             m_playingHalf;
+    int             m_lastHalf;     // Half with the end of the stream, or -1
+
     void SetVolume(double volume)
     {
         // 1e-10 corresponds to -100dB, the minimum
@@ -52,11 +84,60 @@ struct SoundEngine::Sound
 
     void Play()
     {
-        m_buffer->Play(0, 0, (m_playCount != 1) ? DSBPLAY_LOOPING : 0);
+        m_buffer->Play(0, 0, (m_playCount != 1 || m_stream != NULL) ? DSBPLAY_LOOPING : 0);
     }
 
-    Sound(IDirectSoundBuffer* buffer, const SFXEvent& e, const SoundType type)
-        : m_event(e), m_type(type)
+    // Copies the next data from the stream into a half of the buffer
+    void FillHalf(int half)
+    {
+        void* data;
+        DWORD size;
+        if (SUCCEEDED(m_buffer->Lock(half * m_halfSize, m_halfSize, &data, &size, NULL, NULL, 0)))
+        {
+            // Pad with silence if the stream has run dry
+            size_t read = m_stream->Read(data, size);
+            memset((char*)data + read, (m_stream->GetFormat().bitsPerSample == 8) ? 0x80 : 0, size - read);
+            m_buffer->Unlock(data, size, NULL, 0);
+
+            if (m_lastHalf == -1 && m_stream->AtEnd())
+            {
+                m_lastHalf = half;
+            }
+        }
+    }
+
+    // Refills the stream's buffer after a notification.
+    // Returns false if the sound has stopped playing.
+    bool UpdateStream()
+    {
+        DWORD status, cursor;
+        if (FAILED(m_buffer->GetStatus(&status)) || !(status & DSBSTATUS_PLAYING) ||
+            FAILED(m_buffer->GetCurrentPosition(&cursor, NULL)))
+        {
+            return false;
+        }
+
+        int half = (cursor < m_halfSize) ? 0 : 1;
+        if (half != m_playingHalf)
+        {
+            // The other half has finished playing
+            m_playingHalf = half;
+            if (1 - half == m_lastHalf)
+            {
+                // That was the end of the stream; this half is silence.
+                // Stopping signals the notification that cleans up the sound.
+                m_buffer->Stop();
+            }
+            else
+            {
+                FillHalf(1 - half);
+            }
+        }
+        return true;
+    }
+
+    Sound(IDirectSoundBuffer* buffer, ptr<WaveStream> stream, DWORD halfSize, const SFXEvent& e, const SoundType type)
+        : m_event(e), m_type(type), m_stream(stream)
     {
         m_buffer = buffer;
         
@@ -65,6 +146,17 @@ struct SoundEngine::Sound
         m_volume    = GetRandom(e.volume.min, e.volume.max);
         m_pitch     = GetRandom(e.pitch.min, e.pitch.max);
         m_playCount = e.playCount;
+
+        m_halfSize    = halfSize;
+        m_playingHalf = 0;
+        m_lastHalf    = -1;
+        if (m_stream != NULL)
+        {
+            // The stream does the looping; the sound ends with the stream
+            m_playCount = 1;
+            FillHalf(0);
+            FillHalf(1);
+        }
         
         SetVolume(1.0f);
         SetPitch(1.0f);
@@ -106,6 +198,12 @@ void SoundEngine::ReleaseEvent(size_t e)
 void SoundEngine::OnSoundCompleted(size_t i)
 {
     Sound* sound = m_sounds[i];    
+    if (sound->m_stream != NULL && sound->UpdateStream())
+    {
+        // Stream is still playing
+        return;
+    }
+
     if (sound->m_playCount > 1)
     {
         // Decrease loop count
@@ -125,69 +223,107 @@ void SoundEngine::OnSoundCompleted(size_t i)
     }
 }
 
-SoundEngine::Sound* SoundEngine::CreateSound(const SFXEvent& e, const string& sample, const SoundType type)
+IDirectSoundBuffer* SoundEngine::CreateBuffer(const WaveFormat& format, DWORD size)
+{
+    WAVEFORMATEX wfx;
+    wfx.wFormatTag      = format.formatTag;
+    wfx.nChannels       = format.channels;
+    wfx.nSamplesPerSec  = format.samplesPerSec;
+    wfx.nAvgBytesPerSec = format.avgBytesPerSec;
+    wfx.nBlockAlign     = format.blockAlign;
+    wfx.wBitsPerSample  = format.bitsPerSample;
+    wfx.cbSize          = 0;
+
+    DSBUFFERDESC desc;
+    desc.dwSize          = sizeof(DSBUFFERDESC);
+    desc.dwFlags         = DSBCAPS_CTRLVOLUME | DSBCAPS_CTRLFREQUENCY | DSBCAPS_CTRLPOSITIONNOTIFY | DSBCAPS_GETCURRENTPOSITION2;
+    desc.dwBufferBytes   = size;
+    desc.dwReserved      = 0;
+    desc.lpwfxFormat     = &wfx;
+    desc.guid3DAlgorithm = GUID_NULL;
+
+    HRESULT             hRes;
+    IDirectSoundBuffer* buffer;
+    if (FAILED(hRes = m_pDirectSound->CreateSoundBuffer(&desc, &buffer, NULL)))
+    {
+        throw DirectSoundException(hRes);
+    }
+    return buffer;
+}
+
+SoundEngine::Sound* SoundEngine::CreateSound(const SFXEvent& e, const string& name, const SoundType type)
 {
     IDirectSoundBuffer* buffer;
     HRESULT             hRes;
+    ptr<WaveStream>     stream;
+    DWORD               halfSize = 0;
 
     // First look in the cache
-    SoundCache::iterator p = m_cache.find(sample);
-    if (p == m_cache.end() || p->second == NULL)
+    ptr<Sample> sample = m_cache.Find(name);
+    if (sample == NULL)
     {
-        // Not in cache, load the sound file
-        ptr<IFile> file = Assets::LoadFile(sample, "Data/Audio/SFX/");
+        // Not in cache, open the sound file
+        ptr<IFile> file = Assets::LoadFile(name, "Data/Audio/SFX/");
         if (file == NULL)
         {
-            Log::WriteError("Unable to open sound file: %s\n", sample.c_str());
+            Log::WriteError("Unable to open sound file: %s\n", name.c_str());
             return NULL;
         }
 
         ptr<WaveFile> wav = new WaveFile(file);
         if (wav == NULL)
         {
-            Log::WriteError("The file is not a valid WAV file: %s\n", sample.c_str());
+            Log::WriteError("The file is not a valid WAV file: %s\n", name.c_str());
             return NULL;
         }
 
-        // Create the sound buffer
-        DSBUFFERDESC desc;
-        desc.dwSize          = sizeof(DSBUFFERDESC);
-        desc.dwFlags         = DSBCAPS_CTRLVOLUME | DSBCAPS_CTRLFREQUENCY | DSBCAPS_CTRLPOSITIONNOTIFY;
-        desc.dwBufferBytes   = wav->GetSize();
-        desc.dwReserved      = 0;
-        desc.lpwfxFormat     = &wav->GetFormat();
-        desc.guid3DAlgorithm = GUID_NULL;
-
-        if (FAILED(hRes = m_pDirectSound->CreateSoundBuffer(&desc, &buffer, NULL)))
+        const WaveFormat& format = wav->GetFormat();
+        if (wav->GetSize() > STREAM_THRESHOLD && format.blockAlign > 0)
         {
-            throw DirectSoundException(hRes);
+            // Large sample, stream it in blocks of half the buffer
+            halfSize = max(1UL, (unsigned long)(format.avgBytesPerSec * STREAM_HALF_TIME) / format.blockAlign) * format.blockAlign;
+            stream   = new WaveStream(wav, e.playCount, halfSize, STREAM_BLOCKS);
         }
+        else
+        {
+            // Load the entire sample and add it to the cache
+            sample = new Sample(*wav);
+            m_cache.Insert(name, sample);
+        }
+    }
 
-        // Fill the sound buffer
-        void *data;
-        DWORD size;
-        buffer->Lock(0, 0, &data, &size, NULL, NULL, DSBLOCK_ENTIREBUFFER);
-        memcpy(data, wav->GetData(), size);
-        buffer->Unlock(data, size, NULL, 0);
-        
-        // Add to cache
-        m_cache[sample] = buffer;
-        buffer->AddRef();
+    if (stream != NULL)
+    {
+        // The stream fills the buffer once the sound is created
+        buffer = CreateBuffer(stream->GetFormat(), 2 * halfSize);
     }
     else
-    {       
-        // Sound is in the cache, duplicate buffer
-        if (FAILED(hRes = m_pDirectSound->DuplicateSoundBuffer(p->second, &buffer)))
+    {
+        MasterBuffer* master = static_cast<MasterBuffer*>(sample->GetEngineData());
+        if (master == NULL)
+        {
+            // First play since the sample was cached, fill its sound buffer
+            buffer = CreateBuffer(sample->GetFormat(), sample->GetSize());
+
+            void *data;
+            DWORD size;
+            buffer->Lock(0, 0, &data, &size, NULL, NULL, DSBLOCK_ENTIREBUFFER);
+            memcpy(data, sample->GetData(), size);
+            buffer->Unlock(data, size, NULL, 0);
+
+            master = new MasterBuffer(buffer);
+            sample->SetEngineData(master);
+        }
+
+        // Play a duplicate so several sounds can play the sample at once.
+        // The duplicate keeps the data alive if the cache drops the sample.
+        if (FAILED(hRes = m_pDirectSound->DuplicateSoundBuffer(master->GetBuffer(), &buffer)))
         {
             throw DirectSoundException(hRes);
         }
-        
-        // Fix for DirectSound 'issue': always change volume after duplication
-        buffer->SetVolume(0);
-        buffer->SetVolume(1);
     }
 
-    Sound* sound = new Sound(buffer, e, type);
+    Sound* sound = new Sound(buffer, stream, halfSize, e, type);
     sound->SetVolume(m_volume);
 
     size_t index = -1;
@@ -215,15 +351,33 @@ SoundEngine::Sound* SoundEngine::CreateSound(const SFXEvent& e, const string& sa
             throw DirectSoundException(hRes);
         }
 
-        DSBPOSITIONNOTIFY dpn;
-        dpn.dwOffset     = DSBPN_OFFSETSTOP;
-        dpn.hEventNotify = m_hEvents[index];
-        if (FAILED(hRes = notify->SetNotificationPositions(1, &dpn)))
+        // Streams are also notified at the start of each half, to refill the other
+        DSBPOSITIONNOTIFY dpn[3];
+        DWORD             nNotifies = 0;
+        if (stream != NULL)
+        {
+            dpn[nNotifies].dwOffset     = 0;
+            dpn[nNotifies].hEventNotify = m_hEvents[index];
+            nNotifies++;
+            dpn[nNotifies].dwOffset     = halfSize;
+            dpn[nNotifies].hEventNotify = m_hEvents[index];
+            nNotifies++;
+        }
+        dpn[nNotifies].dwOffset     = DSBPN_OFFSETSTOP;
+        dpn[nNotifies].hEventNotify = m_hEvents[index];
+        nNotifies++;
+
+        if (FAILED(hRes = notify->SetNotificationPositions(nNotifies, dpn)))
         {
             SAFE_RELEASE(notify);
             throw DirectSoundException(hRes);
         }
         SAFE_RELEASE(notify);
+
+        if (stream != NULL)
+        {
+            m_numStreams++;
+        }
     }
     catch (...)
     {
@@ -327,6 +481,10 @@ void SoundEngine::Play()
 
 void SoundEngine::DestroySound(size_t i)
 {
+    if (m_sounds[i] != NULL && m_sounds[i]->m_stream != NULL)
+    {
+        m_numStreams--;
+    }
     ReleaseEvent(i);
     delete m_sounds[i];
     m_sounds[i] = NULL;
@@ -343,12 +501,8 @@ void SoundEngine::Clear()
     m_sounds.clear();
     m_soundTypes.clear();
 
-    // Clear the cache
-    for (SoundCache::const_iterator p = m_cache.begin(); p != m_cache.end(); p++)
-    {
-        p->second->Release();
-    }
-    m_cache.clear();
+    m_cache.Clear();
+    m_numStreams = 0;
 
     // First two events are reserved, clear the rest
     for (size_t i = 2; i < m_hEvents.size(); i++)
@@ -365,6 +519,24 @@ void SoundEngine::Clear()
     ResumeCleanupThread();
 }
 
+void SoundEngine::Update()
+{
+    if (m_numStreams > 0)
+    {
+        // Read ahead for the streams; this happens here, on the main thread,
+        // because the asset files can't be read from multiple threads.
+        SuspendCleanupThread();
+        for (size_t i = 0; i < m_sounds.size(); i++)
+        {
+            if (m_sounds[i] != NULL && m_sounds[i]->m_stream != NULL)
+            {
+                m_sounds[i]->m_stream->Fill();
+            }
+        }
+        ResumeCleanupThread();
+    }
+}
+
 static DWORD WINAPI ThreadFunc(LPVOID lpParam)
 {
     ((SoundEngine*)lpParam)->ThreadFunc();
@@ -410,6 +582,7 @@ void SoundEngine::ResumeCleanupThread()
 }
 
 SoundEngine::SoundEngine(HWND hWnd)
+    : m_cache(CACHE_SIZE)
 {
     HRESULT hRes;
     if (FAILED(hRes = DirectSoundCreate(NULL, &m_pDirectSound, NULL)))
@@ -454,8 +627,9 @@ SoundEngine::SoundEngine(HWND hWnd)
         throw runtime_error("Unable to create thread");
     }
 
-    m_paused = false;
-    m_volume = 1.0f;
+    m_paused     = false;
+    m_volume     = 1.0f;
+    m_numStreams = 0;
 }
 
 SoundEngine::~SoundEngine()
@@ -2,6 +2,7 @@
 #define RENDERENGINE_DS8_H
 
 #include "Sound/SoundEngine.h"
+#include "Sound/SampleCache.h"
 #include <windows.h>
 #include <dsound.h>
 #include <stack>
@@ -15,7 +16,6 @@ class SoundEngine : public ISoundEngine
     friend DWORD WINAPI ThreadFunc(LPVOID);
 
     struct Sound;
-    typedef std::map<std::string, IDirectSoundBuffer*> SoundCache;
     enum SoundType { PRE, MAIN, POST };
 
     struct SoundTypeInfo;
@@ -28,11 +28,14 @@ class SoundEngine : public ISoundEngine
     std::vector<Sound*> m_sounds;
     SoundTypeMap        m_soundTypes;
     std::stack<size_t>  m_freeEvents;
-    SoundCache          m_cache;
+    SampleCache         m_cache;
+    size_t              m_numStreams;
     bool                m_paused;
     float               m_volume;
     const Camera*       m_camera;
 
+    IDirectSoundBuffer* CreateBuffer(const WaveFormat& format, DWORD size);
+
     size_t GetEvent();
     void   ReleaseEvent(size_t e);
     Sound* CreateSound(const SFXEvent& e, const std::string& sample, SoundType type);
@@ -49,6 +52,7 @@ class SoundEngine : public ISoundEngine
     void Pause();
     void Play();
     void Clear();
+    void Update();
 
     ~SoundEngine();
 public:
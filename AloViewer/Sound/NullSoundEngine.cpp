@@ -0,0 +1,158 @@
+#include "Assets/Assets.h"
+#include "Sound/NullSoundEngine.h"
+#include "General/Math.h"
+#include "General/Log.h"
+#include <algorithm>
+using namespace std;
+
+namespace Alamo {
+
+// Samples larger than this are streamed from the file instead of loaded
+static const unsigned long STREAM_THRESHOLD = 512 * 1024;
+
+// Bytes per block and number of blocks the streams read ahead
+static const size_t        STREAM_BLOCK_SIZE = 64 * 1024;
+static const size_t        STREAM_BLOCKS     = 4;
+
+void NullSoundEngine::PlaySoundEvent(const SFXEvent& e)
+{
+    const vector<string>* samples = NULL;
+         if (!e.preSamples.empty())  samples = &e.preSamples;
+    else if (!e.samples.empty())     samples = &e.samples;
+    else if (!e.postSamples.empty()) samples = &e.postSamples;
+
+    if (samples == NULL)
+    {
+        return;
+    }
+
+    int nInstances = 0;
+    for (size_t i = 0; i < m_sounds.size(); i++)
+    {
+        if (m_sounds[i].event == &e) nInstances++;
+    }
+    if (nInstances >= e.maxInstances)
+    {
+        return;
+    }
+
+    const string& name = (*samples)[GetRandom(0, (int)samples->size())];
+
+    Sound sound;
+    sound.event     = &e;
+    sound.sample    = m_cache.Find(name);
+    sound.remaining = -1.0f;
+    if (sound.sample == NULL)
+    {
+        ptr<IFile> file = Assets::LoadFile(name, "Data/Audio/SFX/");
+        if (file == NULL)
+        {
+            Log::WriteError("Unable to open sound file: %s\n", name.c_str());
+            return;
+        }
+
+        ptr<WaveFile> wav = new WaveFile(file);
+        if (wav->GetSize() > STREAM_THRESHOLD && wav->GetFormat().blockAlign > 0)
+        {
+            size_t align = wav->GetFormat().blockAlign;
+            sound.stream = new WaveStream(wav, e.playCount, max((size_t)1, STREAM_BLOCK_SIZE / align) * align, STREAM_BLOCKS);
+        }
+        else
+        {
+            sound.sample = new Sample(*wav);
+            m_cache.Insert(name, sound.sample);
+        }
+    }
+
+    if (sound.sample != NULL && e.playCount > 0)
+    {
+        const WaveFormat& format = sound.sample->GetFormat();
+        sound.remaining = (format.avgBytesPerSec > 0)
+            ? (float)sound.sample->GetSize() / format.avgBytesPerSec * e.playCount
+            : 0.0f;
+    }
+    m_sounds.push_back(sound);
+}
+
+void NullSoundEngine::Advance(float seconds)
+{
+    if (m_paused)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < m_sounds.size();)
+    {
+        Sound& sound = m_sounds[i];
+        bool   ended = false;
+        if (sound.stream != NULL)
+        {
+            // Drain the stream at its byte rate
+            const WaveFormat& format = sound.stream->GetFormat();
+            size_t size = (size_t)(seconds * format.avgBytesPerSec);
+            size -= size % format.blockAlign;
+            while (size > 0)
+            {
+                size_t read = sound.stream->Read(m_scratch, min(size, m_scratch.size()));
+                if (read == 0) break;
+                size -= read;
+            }
+            ended = sound.stream->AtEnd();
+        }
+        else if (sound.remaining >= 0.0f)
+        {
+            sound.remaining -= seconds;
+            ended = (sound.remaining <= 0.0f);
+        }
+
+        if (ended)
+        {
+            m_sounds.erase(m_sounds.begin() + i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void NullSoundEngine::Update()
+{
+    for (size_t i = 0; i < m_sounds.size(); i++)
+    {
+        if (m_sounds[i].stream != NULL)
+        {
+            m_sounds[i].stream->Fill();
+        }
+    }
+}
+
+void NullSoundEngine::SetMasterVolume(float volume)
+{
+    m_volume = volume;
+}
+
+void NullSoundEngine::Pause()
+{
+    m_paused = true;
+}
+
+void NullSoundEngine::Play()
+{
+    m_paused = false;
+}
+
+void NullSoundEngine::Clear()
+{
+    m_sounds.clear();
+    m_cache.Clear();
+}
+
+NullSoundEngine::NullSoundEngine(unsigned long cacheSize)
+    : m_cache(cacheSize), m_scratch(STREAM_BLOCK_SIZE)
+{
+    m_paused = false;
+    m_volume = 1.0f;
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef NULLSOUNDENGINE_H
+#define NULLSOUNDENGINE_H
+
+#include "Sound/SoundEngine.h"
+#include "Sound/SampleCache.h"
+#include "Sound/WaveStream.h"
+#include <vector>
+
+namespace Alamo {
+
+/* A sound engine without audio output.
+ * Samples are loaded, cached and streamed like with a real engine, but
+ * nothing is played; time only passes when Advance() is called. This makes it
+ * usable without a sound device.
+ */
+class NullSoundEngine : public ISoundEngine
+{
+    struct Sound
+    {
+        const SFXEvent* event;
+        ptr<Sample>     sample;
+        ptr<WaveStream> stream;
+        float           remaining;  // Seconds left for samples; less than zero for forever
+    };
+
+    std::vector<Sound> m_sounds;
+    SampleCache        m_cache;
+    Buffer<char>       m_scratch;
+    bool               m_paused;
+    float              m_volume;
+
+    ~NullSoundEngine() {}
+public:
+    void PlaySoundEvent(const SFXEvent& e);
+    void SetMasterVolume(float volume);
+    void Pause();
+    void Play();
+    void Clear();
+    void Update();
+
+    // Plays all sounds for @seconds; sounds that finish are removed
+    void Advance(float seconds);
+
+    size_t             GetNumSounds() const { return m_sounds.size(); }
+    const SampleCache& GetCache()     const { return m_cache; }
+
+    NullSoundEngine(unsigned long cacheSize);
+};
+
+}
+
+#endif
@@ -2,18 +2,54 @@
 #include "Assets/Assets.h"
 #include "General/Exceptions.h"
 #include "General/Log.h"
+#include "General/NameTable.h"
 #include "General/XML.h"
 #include <sstream>
 using namespace std;
 
 namespace Alamo {
 
-typedef map<string,SFXEvent> SFXEventMap;
+// The fields that USE_PRESET takes from the preset
+enum PresetField
+{
+    PF_PRIORITY       = 0x00001,
+    PF_MAX_INSTANCES  = 0x00002,
+    PF_PROBABILITY    = 0x00004,
+    PF_MIN_VOLUME     = 0x00008,
+    PF_MAX_VOLUME     = 0x00010,
+    PF_MIN_PITCH      = 0x00020,
+    PF_MAX_PITCH      = 0x00040,
+    PF_MIN_PREDELAY   = 0x00080,
+    PF_MAX_PREDELAY   = 0x00100,
+    PF_LOCALIZE       = 0x00200,
+    PF_PLAY_COUNT     = 0x00400,
+    PF_CHAINED_EVENT  = 0x00800,
+    PF_SEQUENTIALLY   = 0x01000,
+    PF_KILLS_PREVIOUS = 0x02000,
+    PF_SATURATION     = 0x04000,
+    PF_FADE_OUT       = 0x08000,
+    PF_FADE_IN        = 0x10000,
+};
+
+/*
+ * An event or preset as defined in the XML. Events only refer to their
+ * preset by name; the preset's fields are filled in when the event is
+ * first used, so events can use presets from any file.
+ */
+struct SFXEventInfo
+{
+    SFXEvent       event;
+    HashedString   preset;      // USE_PRESET, if any
+    unsigned long  fields;      // The PresetFields set after USE_PRESET
+    int            state;       // 0: unresolved, 1: resolving, 2: resolved
+};
+
+typedef NameTable<SFXEventInfo> SFXEventTable;
 
 static const char* XML_PREFIX = "Data/XML/";
 
-static SFXEventMap m_events;
-static SFXEventMap m_presets;
+static SFXEventTable m_events;
+static SFXEventTable m_presets;
 
 static bool equals(const char* s1, const char* s2)
 {
@@ -75,31 +111,52 @@ static SFXEvent MakeDefaultSFXEvent()
     return e;
 }
 
-static void CopyPresetData(SFXEvent& e, const char* name)
+static void ResolveSFXEvent(SFXEventInfo& info)
 {
-    // Find and use the preset
-    SFXEventMap::const_iterator p = m_presets.find(Uppercase(name));
-    if (p != m_presets.end()) {
-        const SFXEvent& preset = p->second;
-
-        e.type         = preset.type;
-        e.priority     = preset.priority;
-        e.maxInstances = preset.maxInstances;
-        e.probability  = preset.probability;
-        e.volume       = preset.volume;
-        e.pitch        = preset.pitch;
-        e.predelay     = preset.predelay;
-        e.localize     = preset.localize;
-        e.playCount    = preset.playCount;
-        e.chainedSFXEvent          = preset.chainedSFXEvent;
-        e.playSequentially         = preset.playSequentially;
-        e.killsPreviousObjectSFX   = preset.killsPreviousObjectSFX;
-        e.volumeSaturationDistance = preset.volumeSaturationDistance;
-        e.loopFadeOutSeconds       = preset.loopFadeOutSeconds;
-        e.loopFadeInSeconds        = preset.loopFadeInSeconds;
-    } else {
-        Log::WriteError("Invalid SFX preset \"%s\"\n", name);
+    if (info.state == 2)
+    {
+        return;
+    }
+
+    SFXEvent& e = info.event;
+    if (!info.preset.str.empty())
+    {
+        SFXEventInfo* p = m_presets.find(info.preset);
+        if (p == NULL) {
+            Log::WriteError("Invalid SFX preset \"%s\"\n", info.preset.str.c_str());
+        } else if (p->state == 1) {
+            Log::WriteError("SFX preset \"%s\" uses itself\n", info.preset.str.c_str());
+        } else {
+            info.state = 1;
+            ResolveSFXEvent(*p);
+
+            // Take everything from the preset that wasn't set after USE_PRESET
+            const SFXEvent& preset = p->event;
+            unsigned long   fields = info.fields;
+            if (~fields & PF_PRIORITY)       e.priority     = preset.priority;
+            if (~fields & PF_MAX_INSTANCES)  e.maxInstances = preset.maxInstances;
+            if (~fields & PF_PROBABILITY)    e.probability  = preset.probability;
+            if (~fields & PF_MIN_VOLUME)     e.volume.min   = preset.volume.min;
+            if (~fields & PF_MAX_VOLUME)     e.volume.max   = preset.volume.max;
+            if (~fields & PF_MIN_PITCH)      e.pitch.min    = preset.pitch.min;
+            if (~fields & PF_MAX_PITCH)      e.pitch.max    = preset.pitch.max;
+            if (~fields & PF_MIN_PREDELAY)   e.predelay.min = preset.predelay.min;
+            if (~fields & PF_MAX_PREDELAY)   e.predelay.max = preset.predelay.max;
+            if (~fields & PF_LOCALIZE)       e.localize     = preset.localize;
+            if (~fields & PF_PLAY_COUNT)     e.playCount    = preset.playCount;
+            if (~fields & PF_CHAINED_EVENT)  e.chainedSFXEvent          = preset.chainedSFXEvent;
+            if (~fields & PF_SEQUENTIALLY)   e.playSequentially         = preset.playSequentially;
+            if (~fields & PF_KILLS_PREVIOUS) e.killsPreviousObjectSFX   = preset.killsPreviousObjectSFX;
+            if (~fields & PF_SATURATION)     e.volumeSaturationDistance = preset.volumeSaturationDistance;
+            if (~fields & PF_FADE_OUT)       e.loopFadeOutSeconds       = preset.loopFadeOutSeconds;
+            if (~fields & PF_FADE_IN)        e.loopFadeInSeconds        = preset.loopFadeInSeconds;
+        }
     }
+
+    // Sanitize and normalize
+    e.volume.normalize();
+    e.pitch.normalize();
+    info.state = 2;
 }
 
 static void ParseSampleList(const string& data, vector<string>& samples)
@@ -117,9 +174,19 @@ static void ParseSampleList(const string& data, vector<string>& samples)
 
 static void ParseSFXEvent(const XMLNode* ent, const char* name)
 {
-    SFXEvent e = MakeDefaultSFXEvent();
-    
-    bool preset = false, is2D = false, is3D = false, isGUI = false;
+    // Parse the event in place; the tables hand out pointers to their events
+    const XMLNode* isPreset = ent->findChild("IS_PRESET");
+    bool           preset   = (isPreset != NULL && isPreset->getData() != NULL && ParseBool(isPreset->getData(), false));
+
+    SFXEventInfo& info = preset ? m_presets[name] : m_events[name];
+    info.event  = MakeDefaultSFXEvent();
+    info.preset = HashedString();
+    info.fields = 0;
+    info.state  = 0;
+
+    SFXEvent&      e      = info.event;
+    unsigned long& fields = info.fields;
+    bool is2D = false, is3D = false, isGUI = false;
     bool isUnitResponseVO = false, isAmbientVO = false, isHudVO = false;
 
     for (size_t i = 0; i < ent->getNumChildren(); i++)
@@ -128,69 +195,48 @@ static void ParseSFXEvent(const XMLNode* ent, const char* name)
         const char*    data = node->getData();
         if (data != NULL)
         {
-                 if (node->equals("IS_PRESET"))           preset           = ParseBool(data, false);
-            else if (node->equals("IS_2D"))               is2D             = ParseBool(data, false);
+                 if (node->equals("IS_2D"))               is2D             = ParseBool(data, false);
             else if (node->equals("IS_3D"))               is3D             = ParseBool(data, false);
             else if (node->equals("IS_GUI"))              isGUI            = ParseBool(data, false);
             else if (node->equals("IS_UNIT_RESPONSE_VO")) isUnitResponseVO = ParseBool(data, false);
             else if (node->equals("IS_AMBIENT_VO"))       isAmbientVO      = ParseBool(data, false);
             else if (node->equals("IS_HUD_VO"))           isHudVO          = ParseBool(data, false);
-            else if (node->equals("MAX_INSTANCES")) e.maxInstances = max(1, ParseInt(data, e.maxInstances) );
-            else if (node->equals("PRIORITY"))      e.priority     = max(1, ParseInt(data, e.priority) );
-            else if (node->equals("PROBABILITY"))   e.probability  = max(0, min(1, ParseFloat(data, 100) / 100.0f));
-            else if (node->equals("MIN_VOLUME"))    e.volume.min   = max(0, min(1, ParseFloat(data, 100) / 100.0f));
-            else if (node->equals("MAX_VOLUME"))    e.volume.max   = max(0, min(1, ParseFloat(data, 100) / 100.0f));
-            else if (node->equals("MIN_PITCH"))     e.pitch.min    = max(0, min(1, ParseFloat(data, 100) / 100.0f));
-            else if (node->equals("MAX_PITCH"))     e.pitch.max    = max(0, min(1, ParseFloat(data, 100) / 100.0f));
-            else if (node->equals("MIN_PREDELAY"))  e.predelay.min = max(0, ParseFloat(data, 0) / 1000.0f);
-            else if (node->equals("MAX_PREDELAY"))  e.predelay.max = max(0, ParseFloat(data, 0) / 1000.0f);
-            else if (node->equals("PLAY_COUNT"))    e.playCount    = ParseInt(data, 1);
-            else if (node->equals("LOCALIZE"))                   e.localize                 = ParseBool(data, e.localize);
-            else if (node->equals("KILLS_PREVIOUS_OBJECT_SFX"))  e.killsPreviousObjectSFX   = ParseBool(data, e.localize);
-            else if (node->equals("PLAY_SEQUENTIALLY"))          e.playSequentially         = ParseBool(data, e.localize);
-            else if (node->equals("VOLUME_SATURATION_DISTANCE")) e.volumeSaturationDistance = ParseFloat(data, 0);
-            else if (node->equals("LOOP_FADE_IN_SECONDS"))       e.loopFadeOutSeconds       = max(0, ParseFloat(data, 0));
-            else if (node->equals("LOOP_FADE_OUT_SECONDS"))      e.loopFadeInSeconds        = max(0, ParseFloat(data, 0));
-            else if (node->equals("USE_PRESET"))       CopyPresetData(e, data);
+            else if (node->equals("MAX_INSTANCES")) { e.maxInstances = max(1, ParseInt(data, e.maxInstances) );               fields |= PF_MAX_INSTANCES; }
+            else if (node->equals("PRIORITY"))      { e.priority     = max(1, ParseInt(data, e.priority) );                   fields |= PF_PRIORITY;      }
+            else if (node->equals("PROBABILITY"))   { e.probability  = max(0, min(1, ParseFloat(data, 100) / 100.0f));        fields |= PF_PROBABILITY;   }
+            else if (node->equals("MIN_VOLUME"))    { e.volume.min   = max(0, min(1, ParseFloat(data, 100) / 100.0f));        fields |= PF_MIN_VOLUME;    }
+            else if (node->equals("MAX_VOLUME"))    { e.volume.max   = max(0, min(1, ParseFloat(data, 100) / 100.0f));        fields |= PF_MAX_VOLUME;    }
+            else if (node->equals("MIN_PITCH"))     { e.pitch.min    = max(0, min(1, ParseFloat(data, 100) / 100.0f));        fields |= PF_MIN_PITCH;     }
+            else if (node->equals("MAX_PITCH"))     { e.pitch.max    = max(0, min(1, ParseFloat(data, 100) / 100.0f));        fields |= PF_MAX_PITCH;     }
+            else if (node->equals("MIN_PREDELAY"))  { e.predelay.min = max(0, ParseFloat(data, 0) / 1000.0f);                 fields |= PF_MIN_PREDELAY;  }
+            else if (node->equals("MAX_PREDELAY"))  { e.predelay.max = max(0, ParseFloat(data, 0) / 1000.0f);                 fields |= PF_MAX_PREDELAY;  }
+            else if (node->equals("PLAY_COUNT"))    { e.playCount    = ParseInt(data, 1);                                     fields |= PF_PLAY_COUNT;    }
+            else if (node->equals("LOCALIZE"))                   { e.localize                 = ParseBool(data, e.localize);  fields |= PF_LOCALIZE;       }
+            else if (node->equals("KILLS_PREVIOUS_OBJECT_SFX"))  { e.killsPreviousObjectSFX   = ParseBool(data, e.localize);  fields |= PF_KILLS_PREVIOUS; }
+            else if (node->equals("PLAY_SEQUENTIALLY"))          { e.playSequentially         = ParseBool(data, e.localize);  fields |= PF_SEQUENTIALLY;   }
+            else if (node->equals("VOLUME_SATURATION_DISTANCE")) { e.volumeSaturationDistance = ParseFloat(data, 0);          fields |= PF_SATURATION;     }
+            else if (node->equals("LOOP_FADE_IN_SECONDS"))       { e.loopFadeOutSeconds       = max(0, ParseFloat(data, 0));  fields |= PF_FADE_OUT;       }
+            else if (node->equals("LOOP_FADE_OUT_SECONDS"))      { e.loopFadeInSeconds        = max(0, ParseFloat(data, 0));  fields |= PF_FADE_IN;        }
+            else if (node->equals("USE_PRESET"))       { info.preset = data; fields = 0; }
             else if (node->equals("SAMPLES"))          ParseSampleList(data, e.samples);
             else if (node->equals("PRE_SAMPLES"))      ParseSampleList(data, e.preSamples);
             else if (node->equals("POST_SAMPLES"))     ParseSampleList(data, e.postSamples);
-            else if (node->equals("CHAINED_SFXEVENT")) e.chainedSFXEvent = data;
+            else if (node->equals("CHAINED_SFXEVENT")) { e.chainedSFXEvent = data; fields |= PF_CHAINED_EVENT; }
             // We don't care about these
             //else if (name == "TEXT_ID");
             //else if (name == "OVERLAP_TEST");
         }
     }
     
-    // Sanitize and normalize
-    e.volume.normalize();
-    e.pitch.normalize();
+    // The type is never taken from the preset
     e.type = isGUI ? SFXEvent::SFX_GUI : (is3D ? SFXEvent::SFX_3D : SFXEvent::SFX_2D);
-    
-    if (preset) m_presets[Uppercase(name)] = e;
-    else        m_events [Uppercase(name)] = e;
 }
 
-static void ParseSFXEventFile(const string& filename)
+static void ParseSFXEventTree(const XMLTree& xml)
 {
-    ptr<IFile> file = Assets::LoadFile(filename, XML_PREFIX);
-    if (file != NULL)
+    const XMLNode* root = xml.getRoot();
+    if (root != NULL)
     {
-        // Parse file
-        XMLTree xml;
-        try
-        {
-            xml.parse(file);
-        }
-        catch (ParseException& e)
-        {
-            // Can't parse XML
-            Log::WriteError("Parse error in %s%s: %s\n", XML_PREFIX, filename.c_str(), e.what());
-            return;
-        }
-
-        // Parse XML tree
-        const XMLNode* root = xml.getRoot();
         for (size_t i = 0; i < root->getNumChildren(); i++)
         {
             const XMLNode* ent = root->getChild(i);
@@ -222,10 +268,33 @@ void SFXEvents::Initialize()
             return;
         }
 
+        // Open all event files, then parse them in parallel
         const XMLNode* root = xml.getRoot();
+        vector<string>      filenames;
+        vector< ptr<IFile> > files;
         for (size_t i = 0; i < root->getNumChildren(); i++)
         {
-            ParseSFXEventFile( root->getChild(i)->getData() );
+            const char* data = root->getChild(i)->getData();
+            if (data != NULL)
+            {
+                filenames.push_back(data);
+                files.push_back(Assets::LoadFile(data, XML_PREFIX));
+            }
+        }
+
+        XMLTreeList trees;
+        trees.parse(files);
+
+        // Presets can be used by later files, so process the trees in order
+        for (size_t i = 0; i < trees.size(); i++)
+        {
+            if (trees.getError(i) != NULL)
+            {
+                // Can't parse XML
+                Log::WriteError("Parse error in %s%s: %s\n", XML_PREFIX, filenames[i].c_str(), trees.getError(i));
+                continue;
+            }
+            ParseSFXEventTree(trees[i]);
         }
     }
 }   
@@ -236,10 +305,15 @@ void SFXEvents::Uninitialize()
     m_presets.clear();
 }
 
-const SFXEvent* SFXEvents::GetEvent(const string& name)
+const SFXEvent* SFXEvents::GetEvent(const HashedString& name)
 {
-    SFXEventMap::const_iterator p = m_events.find(Uppercase(name));
-    return (p != m_events.end()) ? &p->second : NULL;
+    SFXEventInfo* info = m_events.find(name);
+    if (info == NULL)
+    {
+        return NULL;
+    }
+    ResolveSFXEvent(*info);
+    return &info->event;
 }
 
 }
\ No newline at end of file
@@ -35,7 +35,8 @@ namespace SFXEvents {
 void Initialize();
 void Uninitialize();
 
-const SFXEvent* GetEvent(const std::string& name);
+// Returns the event with the specified (case-insensitive) name, or NULL
+const SFXEvent* GetEvent(const HashedString& name);
 
 }
 }
@@ -0,0 +1,62 @@
+#include "Sound/SampleCache.h"
+#include "General/Exceptions.h"
+using namespace std;
+
+namespace Alamo {
+
+Sample::Sample(WaveFile& wave)
+    : m_format(wave.GetFormat()), m_data(wave.GetSize())
+{
+    wave.Rewind();
+    if (wave.Read(m_data, m_data.size()) != m_data.size())
+    {
+        throw ReadException();
+    }
+}
+
+ptr<Sample> SampleCache::Find(const string& name)
+{
+    EntryMap::iterator p = m_index.find(name);
+    if (p == m_index.end())
+    {
+        return NULL;
+    }
+
+    // Move it to the front
+    m_entries.splice(m_entries.begin(), m_entries, p->second);
+    return p->second->sample;
+}
+
+void SampleCache::Insert(const string& name, ptr<Sample> sample)
+{
+    unsigned long size = sample->GetSize();
+    if (size > m_capacity || m_index.find(name) != m_index.end())
+    {
+        return;
+    }
+
+    // Drop the least recently used samples until it fits
+    while (m_size + size > m_capacity)
+    {
+        Entry& last = m_entries.back();
+        m_size -= last.sample->GetSize();
+        m_index.erase(last.name);
+        m_entries.pop_back();
+    }
+
+    Entry entry;
+    entry.name   = name;
+    entry.sample = sample;
+    m_entries.push_front(entry);
+    m_index[name] = m_entries.begin();
+    m_size += size;
+}
+
+void SampleCache::Clear()
+{
+    m_index.clear();
+    m_entries.clear();
+    m_size = 0;
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include "Sound/WaveFile.h"
+#include <list>
+#include <map>
+#include <string>
+
+namespace Alamo {
+
+// The entire PCM data of a WAV file, in memory
+class Sample : public IObject
+{
+    WaveFormat   m_format;
+    Buffer<char> m_data;
+    ptr<IObject> m_engineData;
+
+    ~Sample() {}
+public:
+    const WaveFormat& GetFormat() const { return m_format; }
+    const char*       GetData()   const { return m_data; }
+    unsigned long     GetSize()   const { return (unsigned long)m_data.size(); }
+
+    // Data the sound engine keeps with the sample, such as a sound buffer
+    // with the PCM data. It's released with the sample, so once the cache
+    // drops the sample.
+    IObject* GetEngineData() const            { return m_engineData; }
+    void     SetEngineData(ptr<IObject> data) { m_engineData = data; }
+
+    // Reads all of the file's PCM data
+    Sample(WaveFile& wave);
+};
+
+/* Keeps recently played samples in memory, up to a total size in bytes.
+ * When a new sample doesn't fit, the least recently used ones are dropped.
+ * Sounds that are still playing a dropped sample keep their reference.
+ */
+class SampleCache
+{
+    struct Entry
+    {
+        std::string name;
+        ptr<Sample> sample;
+    };
+
+    typedef std::list<Entry>                           EntryList;
+    typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+    EntryList     m_entries;    // Most recently used first
+    EntryMap      m_index;
+    unsigned long m_size;
+    unsigned long m_capacity;
+
+public:
+    // Returns the sample and marks it as used, or NULL if it's not cached
+    ptr<Sample> Find(const std::string& name);
+
+    // Adds a sample, dropping others to make room.
+    // Samples larger than the entire cache aren't added.
+    void Insert(const std::string& name, ptr<Sample> sample);
+
+    void Clear();
+
+    unsigned long GetSize()     const { return m_size;     }
+    unsigned long GetCapacity() const { return m_capacity; }
+
+    SampleCache(unsigned long capacity) : m_size(0), m_capacity(capacity) {}
+};
+
+}
+
+#endif
@@ -16,6 +16,9 @@ public:
     virtual void Pause() = 0;
     virtual void Play() = 0;
     virtual void Clear() = 0;
+
+    // Called periodically from the main thread, e.g. to read ahead for streamed sounds
+    virtual void Update() = 0;
 };
 
 }
@@ -1,6 +1,7 @@
 #include "General/ExactTypes.h"
 #include "General/Exceptions.h"
 #include "Sound/WaveFile.h"
+#include <algorithm>
 using namespace std;
 
 namespace Alamo {
@@ -77,13 +78,12 @@ WaveFile::WaveFile(ptr<IFile> file)
     }
     file->skip(letohl(chunk.size) - sizeof(WAVEFORMATEX_LE));
 
-    m_format.wFormatTag      = letohs(fmt.wFormatTag);
-    m_format.nChannels       = letohs(fmt.nChannels);
-    m_format.nSamplesPerSec  = letohl(fmt.nSamplesPerSec);
-    m_format.nAvgBytesPerSec = letohl(fmt.nAvgBytesPerSec);
-    m_format.nBlockAlign     = letohs(fmt.nBlockAlign);
-    m_format.wBitsPerSample  = letohs(fmt.wBitsPerSample);
-    m_format.cbSize          = 0;
+    m_format.formatTag      = letohs(fmt.wFormatTag);
+    m_format.channels       = letohs(fmt.nChannels);
+    m_format.samplesPerSec  = letohl(fmt.nSamplesPerSec);
+    m_format.avgBytesPerSec = letohl(fmt.nAvgBytesPerSec);
+    m_format.blockAlign     = letohs(fmt.nBlockAlign);
+    m_format.bitsPerSample  = letohs(fmt.wBitsPerSample);
 
     // Find data chunk
     do
@@ -99,19 +99,26 @@ WaveFile::WaveFile(ptr<IFile> file)
         }
     } while (letohl(chunk.ID) != DATA_ID);
 
-    // Read data chunk
-    m_size = letohl(chunk.size);
-    m_data = new char[m_size];
-    if (file->read(m_data, m_size) != m_size)
-    {
-        delete[] m_data;
-        throw ReadException();
-    }
+    // Remember where the data chunk is; it's read as it's needed
+    m_file     = file;
+    m_start    = file->tell();
+    m_size     = min((unsigned long)letohl(chunk.size), (unsigned long)(file->size() - m_start));
+    m_position = 0;
 }
 
-WaveFile::~WaveFile()
+size_t WaveFile::Read(void* buffer, size_t size)
 {
-    delete[] m_data;
+    size = min(size, (size_t)(m_size - m_position));
+    if (size > 0)
+    {
+        m_file->seek(m_start + m_position);
+        if (m_file->read(buffer, size) != size)
+        {
+            throw ReadException();
+        }
+        m_position += (unsigned long)size;
+    }
+    return size;
 }
 
 }
\ No newline at end of file
@@ -2,27 +2,49 @@
 #define WAVEFILE_H
 
 #include "Assets/Files.h"
-#include <windows.h>
-#include <mmreg.h>
 
 namespace Alamo {
 
-// Class for reading WAV files
+// Format of the PCM data in a WAV file; the same fields as a WAVEFORMATEX
+struct WaveFormat
+{
+    unsigned short formatTag;
+    unsigned short channels;
+    unsigned long  samplesPerSec;
+    unsigned long  avgBytesPerSec;
+    unsigned short blockAlign;
+    unsigned short bitsPerSample;
+};
+
+/* Class for reading WAV files.
+ * Only the header is read on construction; the PCM data is read from the
+ * file as it's needed, so large files can be played without loading them.
+ */
 class WaveFile : public IObject
 {
-    WAVEFORMATEX  m_format;
-    char*         m_data;
-    unsigned long m_size;
+    ptr<IFile>    m_file;
+    WaveFormat    m_format;
+    unsigned long m_start;      // Offset of the PCM data in the file
+    unsigned long m_size;       // Size of the PCM data
+    unsigned long m_position;   // Read position in the PCM data
 
-    ~WaveFile();
+    ~WaveFile() {}
 public:
-    WAVEFORMATEX& GetFormat()     { return m_format; }
-    const char*   GetData() const { return m_data;   }
-    unsigned long GetSize() const { return m_size;   }
+    const WaveFormat& GetFormat()   const { return m_format;   }
+    unsigned long     GetSize()     const { return m_size;     }
+    unsigned long     GetPosition() const { return m_position; }
+
+    /* Reads PCM data from the current position.
+     * Returns the number of bytes read; less than @size at the end.
+     */
+    size_t Read(void* buffer, size_t size);
+
+    // Moves back to the start of the PCM data
+    void Rewind() { m_position = 0; }
 
     WaveFile(ptr<IFile> file);
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,66 @@
+#include "Sound/WaveStream.h"
+#include <algorithm>
+using namespace std;
+
+namespace Alamo {
+
+size_t WaveStream::ReadFile(size_t size)
+{
+    size_t total = 0;
+    while (total < size && !m_ended)
+    {
+        // Read up to the end of the ring, then wrap around
+        size_t end   = (m_start + m_used) % m_ring.size();
+        size_t chunk = min(size - total, m_ring.size() - end);
+        size_t n     = m_wave->Read(m_ring + end, chunk);
+        m_used += n;
+        total  += n;
+
+        if (n < chunk)
+        {
+            // End of the file; start over or stop
+            if (m_loops == 0 || m_wave->GetSize() == 0) {
+                m_ended = true;
+            } else {
+                if (m_loops > 0) m_loops--;
+                m_wave->Rewind();
+            }
+        }
+    }
+    return total;
+}
+
+void WaveStream::Fill()
+{
+    while (!m_ended && m_ring.size() - m_used >= m_blockSize)
+    {
+        ReadFile(m_blockSize);
+    }
+}
+
+size_t WaveStream::Read(void* buffer, size_t size)
+{
+    size = min(size, m_used);
+
+    // Copy up to the end of the ring, then wrap around
+    size_t first = min(size, m_ring.size() - m_start);
+    memcpy(buffer, m_ring + m_start, first);
+    memcpy((char*)buffer + first, m_ring, size - first);
+
+    m_start = (m_start + size) % m_ring.size();
+    m_used -= size;
+    return size;
+}
+
+WaveStream::WaveStream(ptr<WaveFile> wave, int playCount, size_t blockSize, size_t numBlocks)
+    : m_wave(wave), m_ring(blockSize * numBlocks), m_blockSize(blockSize)
+{
+    m_start = 0;
+    m_used  = 0;
+    m_loops = (playCount > 0) ? playCount - 1 : -1;
+    m_ended = false;
+    m_wave->Rewind();
+    Fill();
+}
+
+}
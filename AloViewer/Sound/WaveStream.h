@@ -0,0 +1,56 @@
+#ifndef WAVESTREAM_H
+#define WAVESTREAM_H
+
+#include "Sound/WaveFile.h"
+
+namespace Alamo {
+
+/* Streams the PCM data of a WAV file in fixed-size blocks.
+ * A ring buffer of several blocks is kept filled ahead of playback, so the
+ * file is read in large pieces before the data is needed, and the memory
+ * used doesn't depend on the length of the file.
+ *
+ * Fill() and Read() may be called from different threads, but not at the
+ * same time.
+ */
+class WaveStream : public IObject
+{
+    ptr<WaveFile> m_wave;
+    Buffer<char>  m_ring;
+    size_t        m_blockSize;
+    size_t        m_start;      // Ring offset of the first unread byte
+    size_t        m_used;       // Number of unread bytes in the ring
+    int           m_loops;      // Times left to restart the file; -1 for forever
+    bool          m_ended;      // Everything has been read from the file
+
+    // Reads up to @size bytes from the file into the ring, at its end
+    size_t ReadFile(size_t size);
+
+    ~WaveStream() {}
+public:
+    const WaveFormat& GetFormat()    const { return m_wave->GetFormat(); }
+    size_t            GetBlockSize() const { return m_blockSize; }
+
+    // Has all of the data been read?
+    bool AtEnd() const { return m_ended && m_used == 0; }
+
+    // Reads from the file until the ring buffer has no room for another block
+    void Fill();
+
+    /* Copies data out of the ring buffer.
+     * Returns the number of bytes copied; less than @size if the ring buffer
+     * runs empty, either because it needs filling or because of AtEnd().
+     */
+    size_t Read(void* buffer, size_t size);
+
+    /* Creates the stream and fills the ring buffer.
+     *  @playCount: times to play the file; zero or less loops forever.
+     *  @blockSize: bytes per block, a multiple of the format's block alignment.
+     *  @numBlocks: number of blocks in the ring buffer.
+     */
+    WaveStream(ptr<WaveFile> wave, int playCount, size_t blockSize, size_t numBlocks);
+};
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+//
+// Test of the particle emitter ordering and batching.
+//
+// ParticleBatches doesn't depend on the render API, so the emitters here are
+// plain structs. Prints the failed checks and returns non-zero if any failed.
+//
+#include "RenderEngine/ParticleBatches.h"
+#include "Tests/TestUtils.h"
+#include <vector>
+using namespace std;
+using namespace Alamo;
+
+struct TestEmitter
+{
+    int   state;    // Emitters with the same state can be batched
+    float depth;
+    bool  zsort;
+    int   index;    // Order of adding
+};
+
+static bool CanBatch(const void* first, const void* next)
+{
+    return static_cast<const TestEmitter*>(first)->state == static_cast<const TestEmitter*>(next)->state;
+}
+
+// The effect and texture only need to be distinct addresses
+static const char g_states[4][2] = {{0}};
+
+static void Add(ParticleBatches& batches, TestEmitter& emitter, int state, float depth, bool zsort, size_t quads = 1)
+{
+    emitter.state = state;
+    emitter.depth = depth;
+    emitter.zsort = zsort;
+    batches.Add(&emitter, quads, &g_states[state][0], &g_states[state][1], depth, zsort);
+}
+
+static const TestEmitter& GetEmitter(const ParticleBatches& batches, size_t i)
+{
+    return *static_cast<const TestEmitter*>(batches.GetItem(i).emitter);
+}
+
+static void TestDepthKey()
+{
+    static const float depths[] = { -1e30f, -100.0f, -1.0f, -0.5f, -1e-30f, 0.0f, 1e-30f, 0.5f, 1.0f, 100.0f, 1e30f };
+    for (size_t i = 1; i < sizeof depths / sizeof *depths; i++)
+    {
+        CHECK(ParticleBatches::GetDepthKey(depths[i - 1]) < ParticleBatches::GetDepthKey(depths[i]));
+    }
+    CHECK(ParticleBatches::GetDepthKey(-0.0f) <= ParticleBatches::GetDepthKey(0.0f));
+}
+
+static void TestOrder()
+{
+    ParticleBatches batches;
+    vector<TestEmitter> emitters(8);
+
+    // Z-sorted emitters, added in no particular order and nearer than the others
+    Add(batches, emitters[0], 2,  5.0f, true);
+    Add(batches, emitters[1], 3, -3.0f, true);
+    Add(batches, emitters[2], 2, 10.0f, true);
+    Add(batches, emitters[3], 3,  0.0f, true);
+
+    // Unsorted emitters
+    Add(batches, emitters[4], 1, 50.0f, false);
+    Add(batches, emitters[5], 0, 90.0f, false);
+    Add(batches, emitters[6], 1, 20.0f, false);
+    Add(batches, emitters[7], 0, 70.0f, false);
+    batches.Sort();
+
+    CHECK(batches.GetNumItems() == emitters.size());
+
+    // The z-sorted emitters come last
+    for (size_t i = 0; i < 4; i++)
+    {
+        CHECK(!GetEmitter(batches, i).zsort);
+        CHECK(GetEmitter(batches, i + 4).zsort);
+    }
+
+    // The unsorted emitters are grouped on their states, then on depth
+    for (size_t i = 1; i < 4; i++)
+    {
+        const TestEmitter& prev = GetEmitter(batches, i - 1);
+        const TestEmitter& cur  = GetEmitter(batches, i);
+        CHECK(prev.state != cur.state || prev.depth < cur.depth);
+    }
+    CHECK(GetEmitter(batches, 0).state == GetEmitter(batches, 1).state);
+    CHECK(GetEmitter(batches, 2).state == GetEmitter(batches, 3).state);
+
+    // The z-sorted emitters are in depth order, whatever their states
+    for (size_t i = 5; i < 8; i++)
+    {
+        CHECK(GetEmitter(batches, i - 1).depth < GetEmitter(batches, i).depth);
+    }
+}
+
+static void TestStable()
+{
+    // Two groups of emitters with equal keys, interleaved with emitters at
+    // other depths so the sort has to move them about
+    ParticleBatches     batches;
+    vector<TestEmitter> emitters(600);
+    for (size_t i = 0; i < emitters.size(); i++)
+    {
+        emitters[i].index = (int)i;
+        if (i % 3 == 0) {
+            Add(batches, emitters[i], 1, 1.0f, false);
+        } else if (i % 3 == 1) {
+            Add(batches, emitters[i], 2, 1.0f, true);
+        } else {
+            Add(batches, emitters[i], 0, (float)(emitters.size() - i), (i % 2) == 0);
+        }
+    }
+    batches.Sort();
+
+    int last[3] = { -1, -1, -1 };
+    for (size_t i = 0; i < batches.GetNumItems(); i++)
+    {
+        const TestEmitter& emitter = GetEmitter(batches, i);
+        if (emitter.index % 3 != 2)
+        {
+            CHECK(emitter.index > last[emitter.index % 3]);
+            last[emitter.index % 3] = emitter.index;
+        }
+    }
+    CHECK(last[0] == 597 && last[1] == 598);
+}
+
+static void TestBatches()
+{
+    ParticleBatches     batches;
+    vector<TestEmitter> emitters(7);
+    size_t              quads;
+
+    // Exactly fills a batch
+    Add(batches, emitters[0], 0, 1.0f, false, 10000);
+    Add(batches, emitters[1], 0, 2.0f, false, ParticleBatches::MAX_BATCH_QUADS - 10000);
+    // One over
+    Add(batches, emitters[2], 0, 3.0f, false, 10000);
+    Add(batches, emitters[3], 0, 4.0f, false, ParticleBatches::MAX_BATCH_QUADS - 10000 + 1);
+    // Other states
+    Add(batches, emitters[4], 1, 5.0f, false, 1);
+    Add(batches, emitters[5], 1, 6.0f, false, 1);
+    Add(batches, emitters[6], 2, 1.0f, false, 1);
+    batches.Sort();
+
+    CHECK(ParticleBatches::MAX_BATCH_QUADS == 16384);
+    CHECK(batches.GetBatchEnd(0, CanBatch, quads) == 2);
+    CHECK(quads == 16384);
+    CHECK(batches.GetBatchEnd(2, CanBatch, quads) == 3);
+    CHECK(quads == 10000);
+    CHECK(batches.GetBatchEnd(3, CanBatch, quads) == 4);
+    CHECK(quads == 6385);
+    CHECK(batches.GetBatchEnd(4, CanBatch, quads) == 6);
+    CHECK(quads == 2);
+    CHECK(batches.GetBatchEnd(6, CanBatch, quads) == 7);
+    CHECK(quads == 1);
+
+    // An emitter larger than a batch still gets one of its own
+    batches.Clear();
+    CHECK(batches.IsEmpty());
+    Add(batches, emitters[0], 0, 1.0f, false, 20000);
+    Add(batches, emitters[1], 0, 2.0f, false, 1);
+    batches.Sort();
+    CHECK(batches.GetBatchEnd(0, CanBatch, quads) == 1);
+    CHECK(quads == 20000);
+}
+
+int main()
+{
+    static const TestFunction tests[] = {
+        TestDepthKey,
+        TestOrder,
+        TestStable,
+        TestBatches,
+    };
+    return RunTests(tests);
+}
@@ -0,0 +1,256 @@
+//
+// Headless test of the sound streaming and caching.
+//
+// WAV files are generated in memory and served through Assets::LoadFile(),
+// so neither a sound device nor game data is needed. Prints the failed checks
+// and returns non-zero if any failed.
+//
+#include "Assets/Assets.h"
+#include "Sound/NullSoundEngine.h"
+#include "Tests/TestUtils.h"
+#include "General/ExactTypes.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+using namespace std;
+using namespace Alamo;
+
+//
+// In-memory files
+//
+class TestFile : public IFile
+{
+    vector<char>  m_data;
+    unsigned long m_offset;
+
+    ~TestFile() {}
+public:
+    bool          eof()  const { return m_offset == m_data.size(); }
+    size_t        size() const { return m_data.size(); }
+    uint64_t      stamp() const { return 0; }
+    unsigned long tell() const { return m_offset; }
+    unsigned long seek(unsigned long pos) { return m_offset = min(pos, (unsigned long)m_data.size()); }
+    unsigned long skip(long count)        { return seek(m_offset + count); }
+
+    size_t read(void* buffer, size_t size)
+    {
+        size = read(m_offset, buffer, size);
+        m_offset += (unsigned long)size;
+        return size;
+    }
+
+    size_t read(unsigned long offset, void* buffer, size_t size)
+    {
+        size = min(size, m_data.size() - min((size_t)offset, m_data.size()));
+        if (size > 0) memcpy(buffer, &m_data[offset], size);
+        return size;
+    }
+
+    size_t write(const void* buffer, size_t size) { return 0; }
+
+    TestFile(const vector<char>& data) : IFile(L"test.wav"), m_data(data), m_offset(0) {}
+};
+
+static map<string, vector<char> > g_files;
+
+// The sound engine loads its samples through this
+namespace Alamo {
+namespace Assets {
+ptr<IFile> LoadFile(const string& filename, const char* prefix, const char* const* extensions)
+{
+    map<string, vector<char> >::const_iterator p = g_files.find(filename);
+    return (p != g_files.end()) ? new TestFile(p->second) : NULL;
+}
+}
+}
+
+// Byte @i of every test sample; 251 is prime so it doesn't line up with the blocks
+static char GetTestByte(size_t i)
+{
+    return (char)(i % 251);
+}
+
+// Returns a 16-bit stereo 44.1kHz WAV file with @size bytes of test data
+static vector<char> MakeWave(unsigned long size)
+{
+    static const uint16_t fmt[8] = {
+        1, 2, 44100 & 0xFFFF, 44100 >> 16, 176400 & 0xFFFF, 176400 >> 16, 4, 16
+    };
+
+    vector<char> data;
+    uint32_t     header[5] = { 0x46464952, 4 + 8 + sizeof fmt + 8 + size, 0x45564157, 0x20746D66, sizeof fmt };
+    data.insert(data.end(), (char*)header, (char*)(header + 5));
+    data.insert(data.end(), (char*)fmt,    (char*)(fmt    + 8));
+
+    uint32_t chunk[2] = { 0x61746164, size };
+    data.insert(data.end(), (char*)chunk, (char*)(chunk + 2));
+    for (unsigned long i = 0; i < size; i++)
+    {
+        data.push_back(GetTestByte(i));
+    }
+    return data;
+}
+
+static ptr<WaveFile> OpenWave(unsigned long size)
+{
+    return new WaveFile(new TestFile(MakeWave(size)));
+}
+
+// Reads the stream in pieces that don't match its blocks until it ends.
+// Returns the number of bytes read, and if they all matched the test data.
+static size_t DrainStream(WaveStream& stream, size_t fileSize, bool& matches, size_t limit)
+{
+    char   buffer[100];
+    size_t total = 0;
+    matches = true;
+    while (!stream.AtEnd() && total < limit)
+    {
+        stream.Fill();
+        size_t read = stream.Read(buffer, sizeof buffer);
+        for (size_t i = 0; i < read; i++)
+        {
+            matches = matches && (buffer[i] == GetTestByte((total + i) % fileSize));
+        }
+        total += read;
+    }
+    return total;
+}
+
+static void TestWaveStream()
+{
+    // Blocks of 64 bytes in a ring of 3; 1000 bytes wrap the ring several times
+    bool matches;
+    ptr<WaveStream> once = new WaveStream(OpenWave(1000), 1, 64, 3);
+    CHECK(DrainStream(*once, 1000, matches, 100000) == 1000);
+    CHECK(matches);
+    CHECK(once->AtEnd());
+
+    // Each loop continues with the start of the file
+    ptr<WaveStream> thrice = new WaveStream(OpenWave(1000), 3, 64, 3);
+    CHECK(DrainStream(*thrice, 1000, matches, 100000) == 3000);
+    CHECK(matches);
+
+    // A file that ends in the middle of a block
+    ptr<WaveStream> odd = new WaveStream(OpenWave(998), 2, 64, 3);
+    CHECK(DrainStream(*odd, 998, matches, 100000) == 2 * 998);
+    CHECK(matches);
+
+    // Zero plays loops forever
+    ptr<WaveStream> forever = new WaveStream(OpenWave(1000), 0, 64, 3);
+    CHECK(DrainStream(*forever, 1000, matches, 10000) >= 10000);
+    CHECK(matches);
+    CHECK(!forever->AtEnd());
+
+    // Without Fill() only what was read ahead comes out
+    char buffer[256];
+    ptr<WaveStream> unfilled = new WaveStream(OpenWave(1000), 1, 64, 3);
+    CHECK(unfilled->Read(buffer, sizeof buffer) == 192);
+    CHECK(unfilled->Read(buffer, sizeof buffer) == 0);
+    CHECK(!unfilled->AtEnd());
+}
+
+static void TestSampleCache()
+{
+    SampleCache cache(2500);
+
+    ptr<Sample> a = new Sample(*OpenWave(1000));
+    ptr<Sample> b = new Sample(*OpenWave(1000));
+    ptr<Sample> c = new Sample(*OpenWave(1000));
+    CHECK(a->GetSize() == 1000);
+    CHECK(a->GetData()[250] == GetTestByte(250));
+
+    cache.Insert("a", a);
+    cache.Insert("b", b);
+    CHECK(cache.GetSize() == 2000);
+
+    // Using A makes B the least recently used, so C replaces it
+    CHECK(cache.Find("a") == a);
+    cache.Insert("c", c);
+    CHECK(cache.GetSize() <= cache.GetCapacity());
+    CHECK(cache.Find("a") == a);
+    CHECK(cache.Find("b") == NULL);
+    CHECK(cache.Find("c") == c);
+
+    // The evicted sample is still intact for whoever holds it
+    CHECK(b->GetData()[999] == GetTestByte(999));
+
+    // Too large for the cache
+    cache.Insert("d", new Sample(*OpenWave(3000)));
+    CHECK(cache.Find("d") == NULL);
+    CHECK(cache.GetSize() == 2000);
+
+    cache.Clear();
+    CHECK(cache.GetSize() == 0);
+    CHECK(cache.Find("a") == NULL);
+}
+
+static void TestNullSoundEngine()
+{
+    // 0.5 seconds each, and one large enough to be streamed
+    g_files["SMALL1.WAV"] = MakeWave(88200);
+    g_files["SMALL2.WAV"] = MakeWave(88200);
+    g_files["SMALL3.WAV"] = MakeWave(88200);
+    g_files["LARGE.WAV"]  = MakeWave(4 * 176400);
+
+    ptr<NullSoundEngine> engine = new NullSoundEngine(200000);
+
+    SFXEvent small;
+    small.maxInstances = 10;
+    small.playCount    = 2;
+    for (int i = 1; i <= 3; i++)
+    {
+        small.samples.clear();
+        small.samples.push_back(string("SMALL") + (char)('0' + i) + ".WAV");
+        engine->PlaySoundEvent(small);
+        CHECK(engine->GetCache().GetSize() <= engine->GetCache().GetCapacity());
+    }
+    CHECK(engine->GetNumSounds() == 3);
+    CHECK(engine->GetCache().GetSize() == 2 * 88200);
+
+    // Played twice, so they end after a second
+    engine->Advance(0.9f);
+    CHECK(engine->GetNumSounds() == 3);
+    engine->Advance(0.2f);
+    CHECK(engine->GetNumSounds() == 0);
+
+    // The large sample is streamed, not cached
+    SFXEvent large;
+    large.maxInstances = 1;
+    large.playCount    = 2;
+    large.samples.push_back("LARGE.WAV");
+    engine->PlaySoundEvent(large);
+    engine->PlaySoundEvent(large);
+    CHECK(engine->GetNumSounds() == 1);
+    CHECK(engine->GetCache().GetSize() == 2 * 88200);
+
+    // Four seconds, played twice
+    float time = 0.0f;
+    while (engine->GetNumSounds() > 0 && time < 20.0f)
+    {
+        engine->Update();
+        engine->Advance(0.25f);
+        time += 0.25f;
+    }
+    CHECK(time > 7.9f && time < 8.6f);
+
+    // Missing files are reported, not played
+    SFXEvent missing;
+    missing.maxInstances = 1;
+    missing.playCount    = 1;
+    missing.samples.push_back("MISSING.WAV");
+    engine->PlaySoundEvent(missing);
+    CHECK(engine->GetNumSounds() == 0);
+
+    engine->Clear();
+    CHECK(engine->GetCache().GetSize() == 0);
+}
+
+int main()
+{
+    static const TestFunction tests[] = {
+        TestWaveStream,
+        TestSampleCache,
+        TestNullSoundEngine,
+    };
+    return RunTests(tests);
+}
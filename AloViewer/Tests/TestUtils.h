@@ -0,0 +1,50 @@
+#ifndef TESTUTILS_H
+#define TESTUTILS_H
+
+//
+// Scaffolding for the headless tests. Every test is its own console program
+// that includes this header once, uses CHECK() for its checks and returns
+// RunTests() from main().
+//
+#include <cstddef>
+#include <exception>
+#include <iostream>
+
+static int g_failed = 0;
+
+// Prints the check and counts it as failed, but keeps going
+#define CHECK(cond) \
+    do { if (!(cond)) { std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " << #cond << std::endl; g_failed++; } } while (0)
+
+typedef void (*TestFunction)();
+
+/* Runs the tests in order and prints the result.
+ * An exception stops the run and fails it.
+ * Returns the exit code for the test program.
+ */
+template <size_t N>
+static int RunTests(const TestFunction (&tests)[N])
+{
+    try
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            tests[i]();
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (g_failed > 0)
+    {
+        std::cerr << g_failed << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
+
+#endif
@@ -271,3 +271,15 @@ void Config::SetDefaultGameMod(const GameMod& gm)
         RegCloseKey(hKey);
     }
 }
+
+unsigned long Config::GetAssetCacheFileSize(unsigned long def)
+{
+	HKEY hKey = NULL;
+    const wstring path = wstring(REGISTRY_BASE_PATH) + L"\\Settings";
+	RegOpenKeyEx(HKEY_CURRENT_USER, path.c_str(), 0, KEY_READ, &hKey);
+
+    // Stored in megabytes
+    unsigned long size = ReadInteger(hKey, L"AssetCacheFileSize", def / (1024 * 1024));
+    RegCloseKey(hKey);
+    return size * 1024 * 1024;
+}
@@ -55,5 +55,8 @@ void AddToHistory(const std::wstring& name);
 // Get and set the default game mod
 GameMod GetDefaultGameMod();
 void SetDefaultGameMod(const GameMod& mode);
+
+// Get the total file size, in bytes, of the assets to cache, or def if it isn't set
+unsigned long GetAssetCacheFileSize(unsigned long def);
 }
 #endif
\ No newline at end of file
@@ -7,7 +7,11 @@
 #include "Sound/DirectSound8/SoundEngine.h"
 #include "Sound/AnimationSFXMaps.h"
 #include "Effects/SurfaceFX.h"
+#include "Assets/GameObjects.h"
+#include "Assets/AssetLoader.h"
+#include "Assets/AssetCache.h"
 #include "General/Log.h"
+#include "General/Profiler.h"
 #include "General/GameTime.h"
 #include "General/WinUtils.h"
 #include "Dialogs/Dialogs.h"
@@ -16,6 +20,7 @@
 #include <afxres.h>
 #include "config.h"
 #include <shlwapi.h>
+#include <shlobj.h>
 #include <commctrl.h>
 using namespace std;
 using namespace Alamo;
@@ -85,6 +90,12 @@ struct ApplicationInfo : public Dialogs::ISelectionCallback
     string             animationName;
     ptr<IRenderObject> object;
     unsigned int       selectedColor;
+
+    // The model that's being loaded in the background
+    ptr<AssetRequest>  loading;
+    ptr<MegaFile>      loadingMegaFile;
+    wstring            loadingFilename;
+
     const COLORREF*    predefinedColors;
 
     // File history
@@ -185,6 +196,25 @@ static void InitializeAssets(ApplicationInfo* info)
     }
 }
 
+// Returns the filename of the game object snapshot for the active game mod,
+// or an empty string if it shouldn't be stored.
+static wstring GetGameObjectSnapshot(const ApplicationInfo* info)
+{
+    wchar_t path[MAX_PATH];
+    if (info->activeGameMod == info->gameMods.end() ||
+        FAILED(SHGetFolderPath(NULL, CSIDL_LOCAL_APPDATA | CSIDL_FLAG_CREATE, NULL, SHGFP_TYPE_CURRENT, path)))
+    {
+        return L"";
+    }
+
+    wstring dir = wstring(path) + L"\\AloViewer";
+    CreateDirectory(dir.c_str(), NULL);
+
+    const GameMod& mod  = info->activeGameMod->first;
+    wstring        name = Uppercase(mod.m_mod);
+    return dir + FormatString(L"\\GameObjects-%d-%08lx.dat", mod.m_game, crc32(name.c_str(), name.length() * sizeof(wchar_t)));
+}
+
 static void SetActiveGameMod(ApplicationInfo* info, GameModList::const_iterator p)
 {
     HMENU hMenu  = GetMenu(info->hMainWnd);
@@ -211,6 +241,8 @@ static void SetActiveGameMod(ApplicationInfo* info, GameModList::const_iterator
     //
 
     // Uninitialize asset-dependent subsystems
+    AssetLoader::CancelAll();
+    GameObjects::Uninitialize();
     SFXEvents::Uninitialize();
     AnimationSFXMaps::Uninitialize();
     SurfaceFX::Uninitialize();
@@ -253,6 +285,7 @@ static void SetActiveGameMod(ApplicationInfo* info, GameModList::const_iterator
         SurfaceFX::Initialize();
     }
     LightSources::Initialize();
+    GameObjects::Initialize(GetGameObjectSnapshot(info));
 
     if (info->engine != NULL && info->model != NULL)
     {
@@ -477,6 +510,63 @@ void ApplicationInfo::OnAnimationSelected(ptr<Animation> anim, const wstring& _f
     }
 }
 
+// Stops loading the model that was opened last, if it's still loading
+static void CancelLoading(ApplicationInfo* info)
+{
+    if (info->loading != NULL)
+    {
+        info->loading->Cancel();
+        info->loading = NULL;
+    }
+    info->loadingMegaFile = NULL;
+}
+
+// Called when the model opened with LoadFile() has been loaded
+static void OnModelRequestFinished(AssetRequest& request, void* data)
+{
+    ApplicationInfo* info = (ApplicationInfo*)data;
+    if (info->loading != &request)
+    {
+        return;
+    }
+
+    bool valid = (request.GetState() == AssetRequest::LOADED);
+    if (valid)
+    {
+#ifdef NDEBUG
+        try
+#endif
+        {
+            // Let the render engine use the textures and particle
+            // systems that were loaded along with the model
+            Assets::SetPreloaded(&request);
+            OnModelLoaded(info, request.GetModel(), info->loadingMegaFile, info->loadingFilename);
+
+            // Add it to the history
+            Config::AddToHistory(info->loadingFilename);
+            AppendHistory(info->hMainWnd, info);
+        }
+#ifdef NDEBUG
+        catch (...)
+        {
+            valid = false;
+        }
+#endif
+        Assets::SetPreloaded(NULL);
+    }
+    else
+    {
+        Log::WriteError("Unable to load %ls: %ls\n", info->loadingFilename.c_str(), request.GetError().c_str());
+    }
+
+    CancelLoading(info);
+    if (!valid)
+    {
+        wstring error = LoadString(IDS_ERR_UNABLE_TO_OPEN_FILE);
+        MessageBox(NULL, error.c_str(), NULL, MB_OK | MB_ICONHAND );
+    }
+}
+
 // Generic file open routine
 static void LoadFile(ApplicationInfo* info, wstring filename)
 {
@@ -488,6 +578,7 @@ static void LoadFile(ApplicationInfo* info, wstring filename)
 
         if (valid)
         {
+            CancelLoading(info);
 #ifdef NDEBUG
             // In debug mode the IDE should catch this
 	        try
@@ -525,18 +616,21 @@ static void LoadFile(ApplicationInfo* info, wstring filename)
                         }
                     }
 
-		            ptr<Model> model = new Model(file);
-		            OnModelLoaded(info, model, meg, filename);
+                    // Load the model and its assets in the background;
+                    // it's shown, and added to the history, when it's done
+                    info->loadingMegaFile = meg;
+                    info->loadingFilename = filename;
+                    info->loading         = AssetLoader::LoadModel(file, AssetLoader::PRIORITY_HIGH, OnModelRequestFinished, info);
                 }
                 else if (info->model != NULL)
                 {
                     ptr<Animation> anim = new Animation(file, *info->model);
 		            info->OnAnimationSelected(anim, filename, false);
-                }
 
-                // Add it to the history
-                Config::AddToHistory(filename);
-                AppendHistory(info->hMainWnd, info);
+                    // Add it to the history
+                    Config::AddToHistory(filename);
+                    AppendHistory(info->hMainWnd, info);
+                }
             }
 #ifdef NDEBUG
             catch (...)
@@ -668,6 +762,7 @@ static void DoMenuItem(ApplicationInfo* info, UINT id)
             ptr<Model> model = Dialogs::ShowOpenModelDialog(info->hMainWnd, &filename, meg);
 			if (model != NULL)
 			{
+                CancelLoading(info);
 				OnModelLoaded(info, model, meg, filename);
 
                 // Add it to the history
@@ -787,6 +882,10 @@ static void DoMenuInit(ApplicationInfo* info, HMENU hMenu)
 
 static void Update(ApplicationInfo* info)
 {
+    // Handle finished background loads
+    AssetLoader::Dispatch();
+    Log::Flush();
+
     UpdateGameTime();
     if (info->object != NULL)
     {
@@ -876,6 +975,12 @@ static void Update(ApplicationInfo* info)
         }
         info->object->Update();
     }
+
+    if (info->sound != NULL)
+    {
+        // Read ahead for streamed sounds
+        info->sound->Update();
+    }
 }
 
 static LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
@@ -1044,11 +1149,13 @@ static LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPAR
             break;
 
         case WM_TIMER:
+            Profiler::BeginFrame();
             Update(info);
             if (info->engine != NULL)
             {
                 RedrawWindow(info->hRenderWnd, NULL, NULL, RDW_INVALIDATE | RDW_UPDATENOW);
             }
+            Profiler::EndFrame();
             break;
 
         case WM_DRAWITEM:
@@ -1418,6 +1525,7 @@ ApplicationInfo::~ApplicationInfo()
     SAFE_RELEASE(sound);
     SAFE_RELEASE(model);
     SAFE_RELEASE(animation);
+    CancelLoading(this);
 
     // Clean up UI
     DestroyWindow(hMainWnd);
@@ -1427,6 +1535,8 @@ ApplicationInfo::~ApplicationInfo()
     UnregisterClass(L"AloViewer", hInstance);
 
     // Clean up subsystems
+    AssetLoader::Uninitialize();
+    GameObjects::Uninitialize();
     LightSources::Uninitialize();
     SurfaceFX::Uninitialize();
     AnimationSFXMaps::Uninitialize();
@@ -1439,6 +1549,8 @@ static void Initialize(ApplicationInfo* info)
 {
     // Initialize assets
     InitializeAssets(info);
+    AssetCache::SetFileBudget(Config::GetAssetCacheFileSize(AssetCache::GetFileBudget()));
+    AssetLoader::Initialize();
 
     // Initialize the UI
     if (!InitializeUI( info ))
@@ -1454,6 +1566,7 @@ static void Initialize(ApplicationInfo* info)
         SurfaceFX::Initialize();
     }
     LightSources::Initialize();
+    GameObjects::Initialize(GetGameObjectSnapshot(info));
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
@@ -1465,6 +1578,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 	freopen("conout$", "wb", stderr);
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
+    Log::Initialize();
 
 #ifdef NDEBUG
     // Only catch exceptions in release mode.
@@ -1475,12 +1589,41 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 		ApplicationInfo info(hInstance);
         vector<wstring> args = ParseCommandLine();
 
+        // Parse arguments
+        wstring filename;
+        wstring profile;
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            if (_wcsicmp(args[i].c_str(), L"/log") == 0 && i + 1 < args.size())
+            {
+                // Also write the log to a file
+                if (!Log::OpenFile(args[++i]))
+                {
+                    Log::WriteError("Unable to create log file %ls\n", args[i].c_str());
+                }
+            }
+            else if (_wcsicmp(args[i].c_str(), L"/quiet") == 0)
+            {
+                // Only log errors
+                Log::SetLevel(Log::LT_ERROR);
+            }
+            else if (_wcsicmp(args[i].c_str(), L"/profile") == 0 && i + 1 < args.size())
+            {
+                // Profile the session and write <name>.json and <name>.csv on exit
+                profile = args[++i];
+                Profiler::Start();
+            }
+            else
+            {
+                filename = args[i];
+            }
+        }
+
         Initialize(&info);
 
-        // Parse arguments
-        if (args.size() > 1)
+        if (!filename.empty())
         {
-            LoadFile(&info, args[1]);
+            LoadFile(&info, filename);
         }
       
         // Main message processing loop
@@ -1504,6 +1647,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 
         // Kill the update timer
         KillTimer(info.hMainWnd, 0);
+
+        if (!profile.empty())
+        {
+            Profiler::Stop();
+            if (!Profiler::WriteTrace(profile + L".json"))
+            {
+                Log::WriteError("Unable to write profile to %ls.json\n", profile.c_str());
+            }
+            if (!Profiler::WriteCSV(profile + L".csv"))
+            {
+                Log::WriteError("Unable to write profile to %ls.csv\n", profile.c_str());
+            }
+        }
     }
 #ifdef NDEBUG
     catch (exception& e)
@@ -0,0 +1,382 @@
+//
+// This file contains the headless atlas builder.
+//
+// Usage: MTDEditor {/build|/update} <directory> <mtd file> [...] [/q]
+//
+// Every image in the directory is packed into a new MTD/TGA pair. The TGA
+// file gets the name of the MTD file with a .TGA extension. This way a build
+// process can regenerate all atlases without ever showing a window.
+//
+// /update starts from the existing pair instead, and only places the images
+// that were added or changed. Unchanged images keep their position, so the
+// TGA changes as little as possible. When the atlas gets too fragmented, it
+// is repacked from scratch.
+//
+// /extract does the opposite: it writes every image in the pair to the
+// directory as a PNG file. It doesn't go through FilePair, but reads the MTD
+// through the read-only MtdIndex and slices the whole TGA in one pass.
+//
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <algorithm>
+#include <iostream>
+#include "batch.h"
+#include "exceptions.h"
+#include "filepair.h"
+#include "mtdindex.h"
+#include "Utils.h"
+#include "resource.h"
+using namespace std;
+
+// New atlases start at this size and grow as needed
+static const unsigned int INITIAL_WIDTH  = 256;
+static const unsigned int INITIAL_HEIGHT = 256;
+
+// Below this occupancy an updated atlas is repacked, if that makes it smaller
+static const double COMPACT_OCCUPANCY = 0.5;
+
+enum JobType
+{
+	JOB_BUILD,
+	JOB_UPDATE,
+	JOB_EXTRACT
+};
+
+struct BuildJob
+{
+	JobType type;
+	wstring directory;
+	wstring indexFilename;
+	wstring imageFilename;
+};
+
+static void PrintUsage()
+{
+	wcerr << L"Usage: MTDEditor {/build|/update|/extract} <directory> <mtd file> [...] [/q]" << endl
+		  << endl
+		  << L"Packs all images in each directory into a MTD and TGA file." << endl
+		  << L"The TGA file is written next to the MTD file, with the same name." << endl
+		  << endl
+		  << L"Options:" << endl
+		  << L"/build   Creates a new MTD and TGA file" << endl
+		  << L"/update  Updates an existing MTD and TGA file, leaving unchanged images in place" << endl
+		  << L"/extract Writes all images in the MTD and TGA file to the directory as PNG files" << endl
+		  << L"/q       Quiet. Prints nothing when all goes well" << endl;
+}
+
+// Returns whether the argument starts a job, and which
+static bool IsJobOption(const wstring& arg, JobType& type)
+{
+	static const struct
+	{
+		const wchar_t* name;
+		JobType        type;
+	} Options[] = {
+		{L"build",   JOB_BUILD},
+		{L"update",  JOB_UPDATE},
+		{L"extract", JOB_EXTRACT},
+	};
+
+	if (arg.length() >= 2 && (arg[0] == L'/' || arg[0] == L'-'))
+	{
+		for (size_t i = 0; i < sizeof Options / sizeof *Options; i++)
+		{
+			if (_wcsicmp(arg.c_str() + 1, Options[i].name) == 0)
+			{
+				type = Options[i].type;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static bool ParseArguments(vector<BuildJob>& jobs, bool& quiet, const vector<wstring>& argv)
+{
+	quiet = false;
+	for (size_t i = 1; i < argv.size(); i++)
+	{
+		JobType type;
+		if (_wcsicmp(argv[i].c_str(), L"/q") == 0 || _wcsicmp(argv[i].c_str(), L"-q") == 0)
+		{
+			quiet = true;
+		}
+		else if (IsJobOption(argv[i], type))
+		{
+			if (i + 2 >= argv.size())
+			{
+				wcerr << argv[i] << L" requires a directory and an MTD file" << endl;
+				return false;
+			}
+
+			BuildJob job;
+			job.type          = type;
+			job.directory     = argv[++i];
+			job.indexFilename = argv[++i];
+
+			size_t ofs = job.indexFilename.find_last_of(L".\\/");
+			job.imageFilename = (ofs != wstring::npos && job.indexFilename[ofs] == L'.')
+				? job.indexFilename.substr(0, ofs) + L".TGA"
+				: job.indexFilename + L".TGA";
+			jobs.push_back(job);
+		}
+		else
+		{
+			wcerr << L"Unknown option '" << argv[i] << L"'" << endl;
+			return false;
+		}
+	}
+
+	if (jobs.empty())
+	{
+		PrintUsage();
+		return false;
+	}
+	return true;
+}
+
+// Returns the full path of the file, for comparing filenames
+static wstring GetFullPath(const wstring& filename)
+{
+	wchar_t path[MAX_PATH];
+	DWORD len = GetFullPathName(filename.c_str(), MAX_PATH, path, NULL);
+	return (len > 0 && len < MAX_PATH) ? wstring(path, len) : filename;
+}
+
+// Returns all readable images in the job's directory, sorted by name.
+// The job's own TGA is skipped when it's in the same directory; otherwise
+// every rebuild would pack the previous atlas into the new one.
+static vector<wstring> GetImageFiles(const BuildJob& job)
+{
+	const wstring& directory = job.directory;
+	const wstring  output    = GetFullPath(job.imageFilename);
+	vector<wstring> filenames;
+
+	WIN32_FIND_DATA wfd;
+	HANDLE hFind = FindFirstFile((directory + L"\\*").c_str(), &wfd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		throw wruntime_error(L"Unable to read directory " + directory);
+	}
+
+	do
+	{
+		if (~wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			FREE_IMAGE_FORMAT fif = FreeImage_GetFIFFromFilenameU(wfd.cFileName);
+			wstring filename = directory + L"\\" + wfd.cFileName;
+			if (fif != FIF_UNKNOWN && FreeImage_FIFSupportsReading(fif) &&
+				_wcsicmp(GetFullPath(filename).c_str(), output.c_str()) != 0)
+			{
+				filenames.push_back(filename);
+			}
+		}
+	} while (FindNextFile(hFind, &wfd));
+	FindClose(hFind);
+
+	sort(filenames.begin(), filenames.end());
+	return filenames;
+}
+
+static void Report(const BuildJob& job, const FilePair& atlas, const wchar_t* action, bool quiet)
+{
+	if (!quiet)
+	{
+		wcout << job.indexFilename << L": " << action << L", " << atlas.getNumFiles() << L" images, "
+			  << (int)(atlas.getOccupancy() * 100 + 0.5) << L"% occupied" << endl;
+	}
+}
+
+static void Build(const BuildJob& job, const vector<wstring>& filenames, bool quiet)
+{
+	vector<wstring> inputs = filenames;
+
+	FilePair atlas(INITIAL_WIDTH, INITIAL_HEIGHT);
+	atlas.insertFiles(inputs);
+	atlas.saveIndex(job.indexFilename);
+	atlas.saveImage(job.imageFilename, FIF_TARGA);
+	Report(job, atlas, L"built", quiet);
+}
+
+static void Update(const BuildJob& job, const vector<wstring>& filenames, bool quiet)
+{
+	if (GetFileAttributes(job.indexFilename.c_str()) == INVALID_FILE_ATTRIBUTES ||
+		GetFileAttributes(job.imageFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+	{
+		// Nothing to update yet
+		Build(job, filenames, quiet);
+		return;
+	}
+
+	FilePair atlas(job.indexFilename, job.imageFilename);
+	if (atlas.isReadOnly())
+	{
+		// The existing pair is corrupt, start over
+		Build(job, filenames, quiet);
+		return;
+	}
+
+	unsigned int changes = atlas.updateFiles(filenames);
+	if (changes == 0)
+	{
+		Report(job, atlas, L"up to date", quiet);
+		return;
+	}
+
+	if (atlas.getOccupancy() < COMPACT_OCCUPANCY)
+	{
+		// Too much free space; see if packing it from scratch does better.
+		// Both contain the same images, so higher occupancy means smaller.
+		vector<wstring> inputs = filenames;
+		FilePair packed(INITIAL_WIDTH, INITIAL_HEIGHT);
+		packed.insertFiles(inputs);
+		if (packed.getOccupancy() > atlas.getOccupancy())
+		{
+			packed.saveIndex(job.indexFilename);
+			packed.saveImage(job.imageFilename, FIF_TARGA);
+			Report(job, packed, L"repacked", quiet);
+			return;
+		}
+	}
+
+	atlas.saveIndex(job.indexFilename);
+	atlas.saveImage(job.imageFilename, FIF_TARGA);
+	Report(job, atlas, L"updated", quiet);
+}
+
+static void Extract(const BuildJob& job, bool quiet)
+{
+	MtdIndex index(job.indexFilename);
+
+	FIBITMAP* tmp = FreeImage_LoadU(FIF_TARGA, job.imageFilename.c_str(), 0);
+	if (tmp == NULL)
+	{
+		throw wruntime_error(LoadString(IDS_ERROR_IMAGE_LOAD));
+	}
+	FIBITMAP* atlas = FreeImage_ConvertTo32Bits(tmp);
+	FreeImage_Unload(tmp);
+	if (atlas == NULL)
+	{
+		throw wruntime_error(LoadString(IDS_ERROR_IMAGE_CONVERT));
+	}
+
+	try
+	{
+		// Slice all images into one buffer
+		vector<size_t>  indices(index.size());
+		vector<size_t>  offsets(index.size());
+		size_t total = 0;
+		for (size_t i = 0; i < index.size(); i++)
+		{
+			MtdIndex::Sprite sprite = index.getSprite(i);
+			indices[i] = i;
+			offsets[i] = total;
+			total += sprite.w * sprite.h;
+		}
+
+		vector<uint32_t>  pixels(max(total, (size_t)1));
+		vector<uint32_t*> buffers(index.size());
+		for (size_t i = 0; i < index.size(); i++)
+		{
+			buffers[i] = &pixels[offsets[i]];
+		}
+		if (!indices.empty())
+		{
+			index.extract(atlas, &indices[0], indices.size(), &buffers[0]);
+		}
+		FreeImage_Unload(atlas);
+		atlas = NULL;
+
+		CreateDirectory(job.directory.c_str(), NULL);
+		for (size_t i = 0; i < index.size(); i++)
+		{
+			MtdIndex::Sprite sprite = index.getSprite(i);
+			if (sprite.w == 0 || sprite.h == 0)
+			{
+				continue;
+			}
+
+			wstring name = AnsiToWide(sprite.name.c_str());
+			size_t ofs = name.find_last_of(L'.');
+			if (ofs != wstring::npos)
+			{
+				name = name.substr(0, ofs);
+			}
+
+			FIBITMAP* dib = FreeImage_ConvertFromRawBits((BYTE*)buffers[i], sprite.w, sprite.h, sprite.w * sizeof(uint32_t), 32,
+				FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, TRUE);
+			if (dib == NULL)
+			{
+				throw wruntime_error(LoadString(IDS_ERROR_BITMAP_CREATE));
+			}
+			BOOL saved = FreeImage_SaveU(FIF_PNG, dib, (job.directory + L"\\" + name + L".PNG").c_str(), 0);
+			FreeImage_Unload(dib);
+			if (!saved)
+			{
+				throw wruntime_error(LoadString(IDS_ERROR_IMAGE_SAVE));
+			}
+		}
+	}
+	catch (...)
+	{
+		if (atlas != NULL)
+		{
+			FreeImage_Unload(atlas);
+		}
+		throw;
+	}
+
+	if (!quiet)
+	{
+		wcout << job.indexFilename << L": extracted " << index.size() << L" images" << endl;
+	}
+}
+
+bool IsBatchCommandLine(const vector<wstring>& argv)
+{
+	for (size_t i = 1; i < argv.size(); i++)
+	{
+		JobType type;
+		if (IsJobOption(argv[i], type))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int RunBatch(const vector<wstring>& argv)
+{
+	vector<BuildJob> jobs;
+	bool quiet;
+	if (!ParseArguments(jobs, quiet, argv))
+	{
+		return 1;
+	}
+
+	// Keep going after a failed atlas, but report it in the exit code
+	int result = 0;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		try
+		{
+			switch (jobs[i].type)
+			{
+			case JOB_BUILD:   Build(jobs[i], GetImageFiles(jobs[i]), quiet); break;
+			case JOB_UPDATE:  Update(jobs[i], GetImageFiles(jobs[i]), quiet); break;
+			case JOB_EXTRACT: Extract(jobs[i], quiet); break;
+			}
+		}
+		catch (wexception& e)
+		{
+			wcerr << jobs[i].indexFilename << L": " << e.what() << endl;
+			result = 1;
+		}
+		catch (exception& e)
+		{
+			wcerr << jobs[i].indexFilename << L": " << AnsiToWide(e.what()) << endl;
+			result = 1;
+		}
+	}
+	return result;
+}
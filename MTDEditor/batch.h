@@ -0,0 +1,16 @@
+//
+// This file defines the headless (command-line) atlas builder
+//
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+// Returns whether the command line asks for a batch build instead of the UI
+bool IsBatchCommandLine(const std::vector<std::wstring>& argv);
+
+// Runs the batch build and returns the process exit code
+int RunBatch(const std::vector<std::wstring>& argv);
+
+#endif
@@ -20,17 +20,9 @@
 #include "exceptions.h"
 #include "Utils.h"
 #include "resource.h"
+#include "mtdfile.h"
 using namespace std;
 
-#pragma pack(1)
-struct FILEINFO
-{
-	char name[64];
-	uint32_t x, y, w, h;
-	uint8_t used;
-};
-#pragma pack()
-
 static const int IMAGE = 1;
 static const int INDEX = 2;
 
@@ -59,7 +51,17 @@ public:
 	void saveBitmapFile(const FileInfo& fi, FIBITMAP* bitmap, const wstring& filename, FREE_IMAGE_FORMAT format);
 
 	// Insertion
-	void insertFiles( vector<wstring>& filenames );
+	void         insertFiles( vector<wstring>& filenames );
+	unsigned int updateFiles( const vector<wstring>& filenames );
+	void         removeFile( map<wstring, FileInfo>::iterator i );
+
+	// Helpers for insertFiles and updateFiles
+	void decodeFiles( const vector<wstring>& filenames, vector<FIBITMAP*>& bitmaps, vector<uint32_t>* hashes );
+	void insertBitmaps( vector<wstring>& filenames, vector<FIBITMAP*>& bitmaps );
+
+	// Worker threads for decodeFiles and insertBitmaps
+	static DWORD WINAPI DecodeThread( LPVOID lpParam );
+	static DWORD WINAPI BlitThread( LPVOID lpParam );
 
 	FilePairImpl( unsigned int width, unsigned int height);
 	FilePairImpl( const wstring& filename1, const wstring& filename2);
@@ -173,152 +175,452 @@ static void QuickSortAreaDesc( vector<wstring>& filenames, vector<FIBITMAP*>& bi
 	if (k < end)   QuickSortAreaDesc(filenames, bitmaps, k, end);
 }
 
-void FilePair::FilePairImpl::insertFiles( vector<wstring>& filenames )
+//
+// Both decoding the images and copying them into the bitmap are done by a
+// pool of threads. Every image gets its own area in the bitmap, so the
+// threads never write to the same pixels.
+//
+struct INSERT_INFO
+{
+	const vector<wstring>*   filenames;
+	vector<FIBITMAP*>*       bitmaps;
+	vector<uint32_t>*        hashes;
+	vector<wstring>*         errors;
+	const vector<FileInfo>*  targets;
+	FIBITMAP*                bitmap;
+	volatile LONG            next;
+};
+
+// Runs the thread function on as many threads as useful and waits for them
+static void RunThreads( LPTHREAD_START_ROUTINE func, INSERT_INFO* info, size_t count )
 {
-	if (readOnly)
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	size_t nThreads = min((size_t)si.dwNumberOfProcessors, count);
+
+	info->next = 0;
+	vector<HANDLE> hThreads;
+	for (size_t i = 1; i < nThreads; i++)
 	{
-		return;
+		DWORD  ThreadID;
+		HANDLE hThread = CreateThread(NULL, 0, func, info, 0, &ThreadID);
+		if (hThread != NULL)
+		{
+			hThreads.push_back(hThread);
+		}
 	}
 
-	vector<FIBITMAP*> bitmaps;
+	// This thread helps out as well
+	func(info);
 
-	try
+	if (!hThreads.empty())
 	{
-		// Read the files
-		size_t i;
-		for (i = 0; i < filenames.size(); i++)
+		WaitForMultipleObjects((DWORD)hThreads.size(), &hThreads[0], TRUE, INFINITE);
+		for (size_t i = 0; i < hThreads.size(); i++)
 		{
-			FIBITMAP* dib = ReadBitmapFile( filenames[i] );
-			bitmaps.push_back( dib );
+			CloseHandle(hThreads[i]);
 		}
+	}
+}
 
-		// Sort them by area, descending
-		QuickSortAreaDesc( filenames, bitmaps, 0, (int)filenames.size() - 1);
-
-		vector<FreeArea::RECT> areas;
+// Hashes the pixels of an area of a 32-bit bitmap (FNV-1a), top row first
+static uint32_t HashPixels( FIBITMAP* dib, unsigned long x, unsigned long y, unsigned long w, unsigned long h )
+{
+	unsigned long height = FreeImage_GetHeight(dib);
+	uint32_t hash = 2166136261U;
+	for (unsigned long row = 0; row < h; row++)
+	{
+		const uint8_t* bits = FreeImage_GetScanLine(dib, height - y - row - 1) + x * sizeof(uint32_t);
+		for (unsigned long i = 0; i < w * sizeof(uint32_t); i++)
+		{
+			hash = (hash ^ bits[i]) * 16777619U;
+		}
+	}
+	return hash;
+}
 
-		// Allocate space
-		FIBITMAP*     newBitmap = NULL;
-		unsigned long newWidth  = FreeImage_GetWidth(bitmap);
-		unsigned long newHeight = FreeImage_GetHeight(bitmap);
+// Compares a complete bitmap against an area of the atlas
+static bool SamePixels( FIBITMAP* atlas, const FileInfo& fi, FIBITMAP* dib )
+{
+	if (FreeImage_GetWidth(dib) != fi.w || FreeImage_GetHeight(dib) != fi.h)
+	{
+		return false;
+	}
 
-		FreeArea backup = freearea;
-		for (i = 0; i < bitmaps.size(); i++)
+	unsigned long height = FreeImage_GetHeight(atlas);
+	for (unsigned long row = 0; row < fi.h; row++)
+	{
+		const uint8_t* bits1 = FreeImage_GetScanLine(atlas, height - fi.y - row - 1) + fi.x * sizeof(uint32_t);
+		const uint8_t* bits2 = FreeImage_GetScanLine(dib, fi.h - row - 1);
+		if (memcmp(bits1, bits2, fi.w * sizeof(uint32_t)) != 0)
 		{
-			FreeArea::RECT area;
+			return false;
+		}
+	}
+	return true;
+}
 
-			// Each image has a 1px border around it
-			area.w = FreeImage_GetWidth(  bitmaps[i] ) + 2;
-			area.h = FreeImage_GetHeight( bitmaps[i] ) + 2;
-			while (!freearea.getFreeArea( area ))
+// The name of a file in the index
+static wstring GetIndexName( const wstring& path )
+{
+	wstring filename = path;
+	size_t ofs = filename.find_last_of('\\');
+	if (ofs != wstring::npos)
+	{
+		filename = filename.substr(ofs + 1);
+	}
+	filename = filename.substr(0,63);
+	transform(filename.begin(), filename.end(), filename.begin(), toupper );
+	return filename;
+}
+
+DWORD WINAPI FilePair::FilePairImpl::DecodeThread( LPVOID lpParam )
+{
+	INSERT_INFO* info = (INSERT_INFO*)lpParam;
+	LONG i;
+	while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->filenames->size())
+	{
+		try
+		{
+			FIBITMAP* dib = ReadBitmapFile( (*info->filenames)[i] );
+			(*info->bitmaps)[i] = dib;
+			if (info->hashes != NULL)
 			{
-				// Bitmap is full, expand (double) it
-				if (newBitmap == NULL)
-				{
-					FreeImage_Unload( newBitmap );
-				}
+				(*info->hashes)[i] = HashPixels(dib, 0, 0, FreeImage_GetWidth(dib), FreeImage_GetHeight(dib));
+			}
+		}
+		catch (wexception& e)
+		{
+			(*info->errors)[i] = (*info->filenames)[i] + L": " + e.what();
+		}
+		catch (exception& e)
+		{
+			(*info->errors)[i] = (*info->filenames)[i] + L": " + AnsiToWide(e.what());
+		}
+	}
+	return 0;
+}
 
-				if (newHeight < newWidth)
-				{
-					freearea.addFreeArea(0, newHeight, newWidth, newHeight);
-					newHeight *= 2;
-				}
-				else
-				{
-					freearea.addFreeArea(newWidth, 0, newWidth, newHeight);
-					newWidth  *= 2;
-				}
+DWORD WINAPI FilePair::FilePairImpl::BlitThread( LPVOID lpParam )
+{
+	INSERT_INFO* info   = (INSERT_INFO*)lpParam;
+	unsigned long pitch  = FreeImage_GetPitch(info->bitmap);
+	unsigned long height = FreeImage_GetHeight(info->bitmap);
 
-				newBitmap = FreeImage_Allocate(newWidth, newHeight, 32);
-				if (newBitmap == NULL)
-				{
-					freearea = backup;
-					throw wruntime_error(LoadString(IDS_ERROR_BITMAP_EXPAND));
-				}
-			}
-			areas.push_back(area);
+	LONG i;
+	while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->targets->size())
+	{
+		const FileInfo& fi = (*info->targets)[i];
+		if (!fi.used)
+		{
+			// Replaced by a later file in the same batch
+			continue;
 		}
 
-		if (newBitmap != NULL)
+		// Copy the image in the bitmap
+		FreeImage_Paste(info->bitmap, (*info->bitmaps)[i], fi.x, fi.y, 255 );
+
+		// Copy the border
+		uint32_t* start = (uint32_t*)FreeImage_GetScanLine(info->bitmap, height - fi.y - 1) + fi.x;
+		uint32_t* bits  = start;
+		for (unsigned int y = 0; y < fi.h; y++)
+		{
+			*(bits - 1)    = *(bits + 0);
+			*(bits + fi.w) = *(bits + fi.w - 1);
+			bits = (uint32_t*)((char*)bits - pitch);
+		}
+
+		memcpy( (char*)(start - 1) + pitch, start - 1, (fi.w + 2) * sizeof(uint32_t) );
+		memcpy( bits - 1,  (char*)(bits - 1) + pitch,  (fi.w + 2) * sizeof(uint32_t) );
+	}
+	return 0;
+}
+
+void FilePair::FilePairImpl::decodeFiles( const vector<wstring>& filenames, vector<FIBITMAP*>& bitmaps, vector<uint32_t>* hashes )
+{
+	bitmaps.assign(filenames.size(), NULL);
+	if (hashes != NULL)
+	{
+		hashes->assign(filenames.size(), 0);
+	}
+
+	vector<wstring> errors(filenames.size());
+	INSERT_INFO info;
+	info.filenames = &filenames;
+	info.bitmaps   = &bitmaps;
+	info.hashes    = hashes;
+	info.errors    = &errors;
+	RunThreads(DecodeThread, &info, filenames.size());
+
+	for (size_t i = 0; i < errors.size(); i++)
+	{
+		if (!errors[i].empty())
 		{
-			// The bitmap has been expanded, copy old contents into new
-			FreeImage_Paste(newBitmap, bitmap, 0, 0, 255 );
-			FreeImage_Unload(bitmap);
-			bitmap = newBitmap;
+			throw wruntime_error(errors[i]);
 		}
+	}
+}
 
-		unsigned long pitch  = FreeImage_GetPitch(bitmap);
-		unsigned long height = FreeImage_GetHeight(bitmap);
+void FilePair::FilePairImpl::removeFile( map<wstring, FileInfo>::iterator i )
+{
+	// Erase the area in the bitmap
+	FIBITMAP* dib = FreeImage_Allocate(i->second.w + 2, i->second.h + 2, 32);
+	if (dib != NULL)
+	{
+		FreeImage_Paste(bitmap, dib, i->second.x - 1, i->second.y - 1, 255 );
+		FreeImage_Unload(dib);
+	}
+	freearea.addFreeArea( i->second.x - 1, i->second.y - 1, i->second.w + 2, i->second.h + 2 );
+	if (selected == &i->second)
+	{
+		selected = NULL;
+	}
+	files.erase(i);
+}
+
+void FilePair::FilePairImpl::insertBitmaps( vector<wstring>& filenames, vector<FIBITMAP*>& bitmaps )
+{
+	if (bitmaps.empty())
+	{
+		return;
+	}
+
+	// Sort them by area, descending
+	QuickSortAreaDesc( filenames, bitmaps, 0, (int)filenames.size() - 1);
+
+	vector<FreeArea::RECT> areas;
+
+	// Allocate space
+	FIBITMAP*     newBitmap = NULL;
+	unsigned long oldWidth  = FreeImage_GetWidth(bitmap);
+	unsigned long oldHeight = FreeImage_GetHeight(bitmap);
+	unsigned long newWidth  = oldWidth;
+	unsigned long newHeight = oldHeight;
+
+	FreeArea backup = freearea;
+	size_t i;
+	for (i = 0; i < bitmaps.size(); i++)
+	{
+		FreeArea::RECT area;
 
-		// Copy data
-		for (i = 0; i < bitmaps.size(); i++)
+		// Each image has a 1px border around it
+		area.w = FreeImage_GetWidth(  bitmaps[i] ) + 2;
+		area.h = FreeImage_GetHeight( bitmaps[i] ) + 2;
+		while (!freearea.getFreeArea( area ))
 		{
-			wstring filename = filenames[i];
-			size_t ofs = filename.find_last_of('\\');
-			if (ofs != wstring::npos)
+			// Bitmap is full, expand (double) it
+			if (newHeight < newWidth)
 			{
-				filename = filename.substr(ofs + 1);
+				freearea.grow(newWidth, newHeight, newWidth, newHeight * 2);
+				newHeight *= 2;
 			}
-			filename = filename.substr(0,63);
-			transform(filename.begin(), filename.end(), filename.begin(), toupper );
+			else
+			{
+				freearea.grow(newWidth, newHeight, newWidth * 2, newHeight);
+				newWidth  *= 2;
+			}
+		}
+		areas.push_back(area);
+	}
+
+	if (newWidth != oldWidth || newHeight != oldHeight)
+	{
+		// Only allocate the expanded bitmap once we know its final size
+		newBitmap = FreeImage_Allocate(newWidth, newHeight, 32);
+		if (newBitmap == NULL)
+		{
+			freearea = backup;
+			throw wruntime_error(LoadString(IDS_ERROR_BITMAP_EXPAND));
+		}
 
-			// Check if this file already existed
-			map<wstring,FileInfo>::iterator j = files.find(filename);
-			if (j != files.end())
+		// The bitmap has been expanded, copy old contents into new
+		FreeImage_Paste(newBitmap, bitmap, 0, 0, 255 );
+		FreeImage_Unload(bitmap);
+		bitmap = newBitmap;
+	}
+
+	// Update the index
+	vector<FileInfo>        targets(bitmaps.size());
+	map<wstring, size_t>    batch;
+	for (i = 0; i < bitmaps.size(); i++)
+	{
+		wstring filename = GetIndexName(filenames[i]);
+
+		// Check if this file already existed
+		map<wstring,FileInfo>::iterator j = files.find(filename);
+		if (j != files.end())
+		{
+			map<wstring, size_t>::iterator b = batch.find(filename);
+			if (b != batch.end())
 			{
-				// Yes, release area in the bitmap
-				FIBITMAP* dib = FreeImage_Allocate(j->second.w + 2, j->second.h + 2, 32);
-				if (dib != NULL)
-				{
-					FreeImage_Paste(bitmap, dib, j->second.x - 1, j->second.y - 1, 255 );
-					FreeImage_Unload(dib);
-				}
+				// It was added by this batch and hasn't been copied yet
+				targets[b->second].used = 0;
 				freearea.addFreeArea( j->second.x - 1, j->second.y - 1, j->second.w + 2, j->second.h + 2 );
 				files.erase(j);
 			}
+			else
+			{
+				// Yes, release area in the bitmap
+				removeFile(j);
+			}
+		}
 
-			FileInfo fi;
-			fi.used = 1;
-			fi.x    = areas[i].x + 1;
-			fi.y    = areas[i].y + 1;
-			fi.w    = areas[i].w - 2;
-			fi.h    = areas[i].h - 2;
+		FileInfo& fi = targets[i];
+		fi.used = 1;
+		fi.x    = areas[i].x + 1;
+		fi.y    = areas[i].y + 1;
+		fi.w    = areas[i].w - 2;
+		fi.h    = areas[i].h - 2;
 
-			// Copy the image in the bitmap
-			FreeImage_Paste(bitmap, bitmaps[i], fi.x, fi.y, 255 );
+		// Insert file in the index
+		files.insert( make_pair(filename, fi) );
+		batch[filename] = i;
+	}
 
-			// Copy the border
-			uint32_t* start = (uint32_t*)FreeImage_GetScanLine(bitmap, height - fi.y - 1) + fi.x;
-			uint32_t* bits  = start;
-			for (unsigned int y = 0; y < fi.h; y++)
-			{
-				*(bits - 1)    = *(bits + 0);
-				*(bits + fi.w) = *(bits + fi.w - 1);
-				bits = (uint32_t*)((char*)bits - pitch);
-			}
+	// Copy data
+	INSERT_INFO info;
+	info.bitmaps = &bitmaps;
+	info.targets = &targets;
+	info.bitmap  = bitmap;
+	RunThreads(BlitThread, &info, targets.size());
 
-			memcpy( (char*)(start - 1) + pitch, start - 1, (fi.w + 2) * sizeof(uint32_t) );
-			memcpy( bits - 1,  (char*)(bits - 1) + pitch,  (fi.w + 2) * sizeof(uint32_t) );
-			
-			// Insert file in the index
-			files.insert( make_pair(filename, fi) );
-		}
+	modified = IMAGE | INDEX;
+}
 
-		// Cleanup bitmaps
-		for (size_t j = 0; j < bitmaps.size(); j++)
+static void UnloadBitmaps( vector<FIBITMAP*>& bitmaps )
+{
+	for (size_t j = 0; j < bitmaps.size(); j++)
+	{
+		if (bitmaps[j] != NULL)
 		{
 			FreeImage_Unload(bitmaps[j]);
 		}
+	}
+	bitmaps.clear();
+}
 
-		modified = IMAGE | INDEX;
+void FilePair::FilePairImpl::insertFiles( vector<wstring>& filenames )
+{
+	if (readOnly || filenames.empty())
+	{
+		return;
+	}
+
+	vector<FIBITMAP*> bitmaps;
+	try
+	{
+		decodeFiles( filenames, bitmaps, NULL );
+		insertBitmaps( filenames, bitmaps );
+		UnloadBitmaps( bitmaps );
 	}
 	catch (wexception&)
 	{
-		// Cleanup bitmaps
-		for (size_t j = 0; j < bitmaps.size(); j++)
+		UnloadBitmaps( bitmaps );
+		throw;
+	}
+}
+
+//
+// Updating keeps every image whose pixels haven't changed where it is, so
+// the TGA only changes where something was actually added, changed or
+// removed. Images are matched on a hash of their pixels, so a renamed image
+// keeps its place as well.
+//
+unsigned int FilePair::FilePairImpl::updateFiles( const vector<wstring>& filenames )
+{
+	if (readOnly)
+	{
+		return 0;
+	}
+
+	vector<FIBITMAP*> bitmaps;
+	try
+	{
+		vector<uint32_t> hashes;
+		decodeFiles( filenames, bitmaps, &hashes );
+
+		// The wanted name for every input; later inputs win
+		map<wstring, size_t> wanted;
+		for (size_t i = 0; i < filenames.size(); i++)
 		{
-			FreeImage_Unload(bitmaps[j]);
+			wanted[GetIndexName(filenames[i])] = i;
+		}
+
+		// Index the images that are no longer wanted under their name by content
+		multimap<uint32_t, wstring> orphans;
+		for (map<wstring, FileInfo>::const_iterator p = files.begin(); p != files.end(); p++)
+		{
+			if (wanted.find(p->first) == wanted.end())
+			{
+				const FileInfo& fi = p->second;
+				orphans.insert( make_pair(HashPixels(bitmap, fi.x, fi.y, fi.w, fi.h), p->first) );
+			}
+		}
+
+		unsigned int changes = 0;
+		vector<wstring>   changedNames;
+		vector<FIBITMAP*> changedBitmaps;
+		for (map<wstring, size_t>::const_iterator p = wanted.begin(); p != wanted.end(); p++)
+		{
+			FIBITMAP* dib = bitmaps[p->second];
+			map<wstring, FileInfo>::iterator cur = files.find(p->first);
+			if (cur != files.end())
+			{
+				if (SamePixels(bitmap, cur->second, dib))
+				{
+					// Unchanged
+					continue;
+				}
+
+				// Changed; free its area first so the new version can take it
+				removeFile(cur);
+			}
+			else
+			{
+				// New name, but perhaps a known image
+				pair<multimap<uint32_t, wstring>::iterator, multimap<uint32_t, wstring>::iterator> range = orphans.equal_range(hashes[p->second]);
+				multimap<uint32_t, wstring>::iterator o;
+				for (o = range.first; o != range.second && !SamePixels(bitmap, files[o->second], dib); o++);
+				if (o != range.second)
+				{
+					// Renamed
+					map<wstring, FileInfo>::iterator old = files.find(o->second);
+					FileInfo fi = old->second;
+					if (selected == &old->second)
+					{
+						selected = NULL;
+					}
+					files.erase(old);
+					files.insert( make_pair(p->first, fi) );
+					orphans.erase(o);
+					modified |= INDEX;
+					changes++;
+					continue;
+				}
+			}
+
+			changedNames.push_back(p->first);
+			changedBitmaps.push_back(dib);
+		}
+
+		// Remove the images that are gone
+		for (multimap<uint32_t, wstring>::const_iterator o = orphans.begin(); o != orphans.end(); o++)
+		{
+			removeFile(files.find(o->second));
+			modified = IMAGE | INDEX;
+			changes++;
 		}
+
+		// And place the new and changed images
+		insertBitmaps( changedNames, changedBitmaps );
+		changes += (unsigned int)changedNames.size();
+
+		UnloadBitmaps( bitmaps );
+		return changes;
+	}
+	catch (wexception&)
+	{
+		UnloadBitmaps( bitmaps );
 		throw;
 	}
 }
@@ -480,6 +782,18 @@ unsigned int FilePair::getNumFiles() const
 	return (unsigned int)pimpl->files.size();
 }
 
+double FilePair::getOccupancy() const
+{
+	// Count every image with its 1px border
+	double used = 0;
+	for (map<wstring,FileInfo>::const_iterator p = pimpl->files.begin(); p != pimpl->files.end(); p++)
+	{
+		used += (double)(p->second.w + 2) * (p->second.h + 2);
+	}
+	double total = (double)FreeImage_GetWidth(pimpl->bitmap) * FreeImage_GetHeight(pimpl->bitmap);
+	return (total > 0) ? used / total : 0.0;
+}
+
 bool FilePair::isModified() const
 {
 	return pimpl->modified != 0;
@@ -500,6 +814,11 @@ void FilePair::insertFiles( vector<wstring>& filenames )
 	pimpl->insertFiles(filenames);
 }
 
+unsigned int FilePair::updateFiles( const vector<wstring>& filenames )
+{
+	return pimpl->updateFiles(filenames);
+}
+
 const FileInfo* FilePair::getSelected() const
 {
 	return pimpl->selected;
@@ -575,15 +894,7 @@ void FilePair::deleteFile( const wstring& filename )
 		FileMap::iterator i = pimpl->files.find(filename);
 		if (i != pimpl->files.end())
 		{
-			// Erase the area in the bitmap
-			FIBITMAP* dib = FreeImage_Allocate(i->second.w + 2, i->second.h + 2, 32);
-			if (dib != NULL)
-			{
-				FreeImage_Paste(pimpl->bitmap, dib, i->second.x - 1, i->second.y - 1, 255 );
-				FreeImage_Unload(dib);
-			}
-			pimpl->freearea.addFreeArea( i->second.x - 1, i->second.y - 1, i->second.w + 2, i->second.h + 2 );
-			pimpl->files.erase(i);
+			pimpl->removeFile(i);
 			pimpl->modified = IMAGE | INDEX;
 		}
 	}
@@ -33,6 +33,7 @@ public:
 	const FileInfo*     getSelected() const;			// Get the currently selected file
 	const FileMap&      getFiles() const;			// Get a list of the files
 	unsigned int	    getNumFiles() const;			// How many files are in the directory?
+	double              getOccupancy() const;		// Fraction of the image used by files
 	bool                isModified() const;			// Has the pair been modified?
 	bool                isUnnamed() const;			// Does the pair have a name?
 	bool                isReadOnly() const;          // Is this file read only?
@@ -43,6 +44,9 @@ public:
 
 	// Directory manipulation
 	void insertFiles(std::vector<std::wstring>& filenames);
+	// Make the directory hold exactly these files, keeping unchanged images in place.
+	// Returns the number of images that were added, changed, renamed or removed.
+	unsigned int updateFiles(const std::vector<std::wstring>& filenames);
 	bool renameFile(const std::wstring& filename, const std::wstring& target);
 	void extractFile( const std::wstring& filename, const std::wstring& target, FREE_IMAGE_FORMAT format = FIF_UNKNOWN );
 	void deleteFile( const std::wstring& filename );
@@ -3,112 +3,262 @@
 // and allocate/free them.
 //
 // Programmer's note:
-// This may not be the most efficient implementation, but it's a hard
-// problem anyway.
+// The free space is described by the set of maximal free rectangles, as in
+// the MaxRects algorithm. Marking an area as used splits every free rectangle
+// it intersects into (at most four) maximal pieces, and any rectangle that is
+// contained in another one is pruned. A grid over the area tells us which
+// rectangles to look at, so this stays local even with thousands of images.
 //
+#include <algorithm>
 #include "freearea.h"
 
 using namespace std;
 
+// Each grid cell is 2^CELL_SHIFT pixels wide and high
+static const int CELL_SHIFT = 6;
+
+static inline bool Contains( const FreeArea::RECT& outer, const FreeArea::RECT& inner )
+{
+	return (inner.x >= outer.x) && (inner.x + inner.w <= outer.x + outer.w) &&
+	       (inner.y >= outer.y) && (inner.y + inner.h <= outer.y + outer.h);
+}
+
+static inline bool Intersects( const FreeArea::RECT& a, const FreeArea::RECT& b )
+{
+	return (a.x + a.w > b.x) && (a.x < b.x + b.w) &&
+	       (a.y + a.h > b.y) && (a.y < b.y + b.h);
+}
+
+void FreeArea::growGrid( const RECT& rect )
+{
+	unsigned long columns = ((rect.x + rect.w - 1) >> CELL_SHIFT) + 1;
+	unsigned long rows    = ((rect.y + rect.h - 1) >> CELL_SHIFT) + 1;
+	if (columns > Columns || rows > Rows)
+	{
+		// Rebuild the grid with room to spare
+		Columns = max(columns, Columns * 2);
+		Rows    = max(rows,    Rows    * 2);
+		Cells.clear();
+		Cells.resize(Columns * Rows);
+		for (size_t i = 0; i < Rects.size(); i++)
+		{
+			if (Rects[i].w != 0)
+			{
+				linkRect(i, true);
+			}
+		}
+	}
+}
+
+void FreeArea::linkRect( size_t index, bool link )
+{
+	const RECT& rect = Rects[index];
+	unsigned long x1 = rect.x >> CELL_SHIFT, x2 = (rect.x + rect.w - 1) >> CELL_SHIFT;
+	unsigned long y1 = rect.y >> CELL_SHIFT, y2 = (rect.y + rect.h - 1) >> CELL_SHIFT;
+	for (unsigned long y = y1; y <= y2; y++)
+	{
+		for (unsigned long x = x1; x <= x2; x++)
+		{
+			vector<size_t>& cell = Cells[y * Columns + x];
+			if (link)
+			{
+				cell.push_back(index);
+			}
+			else
+			{
+				vector<size_t>::iterator p = find(cell.begin(), cell.end(), index);
+				*p = cell.back();
+				cell.pop_back();
+			}
+		}
+	}
+}
+
+void FreeArea::findRects( const RECT& rect, vector<size_t>& found )
+{
+	found.clear();
+	if (Columns == 0 || Rows == 0)
+	{
+		return;
+	}
+
+	// Every rectangle is collected once, even if it spans several cells
+	if (Visited.size() < Rects.size())
+	{
+		Visited.resize(Rects.size(), 0);
+	}
+	Stamp++;
+
+	unsigned long x1 = rect.x >> CELL_SHIFT, x2 = min((rect.x + rect.w - 1) >> CELL_SHIFT, Columns - 1);
+	unsigned long y1 = rect.y >> CELL_SHIFT, y2 = min((rect.y + rect.h - 1) >> CELL_SHIFT, Rows - 1);
+	for (unsigned long y = y1; y <= y2; y++)
+	{
+		for (unsigned long x = x1; x <= x2; x++)
+		{
+			const vector<size_t>& cell = Cells[y * Columns + x];
+			for (size_t i = 0; i < cell.size(); i++)
+			{
+				if (Visited[cell[i]] != Stamp)
+				{
+					Visited[cell[i]] = Stamp;
+					found.push_back(cell[i]);
+				}
+			}
+		}
+	}
+}
+
+void FreeArea::releaseRect( size_t index )
+{
+	linkRect(index, false);
+	Rects[index].w = 0;
+	Recycled.push(index);
+}
+
 void FreeArea::addRect( const RECT& rect )
 {
+	if (rect.w == 0 || rect.h == 0)
+	{
+		return;
+	}
+
+	growGrid(rect);
+
+	vector<size_t> found;
+	findRects(rect, found);
+
 	// Check if the rectangle is completely contained within an existing rectangle
-	for (vector<RECT>::iterator p = Rects.begin(); p != Rects.end(); p++)
+	for (size_t i = 0; i < found.size(); i++)
 	{
-		if ((rect.x >= p->x) && (rect.x + rect.w <= p->x + p->w) &&
-			(rect.y >= p->y) && (rect.y + rect.h <= p->y + p->h))
+		if (Contains(Rects[found[i]], rect))
 		{
 			return;
 		}
 	}
 
-	// If not, add it
+	// Prune the rectangles that it contains
+	for (size_t i = 0; i < found.size(); i++)
+	{
+		if (Contains(rect, Rects[found[i]]))
+		{
+			releaseRect(found[i]);
+		}
+	}
+
+	// Add it
+	size_t index;
 	if (Recycled.empty())
 	{
+		index = Rects.size();
 		Rects.push_back( rect );
 	}
 	else
 	{
-		Rects[ Recycled.top() ] = rect;
+		index = Recycled.top();
 		Recycled.pop();
+		Rects[index] = rect;
 	}
+	linkRect(index, true);
 }
 
 bool FreeArea::removeRect( const RECT& rect )
 {
 	bool complete = false;
-	for (size_t i = 0; i < Rects.size(); i++)
+
+	vector<size_t> found;
+	findRects(rect, found);
+
+	vector<RECT> pieces;
+	for (size_t i = 0; i < found.size(); i++)
 	{
-		if (Rects[i].w != 0 &&
-			(rect.x + rect.w > Rects[i].x) && (rect.x < Rects[i].x + Rects[i].w) &&
-			(rect.y + rect.h > Rects[i].y) && (rect.y < Rects[i].y + Rects[i].h))
+		RECT r = Rects[found[i]];
+		if (Intersects(rect, r))
 		{
 			// The rectangle intersect an existing rectangle
-			if ((rect.x >= Rects[i].x) && (rect.x + rect.w <= Rects[i].x + Rects[i].w) &&
-				(rect.y >= Rects[i].y) && (rect.y + rect.h <= Rects[i].y + Rects[i].h))
+			if (Contains(r, rect))
 			{
 				// The rectangle is completely contained within this rectangle
 				complete = true;
 			}
 
 			// Remove it
-			RECT r = Rects[i];
-			Rects[i].w = 0;
-			Recycled.push(i);
+			releaseRect(found[i]);
 
 			// Now create (at most four) rectangles that describe the remainder
 			if (rect.x > r.x)
 			{
 				// Create the left rectangle
 				RECT nr = {r.x, r.y, rect.x - r.x, r.h};
-				addRect(nr);
+				pieces.push_back(nr);
 			}
 
 			if (rect.y > r.y)
 			{
 				// Create the top rectangle
 				RECT nr = {r.x, r.y, r.w, rect.y - r.y};
-				addRect(nr);
+				pieces.push_back(nr);
 			}
 
 			if (rect.x + rect.w < r.x + r.w)
 			{
 				// Create the right rectangle
 				RECT nr = {rect.x + rect.w, r.y, (r.x + r.w) - (rect.x + rect.w), r.h};
-				addRect(nr);
+				pieces.push_back(nr);
 			}
 
 			if (rect.y + rect.h < r.y + r.h)
 			{
 				// Create the bottom rectangle
 				RECT nr = { r.x, rect.y + rect.h, r.w, (r.y + r.h) - (rect.y + rect.h)};
-				addRect(nr);
+				pieces.push_back(nr);
 			}
 		}
 	}
+
+	// Add the pieces after splitting, so they're pruned against each other
+	for (size_t i = 0; i < pieces.size(); i++)
+	{
+		addRect(pieces[i]);
+	}
 	return complete;
 }
 
 bool FreeArea::getFreeArea( RECT& area )
 {
-	// Find a free rectangle that can hold the area
-	for (vector<RECT>::iterator p = Rects.begin(); p != Rects.end(); p++)
+	// Find the free rectangle that fits the area best
+	const RECT*   best = NULL;
+	unsigned long bestShort = 0, bestLong = 0;
+	for (vector<RECT>::const_iterator p = Rects.begin(); p != Rects.end(); p++)
 	{
-		if ((p->w >= area.w) && (p->h >= area.h))
+		if (p->w != 0 && (p->w >= area.w) && (p->h >= area.h))
 		{
-			// Found one, remove it
-			RECT rect;
-			rect.x = area.x = p->x;
-			rect.y = area.y = p->y;
-			rect.w = area.w;
-			rect.h = area.h;
-			removeRect(rect);
-			return true;
+			unsigned long leftoverW = p->w - area.w;
+			unsigned long leftoverH = p->h - area.h;
+			unsigned long shortSide = min(leftoverW, leftoverH);
+			unsigned long longSide  = max(leftoverW, leftoverH);
+			if (best == NULL || shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+			{
+				best      = &*p;
+				bestShort = shortSide;
+				bestLong  = longSide;
+			}
 		}
 	}
 
-	// No rectangle could hold the area
-	return false;
+	if (best == NULL)
+	{
+		// No rectangle could hold the area
+		return false;
+	}
+
+	// Found one, remove it
+	RECT rect;
+	rect.x = area.x = best->x;
+	rect.y = area.y = best->y;
+	rect.w = area.w;
+	rect.h = area.h;
+	removeRect(rect);
+	return true;
 }
 
 bool FreeArea::addUsedArea( int x, int y, int width, int height )
@@ -122,3 +272,47 @@ void FreeArea::addFreeArea( int x, int y, int width, int height )
 	RECT rect = {x, y, width, height};
 	addRect( rect );
 }
+
+void FreeArea::grow( unsigned long width, unsigned long height, unsigned long newWidth, unsigned long newHeight )
+{
+	// Extend the rectangles that touch the old right or bottom edge
+	vector<RECT> extended;
+	for (vector<RECT>::const_iterator p = Rects.begin(); p != Rects.end(); p++)
+	{
+		if (p->w != 0)
+		{
+			if (newWidth > width && p->x + p->w == width)
+			{
+				RECT r = {p->x, p->y, newWidth - p->x, p->h};
+				extended.push_back(r);
+			}
+			if (newHeight > height && p->y + p->h == height)
+			{
+				RECT r = {p->x, p->y, p->w, newHeight - p->y};
+				extended.push_back(r);
+			}
+		}
+	}
+
+	// Add the new space itself
+	if (newWidth > width)
+	{
+		RECT r = {width, 0, newWidth - width, newHeight};
+		extended.push_back(r);
+	}
+	if (newHeight > height)
+	{
+		RECT r = {0, height, newWidth, newHeight - height};
+		extended.push_back(r);
+	}
+
+	for (size_t i = 0; i < extended.size(); i++)
+	{
+		addRect(extended[i]);
+	}
+}
+
+FreeArea::FreeArea()
+	: Columns(0), Rows(0), Stamp(0)
+{
+}
@@ -17,8 +17,20 @@ public:
 	};
 
 private:
-	std::vector<RECT>   Rects;
-	std::stack<size_t> Recycled;
+	// The free rectangles are kept maximal (they may overlap) and are
+	// indexed by a uniform grid, so splitting and pruning only has to
+	// look at the rectangles near the area of interest.
+	std::vector<RECT>                  Rects;
+	std::stack<size_t>                 Recycled;
+	std::vector< std::vector<size_t> > Cells;
+	unsigned long                      Columns, Rows;
+	std::vector<unsigned long>         Visited;
+	unsigned long                      Stamp;
+
+	void growGrid( const RECT& rect );
+	void linkRect( size_t index, bool link );
+	void findRects( const RECT& rect, std::vector<size_t>& found );
+	void releaseRect( size_t index );
 
 	void addRect( const RECT& rect );
 	bool removeRect( const RECT& rect );
@@ -26,7 +38,8 @@ private:
 public:
 	// Get a free area of size area.width by area.height
 	// The resulting (x,y) coordinates are stored in the parameter along with the
-	// requested width and height.
+	// requested width and height. The free rectangle that leaves the shortest
+	// leftover side is chosen (MaxRects best-short-side-fit).
 	bool getFreeArea( RECT& area );
 
 	// Mark this area as used
@@ -35,6 +48,12 @@ public:
 
 	// Mark this area as free
 	void addFreeArea( int x, int y, int width, int height );
+
+	// The managed area grows from width x height to newWidth x newHeight.
+	// Free rectangles on the old edges are extended into the new space.
+	void grow( unsigned long width, unsigned long height, unsigned long newWidth, unsigned long newHeight );
+
+	FreeArea();
 };
 
-#endif
\ No newline at end of file
+#endif
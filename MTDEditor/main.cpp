@@ -14,6 +14,7 @@
 #include <vector>
 #include "exceptions.h"
 #include "filepair.h"
+#include "batch.h"
 #include "Utils.h"
 using namespace std;
 
@@ -970,6 +971,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 	freopen("conout$", "w", stdout);
 #endif
     FreeImage_Initialise();
+
+	vector<wstring> argv = ParseCommandLine();
+	if (IsBatchCommandLine(argv))
+	{
+		// Headless build; report to the console we were started from
+		AttachConsole(ATTACH_PARENT_PROCESS);
+		freopen("conout$", "w", stdout);
+		freopen("conout$", "w", stderr);
+		int result = RunBatch(argv);
+	    FreeImage_DeInitialise();
+		return result;
+	}
+
 	try
 	{
 		ApplicationInfo info;
@@ -989,7 +1003,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 		// Create a blank file
 		DoNewFile(&info);
 
-		main( &info, ParseCommandLine() );
+		main( &info, argv );
 	}
 	catch (wexception& e)
 	{
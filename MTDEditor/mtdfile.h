@@ -0,0 +1,21 @@
+//
+// This file defines the on-disk format of an MTD file.
+//
+// An MTD file starts with a 32-bit little-endian count, followed by that
+// many fixed-size FILEINFO records.
+//
+#ifndef MTDFILE_H
+#define MTDFILE_H
+
+#include "types.h"
+
+#pragma pack(1)
+struct FILEINFO
+{
+	char name[64];
+	uint32_t x, y, w, h;
+	uint8_t used;
+};
+#pragma pack()
+
+#endif
@@ -0,0 +1,241 @@
+//
+// This file contains the read-only MTD view.
+//
+// The records are used straight from a memory mapping of the file. Names are
+// looked up with a minimal perfect hash: every name first hashes to a bucket,
+// and every bucket stores the displacement that sends all of its names to
+// distinct slots. A lookup is therefore one hash, two table reads and one
+// name compare, regardless of the number of images.
+//
+#include <algorithm>
+#include "mtdindex.h"
+#include "exceptions.h"
+#include "Utils.h"
+#include "resource.h"
+using namespace std;
+
+// Average number of names per bucket
+static const size_t BUCKET_SIZE = 4;
+
+// Give up finding a displacement after this many tries
+static const uint32_t MAX_DISPLACEMENT = 1 << 24;
+
+static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+// Case-insensitive FNV-1a of an MTD name
+static uint32_t HashName(const char* name)
+{
+	uint32_t hash = 2166136261U;
+	for (int i = 0; i < 63 && name[i] != '\0'; i++)
+	{
+		hash = (hash ^ (uint8_t)toupper((uint8_t)name[i])) * 16777619U;
+	}
+	return hash;
+}
+
+// Scrambles the name hash with a displacement
+static uint32_t Displace(uint32_t hash, uint32_t d)
+{
+	hash ^= d * 0x9E3779B9U;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6BU;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35U;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static bool SameName(const char* name1, const char* name2)
+{
+	return _strnicmp(name1, name2, 63) == 0;
+}
+
+struct BucketSizeDesc
+{
+	bool operator()(const vector<uint32_t>* a, const vector<uint32_t>* b) const {
+		return a->size() > b->size();
+	}
+};
+
+void MtdIndex::buildIndex()
+{
+	vector<uint32_t> hashes(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		hashes[i] = HashName(records[i].name);
+	}
+
+	size_t nBuckets = max((size_t)1, (count + BUCKET_SIZE - 1) / BUCKET_SIZE);
+	vector< vector<uint32_t> > buckets(nBuckets);
+	for (size_t i = 0; i < count; i++)
+	{
+		// Duplicate names could never be separated; the first one wins
+		vector<uint32_t>& bucket = buckets[hashes[i] % nBuckets];
+		vector<uint32_t>::const_iterator p;
+		for (p = bucket.begin(); p != bucket.end() && !SameName(records[*p].name, records[i].name); p++);
+		if (p == bucket.end())
+		{
+			bucket.push_back((uint32_t)i);
+		}
+	}
+
+	// Place the largest buckets first, while most slots are still free
+	vector< vector<uint32_t>* > order(nBuckets);
+	for (size_t b = 0; b < nBuckets; b++)
+	{
+		order[b] = &buckets[b];
+	}
+	stable_sort(order.begin(), order.end(), BucketSizeDesc());
+
+	displacements.assign(nBuckets, 0);
+	slots.assign(max((size_t)1, count), EMPTY_SLOT);
+
+	vector<size_t> placed;
+	for (size_t b = 0; b < nBuckets && !order[b]->empty(); b++)
+	{
+		const vector<uint32_t>& bucket = *order[b];
+		uint32_t d;
+		for (d = 0; d < MAX_DISPLACEMENT; d++)
+		{
+			placed.clear();
+			size_t i;
+			for (i = 0; i < bucket.size(); i++)
+			{
+				size_t slot = Displace(hashes[bucket[i]], d) % slots.size();
+				if (slots[slot] != EMPTY_SLOT)
+				{
+					break;
+				}
+				slots[slot] = bucket[i];
+				placed.push_back(slot);
+			}
+
+			if (i == bucket.size())
+			{
+				break;
+			}
+
+			// Collision, undo and try the next displacement
+			for (size_t j = 0; j < placed.size(); j++)
+			{
+				slots[placed[j]] = EMPTY_SLOT;
+			}
+		}
+
+		if (d == MAX_DISPLACEMENT)
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_FILE_READ));
+		}
+		displacements[order[b] - &buckets[0]] = d;
+	}
+}
+
+MtdIndex::Sprite MtdIndex::getSprite(size_t index) const
+{
+	const FILEINFO& record = records[index];
+
+	Sprite sprite;
+	sprite.name = string(record.name, std::find(record.name, record.name + 63, '\0'));
+	sprite.x    = letohl(record.x);
+	sprite.y    = letohl(record.y);
+	sprite.w    = letohl(record.w);
+	sprite.h    = letohl(record.h);
+	sprite.used = record.used != 0;
+	return sprite;
+}
+
+size_t MtdIndex::find(const char* name) const
+{
+	if (count == 0)
+	{
+		return npos;
+	}
+
+	uint32_t hash  = HashName(name);
+	uint32_t d     = displacements[hash % displacements.size()];
+	uint32_t index = slots[Displace(hash, d) % slots.size()];
+	return (index != EMPTY_SLOT && SameName(records[index].name, name)) ? index : npos;
+}
+
+void MtdIndex::extract(FIBITMAP* atlas, const size_t* indices, size_t n, uint32_t* const* buffers) const
+{
+	if (FreeImage_GetBPP(atlas) != 32)
+	{
+		throw wruntime_error(LoadString(IDS_ERROR_FORMAT_UNSUPPORTED));
+	}
+
+	unsigned long width  = FreeImage_GetWidth(atlas);
+	unsigned long height = FreeImage_GetHeight(atlas);
+	unsigned long pitch  = FreeImage_GetPitch(atlas);
+	const uint8_t* bits  = FreeImage_GetBits(atlas);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const FILEINFO& record = records[indices[i]];
+		unsigned long x = letohl(record.x), y = letohl(record.y);
+		unsigned long w = letohl(record.w), h = letohl(record.h);
+		if (x > width || w > width - x || y > height || h > height - y)
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_BITMAP_COPY));
+		}
+
+		// FreeImage stores the bottom row first
+		const uint8_t* src = bits + (height - y - 1) * pitch + x * sizeof(uint32_t);
+		uint32_t*      dst = buffers[i];
+		for (unsigned long row = 0; row < h; row++, src -= pitch, dst += w)
+		{
+			memcpy(dst, src, w * sizeof(uint32_t));
+		}
+	}
+}
+
+void MtdIndex::close()
+{
+	if (view     != NULL) UnmapViewOfFile(view);
+	if (hMapping != NULL) CloseHandle(hMapping);
+	if (hFile    != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+}
+
+MtdIndex::MtdIndex(const wstring& filename)
+	: hFile(INVALID_HANDLE_VALUE), hMapping(NULL), view(NULL), records(NULL), count(0)
+{
+	try
+	{
+		hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_FILE_OPEN));
+		}
+
+		DWORD size = GetFileSize(hFile, NULL);
+		if (size == INVALID_FILE_SIZE || size < sizeof(uint32_t))
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_FILE_READ));
+		}
+
+		hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hMapping == NULL || (view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0)) == NULL)
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_FILE_READ));
+		}
+
+		count = letohl(*(const uint32_t*)view);
+		if (count > (size - sizeof(uint32_t)) / sizeof(FILEINFO))
+		{
+			throw wruntime_error(LoadString(IDS_ERROR_FILE_READ));
+		}
+		records = (const FILEINFO*)((const char*)view + sizeof(uint32_t));
+
+		buildIndex();
+	}
+	catch (...)
+	{
+		close();
+		throw;
+	}
+}
+
+MtdIndex::~MtdIndex()
+{
+	close();
+}
@@ -0,0 +1,60 @@
+//
+// This file defines a read-only view on an MTD file, for tools that only
+// need to look up and extract images.
+//
+#ifndef MTDINDEX_H
+#define MTDINDEX_H
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#include "freeimage.h"
+#include "mtdfile.h"
+
+class MtdIndex
+{
+	HANDLE                hFile;
+	HANDLE                hMapping;
+	const void*           view;
+	const FILEINFO*       records;		// Points into the mapped file
+	size_t                count;
+
+	// Minimal perfect hash over the names (hash and displace)
+	std::vector<uint32_t> displacements;	// Per bucket
+	std::vector<uint32_t> slots;			// Record index per slot
+
+	void buildIndex();
+	void close();
+
+	// Not copyable
+	MtdIndex(const MtdIndex&);
+	MtdIndex& operator=(const MtdIndex&);
+
+public:
+	static const size_t npos = (size_t)-1;
+
+	struct Sprite
+	{
+		std::string   name;
+		unsigned long x, y;
+		unsigned long w, h;
+		bool          used;
+	};
+
+	size_t size() const { return count; }
+	Sprite getSprite(size_t index) const;
+
+	// Returns the index of the named image (case insensitive) or npos
+	size_t find(const char* name) const;
+
+	// Copies the images (without border) from the 32-bit atlas into the buffers.
+	// Each buffer receives w * h pixels, top row first.
+	void extract(FIBITMAP* atlas, const size_t* indices, size_t n, uint32_t* const* buffers) const;
+
+	MtdIndex(const std::wstring& filename);
+	~MtdIndex();
+};
+
+#endif
@@ -0,0 +1,208 @@
+//
+// This file contains the headless preview extractor.
+//
+// Usage: MapPreviewExtractor /extract [/d <directory>] [/q] <source>...
+//
+// Sources can be maps, directories or wildcards; a directory means all *.TED
+// files in it. Every map's preview is written as a TGA file with the map's
+// name, either next to the map or in the /d directory, and removed from the
+// map. Maps without a preview are left alone.
+//
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <iostream>
+
+#include "Batch.h"
+#include "Preview.h"
+#include "Exceptions.h"
+using namespace std;
+
+struct Arguments
+{
+	bool            quiet;
+	wstring         destdir;
+	vector<wstring> sources;
+};
+
+static void PrintUsage()
+{
+	wcerr << L"Usage: MapPreviewExtractor /extract [/d <directory>] [/q] <source>..." << endl
+		  << endl
+		  << L"Writes the preview image of every map to a TGA file and removes it from the map." << endl
+		  << L"Sources can be maps, directories or wildcards." << endl
+		  << endl
+		  << L"Options:" << endl
+		  << L"/d       Writes the TGA files to this directory instead of next to the maps" << endl
+		  << L"/q       Quiet. Prints nothing when all goes well" << endl;
+}
+
+static bool IsOption(const wstring& arg, const wchar_t* name)
+{
+	return arg.length() >= 2 && (arg[0] == L'/' || arg[0] == L'-') && _wcsicmp(arg.c_str() + 1, name) == 0;
+}
+
+static bool ParseArguments(Arguments& args, const vector<wstring>& argv)
+{
+	args.quiet = false;
+	for (size_t i = 1; i < argv.size(); i++)
+	{
+		if (argv[i][0] != L'/' && argv[i][0] != L'-') {
+			args.sources.push_back(argv[i]);
+		} else if (IsOption(argv[i], L"extract")) {
+			// Selects batch mode
+		} else if (IsOption(argv[i], L"q")) {
+			args.quiet = true;
+		} else if (IsOption(argv[i], L"d") && i + 1 < argv.size()) {
+			args.destdir = argv[++i];
+		} else {
+			wcerr << L"Unknown option '" << argv[i] << L"'" << endl;
+			return false;
+		}
+	}
+
+	if (args.sources.empty())
+	{
+		PrintUsage();
+		return false;
+	}
+	return true;
+}
+
+// Adds all files in the directory that match the filter
+static void FindFiles(vector<wstring>& filenames, const wstring& dir, const wstring& filter)
+{
+	WIN32_FIND_DATA wfd;
+	HANDLE hFind = FindFirstFile((dir + filter).c_str(), &wfd);
+	if (hFind != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (~wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				filenames.push_back(dir + wfd.cFileName);
+			}
+		} while (FindNextFile(hFind, &wfd));
+		FindClose(hFind);
+	}
+}
+
+// Returns the name of the preview file for the map
+static wstring GetPreviewFilename(const wstring& map, const wstring& destdir)
+{
+	size_t  slash = map.find_last_of(L"\\/:");
+	wstring dir   = (slash == wstring::npos) ? L"" : map.substr(0, slash + 1);
+	wstring name  = (slash == wstring::npos) ? map : map.substr(slash + 1);
+
+	size_t dot = name.find_last_of(L'.');
+	if (dot != wstring::npos)
+	{
+		name = name.substr(0, dot);
+	}
+
+	if (!destdir.empty())
+	{
+		dir = destdir;
+		if (dir[dir.length() - 1] != L'\\' && dir[dir.length() - 1] != L'/') {
+			dir += L"\\";
+		}
+	}
+	return dir + name + L".tga";
+}
+
+bool IsBatchCommandLine(const vector<wstring>& argv)
+{
+	for (size_t i = 1; i < argv.size(); i++)
+	{
+		if (IsOption(argv[i], L"extract"))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int RunBatch(const vector<wstring>& argv)
+{
+	Arguments args;
+	if (!ParseArguments(args, argv))
+	{
+		return 1;
+	}
+
+	if (!args.destdir.empty())
+	{
+		CreateDirectory(args.destdir.c_str(), NULL);
+	}
+
+	// Collect the maps
+	vector<wstring> maps;
+	int unmatched = 0;
+	for (size_t i = 0; i < args.sources.size(); i++)
+	{
+		size_t  found      = maps.size();
+		wstring source     = args.sources[i];
+		DWORD   attributes = GetFileAttributes(source.c_str());
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			if (source[source.length() - 1] != L'\\' && source[source.length() - 1] != L'/') {
+				source += L"\\";
+			}
+			FindFiles(maps, source, L"*.ted");
+		}
+		else
+		{
+			size_t ofs = source.find_last_of(L"\\/:");
+			ofs = (ofs == wstring::npos) ? 0 : ofs + 1;
+			FindFiles(maps, source.substr(0, ofs), source.substr(ofs));
+		}
+
+		if (maps.size() == found)
+		{
+			// Most likely a typo in the script
+			wcerr << args.sources[i] << L": no maps found" << endl;
+			unmatched++;
+		}
+	}
+
+	// The maps are large and the work is all I/O, so do them one at a
+	// time rather than have the disk seek between several at once.
+	int extracted = 0, failed = 0;
+	for (size_t i = 0; i < maps.size(); i++)
+	{
+		try
+		{
+			wstring dest = GetPreviewFilename(maps[i], args.destdir);
+			if (ExtractMapPreview(maps[i], dest))
+			{
+				if (!args.quiet) {
+					wcout << maps[i] << L": preview written to " << dest << endl;
+				}
+				extracted++;
+			}
+			else if (!args.quiet)
+			{
+				wcout << maps[i] << L": no preview" << endl;
+			}
+		}
+		catch (wexception& e)
+		{
+			wcerr << maps[i] << L": " << e.what() << endl;
+			failed++;
+		}
+		catch (exception& e)
+		{
+			// Out of memory and such; only fail this map
+			wcerr << maps[i] << L": " << e.what() << endl;
+			failed++;
+		}
+	}
+
+	if (!args.quiet || failed > 0 || unmatched > 0)
+	{
+		wcout << extracted << L" extracted, " << maps.size() - extracted - failed << L" without preview, " << failed << L" failed" << endl;
+		if (unmatched > 0) {
+			wcout << unmatched << L" source(s) matched no maps" << endl;
+		}
+	}
+	return (failed > 0 || unmatched > 0) ? 1 : 0;
+}
@@ -2,6 +2,7 @@
 #include "Exceptions.h"
 #include "ExactTypes.h"
 #include <cassert>
+#include <cstring>
 using namespace std;
 
 #pragma pack(1)
@@ -131,7 +132,7 @@ ChunkReader::ChunkReader(File& file)
 void ChunkWriter::beginChunk(ChunkType type)
 {
 	m_curDepth++;
-	m_chunks[m_curDepth].offset   = m_file.tell();
+	m_chunks[m_curDepth].offset   = (unsigned long)m_buffer.size();
 	m_chunks[m_curDepth].hdr.type = type;
 	m_chunks[m_curDepth].hdr.size = 0;
 	if (m_curDepth > 0)
@@ -142,7 +143,7 @@ void ChunkWriter::beginChunk(ChunkType type)
 
 	// Write dummy header
 	CHUNKHDR hdr = {0,0};
-	m_file.write(&hdr, sizeof(CHUNKHDR));
+	append(&hdr, sizeof(CHUNKHDR));
 }
 
 void ChunkWriter::beginMiniChunk(ChunkType type)
@@ -151,13 +152,13 @@ void ChunkWriter::beginMiniChunk(ChunkType type)
 	assert(m_miniChunk.offset == -1);
 	assert(type <= 0xFF);
 
-	m_miniChunk.offset   = m_file.tell();
+	m_miniChunk.offset   = (unsigned long)m_buffer.size();
 	m_miniChunk.hdr.type = (uint8_t)type;
 	m_miniChunk.hdr.size = 0;
 	
 	// Write dummy header
 	MINICHUNKHDR hdr = {0, 0};
-	m_file.write(&hdr, sizeof(MINICHUNKHDR));
+	append(&hdr, sizeof(MINICHUNKHDR));
 }
 
 void ChunkWriter::endChunk()
@@ -166,43 +167,56 @@ void ChunkWriter::endChunk()
 	if (m_miniChunk.offset != -1)
 	{
 		// Ending mini-chunk
-		long pos  = m_file.tell();
-		long size = pos - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
+		long size = (long)m_buffer.size() - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
 		assert(size <= 0xFF);
 
 		m_miniChunk.hdr.size = (uint8_t)size;
 		
 		MINICHUNKHDR hdr = {m_miniChunk.hdr.type, m_miniChunk.hdr.size};
-		m_file.seek(m_miniChunk.offset);
-		m_file.write(&hdr, sizeof(MINICHUNKHDR) );
-		m_file.seek(pos);
+		memcpy(&m_buffer[m_miniChunk.offset], &hdr, sizeof(MINICHUNKHDR));
 		m_miniChunk.offset = -1;
 	}
 	else
 	{
 		// Ending normal chunk
-		long pos  = m_file.tell();
-		long size = pos - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
+		long size = (long)m_buffer.size() - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
 
 		m_chunks[m_curDepth].hdr.size = (m_chunks[m_curDepth].hdr.size & 0x80000000) | (size & ~0x80000000);
 		CHUNKHDR hdr = { htolel(m_chunks[m_curDepth].hdr.type), htolel(m_chunks[m_curDepth].hdr.size) };
-		m_file.seek(m_chunks[m_curDepth].offset);
-		m_file.write(&hdr, sizeof(CHUNKHDR));
-		m_file.seek(pos);
+		memcpy(&m_buffer[m_chunks[m_curDepth].offset], &hdr, sizeof(CHUNKHDR));
 
-		m_curDepth--;
+		if (--m_curDepth < 0)
+		{
+			// The map is written in one go per top-level chunk
+			flush();
+		}
 	}
 }
 
-void ChunkWriter::write(const void* buffer, size_t size)
+void ChunkWriter::append(const void* buffer, size_t size)
 {
-	assert(m_curDepth >= 0);
-	if (m_file.write(buffer, size) != size)
+	const char* data = (const char*)buffer;
+	m_buffer.insert(m_buffer.end(), data, data + size);
+}
+
+void ChunkWriter::flush()
+{
+	if (!m_buffer.empty())
 	{
-		throw WriteException();
+		if (m_file.write(&m_buffer[0], m_buffer.size()) != m_buffer.size())
+		{
+			throw WriteException();
+		}
+		m_buffer.clear();
 	}
 }
 
+void ChunkWriter::write(const void* buffer, size_t size)
+{
+	assert(m_curDepth >= 0);
+	append(buffer, size);
+}
+
 ChunkWriter::ChunkWriter(File& file)
     : m_file(file)
 {
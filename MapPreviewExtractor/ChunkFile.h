@@ -2,6 +2,7 @@
 #define CHUNKFILE_H
 
 #include "Files.h"
+#include <vector>
 
 typedef long ChunkType;
 
@@ -53,10 +54,14 @@ class ChunkWriter
 	};
 
 	File&                      m_file;
+	std::vector<char>          m_buffer;	// Unfinished top-level chunk
 	ChunkInfo<ChunkHeader>     m_chunks[ MAX_CHUNK_DEPTH ];
 	ChunkInfo<MiniChunkHeader> m_miniChunk;
 	int                        m_curDepth;
 
+	void append(const void* buffer, size_t size);
+	void flush();
+
 public:
 	void beginChunk(ChunkType type);
 	void beginMiniChunk(ChunkType type);
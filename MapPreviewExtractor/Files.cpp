@@ -10,6 +10,12 @@ struct PhysicalFile::Handle
 	HANDLE hFile;
 };
 
+struct MappedFile::Handle
+{
+	HANDLE hFile;
+	HANDLE hMapping;
+};
+
 //
 // PhysicalFile class
 //
@@ -86,3 +92,89 @@ PhysicalFile::~PhysicalFile()
     CloseHandle(handle->hFile);
     delete handle;
 }
+
+//
+// MappedFile class
+//
+bool MappedFile::eof()
+{
+	return offset == m_size;
+}
+
+unsigned long MappedFile::size()
+{
+	return m_size;
+}
+
+void MappedFile::seek(unsigned long offset)
+{
+	this->offset = min(offset, m_size);
+}
+
+unsigned long MappedFile::tell()
+{
+	return offset;
+}
+
+size_t MappedFile::read(void* buffer, size_t count)
+{
+	count = min(count, (size_t)(m_size - offset));
+	memcpy(buffer, m_data + offset, count);
+	offset += (unsigned long)count;
+	return count;
+}
+
+size_t MappedFile::write(const void* buffer, size_t count)
+{
+	return 0;
+}
+
+MappedFile::MappedFile(const wstring& filename)
+    : handle(new Handle), m_data(NULL), m_size(0), offset(0)
+{
+	handle->hMapping = NULL;
+	handle->hFile    = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle->hFile == INVALID_HANDLE_VALUE)
+	{
+		DWORD error = GetLastError();
+		delete handle;
+		if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+		{
+			throw FileNotFoundException(filename);
+		}
+		throw IOException(L"Unable to open file" + filename);
+	}
+
+	m_size = GetFileSize(handle->hFile, NULL);
+	if (m_size > 0)
+	{
+		// Empty files can't be mapped
+		handle->hMapping = CreateFileMapping(handle->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (handle->hMapping != NULL)
+		{
+			m_data = (const char*)MapViewOfFile(handle->hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+
+		if (m_data == NULL)
+		{
+			if (handle->hMapping != NULL)
+			{
+				CloseHandle(handle->hMapping);
+			}
+			CloseHandle(handle->hFile);
+			delete handle;
+			throw ReadException();
+		}
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data != NULL)
+	{
+		UnmapViewOfFile(m_data);
+		CloseHandle(handle->hMapping);
+	}
+	CloseHandle(handle->hFile);
+	delete handle;
+}
@@ -42,4 +42,29 @@ public:
 	~PhysicalFile();
 };
 
+// Read-only view of an entire file. Reading from it is a copy from memory,
+// and data() gives direct access, so large files don't need to be loaded.
+class MappedFile : public File
+{
+	struct Handle;
+
+	Handle*       handle;
+	const char*   m_data;
+	unsigned long m_size;
+	unsigned long offset;
+
+public:
+	bool          eof();
+	unsigned long size();
+	void          seek(unsigned long offset);
+	unsigned long tell();
+	size_t read(void* buffer, size_t count);
+    size_t write(const void* buffer, size_t count);
+
+	const char* data() const { return m_data; }
+
+	MappedFile(const std::wstring& filename);
+	~MappedFile();
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include "Preview.h"
+#include "ChunkFile.h"
+#include "Exceptions.h"
+using namespace std;
+
+// The preview image is a top-level data chunk of this type
+static const ChunkType CHUNK_PREVIEW = 0x13;
+
+// Size of a chunk's header in the file
+static const unsigned long CHUNK_HEADER_SIZE = 8;
+
+static void WriteRange(File& file, const char* data, unsigned long size)
+{
+	if (size > 0 && file.write(data, size) != size)
+	{
+		throw WriteException();
+	}
+}
+
+//
+// The map is mapped into memory and only the top-level chunk headers are
+// read to find the preview. Both the preview and the map without it are
+// then written straight from the mapping; no other chunk is ever parsed.
+//
+bool ExtractMapPreview(const wstring& map, const wstring& dest)
+{
+	size_t  ofs = map.find_last_of(L"\\/");
+	wstring dir = (ofs == wstring::npos) ? L"." : map.substr(0, ofs + 1);
+
+	wchar_t tmpname[MAX_PATH];
+	{
+		MappedFile  file(map);
+		ChunkReader reader(file);
+
+		unsigned long start = 0, end = 0;
+		ChunkType type;
+		while ((type = reader.next()) != -1)
+		{
+			if (type == CHUNK_PREVIEW)
+			{
+				if (reader.group())
+				{
+					// Not an image
+					return false;
+				}
+				start = file.tell() - CHUNK_HEADER_SIZE;
+				end   = file.tell() + (unsigned long)reader.size();
+				if (end > file.size())
+				{
+					throw BadFileException();
+				}
+				break;
+			}
+			// Skip it, whether it has children or not
+			reader.skip();
+		}
+
+		if (end == 0)
+		{
+			return false;
+		}
+
+		PhysicalFile preview(dest, FILEMODE_WRITE);
+		WriteRange(preview, file.data() + start + CHUNK_HEADER_SIZE, end - start - CHUNK_HEADER_SIZE);
+
+		// Splice the map around the preview into a temporary file next to it
+		if (GetTempFileName(dir.c_str(), L"ted", 0, tmpname) == 0)
+		{
+			throw IOException(L"Unable to create temporary file in " + dir);
+		}
+
+		try
+		{
+			PhysicalFile output(tmpname, FILEMODE_WRITE);
+			WriteRange(output, file.data(), start);
+			WriteRange(output, file.data() + end, file.size() - end);
+		}
+		catch (...)
+		{
+			DeleteFile(tmpname);
+			throw;
+		}
+	}
+
+	// The mapping is closed, so the map can be replaced now
+	if (!MoveFileEx(tmpname, map.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		DeleteFile(tmpname);
+		throw WriteException();
+	}
+	return true;
+}
@@ -0,0 +1,12 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <string>
+
+//
+// Writes the preview image of the map to dest and removes it from the map.
+// Returns false, and changes nothing, if the map has no preview image.
+//
+bool ExtractMapPreview(const std::wstring& map, const std::wstring& dest);
+
+#endif
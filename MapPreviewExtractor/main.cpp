@@ -1,6 +1,6 @@
-#include "ChunkFile.h"
+#include "Batch.h"
+#include "Preview.h"
 #include "Exceptions.h"
-#include <list>
 #include <vector>
 using namespace std;
 
@@ -28,128 +28,17 @@ static wstring LoadResourceString(UINT uID)
     return wstring(str, n);
 }
 
-class ChunkFile
-{
-    class Chunk
-    {
-        typedef list<pair<ChunkType, Chunk*> > ChunkList;
-
-        ChunkList m_children;
-        char*     m_data;
-        size_t    m_size;
-
-    public:
-        void write(ChunkWriter& writer) const
-        {
-            if (m_data != NULL)
-            {
-                writer.write(m_data, m_size);
-            }
-            else
-            {
-                for (ChunkList::const_iterator p = m_children.begin(); p != m_children.end(); ++p)
-                {
-                    writer.beginChunk(p->first);
-                    p->second->write(writer);
-                    writer.endChunk();
-                }
-            }
-        }
-
-        bool writeAndDeletePreview(const wstring& path)
-        {
-            for (ChunkList::iterator p = m_children.begin(); p != m_children.end(); ++p)
-            {
-                if (p->first == 0x13)
-                {
-                    if (p->second->m_data != NULL)
-                    {
-                        PhysicalFile file(path.c_str(), FILEMODE_WRITE);
-                        file.write(p->second->m_data, p->second->m_size);
-                        delete p->second;
-                        m_children.erase(p);
-                        return true;
-                    }
-                    break;
-                }
-            }
-            return false;
-        }
-
-        Chunk(ChunkReader& reader)
-            : m_data(NULL)
-        {
-            if (reader.group())
-            {
-                ChunkType type;
-                while ((type = reader.next()) != -1)
-                {
-                    m_children.push_back(make_pair(type, (Chunk*)NULL));
-                    m_children.back().second = new Chunk(reader);
-                }
-            }
-            else
-            {
-                m_data = new char[m_size = reader.size()];
-                reader.read(m_data, m_size);
-            }
-        }
-        
-        ~Chunk()
-        {
-            for (ChunkList::const_iterator p = m_children.begin(); p != m_children.end(); ++p)
-            {
-                delete p->second;
-            }
-            delete[] m_data;
-        }
-    };
-
-    Chunk m_root;
-
-public:
-    bool writeAndDeletePreview(const wstring& path)
-    {
-        // Find the preview
-        return m_root.writeAndDeletePreview(path);
-    }
-
-    void write(ChunkWriter& writer) const
-    {
-        m_root.write(writer);
-    }
-
-    ChunkFile(ChunkReader& reader)
-        : m_root(reader)
-    {
-    }
-};
-
 static void ExtractPreview(const wstring& dest, const wstring& src)
 {
-    ChunkFile* file = NULL;
-
+#ifdef NDEBUG
     try
+#endif
     {
-        {
-            // Read the file
-            PhysicalFile fSrc(src, FILEMODE_READ);
-            ChunkReader reader(fSrc);
-            file = new ChunkFile(reader);
-        }
-
-        if (!file->writeAndDeletePreview(dest))
+        if (!ExtractMapPreview(src, dest))
         {
             wstring text = LoadResourceString(IDS_NO_PREVIEW);
             MessageBox(NULL, text.c_str(), NULL, MB_OK | MB_ICONHAND);
         }
-        else
-        {
-            // Write the new file
-            PhysicalFile fSrc(src, FILEMODE_WRITE);
-            ChunkWriter writer(fSrc);
-            file->write(writer);
-        }
     }
 #ifdef NDEBUG
     catch (exception& e)
@@ -161,12 +50,6 @@ static void ExtractPreview(const wstring& dest, const wstring& src)
 		MessageBoxW(NULL, e.what(), NULL, MB_OK );
     }
 #endif
-    catch (...)
-    {
-        delete file;
-        throw;
-    }
-    delete file;
 }
 
 static wstring QueryOpenFilename(HWND hWndParent)
@@ -321,6 +204,16 @@ static vector<wstring> ParseCommandLine()
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 {
+    vector<wstring> args = ParseCommandLine();
+    if (IsBatchCommandLine(args))
+    {
+        // Headless extraction; report to the console we were started from
+        AttachConsole(ATTACH_PARENT_PROCESS);
+        freopen("conout$", "w", stdout);
+        freopen("conout$", "w", stderr);
+        return RunBatch(args);
+    }
+
 #ifndef NDEBUG
     // In debug mode we create a console and turn on memory checking
  	AllocConsole();
@@ -337,8 +230,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
     {
         // Filename to load
         LPCTSTR filename = NULL;
-
-        vector<wstring> args = ParseCommandLine();
         if (args.size() > 1)
         {
             // Fill the 
@@ -2,6 +2,7 @@
 #define CHUNKFILE_H
 
 #include <string>
+#include <vector>
 
 #include "files.h"
 #include "types.h"
@@ -46,6 +47,8 @@ public:
 	~ChunkReader();
 };
 
+// Chunks are built in memory and their sizes patched in the buffer.
+// Every completed top-level chunk is written to the file at once.
 class ChunkWriter
 {
 	static const int MAX_CHUNK_DEPTH = 256;
@@ -58,10 +61,14 @@ class ChunkWriter
 	};
 
 	IFile*                  m_file;
+	std::vector<char>       m_buffer;
 	ChunkInfo<CHUNKHDR>     m_chunks[ MAX_CHUNK_DEPTH ];
 	ChunkInfo<MINICHUNKHDR> m_miniChunk;
 	int                     m_curDepth;
 
+	void append(const void* buffer, unsigned long size);
+	void flush();
+
 public:
 	void beginChunk(ChunkType type);
 	void beginMiniChunk(ChunkType type);
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstring>
 #include "ChunkFile.h"
 #include "exceptions.h"
 using namespace std;
@@ -6,7 +7,7 @@ using namespace std;
 void ChunkWriter::beginChunk(ChunkType type)
 {
 	m_curDepth++;
-	m_chunks[m_curDepth].offset   = m_file->tell();
+	m_chunks[m_curDepth].offset   = (unsigned long)m_buffer.size();
 	m_chunks[m_curDepth].hdr.type = type;
 	m_chunks[m_curDepth].hdr.size = 0;
 	if (m_curDepth > 0)
@@ -17,7 +18,7 @@ void ChunkWriter::beginChunk(ChunkType type)
 
 	// Write dummy header
 	CHUNKHDR hdr = {0,0};
-	m_file->write(&hdr, sizeof(CHUNKHDR));
+	append(&hdr, sizeof(CHUNKHDR));
 }
 
 void ChunkWriter::beginMiniChunk(ChunkType type)
@@ -26,13 +27,13 @@ void ChunkWriter::beginMiniChunk(ChunkType type)
 	assert(m_miniChunk.offset == -1);
 	assert(type <= 0xFF);
 
-	m_miniChunk.offset   = m_file->tell();
+	m_miniChunk.offset   = (unsigned long)m_buffer.size();
 	m_miniChunk.hdr.type = (uint8_t)type;
 	m_miniChunk.hdr.size = 0;
 	
 	// Write dummy header
 	MINICHUNKHDR hdr = {0, 0};
-	m_file->write(&hdr, sizeof(MINICHUNKHDR));
+	append(&hdr, sizeof(MINICHUNKHDR));
 }
 
 void ChunkWriter::endChunk()
@@ -41,40 +42,54 @@ void ChunkWriter::endChunk()
 	if (m_miniChunk.offset != -1)
 	{
 		// Ending mini-chunk
-		long pos  = m_file->tell();
-		long size = pos - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
+		long size = (long)m_buffer.size() - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
 		assert(size <= 0xFF);
 
 		m_miniChunk.hdr.size = (uint8_t)size;
-		m_file->seek(m_miniChunk.offset);
-		m_file->write(&m_miniChunk.hdr, sizeof(MINICHUNKHDR) );
-		m_file->seek(pos);
+		memcpy(&m_buffer[m_miniChunk.offset], &m_miniChunk.hdr, sizeof(MINICHUNKHDR));
 		m_miniChunk.offset = -1;
 	}
 	else
 	{
 		// Ending normal chunk
-		long pos  = m_file->tell();
-		long size = pos - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
+		long size = (long)m_buffer.size() - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
 
 		m_chunks[m_curDepth].hdr.size = (m_chunks[m_curDepth].hdr.size & 0x80000000) | (size & ~0x80000000);
-		m_file->seek(m_chunks[m_curDepth].offset);
-		m_file->write(&m_chunks[m_curDepth].hdr, sizeof(CHUNKHDR));
-		m_file->seek(pos);
+		memcpy(&m_buffer[m_chunks[m_curDepth].offset], &m_chunks[m_curDepth].hdr, sizeof(CHUNKHDR));
 
-		m_curDepth--;
+		if (--m_curDepth < 0)
+		{
+			// The top-level chunk is complete
+			flush();
+		}
 	}
 }
 
-void ChunkWriter::write(const void* buffer, long size)
+void ChunkWriter::append(const void* buffer, unsigned long size)
 {
-	assert(m_curDepth >= 0);
-	if (m_file->write(buffer, size) != size)
+	const char* data = (const char*)buffer;
+	m_buffer.insert(m_buffer.end(), data, data + size);
+}
+
+void ChunkWriter::flush()
+{
+	if (!m_buffer.empty())
 	{
-		throw WriteException();
+		if (m_file->write(&m_buffer[0], (unsigned long)m_buffer.size()) != m_buffer.size())
+		{
+			throw WriteException();
+		}
+		// Keep the memory for the next chunk
+		m_buffer.clear();
 	}
 }
 
+void ChunkWriter::write(const void* buffer, long size)
+{
+	assert(m_curDepth >= 0);
+	append(buffer, size);
+}
+
 void ChunkWriter::writeString(const std::string& str)
 {
 	write(str.c_str(), (int)str.length() + 1);
@@ -161,7 +161,10 @@ bool Engine::Render()
     // Sort the particle systems on distance from camera
     // Negative Z is further away, thus drawn first.
     // Therefore we need a normal ascending sort.
-    sort(m_instances.begin(), m_instances.end(), ParticleSystemCompare);
+    // It's stable so systems at the same distance don't swap between frames.
+    // Unlike the viewer, nothing is batched here: every emitter is drawn with
+    // its own eye position constant, so only the few systems need sorting.
+    stable_sort(m_instances.begin(), m_instances.end(), ParticleSystemCompare);
 	
 	m_pDevice->BeginScene();
 
@@ -756,8 +756,17 @@ bool Application::DoSave(bool saveas)
 			try
 			{
 				document->saveVersion(versioninfo.author, versioninfo.notes);
-				PhysicalFile file(filename, PhysicalFile::WRITE);
-				document->write(file);
+				if (!saveas && document->canAppend())
+				{
+					// Only append the new version to the existing file
+					PhysicalFile file(filename, PhysicalFile::MODIFY);
+					document->append(file);
+				}
+				else
+				{
+					PhysicalFile file(filename, PhysicalFile::WRITE);
+					document->write(file);
+				}
 				document->increaseVersion();
 				document->setActiveVersion();
 				FillVersionList();
@@ -1205,6 +1214,10 @@ void Application::DoFind(bool showDialog)
 
 		const wchar_t* term = findinfo.term.c_str();
 
+		// Narrow down the strings to check with the search index, if possible
+		vector<bool> candidates;
+		bool indexed = document->findCandidates(findinfo.term, findinfo.searchName, findinfo.searchValue, findinfo.searchComment, candidates);
+
 		LCID locale  = MAKELCID(document->getActiveLanguage(), SORT_DEFAULT);
 		LCID english = MAKELCID(MAKELANGID(LANG_ENGLISH, SUBLANG_NEUTRAL), SORT_DEFAULT);
 
@@ -1247,9 +1260,10 @@ void Application::DoFind(bool showDialog)
 				// Not a valid string, deselect it
 				ListView_SetItemState(hActiveListView, item.iItem, 0, LVIS_SELECTED)
 			}
-			else if ((findinfo.searchName    && MatchString(english, strings[id].m_name,    term, findinfo.matchCase, findinfo.matchWord)) ||
+			else if ((!indexed || candidates[id]) && (
+				     (findinfo.searchName    && MatchString(english, strings[id].m_name,    term, findinfo.matchCase, findinfo.matchWord)) ||
 				     (findinfo.searchValue   && MatchString(locale,  values[id],            term, findinfo.matchCase, findinfo.matchWord)) ||
-				     (findinfo.searchComment && MatchString(english, strings[id].m_comment, term, findinfo.matchCase, findinfo.matchWord)))
+				     (findinfo.searchComment && MatchString(english, strings[id].m_comment, term, findinfo.matchCase, findinfo.matchWord))))
 			{
 				// It's a match
 				matches = true;
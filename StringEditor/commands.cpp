@@ -1,8 +1,66 @@
+#include <fstream>
 #include "commands.h"
+#include "datdiff.h"
 #include "exceptions.h"
 #include "utils.h"
 using namespace std;
 
+static wstring GetCanonicalPath(const wstring& filename)
+{
+	wchar_t path[MAX_PATH];
+	DWORD len = GetFullPathName(filename.c_str(), MAX_PATH, path, NULL);
+	wstring result = (len > 0 && len < MAX_PATH) ? wstring(path, len) : filename;
+	CharUpperBuff(&result[0], (DWORD)result.length());
+	return result;
+}
+
+//
+// A DAT file that can be loaded by a prefetch thread, or on first use
+//
+class DatFile
+{
+	wstring     m_filename;
+	StringList* m_strings;
+	wstring     m_error;
+
+public:
+	const wstring& getFilename() const { return m_filename; }
+
+	// Loads the file and remembers, rather than throws, any error
+	void load()
+	{
+		if (m_strings == NULL && m_error.empty())
+		{
+			try
+			{
+				PhysicalFile input(m_filename);
+				m_strings = new StringList(input);
+			}
+			catch (wexception& e)
+			{
+				m_error = e.what();
+			}
+			catch (exception& e)
+			{
+				m_error = AnsiToWide(e.what());
+			}
+		}
+	}
+
+	StringList& get()
+	{
+		load();
+		if (m_strings == NULL)
+		{
+			throw wruntime_error(m_error);
+		}
+		return *m_strings;
+	}
+
+	DatFile(const string& filename) : m_filename(AnsiToWide(filename)), m_strings(NULL) {}
+	~DatFile() { delete m_strings; }
+};
+
 static LANGID ParseLanguage(const string& str)
 {
 	char* endptr;
@@ -84,6 +142,11 @@ public:
 		document = new Document(input);
 	}
 
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(filename));
+	}
+
 	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
 	{
 		if (arg == end) throw ParseException("expected filename");
@@ -101,7 +164,7 @@ public:
 //
 class CommandImport : public ICommand
 {
-	wstring          filename;
+	DatFile          strings;
 	Document::Method method;
 	LANGID           language;
 
@@ -125,9 +188,17 @@ public:
 			throw runtime_error("unable to import; specified method cannot be used with document type");
 		}
 
-		PhysicalFile input(filename);
-		StringList strings(input);
-		document->addStrings(strings, method);
+		document->addStrings(strings.get(), method);
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(strings.getFilename()));
+	}
+
+	void prefetch()
+	{
+		strings.load();
 	}
 
 	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
@@ -150,13 +221,16 @@ public:
 	}
 
 	CommandImport(Document::Method method, LANGID language, const string& filename)
+		: strings(filename)
 	{
-		this->filename = AnsiToWide(filename);
 		this->language = language;
 		this->method   = method;
 	}
 };
 
+//
+// Command: export
+//
 class CommandExport : public ICommand
 {
 	wstring filename;
@@ -189,6 +263,11 @@ public:
 		document->exportFile(language, output);
 	}
 
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		outputs.insert(GetCanonicalPath(filename));
+	}
+
 	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
 	{
 		if (arg == end) throw ParseException("expected export language");
@@ -239,6 +318,376 @@ public:
 	}
 };
 
+//
+// Command: save
+//
+class CommandSave : public ICommand
+{
+	wstring filename;
+	wstring author;
+	wstring notes;
+
+public:
+	void execute(Document* &document)
+	{
+		if (document == NULL)
+		{
+			throw runtime_error("unable to save; please create or open a document first");
+		}
+
+		document->saveVersion(author, notes);
+		PhysicalFile output(filename, PhysicalFile::WRITE);
+		document->write(output);
+		document->increaseVersion();
+		document->setActiveVersion();
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		outputs.insert(GetCanonicalPath(filename));
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		if (arg == end) throw ParseException("expected filename");
+		string filename = *arg;
+
+		if (++arg == end) throw ParseException("expected author");
+		string author = *arg;
+
+		if (++arg == end) throw ParseException("expected notes");
+		return new CommandSave(filename, author, *arg++);
+	}
+
+	CommandSave(const string& filename, const string& author, const string& notes)
+	{
+		this->filename = AnsiToWide(filename);
+		this->author   = AnsiToWide(author);
+		this->notes    = AnsiToWide(notes);
+	}
+};
+
+//
+// Command: diff
+//
+class CommandDiff : public ICommand
+{
+	DatFile left;
+	DatFile right;
+
+public:
+	void execute(Document* &document)
+	{
+		const StringList& oldStrings = left.get();
+		const StringList& newStrings = right.get();
+
+		StringDiff diff;
+		DiffStrings(oldStrings, newStrings, diff);
+
+		for (size_t i = 0; i < diff.removed.size(); i++)
+		{
+			printf("- %ls\n", oldStrings[diff.removed[i]].m_name.c_str());
+		}
+		for (size_t i = 0; i < diff.changed.size(); i++)
+		{
+			printf("* %ls\n", newStrings[diff.changed[i].second].m_name.c_str());
+		}
+		for (size_t i = 0; i < diff.added.size(); i++)
+		{
+			printf("+ %ls\n", newStrings[diff.added[i]].m_name.c_str());
+		}
+		printf("%u added, %u removed, %u changed\n", (unsigned int)diff.added.size(), (unsigned int)diff.removed.size(), (unsigned int)diff.changed.size());
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(left.getFilename()));
+		inputs.insert(GetCanonicalPath(right.getFilename()));
+	}
+
+	void prefetch()
+	{
+		left.load();
+		right.load();
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		if (arg == end) throw ParseException("expected old filename");
+		string filename = *arg;
+
+		if (++arg == end) throw ParseException("expected new filename");
+		return new CommandDiff(filename, *arg++);
+	}
+
+	CommandDiff(const string& left, const string& right)
+		: left(left), right(right)
+	{
+	}
+};
+
+//
+// Command: dump
+//
+class CommandDump : public ICommand
+{
+	DatFile strings;
+	string  filename;
+
+public:
+	void execute(Document* &document)
+	{
+		ofstream output(filename.c_str(), ios::binary);
+		if (!output.is_open())
+		{
+			throw runtime_error("unable to dump; cannot create \"" + filename + "\"");
+		}
+
+		// Write as UTF-8 with a byte-order mark
+		output << "\xEF\xBB\xBF";
+		const StringList& list = strings.get();
+		for (StringList::const_iterator p = list.begin(); p != list.end(); p++)
+		{
+			output << WideToUtf8(p->m_name) << "=" << WideToUtf8(EscapeValue(p->m_value)) << "\r\n";
+		}
+
+		if (output.fail())
+		{
+			throw WriteException();
+		}
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(strings.getFilename()));
+		outputs.insert(GetCanonicalPath(AnsiToWide(filename)));
+	}
+
+	void prefetch()
+	{
+		strings.load();
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		if (arg == end) throw ParseException("expected DAT filename");
+		string filename = *arg;
+
+		if (++arg == end) throw ParseException("expected text filename");
+		return new CommandDump(filename, *arg++);
+	}
+
+	CommandDump(const string& datfile, const string& txtfile)
+		: strings(datfile), filename(txtfile)
+	{
+	}
+};
+
+//
+// Command: compile
+//
+class CommandCompile : public ICommand
+{
+	Document::Type type;
+	string         source;
+	wstring        filename;
+
+public:
+	void execute(Document* &document)
+	{
+		ifstream input(source.c_str(), ios::binary);
+		if (!input.is_open())
+		{
+			throw runtime_error("unable to compile; cannot open \"" + source + "\"");
+		}
+
+		StringList list;
+		string line;
+		for (int lineno = 1; getline(input, line); lineno++)
+		{
+			if (lineno == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+			{
+				line.erase(0, 3);
+			}
+			if (!line.empty() && line[line.length() - 1] == '\r')
+			{
+				line.erase(line.length() - 1);
+			}
+			if (line.empty() || line[0] == '#' || line[0] == ';')
+			{
+				continue;
+			}
+
+			string::size_type sep = line.find('=');
+			if (sep == string::npos)
+			{
+				char buf[16];
+				sprintf(buf, "%d", lineno);
+				throw runtime_error("unable to compile; missing '=' in \"" + source + "\" on line " + buf);
+			}
+			list.add(Utf8ToWide(line.substr(0, sep)), UnescapeValue(Utf8ToWide(line.substr(sep + 1))), L"");
+		}
+
+		PhysicalFile output(filename, PhysicalFile::WRITE);
+		list.write(output, type == Document::DT_NAME);
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(AnsiToWide(source)));
+		outputs.insert(GetCanonicalPath(filename));
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		Document::Type type;
+		if (arg == end) throw ParseException("expected document type");
+			 if (_stricmp(arg->c_str(), "index") == 0) type = Document::DT_INDEX;
+		else if (_stricmp(arg->c_str(), "name")  == 0) type = Document::DT_NAME;
+		else throw ParseException("invalid document type");
+
+		if (++arg == end) throw ParseException("expected text filename");
+		string source = *arg;
+
+		if (++arg == end) throw ParseException("expected DAT filename");
+		return new CommandCompile(type, source, *arg++);
+	}
+
+	CommandCompile(Document::Type type, const string& source, const string& filename)
+	{
+		this->type     = type;
+		this->source   = source;
+		this->filename = AnsiToWide(filename);
+	}
+};
+
+//
+// Command: makepatch
+//
+class CommandMakePatch : public ICommand
+{
+	DatFile left;
+	DatFile right;
+	string  filename;
+
+public:
+	void execute(Document* &document)
+	{
+		const StringList& oldStrings = left.get();
+		const StringList& newStrings = right.get();
+
+		StringDiff  diff;
+		StringPatch patch;
+		DiffStrings(oldStrings, newStrings, diff);
+		CreatePatch(oldStrings, newStrings, diff, patch);
+
+		ofstream output(filename.c_str(), ios::binary);
+		if (!output.is_open())
+		{
+			throw runtime_error("unable to create patch; cannot create \"" + filename + "\"");
+		}
+		WritePatch(output, patch);
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(left.getFilename()));
+		inputs.insert(GetCanonicalPath(right.getFilename()));
+		outputs.insert(GetCanonicalPath(AnsiToWide(filename)));
+	}
+
+	void prefetch()
+	{
+		left.load();
+		right.load();
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		if (arg == end) throw ParseException("expected old filename");
+		string left = *arg;
+
+		if (++arg == end) throw ParseException("expected new filename");
+		string right = *arg;
+
+		if (++arg == end) throw ParseException("expected patch filename");
+		return new CommandMakePatch(left, right, *arg++);
+	}
+
+	CommandMakePatch(const string& left, const string& right, const string& filename)
+		: left(left), right(right), filename(filename)
+	{
+	}
+};
+
+//
+// Command: patch
+//
+class CommandPatch : public ICommand
+{
+	Document::Type type;
+	DatFile        base;
+	string         source;
+	wstring        filename;
+
+public:
+	void execute(Document* &document)
+	{
+		ifstream input(source.c_str(), ios::binary);
+		if (!input.is_open())
+		{
+			throw runtime_error("unable to patch; cannot open \"" + source + "\"");
+		}
+
+		StringPatch patch;
+		ReadPatch(input, patch);
+
+		StringList result;
+		ApplyPatch(base.get(), patch, result);
+
+		PhysicalFile output(filename, PhysicalFile::WRITE);
+		result.write(output, type == Document::DT_NAME);
+	}
+
+	void getFiles(set<wstring>& inputs, set<wstring>& outputs) const
+	{
+		inputs.insert(GetCanonicalPath(base.getFilename()));
+		inputs.insert(GetCanonicalPath(AnsiToWide(source)));
+		outputs.insert(GetCanonicalPath(filename));
+	}
+
+	void prefetch()
+	{
+		base.load();
+	}
+
+	static ICommand* parse(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
+	{
+		Document::Type type;
+		if (arg == end) throw ParseException("expected document type");
+			 if (_stricmp(arg->c_str(), "index") == 0) type = Document::DT_INDEX;
+		else if (_stricmp(arg->c_str(), "name")  == 0) type = Document::DT_NAME;
+		else throw ParseException("invalid document type");
+
+		if (++arg == end) throw ParseException("expected base filename");
+		string base = *arg;
+
+		if (++arg == end) throw ParseException("expected patch filename");
+		string source = *arg;
+
+		if (++arg == end) throw ParseException("expected output filename");
+		return new CommandPatch(type, base, source, *arg++);
+	}
+
+	CommandPatch(Document::Type type, const string& base, const string& source, const string& filename)
+		: base(base)
+	{
+		this->type     = type;
+		this->source   = source;
+		this->filename = AnsiToWide(filename);
+	}
+};
+
 //
 // Commands list
 //
@@ -252,13 +701,19 @@ struct COMMAND
 //
 // IMPORTANT: ALWAYS make sure this array is sorted on the command name (for the binary search)
 //
-static const int N_COMMANDS = 5;
+static const int N_COMMANDS = 11;
 COMMAND Commands[N_COMMANDS] = {
+	{"compile",		CommandCompile::parse},
+	{"diff",		CommandDiff::parse},
+	{"dump",		CommandDump::parse},
 	{"export",		CommandExport::parse},
 	{"import",		CommandImport::parse},
 	{"languages",	CommandLanguages::parse},
+	{"makepatch",	CommandMakePatch::parse},
 	{"new",			CommandNew::parse},
 	{"open",		CommandOpen::parse},
+	{"patch",		CommandPatch::parse},
+	{"save",		CommandSave::parse},
 };
 
 ICommand* ParseCommand(vector<string>::const_iterator& arg, const vector<string>::const_iterator& end)
@@ -283,4 +738,77 @@ ICommand* ParseCommand(vector<string>::const_iterator& arg, const vector<string>
 		else		 low  = mid + 1;
 	}
 	return NULL;
+}
+
+//
+// Prefetching
+//
+struct PREFETCH_INFO
+{
+	const vector<ICommand*>* commands;
+	volatile LONG            next;
+};
+
+static DWORD WINAPI PrefetchThread(LPVOID lpParam)
+{
+	PREFETCH_INFO* info = (PREFETCH_INFO*)lpParam;
+	LONG i;
+	while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->commands->size())
+	{
+		(*info->commands)[i]->prefetch();
+	}
+	return 0;
+}
+
+void PrefetchCommands(const vector<ICommand*>& commands)
+{
+	// Files that are written by any command can't be read ahead of time
+	set<wstring> outputs;
+	vector< set<wstring> > inputs(commands.size());
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		commands[i]->getFiles(inputs[i], outputs);
+	}
+
+	vector<ICommand*> prefetchable;
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		set<wstring>::const_iterator p;
+		for (p = inputs[i].begin(); p != inputs[i].end() && outputs.find(*p) == outputs.end(); p++);
+		if (p == inputs[i].end())
+		{
+			prefetchable.push_back(commands[i]);
+		}
+	}
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	size_t nThreads = min((size_t)si.dwNumberOfProcessors, prefetchable.size());
+
+	PREFETCH_INFO info;
+	info.commands = &prefetchable;
+	info.next     = 0;
+
+	vector<HANDLE> hThreads;
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		DWORD  ThreadID;
+		HANDLE hThread = CreateThread(NULL, 0, PrefetchThread, &info, 0, &ThreadID);
+		if (hThread != NULL)
+		{
+			hThreads.push_back(hThread);
+		}
+	}
+
+	// This thread helps out as well
+	PrefetchThread(&info);
+
+	if (!hThreads.empty())
+	{
+		WaitForMultipleObjects((DWORD)hThreads.size(), &hThreads[0], TRUE, INFINITE);
+		for (size_t i = 0; i < hThreads.size(); i++)
+		{
+			CloseHandle(hThreads[i]);
+		}
+	}
 }
\ No newline at end of file
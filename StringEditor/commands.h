@@ -1,15 +1,27 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include <set>
 #include "document.h"
 
 class ICommand
 {
 public:
 	virtual void execute(Document* &document) = 0;
+
+	// Returns the (full, uppercased) paths of the files this command reads and writes
+	virtual void getFiles(std::set<std::wstring>& inputs, std::set<std::wstring>& outputs) const {}
+
+	// Loads the command's input files ahead of time. This is called from a worker
+	// thread, so it must not touch the document and must not throw.
+	virtual void prefetch() {}
+
 	virtual ~ICommand() {}
 };
 
 extern ICommand* ParseCommand(std::vector<std::string>::const_iterator& args, const std::vector<std::string>::const_iterator& end);
 
-#endif
\ No newline at end of file
+// Calls prefetch() in parallel for all commands whose inputs aren't written by any command
+extern void PrefetchCommands(const std::vector<ICommand*>& commands);
+
+#endif
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include "datdiff.h"
+#include "exceptions.h"
+#include "utils.h"
+using namespace std;
+
+wstring EscapeValue(const wstring& value)
+{
+	wstring result;
+	result.reserve(value.length());
+	for (wstring::const_iterator c = value.begin(); c != value.end(); c++)
+	{
+		switch (*c)
+		{
+			case L'\\': result += L"\\\\"; break;
+			case L'\n': result += L"\\n"; break;
+			case L'\r': result += L"\\r"; break;
+			case L'\t': result += L"\\t"; break;
+			default:    result += *c; break;
+		}
+	}
+	return result;
+}
+
+wstring UnescapeValue(const wstring& value)
+{
+	wstring result;
+	result.reserve(value.length());
+	for (wstring::const_iterator c = value.begin(); c != value.end(); c++)
+	{
+		if (*c == L'\\' && c + 1 != value.end())
+		{
+			switch (*++c)
+			{
+				case L'n': result += L'\n'; break;
+				case L'r': result += L'\r'; break;
+				case L't': result += L'\t'; break;
+				default:   result += *c; break;
+			}
+		}
+		else
+		{
+			result += *c;
+		}
+	}
+	return result;
+}
+
+//
+// Orders indices into a string table on (CRC, name)
+//
+class KeyLess
+{
+	const StringList& m_strings;
+
+public:
+	bool operator()(size_t left, size_t right) const
+	{
+		unsigned long crc1 = m_strings.getCrc(left);
+		unsigned long crc2 = m_strings.getCrc(right);
+		return (crc1 != crc2) ? crc1 < crc2 : m_strings[left].m_name < m_strings[right].m_name;
+	}
+
+	KeyLess(const StringList& strings) : m_strings(strings) {}
+};
+
+static void SortKeys(const StringList& strings, vector<size_t>& order)
+{
+	order.resize(strings.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	stable_sort(order.begin(), order.end(), KeyLess(strings));
+}
+
+// Compares the keys of two strings in different tables
+static int CompareKeys(const StringList& left, size_t i, const StringList& right, size_t j)
+{
+	unsigned long crc1 = left.getCrc(i);
+	unsigned long crc2 = right.getCrc(j);
+	if (crc1 != crc2)
+	{
+		return (crc1 < crc2) ? -1 : 1;
+	}
+	return left[i].m_name.compare(right[j].m_name);
+}
+
+void DiffStrings(const StringList& oldStrings, const StringList& newStrings, StringDiff& diff)
+{
+	vector<size_t> oldOrder, newOrder;
+	SortKeys(oldStrings, oldOrder);
+	SortKeys(newStrings, newOrder);
+
+	diff.added.clear();
+	diff.removed.clear();
+	diff.changed.clear();
+
+	size_t i = 0, j = 0;
+	while (i < oldOrder.size() && j < newOrder.size())
+	{
+		int cmp = CompareKeys(oldStrings, oldOrder[i], newStrings, newOrder[j]);
+		if (cmp < 0)
+		{
+			diff.removed.push_back(oldOrder[i++]);
+		}
+		else if (cmp > 0)
+		{
+			diff.added.push_back(newOrder[j++]);
+		}
+		else
+		{
+			if (oldStrings[oldOrder[i]].m_value != newStrings[newOrder[j]].m_value)
+			{
+				diff.changed.push_back(make_pair(oldOrder[i], newOrder[j]));
+			}
+			i++;
+			j++;
+		}
+	}
+
+	for (; i < oldOrder.size(); i++) diff.removed.push_back(oldOrder[i]);
+	for (; j < newOrder.size(); j++) diff.added.push_back(newOrder[j]);
+}
+
+void CreatePatch(const StringList& oldStrings, const StringList& newStrings, const StringDiff& diff, StringPatch& patch)
+{
+	patch.entries.clear();
+	patch.entries.reserve(diff.removed.size() + diff.changed.size() + diff.added.size());
+
+	StringPatch::Entry entry;
+	entry.operation = StringPatch::SP_REMOVE;
+	for (size_t i = 0; i < diff.removed.size(); i++)
+	{
+		entry.name = oldStrings[diff.removed[i]].m_name;
+		patch.entries.push_back(entry);
+	}
+
+	entry.operation = StringPatch::SP_CHANGE;
+	for (size_t i = 0; i < diff.changed.size(); i++)
+	{
+		entry.name  = newStrings[diff.changed[i].second].m_name;
+		entry.value = newStrings[diff.changed[i].second].m_value;
+		patch.entries.push_back(entry);
+	}
+
+	// Keep added strings in their order in the new table
+	vector<size_t> added(diff.added);
+	sort(added.begin(), added.end());
+
+	entry.operation = StringPatch::SP_ADD;
+	for (size_t i = 0; i < added.size(); i++)
+	{
+		entry.name  = newStrings[added[i]].m_name;
+		entry.value = newStrings[added[i]].m_value;
+		patch.entries.push_back(entry);
+	}
+}
+
+void ApplyPatch(const StringList& base, const StringPatch& patch, StringList& result)
+{
+	// Put the patch entries in a table so we can merge them with the base
+	StringList changes;
+	changes.reserve(patch.entries.size());
+	for (size_t i = 0; i < patch.entries.size(); i++)
+	{
+		changes.add(patch.entries[i].name, patch.entries[i].value, L"");
+	}
+
+	vector<size_t> baseOrder, patchOrder;
+	SortKeys(base,    baseOrder);
+	SortKeys(changes, patchOrder);
+
+	// For every base string, the patch entry that applies to it, if any
+	vector<const StringPatch::Entry*> actions(base.size(), (const StringPatch::Entry*)NULL);
+	vector<bool>                      applied(patch.entries.size(), false);
+
+	size_t i = 0, j = 0;
+	while (i < baseOrder.size() && j < patchOrder.size())
+	{
+		int cmp = CompareKeys(base, baseOrder[i], changes, patchOrder[j]);
+		if (cmp < 0)
+		{
+			i++;
+		}
+		else if (cmp > 0)
+		{
+			j++;
+		}
+		else
+		{
+			actions[baseOrder[i++]] = &patch.entries[patchOrder[j]];
+			applied[patchOrder[j++]] = true;
+		}
+	}
+
+	result = StringList();
+	result.reserve(base.size() + patch.entries.size());
+	for (size_t i = 0; i < base.size(); i++)
+	{
+		const StringPatch::Entry* action = actions[i];
+		if (action == NULL)
+		{
+			result.add(base[i].m_name, base[i].m_value, base[i].m_comment);
+		}
+		else if (action->operation != StringPatch::SP_REMOVE)
+		{
+			// Adding an existing string overwrites it
+			result.add(base[i].m_name, action->value, base[i].m_comment);
+		}
+	}
+
+	for (size_t i = 0; i < patch.entries.size(); i++)
+	{
+		const StringPatch::Entry& entry = patch.entries[i];
+		if (!applied[i])
+		{
+			if (entry.operation != StringPatch::SP_ADD)
+			{
+				throw runtime_error("patch does not apply; string \"" + WideToAnsi(entry.name) + "\" does not exist");
+			}
+			result.add(entry.name, entry.value, L"");
+		}
+	}
+}
+
+void WritePatch(ostream& output, const StringPatch& patch)
+{
+	// Write as UTF-8 with a byte-order mark
+	output << "\xEF\xBB\xBF";
+	for (size_t i = 0; i < patch.entries.size(); i++)
+	{
+		const StringPatch::Entry& entry = patch.entries[i];
+		output << (char)entry.operation << WideToUtf8(entry.name);
+		if (entry.operation != StringPatch::SP_REMOVE)
+		{
+			output << "=" << WideToUtf8(EscapeValue(entry.value));
+		}
+		output << "\r\n";
+	}
+
+	if (output.fail())
+	{
+		throw WriteException();
+	}
+}
+
+void ReadPatch(istream& input, StringPatch& patch)
+{
+	patch.entries.clear();
+
+	string line;
+	for (int lineno = 1; getline(input, line); lineno++)
+	{
+		if (lineno == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+		{
+			line.erase(0, 3);
+		}
+		if (!line.empty() && line[line.length() - 1] == '\r')
+		{
+			line.erase(line.length() - 1);
+		}
+		if (line.empty() || line[0] == '#' || line[0] == ';')
+		{
+			continue;
+		}
+
+		StringPatch::Entry entry;
+		string::size_type sep = line.find('=');
+		switch (line[0])
+		{
+			case '+': entry.operation = StringPatch::SP_ADD;    break;
+			case '-': entry.operation = StringPatch::SP_REMOVE; break;
+			case '*': entry.operation = StringPatch::SP_CHANGE; break;
+			default:  sep = 0; break;
+		}
+
+		if (sep == 0 || (sep == string::npos) != (entry.operation == StringPatch::SP_REMOVE))
+		{
+			char buf[16];
+			sprintf(buf, "%d", lineno);
+			throw ParseException("invalid patch entry on line " + string(buf));
+		}
+
+		entry.name = Utf8ToWide(line.substr(1, sep - 1));
+		if (sep != string::npos)
+		{
+			entry.value = UnescapeValue(Utf8ToWide(line.substr(sep + 1)));
+		}
+		patch.entries.push_back(entry);
+	}
+}
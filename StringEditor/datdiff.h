@@ -0,0 +1,59 @@
+#ifndef DATDIFF_H
+#define DATDIFF_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "stringlist.h"
+
+//
+// Differences between two string tables, as indices into the tables
+//
+struct StringDiff
+{
+	std::vector<size_t>                      added;		// Indices in the new table
+	std::vector<size_t>                      removed;	// Indices in the old table
+	std::vector< std::pair<size_t, size_t> > changed;	// Indices in the old and new table
+};
+
+//
+// A list of changes that can be applied to a string table
+//
+struct StringPatch
+{
+	enum Operation
+	{
+		SP_ADD    = '+',
+		SP_REMOVE = '-',
+		SP_CHANGE = '*',
+	};
+
+	struct Entry
+	{
+		Operation    operation;
+		std::wstring name;
+		std::wstring value;
+	};
+
+	std::vector<Entry> entries;
+};
+
+// Escapes a value so it fits on a single line in a text file, and back
+std::wstring EscapeValue(const std::wstring& value);
+std::wstring UnescapeValue(const std::wstring& value);
+
+// Compares two tables by sorting both on (CRC, name) and merging them
+void DiffStrings(const StringList& oldStrings, const StringList& newStrings, StringDiff& diff);
+
+// Creates a patch from the differences between two tables
+void CreatePatch(const StringList& oldStrings, const StringList& newStrings, const StringDiff& diff, StringPatch& patch);
+
+// Applies a patch to a table. Existing strings keep their order; added
+// strings are appended in patch order.
+void ApplyPatch(const StringList& base, const StringPatch& patch, StringList& result);
+
+// Reads and writes patches as UTF-8 text, one "<op>NAME[=value]" per line
+void WritePatch(std::ostream& output, const StringPatch& patch);
+void ReadPatch(std::istream& input, StringPatch& patch);
+
+#endif
@@ -68,12 +68,16 @@ void Document::changeLanguage(LANGID from, LANGID to)
 
 		m_newPostfixes[to] = m_newPostfixes[from];
 		m_newPostfixes.erase(from);
+
+		m_valueIndex.erase(from);
+		m_valueIndex.erase(to);
 	}
 }
 
 void Document::deleteLanguage(LANGID language)
 {
 	m_versions.back().m_values.erase(language);
+	m_valueIndex.erase(language);
 }
 
 bool Document::setActiveLanguage(LANGID language)
@@ -170,6 +174,8 @@ void Document::checkChanged(unsigned int id)
 		}
 	}
 
+	invalidateIndex(id, false);
+
 	// Add it to the appropriate lists
 	if (infoChanged)  newver.diff_strings.insert(id);
 	else              newver.diff_strings.erase(id);
@@ -187,6 +193,7 @@ void Document::checkChangedAll(unsigned int id)
 	StringInfo& newstr  = newver.m_strings[id];
 
 	newstr.m_modified = DateTime().getEpochSeconds();
+	invalidateIndex(id, true);
 
 	if (m_versions.size() > 1 && ~newstr.m_flags & SF_NEW && id < m_versions[version-1].m_strings.size())
 	{
@@ -418,6 +425,8 @@ void Document::deleteString(unsigned int id)
 			p->second.m_changed.erase(id);
 		}
 
+		invalidateIndex(id, true);
+
 		// This string ID can be reused
 		m_freelist.push(id);
 	}
@@ -532,6 +541,73 @@ bool Document::isModified() const
 	return true;
 }
 
+// Marks a string as changed in the search indices
+void Document::invalidateIndex(unsigned int id, bool allLanguages)
+{
+	m_nameIndex.invalidate(id);
+	m_commentIndex.invalidate(id);
+	if (allLanguages)
+	{
+		for (map<LANGID, SearchIndex>::iterator p = m_valueIndex.begin(); p != m_valueIndex.end(); p++)
+		{
+			p->second.invalidate(id);
+		}
+	}
+	else
+	{
+		map<LANGID, SearchIndex>::iterator p = m_valueIndex.find(m_curLanguage);
+		if (p != m_valueIndex.end())
+		{
+			p->second.invalidate(id);
+		}
+	}
+}
+
+// (Re)builds the requested search indices, if necessary
+void Document::buildIndices(bool names, bool values, bool comments)
+{
+	const vector<StringInfo>& strings = m_curVersion->m_strings;
+
+	SearchIndex* nameIndex    = (names    && !m_nameIndex.isBuilt())    ? &m_nameIndex    : NULL;
+	SearchIndex* commentIndex = (comments && !m_commentIndex.isBuilt()) ? &m_commentIndex : NULL;
+	SearchIndex* valueIndex   = (values   && !m_valueIndex[m_curLanguage].isBuilt()) ? &m_valueIndex[m_curLanguage] : NULL;
+
+	if (nameIndex    != NULL) nameIndex->clear();
+	if (commentIndex != NULL) commentIndex->clear();
+	if (valueIndex   != NULL) valueIndex->clear();
+
+	for (size_t i = 0; i < strings.size(); i++)
+	{
+		if (strings[i].m_name != NULL)
+		{
+			if (nameIndex    != NULL) nameIndex->add((unsigned int)i, strings[i].m_name);
+			if (commentIndex != NULL) commentIndex->add((unsigned int)i, strings[i].m_comment);
+			if (valueIndex   != NULL) valueIndex->add((unsigned int)i, m_curValues->m_virt[i]);
+		}
+	}
+
+	if (nameIndex    != NULL) nameIndex->finish();
+	if (commentIndex != NULL) commentIndex->finish();
+	if (valueIndex   != NULL) valueIndex->finish();
+}
+
+bool Document::findCandidates(const wstring& term, bool names, bool values, bool comments, vector<bool>& candidates)
+{
+	// The indices only track the latest version
+	if (m_curVersion != &m_versions.back() || !SearchIndex::canSearch(term.c_str()))
+	{
+		return false;
+	}
+
+	buildIndices(names, values, comments);
+
+	candidates.assign(m_curVersion->m_strings.size(), false);
+	if (names)    m_nameIndex.getCandidates(term.c_str(), candidates);
+	if (comments) m_commentIndex.getCandidates(term.c_str(), candidates);
+	if (values)   m_valueIndex[m_curLanguage].getCandidates(term.c_str(), candidates);
+	return true;
+}
+
 struct LOOKUP
 {
 	unsigned long m_position;
@@ -725,6 +801,7 @@ void Document::addStrings(const StringList& strings, Method method)
 }
 
 Document::Document(Type type, LANGID language)
+	: m_savedVersions(0), m_savedChars(0), m_savedSize(0)
 {
 	// Create 'current' version
 	m_versions.resize(1);
@@ -9,6 +9,7 @@
 #include "datetime.h"
 #include "stringlist.h"
 #include "strbuf.h"
+#include "searchindex.h"
 
 static const unsigned int SF_NEW       = 0x01;
 static const unsigned int SF_SAVE_MASK = SF_NEW;
@@ -114,18 +115,33 @@ public:
 	bool isModified() const;
 	bool isValidName(unsigned int id) const;
 
+	// Marks the strings in the current language that might contain the term.
+	// Returns false if the search index can't be used for this term.
+	bool findCandidates(const std::wstring& term, bool names, bool values, bool comments, std::vector<bool>& candidates);
+
 	// Export current language to this filename
 	void exportFile(LANGID language, IFile& output) const;
 
-	void write(IFile& output) const;
+	// Writes the entire document, or appends the versions saved since the
+	// last write() or load to that same file.
+	void write(IFile& output);
+	bool canAppend() const;
+	void append(IFile& output);
 	void addStrings(const StringList& strings, Method method);
 
 	Document(Type type, LANGID language);
 	Document(IFile& input);
 
 private:
+	void readVersion1(IFile& input);
+	void readVersion2(IFile& input);
+	void writeHeader(IFile& output) const;
+	void writeVersion(IFile& output, size_t v, size_t charsFrom, size_t charsTo) const;
+
 	void checkChanged(unsigned int id);
 	void checkChangedAll(unsigned int id);
+	void invalidateIndex(unsigned int id, bool allLanguages);
+	void buildIndices(bool names, bool values, bool comments);
 
 	struct StringValues
 	{
@@ -158,6 +174,16 @@ private:
 	StringBuffer                              m_buffer;
 	Type                                      m_type;
 
+	// What is known to be in the file this document was loaded from or last written to
+	size_t                                    m_savedVersions;
+	size_t                                    m_savedChars;
+	unsigned long                             m_savedSize;
+
+	// Search indices for the latest version, built on demand
+	SearchIndex                               m_nameIndex;
+	SearchIndex                               m_commentIndex;
+	std::map<LANGID, SearchIndex>             m_valueIndex;
+
 	// Current language/version
 	Version*      m_curVersion;
 	LANGID        m_curLanguage;
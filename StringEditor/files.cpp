@@ -27,7 +27,7 @@ unsigned long PhysicalFile::write(const void* buffer, unsigned long size)
 
 PhysicalFile::PhysicalFile(const wstring& filename, Mode mode)
 {
-	DWORD dwDesiredAccess       = (mode == WRITE) ? GENERIC_WRITE : GENERIC_READ;
+	DWORD dwDesiredAccess       = (mode == WRITE) ? GENERIC_WRITE : (mode == MODIFY) ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
 	DWORD dwCreationDisposition = (mode == WRITE) ? CREATE_ALWAYS : OPEN_EXISTING;
 	hFile = CreateFile(filename.c_str(), dwDesiredAccess, FILE_SHARE_READ, NULL, dwCreationDisposition, FILE_ATTRIBUTE_NORMAL, NULL);
 	if (hFile == INVALID_HANDLE_VALUE)
@@ -37,7 +37,7 @@ PhysicalFile::PhysicalFile(const wstring& filename, Mode mode)
 		{
 			throw FileNotFoundException(filename);
 		}
-		if (mode == WRITE)
+		if (mode != READ)
 		{
 			throw IOException(LoadString(IDS_ERROR_FILE_CREATE));
 		}
@@ -27,6 +27,7 @@ public:
 	{
 		WRITE,
 		READ,
+		MODIFY,
 	};
 
 	bool          eof()                      { return m_position == m_size; }
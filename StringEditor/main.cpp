@@ -39,6 +39,25 @@ class CommandList
 			"languages                     If no document is open it prints all supported\n"
 			"                              languages, with their language codes. Otherwise,\n"
 			"                              it prints the languages of the latest version.\n"
+			"save <file> <author> <notes>  Saves the document as a new version to a VDF file.\n"
+			"diff <old> <new>              Prints the names of the strings that were added\n"
+			"                              (+), removed (-) or changed (*) between two DAT\n"
+			"                              files.\n"
+			"dump <file> <text>            Writes a DAT file as UTF-8 text, one NAME=value\n"
+			"                              per line. Backslashes, newlines and tabs in values\n"
+			"                              are escaped as \\\\, \\n, \\r and \\t.\n"
+			"compile <type> <text> <file>  Creates a DAT file from a text file written by\n"
+			"                              'dump'. Type can be 'index' or 'name'; name-indexed\n"
+			"                              files are sorted.\n"
+			"makepatch <old> <new> <patch> Writes the differences between two DAT files to\n"
+			"                              a text patch. Each line holds +NAME=value for added\n"
+			"                              strings, *NAME=value for changed strings and -NAME\n"
+			"                              for removed strings.\n"
+			"patch <type> <file> <patch> <output>\n"
+			"                              Applies a patch to a DAT file and writes the result.\n"
+			"                              Type can be 'index' or 'name', as for 'compile'.\n\n"
+			"The DAT files read by the import, diff, dump, makepatch and patch commands are\n"
+			"loaded in parallel before the commands run, unless another command writes them.\n"
 			;
 	}
 
@@ -61,6 +80,9 @@ public:
 
 	void execute()
 	{
+		// Read the input files of all commands at the same time
+		PrefetchCommands(m_commands);
+
 		for (vector<ICommand*>::iterator p = m_commands.begin(); p != m_commands.end(); p++)
 		{
 			(*p)->execute(m_document);
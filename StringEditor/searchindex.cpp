@@ -0,0 +1,143 @@
+#include <algorithm>
+#include "searchindex.h"
+using namespace std;
+
+// Rebuild when more than one in this many strings has changed
+static const size_t MAX_DIRTY_RATIO = 8;
+static const size_t MIN_DIRTY_COUNT = 64;
+
+static wchar_t FoldChar(wchar_t c)
+{
+	// CompareString with NORM_IGNORECASE considers these equal in Turkish
+	if (c == 0x0130 || c == 0x0131)
+	{
+		return L'i';
+	}
+	return (wchar_t)(ULONG_PTR)CharLowerW((LPWSTR)(ULONG_PTR)c);
+}
+
+static uint64_t MakeTrigram(wchar_t c1, wchar_t c2, wchar_t c3)
+{
+	return ((uint64_t)c1 << 32) | ((uint64_t)c2 << 16) | (uint64_t)c3;
+}
+
+bool SearchIndex::canSearch(const wchar_t* term)
+{
+	// CompareString ignores some characters (e.g. hyphens and apostrophes),
+	// so a term with those can match text with different trigrams.
+	size_t len = 0;
+	for (; term[len] != L'\0'; len++)
+	{
+		wchar_t c = term[len];
+		if (!IsCharAlphaNumericW(c) && c != L' ' && c != L'_' && c != L'.')
+		{
+			return false;
+		}
+	}
+	return len >= 3;
+}
+
+void SearchIndex::clear()
+{
+	m_postings.clear();
+	m_dirty.clear();
+	m_count = 0;
+	m_built = false;
+}
+
+void SearchIndex::add(unsigned int id, const wchar_t* text)
+{
+	m_count++;
+	if (text != NULL && text[0] != L'\0' && text[1] != L'\0')
+	{
+		wchar_t c1 = FoldChar(text[0]);
+		wchar_t c2 = FoldChar(text[1]);
+		for (const wchar_t* c = text + 2; *c != L'\0'; c++)
+		{
+			wchar_t c3 = FoldChar(*c);
+
+			// IDs are added in ascending order, so this keeps the lists sorted and unique
+			vector<unsigned int>& ids = m_postings[MakeTrigram(c1, c2, c3)];
+			if (ids.empty() || ids.back() != id)
+			{
+				ids.push_back(id);
+			}
+			c1 = c2;
+			c2 = c3;
+		}
+	}
+}
+
+void SearchIndex::finish()
+{
+	m_built = true;
+}
+
+void SearchIndex::invalidate(unsigned int id)
+{
+	if (m_built)
+	{
+		m_dirty.push_back(id);
+		if (m_dirty.size() > max(MIN_DIRTY_COUNT, m_count / MAX_DIRTY_RATIO))
+		{
+			// Too many changes, let the owner rebuild it
+			clear();
+		}
+	}
+}
+
+void SearchIndex::getCandidates(const wchar_t* term, vector<bool>& candidates) const
+{
+	// Collect the posting lists of all trigrams in the term, shortest first
+	vector<const vector<unsigned int>*> lists;
+	wchar_t c1 = FoldChar(term[0]);
+	wchar_t c2 = FoldChar(term[1]);
+	for (const wchar_t* c = term + 2; *c != L'\0'; c++)
+	{
+		wchar_t c3 = FoldChar(*c);
+		Postings::const_iterator p = m_postings.find(MakeTrigram(c1, c2, c3));
+		if (p == m_postings.end())
+		{
+			lists.clear();
+			break;
+		}
+		lists.push_back(&p->second);
+		c1 = c2;
+		c2 = c3;
+	}
+
+	if (!lists.empty())
+	{
+		for (size_t i = 1; i < lists.size(); i++)
+		{
+			if (lists[i]->size() < lists[0]->size())
+			{
+				swap(lists[0], lists[i]);
+			}
+		}
+
+		vector<unsigned int> result(*lists[0]), temp;
+		for (size_t i = 1; i < lists.size() && !result.empty(); i++)
+		{
+			temp.clear();
+			set_intersection(result.begin(), result.end(), lists[i]->begin(), lists[i]->end(), back_inserter(temp));
+			result.swap(temp);
+		}
+
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			candidates[result[i]] = true;
+		}
+	}
+
+	// Changed strings are not in the postings
+	for (size_t i = 0; i < m_dirty.size(); i++)
+	{
+		candidates[m_dirty[i]] = true;
+	}
+}
+
+SearchIndex::SearchIndex()
+{
+	clear();
+}
@@ -0,0 +1,43 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <map>
+#include <vector>
+#include "types.h"
+
+//
+// Case-insensitive trigram index over a set of strings identified by ID.
+// The index only narrows down candidates; the caller is expected to do the
+// exact (locale-aware) comparison on the returned IDs.
+//
+class SearchIndex
+{
+public:
+	// Returns true if the index can be used to search for the term
+	static bool canSearch(const wchar_t* term);
+
+	bool isBuilt() const { return m_built; }
+	void clear();
+	void add(unsigned int id, const wchar_t* text);
+	void finish();
+
+	// Marks the text of an ID as changed. Changed IDs are always returned as
+	// candidates until the index is rebuilt.
+	void invalidate(unsigned int id);
+
+	// Adds all IDs that might contain the term to candidates
+	void getCandidates(const wchar_t* term, std::vector<bool>& candidates) const;
+
+	SearchIndex();
+
+private:
+	typedef uint64_t Trigram;
+	typedef std::map<Trigram, std::vector<unsigned int> > Postings;
+
+	Postings                  m_postings;
+	std::vector<unsigned int> m_dirty;
+	size_t                    m_count;
+	bool                      m_built;
+};
+
+#endif
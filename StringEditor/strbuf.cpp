@@ -1,25 +1,104 @@
+#include <algorithm>
 #include "strbuf.h"
 #include "exceptions.h"
 using namespace std;
 
-static const size_t  STRING_BUFFER_SIZE = 512*1024;	// 512 kB
+static const size_t STRING_BUFFER_SIZE = 512*1024;	// 512k characters
+static const size_t MIN_TABLE_SIZE     = 4096;		// Must be a power of two
+
+// FNV-1a over the characters of the string
+uint32_t StringBuffer::hashString(const wchar_t* str, size_t len)
+{
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ (uint32_t)str[i]) * 16777619U;
+	}
+	return hash;
+}
+
+// Returns the slot in the table that holds the string, or the empty slot
+// where it should be inserted.
+size_t StringBuffer::findSlot(const wchar_t* str, size_t len, uint32_t hash) const
+{
+	size_t mask = m_table.size() - 1;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		uint32_t index = m_table[slot];
+		if (index == 0)
+		{
+			return slot;
+		}
+
+		const Entry& entry = m_entries[index - 1];
+		if (entry.hash == hash && (entry.str == str || wmemcmp(entry.str, str, len + 1) == 0))
+		{
+			return slot;
+		}
+	}
+}
+
+void StringBuffer::growTable()
+{
+	m_table.assign(max(MIN_TABLE_SIZE, m_table.size() * 2), 0);
+
+	size_t mask = m_table.size() - 1;
+	for (size_t i = 0; i < m_entries.size(); i++)
+	{
+		size_t slot = m_entries[i].hash & mask;
+		while (m_table[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_table[slot] = (uint32_t)(i + 1);
+	}
+}
+
+void StringBuffer::insertEntry(const wchar_t* str, uint32_t hash, uint32_t offset)
+{
+	Entry entry;
+	entry.str    = str;
+	entry.hash   = hash;
+	entry.offset = offset;
+	m_entries.push_back(entry);
+
+	// Keep the load factor at or below one half
+	if (m_entries.size() * 2 > m_table.size())
+	{
+		growTable();
+	}
+	else
+	{
+		size_t mask = m_table.size() - 1;
+		size_t slot = hash & mask;
+		while (m_table[slot] != 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_table[slot] = (uint32_t)m_entries.size();
+	}
+}
 
 const wchar_t* StringBuffer::addString(const wstring& str)
 {
 	// First, check the index
-	wchar_t* src = (wchar_t*)str.c_str();
-	Index::const_iterator p = m_index.find(src);
-	if (p != m_index.end())
+	size_t   len  = str.length();
+	uint32_t hash = hashString(str.c_str(), len);
+	if (!m_table.empty())
 	{
-		return p->first;
+		uint32_t index = m_table[findSlot(str.c_str(), len, hash)];
+		if (index != 0)
+		{
+			return m_entries[index - 1].str;
+		}
 	}
 
 	Buffer* buffer = (m_buffers.size() == 0) ? NULL : &m_buffers.back();
-	if (buffer == NULL || buffer->size - buffer->used < str.length())
+	if (buffer == NULL || buffer->size - buffer->used < len + 1)
 	{
 		// Allocate new buffer
 		Buffer strbuf;
-		strbuf.size = STRING_BUFFER_SIZE;
+		strbuf.size = max(STRING_BUFFER_SIZE, len + 1);
 		strbuf.data = new wchar_t[strbuf.size];
 		strbuf.used = 0;
 		m_starts.push_back( (buffer != NULL) ? m_starts.back() + buffer->used : 0);
@@ -29,15 +108,12 @@ const wchar_t* StringBuffer::addString(const wstring& str)
 
 	// Copy string
 	wchar_t* dest = buffer->data + buffer->used;
-	wcscpy( dest, str.c_str() );
+	wmemcpy( dest, str.c_str(), len + 1 );
 
 	// Add to index
-	Desc desc;
-	desc.buffer  = m_buffers.size() - 1;
-	desc.offset  = buffer->used;
-	m_index.insert(make_pair(dest, desc));
+	insertEntry(dest, hash, (uint32_t)(m_starts.back() + buffer->used));
 
-	buffer->used += str.length() + 1;
+	buffer->used += len + 1;
 
 	return dest;
 }
@@ -76,27 +152,34 @@ void StringBuffer::read(IFile& input)
 			throw ReadException();
 		}
 
-		// Create index
+		// Create index. The last offset is the buffer size, not a string.
 		m_buffers.push_back(buffer);
 		m_starts.push_back(0);
-		for (size_t i = 0; i < leOffsets.size(); i++)
+		m_entries.reserve(nStrings);
+		for (unsigned long i = 0; i < nStrings; i++)
 		{
-			Desc desc;
-			desc.buffer = 0;
-			desc.offset = letohl( (unsigned long)leOffsets[i] );
-			m_index.insert(make_pair(buffer.data + desc.offset, desc));
+			uint32_t offset = letohl(leOffsets[i]);
+			if (offset >= buffer.size)
+			{
+				throw BadFileException();
+			}
+			const wchar_t* str = buffer.data + offset;
+			insertEntry(str, hashString(str, wcslen(str)), offset);
 		}
 	}
 	catch (...)
 	{
-		delete[] buffer.data;
+		if (m_buffers.empty() || m_buffers.back().data != buffer.data)
+		{
+			delete[] buffer.data;
+		}
 		throw;
 	}
 }
 
 void StringBuffer::write(IFile& output) const
 {
-	uint32_t leSize = htolel((unsigned long)m_index.size());
+	uint32_t leSize = htolel((unsigned long)m_entries.size());
 	if (output.write(&leSize, sizeof leSize) != sizeof leSize)
 	{
 		throw WriteException();
@@ -105,13 +188,13 @@ void StringBuffer::write(IFile& output) const
 	//
 	// Write string offsets
 	//
-	int i = 0;
-	vector<uint32_t> offsets( m_index.size() + 1 );
-	for (Index::const_iterator p = m_index.begin(); p != m_index.end(); p++, i++)
+	size_t i = 0;
+	vector<uint32_t> offsets( m_entries.size() + 1 );
+	for (; i < m_entries.size(); i++)
 	{
-		offsets[i] = htolel((uint32_t)(m_starts[p->second.buffer] + p->second.offset));
+		offsets[i] = htolel(m_entries[i].offset);
 	}
-	offsets[i] = htolel((uint32_t)m_starts.back() + m_buffers.back().used);	// Size of written buffer
+	offsets[i] = htolel((m_starts.empty()) ? 0 : (uint32_t)(m_starts.back() + m_buffers.back().used));	// Size of written buffer
 	
 	if (output.write(&offsets[0], (unsigned long)(offsets.size() * sizeof(uint32_t))) != offsets.size() * sizeof(uint32_t))
 	{
@@ -129,26 +212,94 @@ void StringBuffer::write(IFile& output) const
 	}
 }
 
+size_t StringBuffer::size() const
+{
+	return (m_starts.empty()) ? 0 : m_starts.back() + m_buffers.back().used;
+}
+
+void StringBuffer::writeChars(IFile& output, size_t from, size_t to) const
+{
+	for (size_t i = 0; i < m_buffers.size() && from < to; i++)
+	{
+		size_t start = m_starts[i];
+		size_t end   = start + m_buffers[i].used;
+		if (from < end)
+		{
+			size_t size = (min(to, end) - from) * sizeof(wchar_t);
+			if (output.write(m_buffers[i].data + (from - start), (unsigned long)size) != size)
+			{
+				throw WriteException();
+			}
+			from = min(to, end);
+		}
+	}
+}
+
+void StringBuffer::readChars(IFile& input, size_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	Buffer buffer;
+	buffer.size = count;
+	buffer.used = count;
+	buffer.data = new wchar_t[count];
+
+	try
+	{
+		unsigned long size = (unsigned long)(count * sizeof(wchar_t));
+		if (input.read(buffer.data, size) != size)
+		{
+			throw ReadException();
+		}
+
+		if (buffer.data[count - 1] != L'\0')
+		{
+			throw BadFileException();
+		}
+	}
+	catch (...)
+	{
+		delete[] buffer.data;
+		throw;
+	}
+
+	// Index every null-terminated string in the new buffer
+	size_t start = size();
+	m_starts.push_back(start);
+	m_buffers.push_back(buffer);
+	for (size_t offset = 0; offset < count;)
+	{
+		const wchar_t* str = buffer.data + offset;
+		size_t         len = wcslen(str);
+		insertEntry(str, hashString(str, len), (uint32_t)(start + offset));
+		offset += len + 1;
+	}
+}
+
 uint32_t StringBuffer::getStringOffset(const wchar_t* str) const
 {
-	if (str != NULL)
+	if (str != NULL && !m_table.empty())
 	{
-		const Desc& desc = m_index.find(str)->second;
-		return (uint32_t)(m_starts[desc.buffer] + desc.offset);
+		size_t   len   = wcslen(str);
+		uint32_t index = m_table[findSlot(str, len, hashString(str, len))];
+		if (index != 0)
+		{
+			return m_entries[index - 1].offset;
+		}
 	}
 	return UINT32_MAX;
 }
 
-const wchar_t* StringBuffer::getString(size_t offset) const
+const wchar_t* StringBuffer::getString(uint32_t offset) const
 {
 	if (m_starts.size() > 0 && offset < m_starts.back() + m_buffers.back().used)
 	{
-		size_t i;
-		for (i = 0; (i < m_starts.size() - 1) && (offset > m_starts[i+1]); i++)
-		{
-			offset -= m_starts[i+1];
-		}
-		return m_buffers[i].data + offset;
+		// Find the last buffer that starts at or before the offset
+		size_t i = upper_bound(m_starts.begin(), m_starts.end(), (size_t)offset) - m_starts.begin() - 1;
+		return m_buffers[i].data + (offset - m_starts[i]);
 	}
 	return NULL;
 }
@@ -161,10 +312,15 @@ void StringBuffer::clear()
 	}
 	m_buffers.clear();
 	m_starts.clear();
-	m_index.clear();
+	m_entries.clear();
+	m_table.clear();
+}
+
+StringBuffer::StringBuffer()
+{
 }
 
 StringBuffer::~StringBuffer()
 {
 	clear();
-}
\ No newline at end of file
+}
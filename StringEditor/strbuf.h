@@ -1,30 +1,41 @@
 #ifndef STRBUF_H
 #define STRBUF_H
 
-#include <map>
 #include <string>
 #include <vector>
 #include "files.h"
 #include "utils.h"
 
+//
+// Stores unique strings in large, never-moving buffers. Strings are interned
+// through an open-addressing hash table that keeps the hash and the global
+// offset per entry, so lookups don't need to compare every string.
+//
 class StringBuffer
 {
 public:
 	uint32_t       getStringOffset(const wchar_t* str) const;
 	const wchar_t* getString(uint32_t offset) const;
 	void           write(IFile& output) const;
+	size_t         size() const;
+
+	// Write or append a range of raw characters, for incremental files
+	void           writeChars(IFile& output, size_t from, size_t to) const;
+	void           readChars(IFile& input, size_t count);
 
 	void           read(IFile& input);
 	const wchar_t* addString(const std::wstring& str);
 	void           clear();
 
+	StringBuffer();
 	~StringBuffer();
 
 private:
-	struct Desc
+	struct Entry
 	{
-		size_t buffer;
-		size_t offset;
+		const wchar_t* str;
+		uint32_t       hash;
+		uint32_t       offset;
 	};
 
 	struct Buffer
@@ -34,11 +45,16 @@ private:
 		size_t   used;
 	};
 
-	typedef std::map<const wchar_t*, Desc, wcsless> Index;
+	static uint32_t hashString(const wchar_t* str, size_t len);
+
+	size_t findSlot(const wchar_t* str, size_t len, uint32_t hash) const;
+	void   insertEntry(const wchar_t* str, uint32_t hash, uint32_t offset);
+	void   growTable();
 
-	Index			    m_index;
-	std::vector<Buffer> m_buffers;
-	std::vector<size_t> m_starts;
+	std::vector<Entry>    m_entries;	// In order of insertion
+	std::vector<uint32_t> m_table;		// Index+1 into m_entries, 0 is empty
+	std::vector<Buffer>   m_buffers;
+	std::vector<size_t>   m_starts;
 };
 
-#endif
\ No newline at end of file
+#endif
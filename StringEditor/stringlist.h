@@ -53,7 +53,8 @@ public:
 		std::vector<String>::size_type m_index;
 	};
 
-	size_t size() const { return m_strings.size(); }
+	size_t        size() const { return m_strings.size(); }
+	unsigned long getCrc(size_t i) const { return m_strings[i].m_crc; }
 	void   reserve(size_t newSize);
 	void   add(const std::wstring& name, const std::wstring& value, const std::wstring& comment);
 
@@ -57,6 +57,30 @@ string WideToAnsi(const wchar_t* cstr, const char* defChar)
 	}
 }
 
+string WideToUtf8(const wstring& str)
+{
+	if (str.empty())
+	{
+		return "";
+	}
+	int size = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), (int)str.length(), NULL, 0, NULL, NULL);
+	string result(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, str.c_str(), (int)str.length(), &result[0], size, NULL, NULL);
+	return result;
+}
+
+wstring Utf8ToWide(const string& str)
+{
+	if (str.empty())
+	{
+		return L"";
+	}
+	int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.length(), NULL, 0);
+	wstring result(size, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), (int)str.length(), &result[0], size);
+	return result;
+}
+
 wstring GetLanguageName(LANGID language)
 {
 	LCID locale = MAKELCID(language, SORT_DEFAULT);
@@ -30,6 +30,10 @@ static std::string WideToAnsi(const std::wstring& str, const char* defChar = " "
 	return WideToAnsi(str.c_str(), defChar);
 }
 
+// Convert between wide (UCS-2) and UTF-8 strings
+std::string  WideToUtf8(const std::wstring& str);
+std::wstring Utf8ToWide(const std::string& str);
+
 void GetLanguageList(std::set<LANGID>& languages);
 std::wstring GetLanguageName(LANGID language);
 std::wstring GetEnglishLanguageName(LANGID language);
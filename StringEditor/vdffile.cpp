@@ -2,7 +2,12 @@
 #include "exceptions.h"
 using namespace std;
 
-static const uint8_t VDF_VERSION = 0x01;
+// Version 1 stores the string buffer up front, followed by all versions.
+// Version 2 stores one self-contained record per version, including the
+// characters it added to the string buffer, so a save only has to append the
+// new version and update the file header.
+static const uint8_t VDF_VERSION_1 = 0x01;
+static const uint8_t VDF_VERSION_2 = 0x02;
 
 #pragma pack(1)
 struct FILEINFO
@@ -13,6 +18,13 @@ struct FILEINFO
 	uint8_t  type;
 };
 
+struct FILEINFO2
+{
+	uint32_t nVersions;
+	uint16_t language;
+	uint8_t  type;
+};
+
 struct VERSIONDESC
 {
 	uint64_t saved;
@@ -23,6 +35,18 @@ struct VERSIONDESC
 	uint32_t nLanguages;
 };
 
+struct VERSIONDESC2
+{
+	uint64_t saved;
+	uint32_t lenAuthor;
+	uint32_t lenNotes;
+	uint32_t maxString;
+	uint32_t nStrings;
+	uint32_t nLanguages;
+	uint32_t nPostfixes;
+	uint32_t nChars;
+};
+
 struct LANGUAGEDESC
 {
 	uint32_t nStrings;
@@ -74,35 +98,32 @@ static wstring ReadString(IFile& input, unsigned long len)
 	return str;
 }
 
-void Document::write(IFile& output) const
+void Document::writeVersion(IFile& output, size_t v, size_t charsFrom, size_t charsTo) const
 {
-	vector<size_t> starts;
-
-	// Write file signature
-	uint8_t signature[4] = {'V','D','F', VDF_VERSION};
-	if (output.write(signature, 4) != 4)
-	{
-		throw WriteException();
-	}
-
-	// Write counts
-	FILEINFO info;
-	info.nVersions  = htolel((unsigned long)m_versions.size());
-	info.nPostfixes = htolel((unsigned long)m_newPostfixes.size());
-	info.language   = htoles(m_curLanguage);
-	info.type       = (uint8_t)m_type;
-	if (output.write(&info, sizeof info) != sizeof info)
+	const Version& version = m_versions[v];
+
+	VERSIONDESC2 desc;
+	desc.saved      = htolell(version.m_saved);
+	desc.lenAuthor  = htolel((unsigned long)version.m_author.length() + 1);
+	desc.lenNotes   = htolel((unsigned long)version.m_notes.length() + 1);
+	desc.maxString  = htolel((unsigned long)version.m_strings.size());
+	desc.nStrings   = htolel((unsigned long)version.diff_strings.size());
+	desc.nLanguages = htolel((unsigned long)version.m_values.size());
+	desc.nPostfixes = htolel((unsigned long)m_newPostfixes.size());
+	desc.nChars     = htolel((unsigned long)(charsTo - charsFrom));
+	if (output.write(&desc, sizeof desc) != sizeof desc)
 	{
 		throw WriteException();
 	}
 
-	m_buffer.write(output);
+	// Write the strings that this version added to the buffer
+	m_buffer.writeChars(output, charsFrom, charsTo);
 
 	// Write postfixes
 	for (map<LANGID,wstring>::const_iterator p = m_newPostfixes.begin(); p != m_newPostfixes.end(); p++)
 	{
 		POSTFIXINFO info;
-		info.language = htolel(p->first);
+		info.language = htoles(p->first);
 		info.length   = htolel((unsigned long)p->second.length() + 1);
 		if (output.write(&info, sizeof info) != sizeof info)
 		{
@@ -111,122 +132,298 @@ void Document::write(IFile& output) const
 		WriteString(output, p->second);
 	}
 
-	// Write versions
-	for (vector<Version>::const_iterator v = m_versions.begin(); v != m_versions.end(); v++)
+	WriteString(output, version.m_author);
+	WriteString(output, version.m_notes);
+
+	// Write changed string infos
+	for (set<size_t>::const_iterator p = version.diff_strings.begin(); p != version.diff_strings.end(); p++)
 	{
-		VERSIONDESC version;
-		version.saved      = htolell(v->m_saved);
-		version.lenAuthor  = htolel((unsigned long)v->m_author.length() + 1);
-		version.lenNotes   = htolel((unsigned long)v->m_notes.length() + 1);
-		version.maxString  = htolel((unsigned long)v->m_strings.size());
-		version.nStrings   = htolel((unsigned long)v->diff_strings.size());
-		version.nLanguages = htolel((unsigned long)v->m_values.size());
-
-		if (output.write(&version, sizeof version) != sizeof version)
+		const StringInfo& str = version.m_strings[*p];
+
+		STRINGDESC desc;
+		desc.id       = htolel((uint32_t)*p);
+		desc.position = htolel(str.m_position);
+		desc.name     = htolel(m_buffer.getStringOffset(str.m_name));
+		desc.comment  = htolel(m_buffer.getStringOffset(str.m_comment));
+		desc.flags    = str.m_flags & SF_SAVE_MASK;
+		if (output.write(&desc, sizeof desc) != sizeof desc)
 		{
 			throw WriteException();
 		}
+	}
 
-		WriteString(output, v->m_author);
-		WriteString(output, v->m_notes);
+	// Write languages
+	for (map<LANGID, StringValues>::const_iterator p = version.m_values.begin(); p != version.m_values.end(); p++)
+	{
+		uint16_t leLang = htoles(p->first);
+		if (output.write(&leLang, sizeof leLang) != sizeof leLang)
+		{
+			throw WriteException();
+		}
+	}
 
-		// Write changed string infos
-		for (set<size_t>::const_iterator p = v->diff_strings.begin(); p != v->diff_strings.end(); p++)
+	// Write changed values, per language
+	for (map<LANGID, StringValues>::const_iterator p = version.m_values.begin(); p != version.m_values.end(); p++)
+	{
+		const StringValues& values = p->second;
+
+		uint32_t leNumValues = htolel((unsigned long)values.m_changed.size());
+		if (output.write(&leNumValues, sizeof leNumValues) != sizeof leNumValues)
 		{
-			const StringInfo& str = v->m_strings[*p];
+			throw WriteException();
+		}
 
-			STRINGDESC desc;
-			desc.id       = htolel((uint32_t)*p);
-			desc.position = htolel(str.m_position);
-			desc.name     = htolel(m_buffer.getStringOffset(str.m_name));
-			desc.comment  = htolel(m_buffer.getStringOffset(str.m_comment));
-			desc.flags    = htolel(str.m_flags & SF_SAVE_MASK);
-			if (output.write(&desc, sizeof desc) != sizeof desc)
+		for (set<size_t>::const_iterator q = values.m_changed.begin(); q != values.m_changed.end(); q++)
+		{
+			VALUEDESC desc;
+			desc.id     = htolel((uint32_t)*q);
+			desc.offset = htolel((uint32_t)m_buffer.getStringOffset(values.m_virt[*q]));
+			if (output.write(&desc, sizeof(VALUEDESC)) != sizeof(VALUEDESC))
 			{
 				throw WriteException();
 			}
 		}
+	}
+}
+
+void Document::writeHeader(IFile& output) const
+{
+	// Write file signature
+	uint8_t signature[4] = {'V','D','F', VDF_VERSION_2};
+	if (output.write(signature, 4) != 4)
+	{
+		throw WriteException();
+	}
+
+	FILEINFO2 info;
+	info.nVersions = htolel((unsigned long)m_versions.size());
+	info.language  = htoles(m_curLanguage);
+	info.type      = (uint8_t)m_type;
+	if (output.write(&info, sizeof info) != sizeof info)
+	{
+		throw WriteException();
+	}
+}
+
+void Document::write(IFile& output)
+{
+	// Until this succeeds, we can't assume anything about the file
+	m_savedVersions = 0;
+
+	writeHeader(output);
+
+	// The first record carries the entire string buffer; we don't know which
+	// version added which string for files that were loaded as version 1.
+	for (size_t v = 0; v < m_versions.size(); v++)
+	{
+		writeVersion(output, v, 0, (v == 0) ? m_buffer.size() : 0);
+	}
+
+	m_savedVersions = m_versions.size();
+	m_savedChars    = m_buffer.size();
+	m_savedSize     = output.tell();
+}
+
+bool Document::canAppend() const
+{
+	return m_savedVersions > 0 && m_savedVersions < m_versions.size();
+}
+
+void Document::append(IFile& output)
+{
+	// Append the new versions after the last known record first, so the
+	// file remains valid until the header is updated.
+	output.seek(m_savedSize);
+	for (size_t v = m_savedVersions; v < m_versions.size(); v++)
+	{
+		writeVersion(output, v, (v == m_savedVersions) ? m_savedChars : 0, (v == m_savedVersions) ? m_buffer.size() : 0);
+	}
+	unsigned long size = output.tell();
+
+	output.seek(0);
+	writeHeader(output);
+
+	m_savedVersions = m_versions.size();
+	m_savedChars    = m_buffer.size();
+	m_savedSize     = size;
+}
+
+void Document::readVersion1(IFile& input)
+{
+	// Read file info
+	FILEINFO info;
+	if (input.read(&info, sizeof info) != sizeof info)
+	{
+		throw ReadException();
+	}
+
+	unsigned long nVersions  = letohl(info.nVersions);
+	unsigned long nPostfixes = letohl(info.nPostfixes);
+	m_curLanguage            = letohs(info.language);
+	m_type                   = (Type)info.type;
+
+	m_versions.resize(nVersions + 1);
+
+	// Read string data
+	m_buffer.read(input);
+
+	// Read postfixes
+	for (unsigned long i = 0; i < nPostfixes; i++)
+	{
+		POSTFIXINFO info;
+		if (input.read(&info, sizeof info) != sizeof info)
+		{
+			throw ReadException();
+		}
+		wstring str = ReadString(input, letohl(info.length));
+		m_oldPostfixes.insert(make_pair(letohl(info.language), str));
+	}
+	m_newPostfixes = m_oldPostfixes;
 
-		// Writes language
-		for (map<LANGID, StringValues>::const_iterator p = v->m_values.begin(); p != v->m_values.end(); p++)
+	// Read versions
+	for (size_t v = 0; v < nVersions; v++)
+	{
+		VERSIONDESC desc;
+		if (input.read(&desc, sizeof desc) != sizeof desc)
+		{
+			throw ReadException();
+		}
+
+		Version& version = m_versions[v];
+		version.m_saved  = letohll(desc.saved);
+		version.m_author = ReadString(input, letohl(desc.lenAuthor));
+		version.m_notes  = ReadString(input, letohl(desc.lenNotes));
+
+		unsigned long nLanguages = letohl(desc.nLanguages);
+		unsigned long nStrings   = letohl(desc.nStrings);
+		unsigned long maxString  = letohl(desc.maxString);
+
+		// Read changed strings
+		version.m_strings.resize(maxString);
+		for (unsigned long i = 0; i < nStrings; i++)
 		{
-			uint16_t leLang = htoles(p->first);
-			if (output.write(&leLang, sizeof leLang) != sizeof leLang)
+			STRINGDESC desc;
+			if (input.read(&desc, sizeof desc) != sizeof desc)
 			{
-				throw WriteException();
+				throw ReadException();
+			}
+
+			unsigned long id = letohl(desc.id);
+			version.diff_strings.insert(id);
+
+			// Set for current version
+			StringInfo& str = version.m_strings[ id ];
+			str.m_position = letohl(desc.position);
+			str.m_flags    = letohl(desc.flags);
+			str.m_name     = m_buffer.getString(letohl(desc.name));
+			str.m_comment  = m_buffer.getString(letohl(desc.comment));
+			str.m_modified = version.m_saved;
+		}
+
+		// Read languages
+		for (unsigned long i = 0; i < nLanguages; i++)
+		{
+			uint16_t leLang;
+			if (input.read(&leLang, sizeof leLang) != sizeof leLang)
+			{
+				throw ReadException();
+			}
+			version.m_values[ letohs(leLang) ];
+		}
+
+		version.m_numDifferences = (unsigned long)version.diff_strings.size();
+		version.m_numLanguages	 = (unsigned long)version.m_values.size();
+		version.m_numStrings     = 0;
+
+		// Copy this version's strings to next version and clear flags
+		m_versions[v+1].m_strings = version.m_strings;
+		for (size_t i = 0; i < m_versions[v+1].m_strings.size(); i++)
+		{
+			m_versions[v+1].m_strings[i].m_flags = 0;
+			if (m_versions[v+1].m_strings[i].m_name != NULL)
+			{
+				version.m_numStrings++;
 			}
 		}
 	}
 
-	// Write changed values, per language, per version
-	for (vector<Version>::const_iterator v = m_versions.begin(); v != m_versions.end(); v++)
+	// Copy the languages from the last version to the current version
+	m_versions[nVersions].m_values = m_versions[nVersions - 1].m_values;
+
+	// Read values, per language, per version
+	for (size_t v = 0; v < nVersions; v++)
 	{
-		for (map<LANGID, StringValues>::const_iterator p = v->m_values.begin(); p != v->m_values.end(); p++)
+		Version& version = m_versions[v];
+		for (map<LANGID, StringValues>::iterator p = version.m_values.begin(); p != version.m_values.end(); p++)
 		{
-			const StringValues& values = p->second;
-
-			uint32_t leNumValues = htolel((unsigned long)values.m_changed.size());
-			if (output.write(&leNumValues, sizeof leNumValues) != sizeof leNumValues)
+			uint32_t leNumValues;
+			if (input.read(&leNumValues, sizeof leNumValues) != sizeof leNumValues)
 			{
-				throw WriteException();
+				throw ReadException();
 			}
+			unsigned long nValues = letohl(leNumValues);
 
-			for (set<size_t>::const_iterator q = values.m_changed.begin(); q != values.m_changed.end(); q++)
+			// Read changed values
+			StringValues& values = p->second;
+			values.m_virt.resize( version.m_strings.size() );
+			for (unsigned long j = 0; j < nValues; j++)
 			{
 				VALUEDESC desc;
-				desc.id     = htolel((uint32_t)*q);
-				desc.offset = htolel((uint32_t)m_buffer.getStringOffset(values.m_virt[*q]));
-
-				if (output.write(&desc, sizeof(VALUEDESC)) != sizeof(VALUEDESC))
+				if (input.read(&desc, sizeof(VALUEDESC)) != sizeof(VALUEDESC))
 				{
-					throw WriteException();
+					throw ReadException();
 				}
+
+				unsigned long id  = letohl(desc.id);
+				values.m_virt[id] = m_buffer.getString(letohl(desc.offset));
+				values.m_changed.insert(id);
+			}
+			version.m_numDifferences += (unsigned long)values.m_changed.size();
+
+			// Copy values to next version, if it also has the language
+			map<LANGID, StringValues>::iterator q = m_versions[v+1].m_values.find(p->first);
+			if (q != m_versions[v+1].m_values.end())
+			{
+				q->second.m_virt = values.m_virt;
 			}
 		}
 	}
 }
 
-Document::Document(IFile& input)
+void Document::readVersion2(IFile& input)
 {
-	try
+	// Read file info
+	FILEINFO2 info;
+	if (input.read(&info, sizeof info) != sizeof info)
 	{
-		uint8_t signature[4];
-		if (input.read(signature, 4) != 4)
-		{
-			throw ReadException();
-		}
+		throw ReadException();
+	}
 
-		uint8_t version = signature[3];
-		if (signature[0] != 'V' || signature[1] != 'D' || signature[2] != 'F' || version == 0)
-		{
-			throw BadFileException();
-		}
+	unsigned long nVersions = letohl(info.nVersions);
+	m_curLanguage           = letohs(info.language);
+	m_type                  = (Type)info.type;
 
-		// Currently, we only support Version 1 of the VDF file format
-		if (version != VDF_VERSION)
-		{
-			throw UnsupportedVersionException();
-		}
+	if (nVersions == 0)
+	{
+		throw BadFileException();
+	}
+	m_versions.resize(nVersions + 1);
 
-		// Read file info
-		FILEINFO info;
-		if (input.read(&info, sizeof info) != sizeof info)
+	// Read versions
+	for (size_t v = 0; v < nVersions; v++)
+	{
+		VERSIONDESC2 desc;
+		if (input.read(&desc, sizeof desc) != sizeof desc)
 		{
 			throw ReadException();
 		}
 
-		unsigned long nVersions  = letohl(info.nVersions);
-		unsigned long nPostfixes = letohl(info.nPostfixes);
-		m_curLanguage            = letohs(info.language);
-		m_type                   = (Type)info.type;
-
-		m_versions.resize(nVersions + 1);
+		// Read the strings this version added to the buffer
+		m_buffer.readChars(input, letohl(desc.nChars));
 
-		// Read string data
-		m_buffer.read(input);
-
-		// Read postfixes
-		for (unsigned long i = 0; i < nPostfixes; i++)
+		// Read postfixes; the last version's postfixes are the current ones
+		m_oldPostfixes.clear();
+		for (unsigned long i = 0; i < letohl(desc.nPostfixes); i++)
 		{
 			POSTFIXINFO info;
 			if (input.read(&info, sizeof info) != sizeof info)
@@ -234,117 +431,148 @@ Document::Document(IFile& input)
 				throw ReadException();
 			}
 			wstring str = ReadString(input, letohl(info.length));
-			m_oldPostfixes.insert(make_pair(letohl(info.language), str));
+			m_oldPostfixes.insert(make_pair(letohs(info.language), str));
 		}
-		m_newPostfixes = m_oldPostfixes;
 
-		// Read versions
-		for (size_t v = 0; v < nVersions; v++)
+		Version& version = m_versions[v];
+		version.m_saved  = letohll(desc.saved);
+		version.m_author = ReadString(input, letohl(desc.lenAuthor));
+		version.m_notes  = ReadString(input, letohl(desc.lenNotes));
+
+		unsigned long nLanguages = letohl(desc.nLanguages);
+		unsigned long nStrings   = letohl(desc.nStrings);
+		unsigned long maxString  = letohl(desc.maxString);
+
+		// Read changed strings
+		version.m_strings.resize(maxString);
+		for (unsigned long i = 0; i < nStrings; i++)
 		{
-			VERSIONDESC desc;
+			STRINGDESC desc;
 			if (input.read(&desc, sizeof desc) != sizeof desc)
 			{
 				throw ReadException();
 			}
 
-			Version& version = m_versions[v];
-			version.m_saved  = letohll(desc.saved);
-			version.m_author = ReadString(input, letohl(desc.lenAuthor));
-			version.m_notes  = ReadString(input, letohl(desc.lenNotes));
+			unsigned long id = letohl(desc.id);
+			if (id >= maxString)
+			{
+				throw BadFileException();
+			}
+			version.diff_strings.insert(id);
+
+			// Set for current version
+			StringInfo& str = version.m_strings[ id ];
+			str.m_position = letohl(desc.position);
+			str.m_flags    = desc.flags;
+			str.m_name     = m_buffer.getString(letohl(desc.name));
+			str.m_comment  = m_buffer.getString(letohl(desc.comment));
+			str.m_modified = version.m_saved;
+		}
 
-			unsigned long nLanguages = letohl(desc.nLanguages);
-			unsigned long nStrings   = letohl(desc.nStrings);
-			unsigned long maxString  = letohl(desc.maxString);
+		// Read languages and start from the previous version's values
+		for (unsigned long i = 0; i < nLanguages; i++)
+		{
+			uint16_t leLang;
+			if (input.read(&leLang, sizeof leLang) != sizeof leLang)
+			{
+				throw ReadException();
+			}
 
-			// Read changed strings
-			version.m_strings.resize(maxString);
-			for (unsigned long i = 0; i < nStrings; i++)
+			LANGID        language = letohs(leLang);
+			StringValues& values   = version.m_values[language];
+			if (v > 0)
 			{
-				STRINGDESC desc;
-				if (input.read(&desc, sizeof desc) != sizeof desc)
+				map<LANGID, StringValues>::const_iterator q = m_versions[v-1].m_values.find(language);
+				if (q != m_versions[v-1].m_values.end())
 				{
-					throw ReadException();
+					values.m_virt = q->second.m_virt;
 				}
+			}
+			values.m_virt.resize(maxString);
+		}
 
-				unsigned long id = letohl(desc.id);
-				version.diff_strings.insert(id);
-
-				// Set for current version
-				StringInfo& str = version.m_strings[ id ];
-				str.m_position = letohl(desc.position);
-				str.m_flags    = letohl(desc.flags);
-				str.m_name     = m_buffer.getString(letohl(desc.name));
-				str.m_comment  = m_buffer.getString(letohl(desc.comment));
-				str.m_modified = version.m_saved;
+		// Read changed values, per language
+		version.m_numDifferences = (unsigned long)version.diff_strings.size();
+		for (map<LANGID, StringValues>::iterator p = version.m_values.begin(); p != version.m_values.end(); p++)
+		{
+			uint32_t leNumValues;
+			if (input.read(&leNumValues, sizeof leNumValues) != sizeof leNumValues)
+			{
+				throw ReadException();
 			}
+			unsigned long nValues = letohl(leNumValues);
 
-			// Read languages
-			for (unsigned long i = 0; i < nLanguages; i++)
+			StringValues& values = p->second;
+			for (unsigned long j = 0; j < nValues; j++)
 			{
-				uint16_t leLang;
-				if (input.read(&leLang, sizeof leLang) != sizeof leLang)
+				VALUEDESC desc;
+				if (input.read(&desc, sizeof(VALUEDESC)) != sizeof(VALUEDESC))
 				{
 					throw ReadException();
 				}
-				version.m_values[ letohs(leLang) ];
-			}
-
-			version.m_numDifferences = (unsigned long)version.diff_strings.size();
-			version.m_numLanguages	 = (unsigned long)version.m_values.size();
-			version.m_numStrings     = 0;
 
-			// Copy this version's strings to next version and clear flags
-			m_versions[v+1].m_strings = version.m_strings;
-			for (size_t i = 0; i < m_versions[v+1].m_strings.size(); i++)
-			{
-				m_versions[v+1].m_strings[i].m_flags = 0;
-				if (m_versions[v+1].m_strings[i].m_name != NULL)
+				unsigned long id = letohl(desc.id);
+				if (id >= maxString)
 				{
-					version.m_numStrings++;
+					throw BadFileException();
 				}
+				values.m_virt[id] = m_buffer.getString(letohl(desc.offset));
+				values.m_changed.insert(id);
 			}
+			version.m_numDifferences += (unsigned long)values.m_changed.size();
 		}
 
-		// Copy the languages from the last version to the current version
-		m_versions[nVersions].m_values = m_versions[nVersions - 1].m_values;
+		version.m_numLanguages = (unsigned long)version.m_values.size();
+		version.m_numStrings   = 0;
 
-		// Read values, per language, per version
-		for (size_t v = 0; v < nVersions; v++)
+		// Copy this version's strings to next version and clear flags
+		m_versions[v+1].m_strings = version.m_strings;
+		for (size_t i = 0; i < m_versions[v+1].m_strings.size(); i++)
 		{
-			Version& version = m_versions[v];
-			for (map<LANGID, StringValues>::iterator p = version.m_values.begin(); p != version.m_values.end(); p++)
+			m_versions[v+1].m_strings[i].m_flags = 0;
+			if (m_versions[v+1].m_strings[i].m_name != NULL)
 			{
-				uint32_t leNumValues;
-				if (input.read(&leNumValues, sizeof leNumValues) != sizeof leNumValues)
-				{
-					throw ReadException();
-				}
-				unsigned long nValues = letohl(leNumValues);
+				version.m_numStrings++;
+			}
+		}
+	}
+	m_newPostfixes = m_oldPostfixes;
 
-				// Read changed values
-				StringValues& values = p->second;
-				values.m_virt.resize( version.m_strings.size() );
-				for (unsigned long j = 0; j < nValues; j++)
-				{
-					VALUEDESC desc;
-					if (input.read(&desc, sizeof(VALUEDESC)) != sizeof(VALUEDESC))
-					{
-						throw ReadException();
-					}
-
-					unsigned long id  = letohl(desc.id);
-					values.m_virt[id] = m_buffer.getString(letohl(desc.offset));
-					values.m_changed.insert(id);
-				}
-				version.m_numDifferences += (unsigned long)values.m_changed.size();
+	// Copy the languages and values, but not the changes, from the last version to the current version
+	const Version& last = m_versions[nVersions - 1];
+	for (map<LANGID, StringValues>::const_iterator p = last.m_values.begin(); p != last.m_values.end(); p++)
+	{
+		m_versions[nVersions].m_values[p->first].m_virt = p->second.m_virt;
+	}
 
-				// Copy values to next version, if it also has the language
-				map<LANGID, StringValues>::iterator q = m_versions[v+1].m_values.find(p->first);
-				if (q != m_versions[v+1].m_values.end())
-				{
-					q->second.m_virt = values.m_virt;
-				}
-			}
+	// Future saves can append to this file
+	m_savedVersions = nVersions;
+	m_savedChars    = m_buffer.size();
+	m_savedSize     = input.tell();
+}
+
+Document::Document(IFile& input)
+	: m_savedVersions(0), m_savedChars(0), m_savedSize(0)
+{
+	try
+	{
+		uint8_t signature[4];
+		if (input.read(signature, 4) != 4)
+		{
+			throw ReadException();
+		}
+
+		uint8_t version = signature[3];
+		if (signature[0] != 'V' || signature[1] != 'D' || signature[2] != 'F' || version == 0)
+		{
+			throw BadFileException();
+		}
+
+		switch (version)
+		{
+			case VDF_VERSION_1: readVersion1(input); break;
+			case VDF_VERSION_2: readVersion2(input); break;
+			default:            throw UnsupportedVersionException();
 		}
 
 		// Set cached values
@@ -361,7 +589,7 @@ Document::Document(IFile& input)
 				m_strings[i].m_comment = m_curVersion->m_strings[i].m_comment;
 				m_curVersion->m_strings[i].m_name    = m_strings[i].m_name.c_str();
 				m_curVersion->m_strings[i].m_comment = m_strings[i].m_comment.c_str();
-				
+			
 				m_names.insert(make_pair(m_strings[i].m_name, (unsigned int)i));
 			}
 			else
@@ -2,8 +2,10 @@
 #define CHUNKFILE_H
 
 #include <string>
+#include <vector>
 
 #include "types.h"
+#include "files.h"
 
 typedef long ChunkType;
 
@@ -25,7 +27,7 @@ class ChunkReader
 {
 	static const int MAX_CHUNK_DEPTH = 256;
 
-	HANDLE m_file;
+	IFile* m_file;
 	long   m_position;
 	long   m_size;
 	long   m_offsets[ MAX_CHUNK_DEPTH ];
@@ -46,9 +48,14 @@ public:
 	unsigned long	readInteger();
 	std::string		readString();
 
-	ChunkReader(HANDLE file);
+	ChunkReader(IFile* file);
 };
 
+//
+// The chunks are built in memory; sizes are patched into the buffer when a
+// chunk ends, and every completed top-level chunk goes to the file in a
+// single write. Offsets are relative to the start of the buffer.
+//
 class ChunkWriter
 {
 	static const int MAX_CHUNK_DEPTH = 256;
@@ -60,12 +67,15 @@ class ChunkWriter
 		unsigned long offset;
 	};
 
-	HANDLE                  m_file;
+	IFile*                  m_file;
+	std::vector<char>       m_buffer;
 	ChunkInfo<CHUNKHDR>     m_chunks[ MAX_CHUNK_DEPTH ];
 	ChunkInfo<MINICHUNKHDR> m_miniChunk;
 	int                     m_curDepth;
 
+	void append(const void* buffer, unsigned long size);
 	void endMiniChunk();
+	void flush();
 
 public:
 	void beginChunk(ChunkType type);
@@ -79,6 +89,6 @@ public:
 	void writeInteger(unsigned long value);
 	void writeString(const std::string& str);
 
-	ChunkWriter(HANDLE file);
+	ChunkWriter(IFile* file);
 };
 #endif
\ No newline at end of file
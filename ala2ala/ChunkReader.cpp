@@ -14,7 +14,7 @@ ChunkType ChunkReader::nextMini()
 		skip();
 	}
 
-	if (SetFilePointer(m_file, 0, NULL, FILE_CURRENT) == m_offsets[m_curDepth])
+	if ((long)m_file->tell() == m_offsets[m_curDepth])
 	{
 		// We're at the end of the current chunk, move up one
 		m_curDepth--;
@@ -24,14 +24,13 @@ ChunkType ChunkReader::nextMini()
 	}
 
 	MINICHUNKHDR hdr;
-	DWORD read;
-	if (!ReadFile(m_file, &hdr, sizeof(MINICHUNKHDR), &read, NULL) || read != sizeof(MINICHUNKHDR))
+	if (m_file->read(&hdr, sizeof(MINICHUNKHDR)) != sizeof(MINICHUNKHDR))
 	{
 		throw ReadException();
 	}
 
 	m_miniSize   = letohl(hdr.size);
-	m_miniOffset = SetFilePointer(m_file, 0, NULL, FILE_CURRENT) + m_miniSize;
+	m_miniOffset = m_file->tell() + m_miniSize;
 	m_position   = 0;
 
 	return letohl(hdr.type);
@@ -47,7 +46,7 @@ ChunkType ChunkReader::next()
 		skip();
 	}
 	
-	if (SetFilePointer(m_file, 0, NULL, FILE_CURRENT) == m_offsets[m_curDepth])
+	if ((long)m_file->tell() == m_offsets[m_curDepth])
 	{
 		// We're at the end of the current chunk, move up one
 		m_curDepth--;
@@ -57,14 +56,13 @@ ChunkType ChunkReader::next()
 	}
 
 	CHUNKHDR hdr;
-	DWORD read;
-	if (!ReadFile(m_file, &hdr, sizeof(CHUNKHDR), &read, NULL) || read != sizeof(CHUNKHDR))
+	if (m_file->read(&hdr, sizeof(CHUNKHDR)) != sizeof(CHUNKHDR))
 	{
 		throw ReadException();
 	}
 
 	unsigned long size = letohl(hdr.size);
-	m_offsets[ ++m_curDepth ] = SetFilePointer(m_file, 0, NULL, FILE_CURRENT) + (size & 0x7FFFFFFF);
+	m_offsets[ ++m_curDepth ] = m_file->tell() + (size & 0x7FFFFFFF);
 	m_size     = (~size & 0x80000000) ? size : -1;
 	m_miniSize = -1;
 	m_position = 0;
@@ -76,11 +74,11 @@ void ChunkReader::skip()
 {
 	if (m_miniSize >= 0)
 	{
-		SetFilePointer(m_file, m_miniOffset, NULL, FILE_BEGIN);
+		m_file->seek(m_miniOffset);
 	}
 	else
 	{
-		SetFilePointer(m_file, m_offsets[m_curDepth--], NULL, FILE_BEGIN);
+		m_file->seek(m_offsets[m_curDepth--]);
 	}
 }
 
@@ -143,10 +141,9 @@ long ChunkReader::read(void* buffer, long size, bool check)
 {
 	if (m_size >= 0)
 	{
-		DWORD read = 0;
-		BOOL  ok   = ReadFile(m_file, buffer, min(m_position + size, this->size()) - m_position, &read, NULL);
+		long read = m_file->read(buffer, min(m_position + size, this->size()) - m_position);
 		m_position += read;
-		if (check && (!ok || read != size))
+		if (check && read != size)
 		{
 			throw ReadException();
 		}
@@ -155,10 +152,10 @@ long ChunkReader::read(void* buffer, long size, bool check)
 	throw ReadException();
 }
 
-ChunkReader::ChunkReader(HANDLE file)
+ChunkReader::ChunkReader(IFile* file)
 {
 	m_file       = file;
-	m_offsets[0] = GetFileSize(m_file, NULL);
+	m_offsets[0] = m_file->size();
 	m_curDepth   = 0;
 	m_size       = -1;
 	m_miniSize   = -1;
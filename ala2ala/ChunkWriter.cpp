@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstring>
 #include "ChunkFile.h"
 #include "exceptions.h"
 using namespace std;
@@ -6,7 +7,7 @@ using namespace std;
 void ChunkWriter::beginChunk(ChunkType type)
 {
 	m_curDepth++;
-	m_chunks[m_curDepth].offset   = SetFilePointer(m_file, 0, NULL, FILE_CURRENT);
+	m_chunks[m_curDepth].offset   = (unsigned long)m_buffer.size();
 	m_chunks[m_curDepth].hdr.type = type;
 	m_chunks[m_curDepth].hdr.size = 0;
 	if (m_curDepth > 0)
@@ -17,11 +18,7 @@ void ChunkWriter::beginChunk(ChunkType type)
 
 	// Write dummy header
 	CHUNKHDR hdr = {0,0};
-	DWORD written;
-	if (!WriteFile(m_file, &hdr, sizeof(CHUNKHDR), &written, NULL) || written != sizeof(CHUNKHDR))
-	{
-		throw WriteException();
-	}
+	append(&hdr, sizeof(CHUNKHDR));
 }
 
 void ChunkWriter::beginMiniChunk(ChunkType type)
@@ -33,17 +30,13 @@ void ChunkWriter::beginMiniChunk(ChunkType type)
 		endMiniChunk();
 	}
 
-	m_miniChunk.offset   = SetFilePointer(m_file, 0, NULL, FILE_CURRENT);
+	m_miniChunk.offset   = (unsigned long)m_buffer.size();
 	m_miniChunk.hdr.type = (uint8_t)type;
 	m_miniChunk.hdr.size = 0;
 	
 	// Write dummy header
 	MINICHUNKHDR hdr = {0, 0};
-	DWORD written;
-	if (!WriteFile(m_file, &hdr, sizeof(MINICHUNKHDR), &written, NULL) || written != sizeof(MINICHUNKHDR))
-	{
-		throw WriteException();
-	}
+	append(&hdr, sizeof(MINICHUNKHDR));
 }
 
 void ChunkWriter::endMiniChunk()
@@ -52,18 +45,11 @@ void ChunkWriter::endMiniChunk()
 	assert(m_miniChunk.offset != -1);
 
 	// Ending mini-chunk
-	long pos  = SetFilePointer(m_file, 0, NULL, FILE_CURRENT);
-	long size = pos - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
+	long size = (long)m_buffer.size() - (m_miniChunk.offset + sizeof(MINICHUNKHDR));
 	assert(size <= 0xFF);
 
 	m_miniChunk.hdr.size = (uint8_t)size;
-	SetFilePointer(m_file, m_miniChunk.offset, NULL, FILE_BEGIN);
-	DWORD written;
-	if (!WriteFile(m_file, &m_miniChunk.hdr, sizeof(MINICHUNKHDR), &written, NULL) || written != sizeof(MINICHUNKHDR))
-	{
-		throw WriteException();
-	}
-	SetFilePointer(m_file, pos, NULL, FILE_BEGIN);
+	memcpy(&m_buffer[m_miniChunk.offset], &m_miniChunk.hdr, sizeof(MINICHUNKHDR));
 	m_miniChunk.offset = -1;
 }
 
@@ -77,31 +63,43 @@ void ChunkWriter::endChunk()
 	}
 
 	// Ending normal chunk
-	long pos  = SetFilePointer(m_file, 0, NULL, FILE_CURRENT);
-	long size = pos - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
+	long size = (long)m_buffer.size() - (m_chunks[m_curDepth].offset + sizeof(CHUNKHDR));
 
 	m_chunks[m_curDepth].hdr.size = (m_chunks[m_curDepth].hdr.size & 0x80000000) | (size & ~0x80000000);
-	SetFilePointer(m_file, m_chunks[m_curDepth].offset, NULL, FILE_BEGIN);
-	DWORD written;
-	if (!WriteFile(m_file, &m_chunks[m_curDepth].hdr, sizeof(CHUNKHDR), &written, NULL) || written != sizeof(CHUNKHDR))
+	memcpy(&m_buffer[m_chunks[m_curDepth].offset], &m_chunks[m_curDepth].hdr, sizeof(CHUNKHDR));
+
+	if (--m_curDepth < 0)
 	{
-		throw WriteException();
+		// The top-level chunk is complete
+		flush();
 	}
-	SetFilePointer(m_file, pos, NULL, FILE_BEGIN);
+}
 
-	m_curDepth--;
+void ChunkWriter::append(const void* buffer, unsigned long size)
+{
+	const char* data = (const char*)buffer;
+	m_buffer.insert(m_buffer.end(), data, data + size);
 }
 
-void ChunkWriter::write(const void* buffer, long size)
+void ChunkWriter::flush()
 {
-	assert(m_curDepth >= 0);
-	DWORD written;
-	if (!WriteFile(m_file, buffer, size, &written, NULL) || written != size)
+	if (!m_buffer.empty())
 	{
-		throw WriteException();
+		if (m_file->write(&m_buffer[0], (unsigned long)m_buffer.size()) != m_buffer.size())
+		{
+			throw WriteException();
+		}
+		// Keep the memory for the next chunk
+		m_buffer.clear();
 	}
 }
 
+void ChunkWriter::write(const void* buffer, long size)
+{
+	assert(m_curDepth >= 0);
+	append(buffer, size);
+}
+
 void ChunkWriter::writeString(const std::string& str)
 {
 	write(str.c_str(), (int)str.length() + 1);
@@ -130,7 +128,7 @@ void ChunkWriter::writeInteger(unsigned long value)
 	write(&leValue, sizeof(leValue));
 }
 
-ChunkWriter::ChunkWriter(HANDLE file)
+ChunkWriter::ChunkWriter(IFile* file)
 {
 	m_file     = file;
 	m_curDepth = -1;
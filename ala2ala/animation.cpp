@@ -88,7 +88,7 @@ void Animation::writeBoneAnimation(ChunkWriter& writer, const BoneAnimation& bon
 	writer.endChunk();
 }
 
-void Animation::write(HANDLE file, Type type)
+void Animation::write(IFile* file, Type type)
 {
 	ChunkWriter writer(file);
 
@@ -255,7 +255,7 @@ void Animation::readBoneAnimation(ChunkReader& reader, BoneAnimation& bone)
 	Verify(type == -1);
 }
 
-Animation::Animation(HANDLE file)
+Animation::Animation(IFile* file)
 {
 	ChunkReader reader(file);
 	ChunkType   type;
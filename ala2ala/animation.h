@@ -37,10 +37,10 @@ public:
 
 	enum Type { ANIM_NONE, ANIM_EAW, ANIM_FOC };
 
-	Animation(HANDLE hFile);
+	Animation(IFile* file);
 
 	Type getType() const;
-	void write(HANDLE hFile, Type type);
+	void write(IFile* file, Type type);
 
 private:
 	void readBoneAnimation(ChunkReader& reader, BoneAnimation& bone);
@@ -0,0 +1,385 @@
+//
+// This file contains the headless animation converter.
+//
+// Usage: ala2ala [/eaw|/foc] [/r] [/y] [/q] /d <directory> <source>...
+//
+// Sources can be files, directories or wildcards. Directories are searched
+// for *.ALA files, and with /r their subdirectories are mirrored in the
+// destination directory. Without /eaw or /foc, every animation is converted
+// to the other format, just like the "Convert" button does.
+//
+// The files are converted in parallel, one per processor. Every file is read
+// with a single read, converted in memory and written to a temporary file
+// that replaces the destination when it's complete. An interrupted run never
+// leaves a half-written animation behind.
+//
+#include <iostream>
+#include <set>
+#include "batch.h"
+#include "animation.h"
+#include "exceptions.h"
+#include "files.h"
+#include "utils.h"
+using namespace std;
+
+static const int OPT_RECURSIVE = 1;
+static const int OPT_OVERWRITE = 2;
+static const int OPT_QUIET     = 4;
+
+struct Arguments
+{
+	int             options;
+	Animation::Type type;		// ANIM_NONE to swap the format
+	wstring         destdir;
+	vector<wstring> sources;
+};
+
+struct ConvertJob
+{
+	wstring         src;
+	wstring         dest;
+	wstring         error;
+	Animation::Type srcType;
+	Animation::Type destType;
+	unsigned long   srcSize;
+	unsigned long   destSize;
+	LONGLONG        ticks;
+};
+
+struct BATCH_INFO
+{
+	vector<ConvertJob>* jobs;
+	const Arguments*    args;
+	LONGLONG            frequency;
+	CRITICAL_SECTION    output;
+	volatile LONG       next;
+};
+
+static void PrintUsage()
+{
+	wcerr << L"Usage: ala2ala [/eaw|/foc] [/r] [/y] [/q] /d <directory> <source>..." << endl
+		  << endl
+		  << L"Converts animations between the Empire at War and Forces of Corruption format." << endl
+		  << L"Sources can be files, directories or wildcards. The files are converted in" << endl
+		  << L"parallel and written to the destination directory." << endl
+		  << endl
+		  << L"Options:" << endl
+		  << L"/eaw     Converts all animations to the Empire at War format" << endl
+		  << L"/foc     Converts all animations to the Forces of Corruption format" << endl
+		  << L"/d       Destination directory" << endl
+		  << L"/r       Recursive. Also converts subdirectories, mirroring them in <directory>" << endl
+		  << L"/y       Overwrites existing files in the destination directory" << endl
+		  << L"/q       Quiet. Prints nothing when all goes well" << endl
+		  << endl
+		  << L"Without /eaw or /foc, every animation is converted to the other format." << endl;
+}
+
+static bool IsOption(const wstring& arg, const wchar_t* name)
+{
+	return arg.length() >= 2 && (arg[0] == L'/' || arg[0] == L'-') && _wcsicmp(arg.c_str() + 1, name) == 0;
+}
+
+static bool ParseArguments(Arguments& args, const vector<wstring>& argv)
+{
+	args.options = 0;
+	args.type    = Animation::ANIM_NONE;
+	for (size_t i = 1; i < argv.size(); i++)
+	{
+		if (argv[i][0] != L'/' && argv[i][0] != L'-') {
+			args.sources.push_back(argv[i]);
+		} else if (IsOption(argv[i], L"eaw")) {
+			args.type = Animation::ANIM_EAW;
+		} else if (IsOption(argv[i], L"foc")) {
+			args.type = Animation::ANIM_FOC;
+		} else if (IsOption(argv[i], L"r")) {
+			args.options |= OPT_RECURSIVE;
+		} else if (IsOption(argv[i], L"y")) {
+			args.options |= OPT_OVERWRITE;
+		} else if (IsOption(argv[i], L"q")) {
+			args.options |= OPT_QUIET;
+		} else if (IsOption(argv[i], L"d") && i + 1 < argv.size()) {
+			args.destdir = argv[++i];
+		} else {
+			wcerr << L"Unknown option '" << argv[i] << L"'" << endl;
+			return false;
+		}
+	}
+
+	if (args.destdir.empty() || args.sources.empty())
+	{
+		PrintUsage();
+		return false;
+	}
+	return true;
+}
+
+// Adds a job for every file matching the filter in the directory.
+// Subdirectories are mirrored in the destination directory.
+static void FindFiles(vector<ConvertJob>& jobs, const wstring& srcdir, const wstring& filter, const wstring& destdir, bool recursive)
+{
+	WIN32_FIND_DATA wfd;
+	HANDLE hFind = FindFirstFile((srcdir + filter).c_str(), &wfd);
+	if (hFind != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (~wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				ConvertJob job;
+				job.src      = srcdir  + wfd.cFileName;
+				job.dest     = destdir + wfd.cFileName;
+				job.srcType  = Animation::ANIM_NONE;
+				job.destType = Animation::ANIM_NONE;
+				job.srcSize  = 0;
+				job.destSize = 0;
+				job.ticks    = 0;
+				jobs.push_back(job);
+			}
+		} while (FindNextFile(hFind, &wfd));
+		FindClose(hFind);
+	}
+
+	if (recursive)
+	{
+		hFind = FindFirstFile((srcdir + L"*").c_str(), &wfd);
+		if (hFind != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				if ((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && wcscmp(wfd.cFileName, L".") != 0 && wcscmp(wfd.cFileName, L"..") != 0)
+				{
+					FindFiles(jobs, srcdir + wfd.cFileName + L"\\", filter, destdir + wfd.cFileName + L"\\", true);
+				}
+			} while (FindNextFile(hFind, &wfd));
+			FindClose(hFind);
+		}
+	}
+}
+
+// Removes the jobs for files that an earlier job already converts, so
+// overlapping sources (e.g. "Data" and "Data\\*.ala") don't have two threads
+// writing the same destination.
+static void RemoveDuplicates(vector<ConvertJob>& jobs)
+{
+	set<wstring> seen;
+	vector<ConvertJob>::iterator out = jobs.begin();
+	for (vector<ConvertJob>::iterator j = jobs.begin(); j != jobs.end(); j++)
+	{
+		wchar_t path[MAX_PATH];
+		DWORD   len = GetFullPathName(j->src.c_str(), MAX_PATH, path, NULL);
+		wstring key = (len > 0 && len < MAX_PATH) ? wstring(path, len) : j->src;
+		CharUpperBuff(&key[0], (DWORD)key.length());
+		if (seen.insert(key).second)
+		{
+			*out++ = *j;
+		}
+	}
+	jobs.erase(out, jobs.end());
+}
+
+// Creates all directories on the path of the file
+static void CreateDirectories(const wstring& filename)
+{
+	for (size_t ofs = filename.find_first_of(L"\\/", 1); ofs != wstring::npos; ofs = filename.find_first_of(L"\\/", ofs + 1))
+	{
+		CreateDirectory(filename.substr(0, ofs).c_str(), NULL);
+	}
+}
+
+static const wchar_t* GetTypeName(Animation::Type type)
+{
+	return (type == Animation::ANIM_EAW) ? L"EaW" : L"FoC";
+}
+
+// Converts a single file; throws on any error
+static void ConvertFile(ConvertJob& job, Animation::Type type, bool overwrite)
+{
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+
+	MemoryFile input(job.src);
+	job.srcSize = input.size();
+
+	Animation animation(&input);
+	job.srcType  = animation.getType();
+	job.destType = type;
+	if (type == Animation::ANIM_NONE)
+	{
+		job.destType = (job.srcType == Animation::ANIM_EAW) ? Animation::ANIM_FOC : Animation::ANIM_EAW;
+	}
+
+	MemoryFile output;
+	animation.write(&output, job.destType);
+	output.save(job.dest, overwrite);
+	job.destSize = output.size();
+
+	QueryPerformanceCounter(&end);
+	job.ticks = end.QuadPart - start.QuadPart;
+}
+
+static DWORD WINAPI BatchThread(LPVOID lpParam)
+{
+	BATCH_INFO* info = (BATCH_INFO*)lpParam;
+	LONG i;
+	while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->jobs->size())
+	{
+		ConvertJob& job = (*info->jobs)[i];
+		try
+		{
+			ConvertFile(job, info->args->type, (info->args->options & OPT_OVERWRITE) != 0);
+		}
+		catch (wexception& e)
+		{
+			job.error = e.what();
+		}
+		catch (exception& e)
+		{
+			const char* what = e.what();
+			job.error = wstring(what, what + strlen(what));
+		}
+
+		if (job.error.empty() && (~info->args->options & OPT_QUIET))
+		{
+			// Report as we go; with thousands of files, the wait is long otherwise
+			double seconds = (double)job.ticks / info->frequency;
+			wstring line = FormatString(L"%ls: %ls -> %ls, %lu bytes in %.2f ms (%.1f MB/s)",
+				job.src.c_str(), GetTypeName(job.srcType), GetTypeName(job.destType), job.srcSize,
+				seconds * 1000, (seconds > 0) ? job.srcSize / seconds / 1048576 : 0.0);
+
+			EnterCriticalSection(&info->output);
+			wcout << line << endl;
+			LeaveCriticalSection(&info->output);
+		}
+	}
+	return 0;
+}
+
+static void ConvertFiles(vector<ConvertJob>& jobs, const Arguments& args)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	size_t nThreads = min((size_t)si.dwNumberOfProcessors, jobs.size());
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	BATCH_INFO info;
+	info.jobs      = &jobs;
+	info.args      = &args;
+	info.frequency = frequency.QuadPart;
+	info.next      = 0;
+	InitializeCriticalSection(&info.output);
+
+	vector<HANDLE> hThreads;
+	for (size_t i = 1; i < nThreads; i++)
+	{
+		DWORD  ThreadID;
+		HANDLE hThread = CreateThread(NULL, 0, BatchThread, &info, 0, &ThreadID);
+		if (hThread != NULL)
+		{
+			hThreads.push_back(hThread);
+		}
+	}
+
+	// This thread helps out as well
+	BatchThread(&info);
+
+	if (!hThreads.empty())
+	{
+		WaitForMultipleObjects((DWORD)hThreads.size(), &hThreads[0], TRUE, INFINITE);
+		for (size_t i = 0; i < hThreads.size(); i++)
+		{
+			CloseHandle(hThreads[i]);
+		}
+	}
+	DeleteCriticalSection(&info.output);
+}
+
+bool IsBatchCommandLine(const vector<wstring>& argv)
+{
+	// The UI takes no arguments
+	return argv.size() > 1;
+}
+
+int RunBatch(const vector<wstring>& argv)
+{
+	Arguments args;
+	if (!ParseArguments(args, argv))
+	{
+		return 1;
+	}
+
+	wstring destdir = args.destdir;
+	if (destdir[destdir.length() - 1] != L'\\' && destdir[destdir.length() - 1] != L'/') {
+		destdir += L"\\";
+	}
+
+	// Collect the files
+	vector<ConvertJob> jobs;
+	int unmatched = 0;
+	for (size_t i = 0; i < args.sources.size(); i++)
+	{
+		size_t  found      = jobs.size();
+		wstring source     = args.sources[i];
+		DWORD   attributes = GetFileAttributes(source.c_str());
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			// Entire directory
+			if (source[source.length() - 1] != L'\\' && source[source.length() - 1] != L'/') {
+				source += L"\\";
+			}
+			FindFiles(jobs, source, L"*.ala", destdir, (args.options & OPT_RECURSIVE) != 0);
+		}
+		else
+		{
+			// A file or a wildcard
+			size_t ofs = source.find_last_of(L"\\/:");
+			ofs = (ofs == wstring::npos) ? 0 : ofs + 1;
+			FindFiles(jobs, source.substr(0, ofs), source.substr(ofs), destdir, (args.options & OPT_RECURSIVE) != 0);
+		}
+
+		if (jobs.size() == found)
+		{
+			// Most likely a typo in the script
+			wcerr << args.sources[i] << L": no files found" << endl;
+			unmatched++;
+		}
+	}
+	RemoveDuplicates(jobs);
+
+	for (vector<ConvertJob>::const_iterator j = jobs.begin(); j != jobs.end(); j++)
+	{
+		CreateDirectories(j->dest);
+	}
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+	ConvertFiles(jobs, args);
+	QueryPerformanceCounter(&end);
+
+	// Report
+	int      failed = 0;
+	LONGLONG bytes  = 0;
+	for (vector<ConvertJob>::const_iterator j = jobs.begin(); j != jobs.end(); j++)
+	{
+		if (!j->error.empty()) {
+			wcerr << j->src << L": " << j->error << endl;
+			failed++;
+		} else {
+			bytes += j->srcSize;
+		}
+	}
+
+	if (~args.options & OPT_QUIET || failed > 0 || unmatched > 0)
+	{
+		double seconds = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+		wcout << FormatString(L"%u converted, %d failed; %I64d bytes in %.2f s (%.1f MB/s)",
+			(unsigned int)(jobs.size() - failed), failed, bytes,
+			seconds, (seconds > 0) ? bytes / seconds / 1048576 : 0.0) << endl;
+		if (unmatched > 0) {
+			wcout << unmatched << L" source(s) matched no files" << endl;
+		}
+	}
+	return (failed > 0 || unmatched > 0) ? 1 : 0;
+}
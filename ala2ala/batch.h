@@ -0,0 +1,16 @@
+//
+// This file defines the headless (command-line) animation converter
+//
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+// Returns whether the command line asks for a batch conversion instead of the UI
+bool IsBatchCommandLine(const std::vector<std::wstring>& argv);
+
+// Runs the batch conversion and returns the process exit code
+int RunBatch(const std::vector<std::wstring>& argv);
+
+#endif
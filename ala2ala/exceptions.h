@@ -40,6 +40,12 @@ public:
 	FileNotFoundException(const std::wstring filename) : IOException(L"Unable to find file:\n" + filename) {}
 };
 
+class OpenException : public IOException
+{
+public:
+	OpenException(const std::wstring filename) : IOException(L"Unable to open file:\n" + filename) {}
+};
+
 class ReadException : public IOException
 {
 public:
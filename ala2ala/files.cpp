@@ -0,0 +1,108 @@
+#include "files.h"
+#include "exceptions.h"
+using namespace std;
+
+unsigned long MemoryFile::read(void* buffer, unsigned long size)
+{
+	size = min(size, (unsigned long)m_data.size() - m_position);
+	if (size > 0)
+	{
+		memcpy(buffer, &m_data[m_position], size);
+		m_position += size;
+	}
+	return size;
+}
+
+unsigned long MemoryFile::write(const void* buffer, unsigned long size)
+{
+	if (m_position + size > m_data.size())
+	{
+		m_data.resize(m_position + size);
+	}
+	if (size > 0)
+	{
+		memcpy(&m_data[m_position], buffer, size);
+		m_position += size;
+	}
+	return size;
+}
+
+void MemoryFile::save(const wstring& filename, bool overwrite) const
+{
+	// The temporary file must be on the same volume for the move to be atomic
+	size_t  ofs = filename.find_last_of(L"\\/");
+	wstring dir = (ofs == wstring::npos) ? L"." : filename.substr(0, ofs + 1);
+
+	wchar_t tmpname[MAX_PATH];
+	if (GetTempFileName(dir.c_str(), L"ala", 0, tmpname) == 0)
+	{
+		throw wruntime_error(LoadString(IDS_ERROR_FILE_CREATE, filename.c_str()));
+	}
+
+	HANDLE hFile = CreateFile(tmpname, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		DeleteFile(tmpname);
+		throw wruntime_error(LoadString(IDS_ERROR_FILE_CREATE, filename.c_str()));
+	}
+
+	DWORD written = 0;
+	BOOL  ok = m_data.empty() || (WriteFile(hFile, &m_data[0], (DWORD)m_data.size(), &written, NULL) && written == m_data.size());
+	CloseHandle(hFile);
+	if (!ok)
+	{
+		DeleteFile(tmpname);
+		throw WriteException();
+	}
+
+	// Without MOVEFILE_REPLACE_EXISTING this fails when the destination exists
+	DWORD flags = MOVEFILE_WRITE_THROUGH | (overwrite ? MOVEFILE_REPLACE_EXISTING : 0);
+	if (!MoveFileEx(tmpname, filename.c_str(), flags))
+	{
+		DeleteFile(tmpname);
+		throw wruntime_error(LoadString(IDS_ERROR_FILE_CREATE, filename.c_str()));
+	}
+}
+
+MemoryFile::MemoryFile()
+{
+	m_position = 0;
+}
+
+MemoryFile::MemoryFile(const void* data, unsigned long size)
+	: m_data((const char*)data, (const char*)data + size)
+{
+	m_position = 0;
+}
+
+MemoryFile::MemoryFile(const wstring& filename)
+{
+	HANDLE hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw OpenException(filename);
+	}
+
+	try
+	{
+		DWORD size = GetFileSize(hFile, NULL);
+		if (size == INVALID_FILE_SIZE)
+		{
+			throw ReadException();
+		}
+
+		DWORD read = 0;
+		m_data.resize(size);
+		if (size > 0 && (!ReadFile(hFile, &m_data[0], size, &read, NULL) || read != size))
+		{
+			throw ReadException();
+		}
+	}
+	catch (...)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+	CloseHandle(hFile);
+	m_position = 0;
+}
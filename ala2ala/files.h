@@ -0,0 +1,47 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+class IFile
+{
+public:
+	virtual bool          eof() = 0;
+	virtual unsigned long size() = 0;
+	virtual void          seek(unsigned long offset) = 0;
+	virtual unsigned long tell() = 0;
+	virtual unsigned long read(void* buffer, unsigned long size) = 0;
+	virtual unsigned long write(const void* buffer, unsigned long size) = 0;
+	virtual ~IFile() {}
+};
+
+//
+// A file that lives entirely in memory. Animations are read from and written
+// to a MemoryFile, so the chunk code never touches the disk itself; the whole
+// file is loaded with one read and saved with one write.
+//
+class MemoryFile : public IFile
+{
+	std::vector<char> m_data;
+	unsigned long     m_position;
+
+public:
+	bool          eof()                      { return m_position == m_data.size(); }
+	unsigned long size()                     { return (unsigned long)m_data.size(); }
+	unsigned long tell()                     { return m_position; }
+	void          seek(unsigned long offset) { m_position = min(offset, (unsigned long)m_data.size()); }
+	unsigned long read(void* buffer, unsigned long size);
+	unsigned long write(const void* buffer, unsigned long size);
+
+	// Writes the contents to disk. The data goes to a temporary file which then
+	// replaces the destination, so the destination is never left half-written.
+	void save(const std::wstring& filename, bool overwrite) const;
+
+	MemoryFile();
+	MemoryFile(const void* data, unsigned long size);
+	MemoryFile(const std::wstring& filename);
+};
+
+#endif
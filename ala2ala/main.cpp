@@ -2,7 +2,8 @@
 #include "utils.h"
 #include "resource.h"
 #include "animation.h"
-#include "utils.h"
+#include "batch.h"
+#include "files.h"
 #include <commctrl.h>
 #include <commdlg.h>
 #include <shlwapi.h>
@@ -107,8 +108,13 @@ static void DoAddFiles(APPLICATION_INFO* info)
 		size_t i;
 		for (i = 0; i < filenames.size(); i++)
 		{
-			HANDLE hFile = CreateFile(filenames[i].c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-			if (hFile == INVALID_HANDLE_VALUE)
+			try
+			{
+				MemoryFile file(filenames[i]);
+				animations[i].first  = new Animation(&file);
+				animations[i].second = file.size();
+			}
+			catch (OpenException&)
 			{
 				wstring message = LoadString(IDS_ERROR_FILE_OPEN, filenames[i].c_str());
 				if (MessageBox(NULL, message.c_str(), NULL, MB_YESNO | MB_ICONWARNING) == IDNO)
@@ -116,23 +122,12 @@ static void DoAddFiles(APPLICATION_INFO* info)
 					break;
 				}
 			}
-
-			try
-			{
-				animations[i].first  = new Animation(hFile);
-			}
 			catch (wruntime_error&)
 			{
 				wstring message = LoadString(IDS_ERROR_FILE_FORMAT, filenames[i].c_str());
 				MessageBox(NULL, message.c_str(), NULL, MB_OK | MB_ICONWARNING);
 				animations[i].first = NULL;
 			}
-
-			LARGE_INTEGER size;
-			size.LowPart = GetFileSize(hFile, (DWORD*)&size.HighPart);
-			animations[i].second = size.QuadPart;
-
-			CloseHandle(hFile);
 		}
 
 		if (i == filenames.size())
@@ -270,7 +265,6 @@ static void DoConvertFiles(APPLICATION_INFO* info, const Animation::Type type)
 		EnableWindow(hControl, FALSE);
 	}
 
-	HANDLE hFile = NULL;
 	try
 	{
 		size_t count = info->files.size();
@@ -294,16 +288,9 @@ static void DoConvertFiles(APPLICATION_INFO* info, const Animation::Type type)
 				destType = (info->files[i].animation->getType() == Animation::ANIM_EAW) ? Animation::ANIM_FOC : Animation::ANIM_EAW;
 			}
 
-			hFile = CreateFile(pathbuf, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
-			if (hFile == INVALID_HANDLE_VALUE)
-			{
-				throw wruntime_error(LoadString(IDS_ERROR_FILE_CREATE, pathbuf));
-			}
-
-			info->files[i].animation->write(hFile, destType);
-
-			CloseHandle(hFile);
-			hFile = NULL;
+			MemoryFile file;
+			info->files[i].animation->write(&file, destType);
+			file.save(pathbuf, false);
 
 			// Restore path
 			PathRemoveFileSpec(pathbuf);
@@ -315,7 +302,6 @@ static void DoConvertFiles(APPLICATION_INFO* info, const Animation::Type type)
 	}
 	catch (wruntime_error& e)
 	{
-		CloseHandle(hFile);
 		wstring message = LoadString(IDS_ERROR_CONVERSION, e.what());
 		MessageBox(NULL, message.c_str(), NULL, MB_OK | MB_ICONHAND);
 	}
@@ -471,8 +457,42 @@ int main(APPLICATION_INFO* info)
 	return (int)msg.wParam;
 }
 
+// Parse the command line into a argv-style vector
+static vector<wstring> ParseCommandLine()
+{
+	vector<wstring> argv;
+	TCHAR* cmdline = GetCommandLine();
+
+	bool quoted = false;
+	wstring arg;
+	for (TCHAR* p = cmdline; p == cmdline || *(p - 1) != '\0'; p++)
+	{
+		if (*p == L'\0' || (*p == L' ' && !quoted))
+		{
+			if (arg != L"")
+			{
+				argv.push_back(arg);
+				arg = L"";
+			}
+		}
+		else if (*p == L'"') quoted = !quoted;
+		else arg += *p;
+	}
+	return argv;
+}
+
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)
 {
+	vector<wstring> argv = ParseCommandLine();
+	if (IsBatchCommandLine(argv))
+	{
+		// Headless conversion; report to the console we were started from
+		AttachConsole(ATTACH_PARENT_PROCESS);
+		freopen("conout$", "w", stdout);
+		freopen("conout$", "w", stderr);
+		return RunBatch(argv);
+	}
+
 #ifndef NDEBUG
 	AllocConsole();
 	freopen("conout$", "w", stdout);
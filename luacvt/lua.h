@@ -2,6 +2,8 @@
 #define LUP_H
 // Petroglyph LUA format
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include <string>
@@ -23,45 +25,117 @@ enum Type
     TTHREAD
 };
 
+// A string in the loaded file; it ends at the first zero.
+// It isn't zero-terminated itself, so always use the size.
+struct String
+{
+    const char* data;
+    size_t      size;
+
+    bool empty() const { return size == 0; }
+};
+
+inline bool operator==(const String& a, const String& b) { return a.size == b.size && (a.size == 0 || memcmp(a.data, b.data, a.size) == 0); }
+inline bool operator!=(const String& a, const String& b) { return !(a == b); }
+
+// An array of plain values, allocated in an Arena
+template <typename T>
+struct Array
+{
+    T*     data;
+    size_t size;
+
+    T&       operator[](size_t i)       { return data[i]; }
+    const T& operator[](size_t i) const { return data[i]; }
+    bool     empty()              const { return size == 0; }
+};
+
+template <typename T>
+bool operator==(const Array<T>& a, const Array<T>& b) { return a.size == b.size && std::equal(a.data, a.data + a.size, b.data); }
+template <typename T>
+bool operator!=(const Array<T>& a, const Array<T>& b) { return !(a == b); }
+
+/*
+ * Allocates memory in large blocks, which are freed together when the arena
+ * is destroyed. Only for plain structures; nothing is constructed or
+ * destroyed.
+ */
+class Arena
+{
+    std::vector<char*> m_blocks;
+    char*              m_next;
+    size_t             m_free;      // Bytes left after m_next
+
+    // Not copyable; the copies would free the same blocks
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+public:
+    void* Allocate(size_t size);
+
+    template <typename T>
+    T* Allocate() { return (T*)Allocate(sizeof(T)); }
+
+    template <typename T>
+    void Allocate(Array<T>& array, size_t size)
+    {
+        array.data = (T*)Allocate(size * sizeof(T));
+        array.size = size;
+    }
+
+    Arena();
+    ~Arena();
+};
+
 struct Local
 {
-    std::string name;
-    int         startPC;
-    int         endPC;
+    String name;
+    int    startPC;
+    int    endPC;
 };
 
 typedef int           Line;
-typedef std::string   UpValue;
+typedef String        UpValue;
 typedef unsigned long Instruction;
 
 struct Constant
 {
     Type        type;
-    std::string str;
+    String      str;
     double      number;
     bool        boolean;
 };
 
 struct Function
 {
-    std::string    name;
+    String         name;
     int            lineDefined;
     int            lastLineDefined;
     unsigned char  nUpvalues;
     unsigned char  nParameters;
     unsigned char  isVararg;
     unsigned char  maxStackSize;
-    std::vector<Line>        lines;
-    std::vector<Local>       locals;
-    std::vector<UpValue>     upvalues;
-    std::vector<Constant>    constants;
-    std::vector<Function>    functions;
-    std::vector<Instruction> instructions;
+    Array<Line>        lines;
+    Array<Local>       locals;
+    Array<UpValue>     upvalues;
+    Array<Constant>    constants;
+    Array<Function*>   functions;
+    Array<Instruction> instructions;
 };
 
+/*
+ * A loaded Lua file. The functions are allocated in the arena and their
+ * strings point into the buffer with the file's contents, so loading a file
+ * doesn't allocate memory per function or string, and the optimizations can
+ * move functions around without copying them.
+ */
 struct File
 {
-	Function function;
+    std::vector<char> buffer;
+    Arena             arena;
+    Function*         function;
+
+    File() : function(NULL) {}
 };
 
 namespace Lua50
@@ -87,5 +161,14 @@ enum Version
 
 Version DetectFileVersion(std::istream& input);
 
+// Optimizations, see Optimize()
+static const int OPTIMIZE_STRIP_DEBUG = 1;  // Remove line numbers, local and upvalue names
+static const int OPTIMIZE_CONSTANTS   = 2;  // Remove unused constants
+static const int OPTIMIZE_FUNCTIONS   = 4;  // Share identical nested functions
+
+// Rewrites the functions in the file to make it smaller.
+// isNew selects the Lua 5.1 instruction encoding instead of 5.0.
+void Optimize(File& file, bool isNew, int options);
+
 }
 #endif
\ No newline at end of file
@@ -25,13 +25,10 @@ struct Header
 };
 #pragma pack()
 
-static Reader ReadHeader(istream& input, bool isLup)
+static void ReadHeader(Reader& reader, bool isLup)
 {
     Header header;
-	input.read( (char*)&header, sizeof header );
-    if (input.fail()) {
-        throw IOException("Unable to read file");
-    }
+	reader.Read( &header, sizeof header );
 
     unsigned char format = (isLup ? 'p' : 0);
 	
@@ -48,23 +45,22 @@ static Reader ReadHeader(istream& input, bool isLup)
 	{
 		throw BadFileException();
 	}
-
-    return Reader(input, header.sizeNumber);
+    reader.SetSizeNumber(header.sizeNumber);
 }
 
-static void ReadLines(Reader& reader, vector<Line>& lines)
+static void ReadLines(Reader& reader, Arena& arena, Array<Line>& lines)
 {
-	lines.resize( reader.ReadInt() );
-	for (size_t i = 0; i < lines.size(); i++)
+	arena.Allocate(lines, reader.ReadCount());
+	for (size_t i = 0; i < lines.size; i++)
 	{
 		lines[i] = reader.ReadInt();
 	}
 }
 
-static void ReadLocals(Reader& reader, vector<Local>& locals)
+static void ReadLocals(Reader& reader, Arena& arena, Array<Local>& locals)
 {
-	locals.resize( reader.ReadInt() );
-	for (size_t i = 0; i < locals.size(); i++)
+	arena.Allocate(locals, reader.ReadCount());
+	for (size_t i = 0; i < locals.size; i++)
 	{
         Local& local = locals[i];
 		local.name    = reader.ReadString();
@@ -73,19 +69,19 @@ static void ReadLocals(Reader& reader, vector<Local>& locals)
 	}
 }
 
-static void ReadUpvalues(Reader& reader, vector<UpValue>& upvalues)
+static void ReadUpvalues(Reader& reader, Arena& arena, Array<UpValue>& upvalues)
 {
-	upvalues.resize( reader.ReadInt() );
-	for (size_t i = 0; i < upvalues.size(); i++)
+	arena.Allocate(upvalues, reader.ReadCount());
+	for (size_t i = 0; i < upvalues.size; i++)
 	{
 		upvalues[i] = reader.ReadString();
 	}
 }
 
-static void ReadConstants(Reader& reader, vector<Constant>& constants)
+static void ReadConstants(Reader& reader, Arena& arena, Array<Constant>& constants)
 {
-	constants.resize( reader.ReadInt() );
-	for (size_t i = 0; i < constants.size(); i++)
+	arena.Allocate(constants, reader.ReadCount());
+	for (size_t i = 0; i < constants.size; i++)
 	{
 		Constant& constant = constants[i];
 		constant.type = (Type)reader.ReadByte();
@@ -101,27 +97,28 @@ static void ReadConstants(Reader& reader, vector<Constant>& constants)
 	}
 }
 
-static void ReadFunction(Reader& reader, Function& function, bool isLup);
+static void ReadFunction(Reader& reader, Arena& arena, Function& function, bool isLup);
 
-static void ReadFunctions(Reader& reader, vector<Function>& functions, bool isLup)
+static void ReadFunctions(Reader& reader, Arena& arena, Array<Function*>& functions, bool isLup)
 {
-	functions.resize( reader.ReadInt() );
-	for (size_t i = 0; i < functions.size(); i++)
+	arena.Allocate(functions, reader.ReadCount());
+	for (size_t i = 0; i < functions.size; i++)
 	{
-		ReadFunction(reader, functions[i], isLup);
+		functions[i] = arena.Allocate<Function>();
+		ReadFunction(reader, arena, *functions[i], isLup);
 	}
 }
 
-static void ReadInstructions(Reader& reader, vector<Instruction>& instructions)
+static void ReadInstructions(Reader& reader, Arena& arena, Array<Instruction>& instructions)
 {
-    instructions.resize( reader.ReadInt() );
-	for (size_t i = 0; i < instructions.size(); i++)
+    arena.Allocate(instructions, reader.ReadCount());
+	for (size_t i = 0; i < instructions.size; i++)
 	{
 		instructions[i] = reader.ReadInt();
 	}
 }
 
-static void ReadFunction(Reader& reader, Function& function, bool isLup)
+static void ReadFunction(Reader& reader, Arena& arena, Function& function, bool isLup)
 {
 	function.name            = reader.ReadString();
 	function.lineDefined     = reader.ReadInt();
@@ -135,25 +132,30 @@ static void ReadFunction(Reader& reader, Function& function, bool isLup)
 	function.nParameters  = reader.ReadByte();
 	function.isVararg     = reader.ReadByte();
 	function.maxStackSize = reader.ReadByte();
-	ReadInstructions(reader, function.instructions);
-	ReadConstants   (reader, function.constants);
-	ReadFunctions   (reader, function.functions, isLup);
-    ReadLines       (reader, function.lines);
-    ReadLocals      (reader, function.locals);
-	ReadUpvalues    (reader, function.upvalues);
+	ReadInstructions(reader, arena, function.instructions);
+	ReadConstants   (reader, arena, function.constants);
+	ReadFunctions   (reader, arena, function.functions, isLup);
+    ReadLines       (reader, arena, function.lines);
+    ReadLocals      (reader, arena, function.locals);
+	ReadUpvalues    (reader, arena, function.upvalues);
 }
 
 void ReadFile(istream& input, File& file, bool isLup)
 {
-    Reader reader = ReadHeader(input, isLup);
-	ReadFunction(reader, file.function, isLup);
+    // The file's strings point into its buffer
+    ReadStream(input, file.buffer);
+
+    Reader reader(file.buffer.empty() ? NULL : &file.buffer[0], file.buffer.size());
+    ReadHeader(reader, isLup);
+    file.function = file.arena.Allocate<Function>();
+	ReadFunction(reader, file.arena, *file.function, isLup);
 }
 
 //
 // Writing
 //
 
-static Writer WriteHeader(ostream& output, bool isLup)
+static void WriteHeader(Writer& writer, bool isLup)
 {
 	// Fill header
     Header header;
@@ -167,24 +169,23 @@ static Writer WriteHeader(ostream& output, bool isLup)
 	header.sizeNumber      = 4;
     header.integral        = 0;
 
-    Writer writer(output, header.sizeNumber);
+    writer.SetSizeNumber(header.sizeNumber);
 	writer.Write( (char*)&header, sizeof header );
-    return writer;
 }
 
-static void WriteLines(Writer& writer, const vector<Line>& lines)
+static void WriteLines(Writer& writer, const Array<Line>& lines)
 {
-	writer.WriteInt((unsigned int)lines.size());
-	for (size_t i = 0; i < lines.size(); i++)
+	writer.WriteInt((unsigned int)lines.size);
+	for (size_t i = 0; i < lines.size; i++)
 	{
 		writer.WriteInt(lines[i]);
 	}
 }
 
-static void WriteLocals(Writer& writer, const vector<Local>& locals)
+static void WriteLocals(Writer& writer, const Array<Local>& locals)
 {
-	writer.WriteInt((unsigned int)locals.size());
-	for (size_t i = 0; i < locals.size(); i++)
+	writer.WriteInt((unsigned int)locals.size);
+	for (size_t i = 0; i < locals.size; i++)
 	{
 		writer.WriteString(locals[i].name);
 		writer.WriteInt(locals[i].startPC);
@@ -192,19 +193,19 @@ static void WriteLocals(Writer& writer, const vector<Local>& locals)
 	}
 }
 
-static void WriteUpvalues(Writer& writer, const vector<UpValue>& upvalues)
+static void WriteUpvalues(Writer& writer, const Array<UpValue>& upvalues)
 {
-	writer.WriteInt((unsigned int)upvalues.size());
-	for (size_t i = 0; i < upvalues.size(); i++)
+	writer.WriteInt((unsigned int)upvalues.size);
+	for (size_t i = 0; i < upvalues.size; i++)
 	{
 		writer.WriteString(upvalues[i]);
 	}
 }
 
-static void WriteConstants(Writer& writer, const vector<Constant>& constants )
+static void WriteConstants(Writer& writer, const Array<Constant>& constants )
 {
-	writer.WriteInt((unsigned int)constants.size());
-	for (size_t i = 0; i < constants.size(); i++)
+	writer.WriteInt((unsigned int)constants.size);
+	for (size_t i = 0; i < constants.size; i++)
 	{
 		writer.WriteByte(constants[i].type);
 		switch (constants[i].type)
@@ -219,19 +220,19 @@ static void WriteConstants(Writer& writer, const vector<Constant>& constants )
 
 static void WriteFunction(Writer& writer, const Function& function, int* petroValue);
 
-static void WriteFunctions(Writer writer, const vector<Function>& functions, int* petroValue)
+static void WriteFunctions(Writer& writer, const Array<Function*>& functions, int* petroValue)
 {
-	writer.WriteInt((unsigned int)functions.size());
-	for (size_t i = 0; i < functions.size(); i++)
+	writer.WriteInt((unsigned int)functions.size);
+	for (size_t i = 0; i < functions.size; i++)
 	{
-		WriteFunction(writer, functions[i], petroValue);
+		WriteFunction(writer, *functions[i], petroValue);
 	}
 }
 
-static void WriteInstructions(Writer& writer, const vector<Instruction>& instructions)
+static void WriteInstructions(Writer& writer, const Array<Instruction>& instructions)
 {
-	writer.WriteInt((unsigned int)instructions.size());
-	for (size_t i = 0; i < instructions.size(); i++)
+	writer.WriteInt((unsigned int)instructions.size);
+	for (size_t i = 0; i < instructions.size; i++)
 	{
 		writer.WriteInt(instructions[i]);
 	}
@@ -261,8 +262,10 @@ static void WriteFunction( Writer& writer, const Function& function, int* petroV
 void WriteFile(ostream& output, const File& file, bool isLup)
 {
     int petroValue = 1;
-    Writer writer = WriteHeader(output, isLup);
-    WriteFunction(writer, file.function, isLup ? &petroValue : NULL);
+    Writer writer(output);
+    WriteHeader(writer, isLup);
+    WriteFunction(writer, *file.function, isLup ? &petroValue : NULL);
+    writer.Flush();
 }
 
 }
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include "lua_io.h"
 #include "exceptions.h"
 using namespace std;
@@ -5,101 +7,187 @@ using namespace std;
 namespace Lua
 {
 
-Reader::Reader(std::istream& input, size_t sizeNumber)
-    : m_input(input), m_sizeNumber(sizeNumber)
+// The writer flushes its buffer when it grows beyond this size
+static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+// Size of the arena's blocks. A file's functions usually fit in one.
+static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+Arena::Arena()
+    : m_next(NULL), m_free(0)
+{
+}
+
+Arena::~Arena()
+{
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        delete[] m_blocks[i];
+    }
+}
+
+void* Arena::Allocate(size_t size)
+{
+    // Keep everything aligned for doubles and pointers
+    size = (size + 7) & ~(size_t)7;
+    if (size > m_free)
+    {
+        // Make room in the list first, so the block isn't leaked if that fails
+        m_blocks.push_back(NULL);
+        if (size > ARENA_BLOCK_SIZE / 4)
+        {
+            // Large arrays get a block of their own, so the rest
+            // of the current block isn't wasted
+            return m_blocks.back() = new char[size];
+        }
+        m_next = m_blocks.back() = new char[ARENA_BLOCK_SIZE];
+        m_free = ARENA_BLOCK_SIZE;
+    }
+
+    void* p = m_next;
+    m_next += size;
+    m_free -= size;
+    return p;
+}
+
+void ReadStream(istream& input, vector<char>& buffer)
+{
+    // Reserve the remaining size, if the stream can tell us
+    streampos pos = input.tellg();
+    if (pos != streampos(-1) && input.seekg(0, ios_base::end))
+    {
+        streampos end = input.tellg();
+        input.seekg(pos);
+        if (end > pos) {
+            buffer.reserve(buffer.size() + (size_t)(end - pos));
+        }
+    }
+    input.clear();
+
+    char chunk[16384];
+    while (input.read(chunk, sizeof chunk) || input.gcount() > 0)
+    {
+        buffer.insert(buffer.end(), chunk, chunk + input.gcount());
+    }
+    if (input.bad()) {
+        throw IOException("Unable to read file");
+    }
+}
+
+Reader::Reader(const char* data, size_t size, size_t sizeNumber)
+    : m_data(data), m_size(size), m_pos(0), m_sizeNumber(sizeNumber)
 {
 }
 
 Writer::Writer(std::ostream& output, size_t sizeNumber)
     : m_output(output), m_sizeNumber(sizeNumber)
 {
+    m_buffer.reserve(WRITE_BUFFER_SIZE);
+}
+
+Writer::~Writer()
+{
+    // Errors should be caught with an explicit Flush()
+    try {
+        Flush();
+    } catch (...) {
+    }
 }
 
 void Reader::Read(void* dest, size_t size)
 {
-    m_input.read((char*)dest, (streamsize)size);
-    if (m_input.fail()) {
+    if (size > m_size - m_pos) {
         throw IOException("Unable to read file");
     }
+    memcpy(dest, m_data + m_pos, size);
+    m_pos += size;
 }
 
 void Writer::Write(const void* src, size_t size)
 {
-    m_output.write((char*)src, (streamsize)size);
-    if (m_output.fail()) {
-        throw IOException("Unable to write file");
+    m_buffer.insert(m_buffer.end(), (const char*)src, (const char*)src + size);
+    if (m_buffer.size() >= WRITE_BUFFER_SIZE) {
+        Flush();
     }
 }
 
-string Reader::ReadString()
+void Writer::Flush()
 {
-	int size = ReadInt();
-    
-    string str;
-    if (size > 0)
+    if (!m_buffer.empty())
     {
-	    char* data = new char[size + 1];
-        try
-        {
-	        Read(data, size);
-            data[size] = '\0';
-	        str = data;
-	        delete[] data;
-        }
-        catch (...)
-        {
-            delete[] data;
-            throw;
+        m_output.write(&m_buffer[0], (streamsize)m_buffer.size());
+        m_buffer.clear();
+        if (m_output.fail()) {
+            throw IOException("Unable to write file");
         }
     }
-	return str;
 }
 
-void Writer::WriteString(const string& str, bool null_if_empty)
+String Reader::ReadString()
+{
+    String str = {NULL, 0};
+	int size = ReadInt();
+    if (size <= 0) {
+        return str;
+    }
+
+    if ((size_t)size > m_size - m_pos) {
+        throw IOException("Unable to read file");
+    }
+
+    // Strings are stored with their terminating zero, but may contain others
+    str.data = m_data + m_pos;
+    str.size = find(str.data, str.data + size, '\0') - str.data;
+    m_pos += size;
+    return str;
+}
+
+void Writer::WriteString(const String& str, bool null_if_empty)
 {
     if (str.empty() && null_if_empty) {
         WriteInt(0);
     } else {
-        WriteInt((int)str.length() + 1);
-	    Write(str.c_str(), str.length() + 1);
+        WriteInt((int)str.size + 1);
+	    Write(str.data, str.size);
+        WriteByte(0);
     }
 }
 
-int Reader::ReadInt()
+size_t Reader::ReadCount()
 {
-	int32_t value;
-	m_input.read( (char*)&value, sizeof value );
-    if (m_input.fail()) {
+    int count = ReadInt();
+    if (count < 0 || (size_t)count > m_size - m_pos) {
         throw IOException("Unable to read file");
     }
+    return count;
+}
+
+int Reader::ReadInt()
+{
+	int32_t value;
+	Read(&value, sizeof value);
 	return letohl(value);
 }
 
 void Writer::WriteInt(int val)
 {
 	int32_t value = htolel(val);
-	m_output.write( (char*)&value, sizeof value );
-    if (m_output.fail()) {
-        throw IOException("Unable to read file");
-    }
+	Write(&value, sizeof value);
 }
 
 int Reader::ReadByte()
 {
-	uint8_t value;
-	m_input.read( (char*)&value, sizeof value );
-    if (m_input.fail()) {
+    if (m_pos >= m_size) {
         throw IOException("Unable to read file");
     }
-	return value;
+	return (uint8_t)m_data[m_pos++];
 }
 
 void Writer::WriteByte(int val)
 {
-	uint8_t value = (uint8_t)val;
-	m_output.write( (char*)&value, sizeof value );
-    if (m_output.fail()) {
-        throw IOException("Unable to read file");
+    m_buffer.push_back((char)val);
+    if (m_buffer.size() >= WRITE_BUFFER_SIZE) {
+        Flush();
     }
 }
 
@@ -153,7 +241,11 @@ static Version DetectFileVersion(Reader& reader)
 
 Version DetectFileVersion(istream& input)
 {
-    Reader reader(input, 4);
+    // Only the signature, version and format are needed
+    char data[6];
+    input.read(data, sizeof data);
+    Reader reader(data, (size_t)input.gcount());
+    input.clear();
     Version version = DetectFileVersion(reader);
     
     // Reset stream
@@ -161,4 +253,4 @@ Version DetectFileVersion(istream& input)
     return version;
 }
 
-}
\ No newline at end of file
+}
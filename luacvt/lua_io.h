@@ -6,36 +6,58 @@
 namespace Lua
 {
 
+// Reads the remainder of the stream into the buffer
+void ReadStream(std::istream& input, std::vector<char>& buffer);
+
+// Reads values from a chunk that has been loaded in memory.
+// The strings it returns point into the chunk.
 class Reader
 {
-    std::istream& m_input;
-    size_t        m_sizeNumber;
+    const char* m_data;
+    size_t      m_size;
+    size_t      m_pos;
+    size_t      m_sizeNumber;
 
 public:
     void        Read(void* dest, size_t size);
     int         ReadByte();
     int         ReadInt();
     double      ReadNumber();
-    std::string ReadString();
+    String      ReadString();
+
+    // Reads the size of an array; every element takes at least a byte
+    size_t      ReadCount();
+
+    void SetSizeNumber(size_t sizeNumber) { m_sizeNumber = sizeNumber; }
 
-    Reader(std::istream& input, size_t sizeNumber);
+    Reader(const char* data, size_t size, size_t sizeNumber = 4);
 };
 
+// Collects the chunk in memory and writes it to the stream in large blocks
 class Writer
 {
-    std::ostream& m_output;
-    size_t        m_sizeNumber;
+    std::ostream&     m_output;
+    std::vector<char> m_buffer;
+    size_t            m_sizeNumber;
+
+    // Not copyable; copies would write their part of the buffer separately
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
 
 public:
     void Write(const void* src, size_t size);
     void WriteByte(int val);
     void WriteInt(int val);
     void WriteNumber(double value);
-    void WriteString(const std::string& str, bool null_if_empty = false);
+    void WriteString(const String& str, bool null_if_empty = false);
+    void Flush();
+
+    void SetSizeNumber(size_t sizeNumber) { m_sizeNumber = sizeNumber; }
 
-    Writer(std::ostream& output, size_t sizeNumber);
+    Writer(std::ostream& output, size_t sizeNumber = 4);
+    ~Writer();
 };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,350 @@
+#include <cstring>
+#include "lua.h"
+#include "exceptions.h"
+using namespace std;
+
+namespace Lua
+{
+
+//
+// Instruction encodings
+//
+// Lua 5.0 and 5.1 use the same 6-bit opcode field, but place the operands
+// differently and number the opcodes differently. Both encode a register or
+// constant (RK) operand as a 9-bit value where values from a certain base up
+// refer to a constant.
+//
+enum
+{
+    ARG_K_BX     = 1,   // Bx is a constant index
+    ARG_RK_B     = 2,   // B is a register or constant
+    ARG_RK_C     = 4,   // C is a register or constant
+    ARG_PROTO_BX = 8,   // Bx is a function index
+    ARG_SKIP_C0  = 16,  // When C is 0, the next instruction is raw data
+};
+
+static const int RK_BOTH = ARG_RK_B | ARG_RK_C;
+
+static const unsigned char Arguments50[] = {
+    0,            // MOVE
+    ARG_K_BX,     // LOADK
+    0,            // LOADBOOL
+    0,            // LOADNIL
+    0,            // GETUPVAL
+    ARG_K_BX,     // GETGLOBAL
+    ARG_RK_C,     // GETTABLE
+    ARG_K_BX,     // SETGLOBAL
+    0,            // SETUPVAL
+    RK_BOTH,      // SETTABLE
+    0,            // NEWTABLE
+    ARG_RK_C,     // SELF
+    RK_BOTH,      // ADD
+    RK_BOTH,      // SUB
+    RK_BOTH,      // MUL
+    RK_BOTH,      // DIV
+    RK_BOTH,      // POW
+    0,            // UNM
+    0,            // NOT
+    0,            // CONCAT
+    0,            // JMP
+    RK_BOTH,      // EQ
+    RK_BOTH,      // LT
+    RK_BOTH,      // LE
+    0,            // TEST
+    0,            // CALL
+    0,            // TAILCALL
+    0,            // RETURN
+    0,            // FORLOOP
+    0,            // TFORLOOP
+    0,            // TFORPREP
+    0,            // SETLIST
+    0,            // SETLISTO
+    0,            // CLOSE
+    ARG_PROTO_BX, // CLOSURE
+};
+
+static const unsigned char Arguments51[] = {
+    0,            // MOVE
+    ARG_K_BX,     // LOADK
+    0,            // LOADBOOL
+    0,            // LOADNIL
+    0,            // GETUPVAL
+    ARG_K_BX,     // GETGLOBAL
+    ARG_RK_C,     // GETTABLE
+    ARG_K_BX,     // SETGLOBAL
+    0,            // SETUPVAL
+    RK_BOTH,      // SETTABLE
+    0,            // NEWTABLE
+    ARG_RK_C,     // SELF
+    RK_BOTH,      // ADD
+    RK_BOTH,      // SUB
+    RK_BOTH,      // MUL
+    RK_BOTH,      // DIV
+    RK_BOTH,      // MOD
+    RK_BOTH,      // POW
+    0,            // UNM
+    0,            // NOT
+    0,            // LEN
+    0,            // CONCAT
+    0,            // JMP
+    RK_BOTH,      // EQ
+    RK_BOTH,      // LT
+    RK_BOTH,      // LE
+    0,            // TEST
+    0,            // TESTSET
+    0,            // CALL
+    0,            // TAILCALL
+    0,            // RETURN
+    0,            // FORLOOP
+    0,            // FORPREP
+    0,            // TFORLOOP
+    ARG_SKIP_C0,  // SETLIST
+    0,            // CLOSE
+    ARG_PROTO_BX, // CLOSURE
+    0,            // VARARG
+};
+
+struct Encoding
+{
+    unsigned int         posB;
+    unsigned int         posC;
+    unsigned int         posBx;
+    unsigned int         rkBase;    // RK values from here up are constants
+    const unsigned char* arguments;
+    size_t               nOpcodes;
+};
+
+static const Encoding Encoding50 = {15,  6,  6, 250, Arguments50, sizeof Arguments50};
+static const Encoding Encoding51 = {23, 14, 14, 256, Arguments51, sizeof Arguments51};
+
+static const Instruction MASK_OP   = 0x3F;
+static const Instruction MASK_BC   = 0x1FF;
+static const Instruction MASK_BX   = 0x3FFFF;
+
+static inline Instruction GetField(Instruction i, unsigned int pos, Instruction mask)
+{
+    return (i >> pos) & mask;
+}
+
+static inline Instruction SetField(Instruction i, unsigned int pos, Instruction mask, Instruction value)
+{
+    return (i & ~(mask << pos)) | ((value & mask) << pos);
+}
+
+//
+// Calls the mapping for every constant and function reference in the code and
+// stores its result. The mappings also check that each reference is valid.
+//
+class ReferenceMap
+{
+public:
+    virtual Instruction constant(Instruction index) = 0;
+    virtual Instruction function(Instruction index) = 0;
+};
+
+static void MapReferences(Array<Instruction>& code, const Encoding& enc, ReferenceMap& map)
+{
+    for (size_t pc = 0; pc < code.size; pc++)
+    {
+        Instruction& i = code[pc];
+        Instruction  op = i & MASK_OP;
+        if (op >= enc.nOpcodes) {
+            throw BadCodeException("Unknown opcode");
+        }
+
+        int args = enc.arguments[op];
+        if (args & ARG_K_BX) {
+            i = SetField(i, enc.posBx, MASK_BX, map.constant(GetField(i, enc.posBx, MASK_BX)));
+        }
+        if (args & ARG_PROTO_BX) {
+            i = SetField(i, enc.posBx, MASK_BX, map.function(GetField(i, enc.posBx, MASK_BX)));
+        }
+        if ((args & ARG_RK_B) && GetField(i, enc.posB, MASK_BC) >= enc.rkBase) {
+            i = SetField(i, enc.posB, MASK_BC, map.constant(GetField(i, enc.posB, MASK_BC) - enc.rkBase) + enc.rkBase);
+        }
+        if ((args & ARG_RK_C) && GetField(i, enc.posC, MASK_BC) >= enc.rkBase) {
+            i = SetField(i, enc.posC, MASK_BC, map.constant(GetField(i, enc.posC, MASK_BC) - enc.rkBase) + enc.rkBase);
+        }
+        if ((args & ARG_SKIP_C0) && GetField(i, enc.posC, MASK_BC) == 0) {
+            // Not an instruction
+            pc++;
+        }
+    }
+}
+
+// Marks the used constants
+class MarkReferences : public ReferenceMap
+{
+    const Function& m_function;
+
+public:
+    vector<bool> constants;
+
+    Instruction constant(Instruction index)
+    {
+        if (index >= constants.size()) {
+            throw BadCodeException("Invalid constant reference");
+        }
+        constants[index] = true;
+        return index;
+    }
+
+    Instruction function(Instruction index)
+    {
+        if (index >= m_function.functions.size) {
+            throw BadCodeException("Invalid function reference");
+        }
+        return index;
+    }
+
+    MarkReferences(const Function& function)
+        : m_function(function), constants(function.constants.size, false) {}
+};
+
+// Renumbers the references
+class RemapReferences : public ReferenceMap
+{
+    const vector<Instruction>& m_constants;
+    const vector<Instruction>& m_functions;
+
+public:
+    Instruction constant(Instruction index) { return m_constants[index]; }
+    Instruction function(Instruction index) { return m_functions[index]; }
+
+    RemapReferences(const vector<Instruction>& constants, const vector<Instruction>& functions)
+        : m_constants(constants), m_functions(functions) {}
+};
+
+//
+// Comparison
+//
+static bool SameConstant(const Constant& a, const Constant& b)
+{
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type)
+    {
+        case TNUMBER:  return memcmp(&a.number, &b.number, sizeof a.number) == 0;
+        case TSTRING:  return a.str == b.str;
+        case TBOOLEAN: return a.boolean == b.boolean;
+        default:       return true;
+    }
+}
+
+static bool SameFunction(const Function& a, const Function& b, bool ignoreDebug)
+{
+    if (a.nUpvalues    != b.nUpvalues   || a.nParameters         != b.nParameters         ||
+        a.isVararg     != b.isVararg    || a.maxStackSize        != b.maxStackSize        ||
+        a.instructions != b.instructions || a.constants.size     != b.constants.size     ||
+        a.functions.size   != b.functions.size)
+    {
+        return false;
+    }
+
+    if (!ignoreDebug)
+    {
+        if (a.name != b.name || a.lineDefined != b.lineDefined || a.lastLineDefined != b.lastLineDefined ||
+            a.lines != b.lines || a.upvalues != b.upvalues || a.locals.size != b.locals.size)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.locals.size; i++)
+        {
+            if (a.locals[i].name != b.locals[i].name || a.locals[i].startPC != b.locals[i].startPC || a.locals[i].endPC != b.locals[i].endPC) {
+                return false;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < a.constants.size; i++)
+    {
+        if (!SameConstant(a.constants[i], b.constants[i])) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < a.functions.size; i++)
+    {
+        if (!SameFunction(*a.functions[i], *b.functions[i], ignoreDebug)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Optimization
+//
+// The constants and functions are compacted in place and duplicate functions
+// are dropped from the array, not copied, so nothing is allocated here. No
+// string is changed either; stripped debug information is simply cut off.
+//
+static void Optimize(Function& function, const Encoding& enc, int options)
+{
+    // Nested functions first, so identical ones are identical after optimization
+    for (size_t i = 0; i < function.functions.size; i++)
+    {
+        Optimize(*function.functions[i], enc, options);
+    }
+
+    if (options & OPTIMIZE_STRIP_DEBUG)
+    {
+        function.name.size     = 0;
+        function.lines.size    = 0;
+        function.locals.size   = 0;
+        function.upvalues.size = 0;
+    }
+
+    // Also validates all references
+    MarkReferences used(function);
+    MapReferences(function.instructions, enc, used);
+
+    vector<Instruction> constantMap(function.constants.size);
+    vector<Instruction> functionMap(function.functions.size);
+
+    // Number the constants that are still used and move them down
+    size_t nConstants = 0;
+    for (size_t i = 0; i < function.constants.size; i++)
+    {
+        constantMap[i] = (Instruction)nConstants;
+        if (used.constants[i] || (~options & OPTIMIZE_CONSTANTS)) {
+            function.constants[nConstants++] = function.constants[i];
+        }
+    }
+
+    // Number the functions, mapping duplicates onto the first copy
+    size_t nFunctions = 0;
+    for (size_t i = 0; i < function.functions.size; i++)
+    {
+        functionMap[i] = (Instruction)nFunctions;
+        if (options & OPTIMIZE_FUNCTIONS)
+        {
+            for (size_t j = 0; j < nFunctions; j++)
+            {
+                if (SameFunction(*function.functions[j], *function.functions[i], (options & OPTIMIZE_STRIP_DEBUG) != 0)) {
+                    functionMap[i] = (Instruction)j;
+                    break;
+                }
+            }
+        }
+        if (functionMap[i] == nFunctions) {
+            function.functions[nFunctions++] = function.functions[i];
+        }
+    }
+
+    if (nConstants != function.constants.size || nFunctions != function.functions.size)
+    {
+        RemapReferences remap(constantMap, functionMap);
+        MapReferences(function.instructions, enc, remap);
+        function.constants.size = nConstants;
+        function.functions.size = nFunctions;
+    }
+}
+
+void Optimize(File& file, bool isNew, int options)
+{
+    Optimize(*file.function, isNew ? Encoding51 : Encoding50, options);
+}
+
+}
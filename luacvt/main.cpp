@@ -1,3 +1,5 @@
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 #include <algorithm>
 #include <iostream>
 #include <fstream>
@@ -5,6 +7,7 @@
 #include <stdexcept>
 
 #include "lua.h"
+#include "exceptions.h"
 using namespace std;
 
 class LuaFormat
@@ -59,54 +62,457 @@ static const struct {
     {NULL}
 };
 
-int main(int argc, char* argv[])
+// Converts a single file; throws on any error
+static void ConvertFile(const string& src, const string& dest, int optimize)
 {
-    // Parse the arguments
-	if (argc != 3)
-	{
-		cerr << "Lup/Lua converter 1.1, by Mike Lankamp." << endl
-		     << "Syntax: luacvt <src-file> <dest-file>" << endl
-             << endl
-             << "The program will read a Lua or Lup file and convert it to a Lup or Lua file." << endl
-             << "The format of the source file is automatically detected and the appropriate" << endl
-             << "destination format selected. EaW/FoC Luas will be converted to Lua 5.0 files" << endl
-             << "and vica versa. UaW Luas will be converted to Lua 5.1 files and vica versa." << endl;
-        return 1;
-	}
+    ifstream input(src.c_str(), ios_base::binary | ios_base::in);
+    if (!input.is_open())
+    {
+        throw IOException("Unable to open input file \"" + src + "\"");
+    }
 
-    const char* src  = argv[1];
-    const char* dest = argv[2];
+    Lua::Version version = Lua::DetectFileVersion(input);
+    if (version == Lua::LUA_UNKNOWN)
+    {
+        throw IOException("Input file is not recognized as a supported Lua file");
+    }
 
-#ifdef NDEBUG
-	try
-#endif
-	{
-		ifstream input(src, ios_base::binary | ios_base::in);
-		if (!input.is_open())
-		{
-			cerr << "Unable to open input file \"" << src << "\"" << endl;
-            return 1;
-		}
+    Lua::File file;
+    LuaFormats[version].input->Load(input, file);
+    input.close();
 
+    if (optimize != 0)
+    {
+        Lua::Optimize(file, version == Lua::LUA_51 || version == Lua::LUA_UAW, optimize);
+    }
+
+    ofstream output(dest.c_str(), ios_base::binary | ios_base::out);
+    if (!output.is_open())
+    {
+        throw IOException("Unable to open output file \"" + dest + "\"");
+    }
+
+    LuaFormats[version].output->Save(output, file);
+}
+
+//
+// Batch mode
+//
+static const int OPT_RECURSIVE = 1;
+static const int OPT_FORCE     = 2;
+static const int OPT_QUIET     = 4;
+static const int OPT_BENCHMARK = 8;
+
+struct Arguments
+{
+    int            options;
+    int            optimize;    // Lua::OPTIMIZE_* flags
+    string         destdir;
+    vector<string> sources;
+};
+
+struct Job
+{
+    string src;
+    string dest;
+    string error;
+    bool   skipped;
+};
+
+struct BATCH_INFO
+{
+    vector<Job>*  jobs;
+    int           optimize;
+    volatile LONG next;
+};
+
+// Returns whether the destination file is at least as new as the source file
+static bool IsUpToDate(const string& src, const string& dest)
+{
+    WIN32_FILE_ATTRIBUTE_DATA srcData, destData;
+    if (!GetFileAttributesExA(src.c_str(),  GetFileExInfoStandard, &srcData) ||
+        !GetFileAttributesExA(dest.c_str(), GetFileExInfoStandard, &destData))
+    {
+        return false;
+    }
+    return CompareFileTime(&destData.ftLastWriteTime, &srcData.ftLastWriteTime) >= 0;
+}
+
+// Adds a job for every file matching the filter in the directory.
+// Subdirectories are mirrored in the destination directory.
+static void FindFiles(vector<Job>& jobs, const string& srcdir, const string& filter, const string& destdir, bool recursive)
+{
+    WIN32_FIND_DATAA wfd;
+    HANDLE hFind = FindFirstFileA((srcdir + filter).c_str(), &wfd);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (~wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                Job job;
+                job.src     = srcdir  + wfd.cFileName;
+                job.dest    = destdir + wfd.cFileName;
+                job.skipped = false;
+                jobs.push_back(job);
+            }
+        } while (FindNextFileA(hFind, &wfd));
+        FindClose(hFind);
+    }
+
+    if (recursive)
+    {
+        hFind = FindFirstFileA((srcdir + "*").c_str(), &wfd);
+        if (hFind != INVALID_HANDLE_VALUE)
+        {
+            do
+            {
+                if ((wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && strcmp(wfd.cFileName, ".") != 0 && strcmp(wfd.cFileName, "..") != 0)
+                {
+                    FindFiles(jobs, srcdir + wfd.cFileName + "\\", filter, destdir + wfd.cFileName + "\\", true);
+                }
+            } while (FindNextFileA(hFind, &wfd));
+            FindClose(hFind);
+        }
+    }
+}
+
+// Creates all directories on the path of the file
+static void CreateDirectories(const string& filename)
+{
+    for (size_t ofs = filename.find_first_of("\\/", 1); ofs != string::npos; ofs = filename.find_first_of("\\/", ofs + 1))
+    {
+        CreateDirectoryA(filename.substr(0, ofs).c_str(), NULL);
+    }
+}
+
+static DWORD WINAPI BatchThread(LPVOID lpParam)
+{
+    BATCH_INFO* info = (BATCH_INFO*)lpParam;
+    LONG i;
+    while ((i = InterlockedIncrement(&info->next) - 1) < (LONG)info->jobs->size())
+    {
+        Job& job = (*info->jobs)[i];
+        try
+        {
+            ConvertFile(job.src, job.dest, info->optimize);
+        }
+        catch (exception& e)
+        {
+            job.error = e.what();
+        }
+    }
+    return 0;
+}
+
+static void ConvertFiles(vector<Job>& jobs, int optimize)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    size_t nThreads = min((size_t)si.dwNumberOfProcessors, jobs.size());
+
+    BATCH_INFO info;
+    info.jobs     = &jobs;
+    info.optimize = optimize;
+    info.next     = 0;
+
+    vector<HANDLE> hThreads;
+    for (size_t i = 1; i < nThreads; i++)
+    {
+        DWORD  ThreadID;
+        HANDLE hThread = CreateThread(NULL, 0, BatchThread, &info, 0, &ThreadID);
+        if (hThread != NULL)
+        {
+            hThreads.push_back(hThread);
+        }
+    }
+
+    // This thread helps out as well
+    BatchThread(&info);
+
+    if (!hThreads.empty())
+    {
+        WaitForMultipleObjects((DWORD)hThreads.size(), &hThreads[0], TRUE, INFINITE);
+        for (size_t i = 0; i < hThreads.size(); i++)
+        {
+            CloseHandle(hThreads[i]);
+        }
+    }
+}
+
+// Adds a job for every file in the sources
+static void CollectFiles(vector<Job>& jobs, const Arguments& args, const string& destdir)
+{
+    bool recursive = (args.options & OPT_RECURSIVE) != 0;
+    for (size_t i = 0; i < args.sources.size(); i++)
+    {
+        string source = args.sources[i];
+        DWORD  attributes = GetFileAttributesA(source.c_str());
+        if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            // Every Lua file in the directory (.lua, .lup, .luc)
+            if (source[source.length() - 1] != '\\' && source[source.length() - 1] != '/') {
+                source += "\\";
+            }
+            FindFiles(jobs, source, "*.lu?", destdir, recursive);
+        }
+        else
+        {
+            // A file or a wildcard
+            size_t ofs = source.find_last_of("\\/:");
+            ofs = (ofs == string::npos) ? 0 : ofs + 1;
+            FindFiles(jobs, source.substr(0, ofs), source.substr(ofs), destdir, recursive);
+        }
+    }
+}
+
+static bool ParseArguments(Arguments& args, int argc, char* argv[])
+{
+    args.options  = 0;
+    args.optimize = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '-' && argv[i][0] != '/') {
+            args.sources.push_back(argv[i]);
+        } else if (strcmp(argv[i] + 1, "r") == 0) {
+            args.options |= OPT_RECURSIVE;
+        } else if (strcmp(argv[i] + 1, "f") == 0) {
+            args.options |= OPT_FORCE;
+        } else if (strcmp(argv[i] + 1, "q") == 0) {
+            args.options |= OPT_QUIET;
+        } else if (strcmp(argv[i] + 1, "b") == 0) {
+            args.options |= OPT_BENCHMARK;
+        } else if (strcmp(argv[i] + 1, "s") == 0) {
+            args.optimize |= Lua::OPTIMIZE_STRIP_DEBUG;
+        } else if (strcmp(argv[i] + 1, "O") == 0) {
+            args.optimize |= Lua::OPTIMIZE_CONSTANTS | Lua::OPTIMIZE_FUNCTIONS;
+        } else if (strcmp(argv[i] + 1, "d") == 0 && i + 1 < argc) {
+            args.destdir = argv[++i];
+        } else {
+            cerr << "Unknown option '" << argv[i] << "'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static int RunBatch(const Arguments& args)
+{
+    int    options = args.options;
+    string destdir = args.destdir;
+    if (destdir[destdir.length() - 1] != '\\' && destdir[destdir.length() - 1] != '/') {
+        destdir += "\\";
+    }
+
+    // Collect the files
+    vector<Job> jobs;
+    CollectFiles(jobs, args, destdir);
+
+    // Leave out the files that are up to date
+    vector<Job> todo;
+    for (vector<Job>::iterator j = jobs.begin(); j != jobs.end(); j++)
+    {
+        if (~options & OPT_FORCE && IsUpToDate(j->src, j->dest)) {
+            j->skipped = true;
+        } else {
+            CreateDirectories(j->dest);
+            todo.push_back(*j);
+        }
+    }
+
+    ConvertFiles(todo, args.optimize);
+
+    // Report
+    int failed = 0;
+    for (vector<Job>::const_iterator j = todo.begin(); j != todo.end(); j++)
+    {
+        if (!j->error.empty()) {
+            cerr << j->src << ": " << j->error << endl;
+            failed++;
+        }
+    }
+
+    if (~options & OPT_QUIET || failed > 0) {
+        cout << todo.size() - failed << " converted, " << jobs.size() - todo.size() << " up to date, " << failed << " failed" << endl;
+    }
+    return (failed > 0) ? 1 : 0;
+}
+
+//
+// Benchmark mode
+//
+static const int BENCHMARK_PASSES = 5;
+
+enum BenchmarkPhase
+{
+    PHASE_LOAD, PHASE_OPTIMIZE, PHASE_SAVE, PHASE_FREE, NUM_PHASES
+};
+
+static const char* const PhaseNames[NUM_PHASES] = {"load", "optimize", "save", "free"};
+
+// Returns the time in seconds since some point in the past
+static double GetTime()
+{
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+// Converts one file in memory and adds the time of each phase
+static void BenchmarkFile(const string& contents, int optimize, double times[NUM_PHASES])
+{
+    istringstream input(contents);
+    double        start = GetTime(), end;
+    {
         Lua::Version version = Lua::DetectFileVersion(input);
         if (version == Lua::LUA_UNKNOWN)
         {
-            cerr << "Input file is not recognized as a supported Lua file" << endl;
-            return 1;
+            throw IOException("Input file is not recognized as a supported Lua file");
         }
 
         Lua::File file;
         LuaFormats[version].input->Load(input, file);
-        input.close();
+        end = GetTime(); times[PHASE_LOAD] += end - start; start = end;
 
-		ofstream output(dest, ios_base::binary | ios_base::out);
-		if (!output.is_open())
-		{
-			cerr << "Unable to open output file \"" << dest << "\"" << endl;
-            return 1;
-		}
+        if (optimize != 0)
+        {
+            Lua::Optimize(file, version == Lua::LUA_51 || version == Lua::LUA_UAW, optimize);
+        }
+        end = GetTime(); times[PHASE_OPTIMIZE] += end - start; start = end;
 
+        ostringstream output;
         LuaFormats[version].output->Save(output, file);
+        end = GetTime(); times[PHASE_SAVE] += end - start; start = end;
+    }
+    end = GetTime(); times[PHASE_FREE] += end - start;
+}
+
+// Converts the files a few times, single-threaded and without writing them,
+// and prints the time spent in each phase. The files are read beforehand,
+// so the disk isn't measured.
+static int RunBenchmark(const Arguments& args)
+{
+    vector<Job> jobs;
+    CollectFiles(jobs, args, "");
+
+    vector<string> contents(jobs.size());
+    size_t         size = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        ifstream input(jobs[i].src.c_str(), ios_base::binary | ios_base::in);
+        if (!input.is_open())
+        {
+            jobs[i].error = "Unable to open input file";
+            continue;
+        }
+        ostringstream data;
+        data << input.rdbuf();
+        contents[i] = data.str();
+        size += contents[i].size();
+    }
+
+    double times[NUM_PHASES] = {0};
+    for (int pass = 0; pass < BENCHMARK_PASSES; pass++)
+    {
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            if (jobs[i].error.empty())
+            {
+                try
+                {
+                    BenchmarkFile(contents[i], args.optimize, times);
+                }
+                catch (exception& e)
+                {
+                    jobs[i].error = e.what();
+                    size -= contents[i].size();
+                }
+            }
+        }
+    }
+
+    int failed = 0;
+    for (vector<Job>::const_iterator j = jobs.begin(); j != jobs.end(); j++)
+    {
+        if (!j->error.empty()) {
+            cerr << j->src << ": " << j->error << endl;
+            failed++;
+        }
+    }
+
+    // Throughput over the files that converted
+    double mb    = (double)size * BENCHMARK_PASSES / (1024 * 1024);
+    double total = 0;
+    cout << jobs.size() - failed << " files, " << (double)size / (1024 * 1024) << " MB, " << BENCHMARK_PASSES << " passes" << endl;
+    for (int i = 0; i < NUM_PHASES; i++)
+    {
+        cout << PhaseNames[i] << ": " << times[i] << " s";
+        if (times[i] > 0) {
+            cout << ", " << mb / times[i] << " MB/s";
+        }
+        cout << endl;
+        total += times[i];
+    }
+    cout << "total: " << total << " s, " << mb / total << " MB/s" << endl;
+    return (failed > 0) ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // Parse the arguments
+    Arguments args;
+    if (!ParseArguments(args, argc, argv))
+    {
+        return 1;
+    }
+
+    if (args.options & OPT_BENCHMARK && !args.sources.empty())
+    {
+        return RunBenchmark(args);
+    }
+
+    if (!args.destdir.empty() && !args.sources.empty())
+    {
+        return RunBatch(args);
+    }
+
+	if (!args.destdir.empty() || args.sources.size() != 2)
+	{
+		cerr << "Lup/Lua converter 1.1, by Mike Lankamp." << endl
+		     << "Syntax: luacvt [-s] [-O] <src-file> <dest-file>" << endl
+		     << "        luacvt [-s] [-O] [-r] [-f] [-q] -d <dest-dir> <src>..." << endl
+		     << "        luacvt [-s] [-O] [-r] -b <src>..." << endl
+             << endl
+             << "The program will read a Lua or Lup file and convert it to a Lup or Lua file." << endl
+             << "The format of the source file is automatically detected and the appropriate" << endl
+             << "destination format selected. EaW/FoC Luas will be converted to Lua 5.0 files" << endl
+             << "and vica versa. UaW Luas will be converted to Lua 5.1 files and vica versa." << endl
+             << endl
+             << "The second form converts many files at once, in parallel. Sources can be files," << endl
+             << "directories or wildcards. Files whose destination is newer are skipped." << endl
+             << endl
+             << "The third form converts the sources in memory a few times, without writing" << endl
+             << "them, and prints how long loading, optimizing, saving and freeing took." << endl
+             << endl
+             << "Options:" << endl
+             << "-s    Strip debug information (line numbers, local and upvalue names)" << endl
+             << "-O    Optimize. Removes unused constants and shares identical functions" << endl
+             << "-r    Recursive. Also converts subdirectories, mirroring them in <dest-dir>" << endl
+             << "-f    Force. Converts files even when the destination is up to date" << endl
+             << "-q    Quiet. Prints nothing when all goes well" << endl
+             << "-b    Benchmark. Times the conversion of the sources instead of writing them" << endl;
+        return 1;
+	}
+
+	try
+	{
+        ConvertFile(args.sources[0], args.sources[1], args.optimize);
+	}
+	catch (IOException& e)
+	{
+		cerr << e.what() << endl;
+        return 1;
 	}
 #ifdef NDEBUG
 	catch (exception& e)
@@ -116,4 +522,4 @@ int main(int argc, char* argv[])
 	}
 #endif
 	return 0;
-}
\ No newline at end of file
+}